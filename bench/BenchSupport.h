@@ -0,0 +1,47 @@
+#pragma once
+// Shared helpers for the Windows-only benchmarks: picking the images to run on and
+// reading the process's memory and I/O counters around each pass.
+#include "pch.h"
+#include "ImageLoader.h"
+#include <psapi.h>
+#include <chrono>
+#include <cstdio>
+
+namespace bench {
+
+// Supported images in folder of at least minBytes, in name order
+inline std::vector<std::wstring> ListImages(const std::wstring& folder, uintmax_t minBytes) {
+    std::vector<std::wstring> files;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(folder, ec)) {
+        if (!entry.is_regular_file(ec) || entry.file_size(ec) < minBytes) continue;
+        std::wstring path = entry.path().wstring();
+        if (ImageLoader::IsSupportedFormat(path)) {
+            files.push_back(std::move(path));
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+inline PROCESS_MEMORY_COUNTERS_EX MemoryCounters() {
+    PROCESS_MEMORY_COUNTERS_EX counters = {};
+    counters.cb = sizeof(counters);
+    GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters),
+        sizeof(counters));
+    return counters;
+}
+
+inline IO_COUNTERS IoCounters() {
+    IO_COUNTERS counters = {};
+    GetProcessIoCounters(GetCurrentProcess(), &counters);
+    return counters;
+}
+
+inline double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+constexpr double MB = 1024.0 * 1024.0;
+
+}  // namespace bench
@@ -0,0 +1,103 @@
+#include "BenchSupport.h"
+
+// Compares decoding large JPEGs at full resolution with decoding them straight to a
+// 1920x1080 box (decoder-native DCT scaling plus a Fant resample for the remainder).
+// Reported per mode: mean and slowest decode time, the decoded pixels' size, and the
+// process's peak working set after the pass (GetProcessMemoryInfo).
+//
+// Usage: ScaledDecodeBench <folder> [scaled|full|both, default both]
+//
+// The peak working set only ever grows, so with "both" the scaled pass runs first and
+// the full pass's peak includes it. Run each mode in its own process for clean peaks.
+
+namespace {
+
+constexpr UINT BOX_WIDTH = 1920;
+constexpr UINT BOX_HEIGHT = 1080;
+
+struct PassResult {
+    double totalMs = 0.0;
+    double slowestMs = 0.0;
+    double decodedBytes = 0.0;
+    size_t decoded = 0;
+    size_t peakWorkingSet = 0;
+};
+
+bool IsJpeg(const std::wstring& filePath) {
+    std::wstring extension = ToLowerCase(fs::path(filePath).extension().wstring());
+    return extension == L".jpg" || extension == L".jpeg";
+}
+
+PassResult RunPass(IWICImagingFactory* wicFactory, const std::vector<std::wstring>& files, UINT maxWidth,
+    UINT maxHeight) {
+    PassResult result;
+    for (const auto& filePath : files) {
+        auto start = std::chrono::steady_clock::now();
+        auto decoded = ImageLoader::DecodeImage(wicFactory, filePath, nullptr, maxWidth, maxHeight);
+        double ms = bench::SecondsSince(start) * 1000.0;
+        if (!decoded) {
+            std::wprintf(L"  Could not decode %s\n", filePath.c_str());
+            continue;
+        }
+        result.totalMs += ms;
+        result.slowestMs = std::max(result.slowestMs, ms);
+        result.decodedBytes += static_cast<double>(decoded->image.ByteSize() + decoded->planar.ByteSize());
+        result.decoded++;
+    }
+    result.peakWorkingSet = bench::MemoryCounters().PeakWorkingSetSize;
+    return result;
+}
+
+void Print(const wchar_t* name, const PassResult& result) {
+    if (result.decoded == 0) return;
+    std::wprintf(L"  %-7s %8.1f ms mean %8.1f ms slowest %8.1f MB decoded per image %8.1f MB peak working set\n",
+        name, result.totalMs / result.decoded, result.slowestMs,
+        result.decodedBytes / result.decoded / bench::MB, result.peakWorkingSet / bench::MB);
+}
+
+}  // namespace
+
+int wmain(int argc, wchar_t** argv) {
+    if (argc < 2) {
+        std::wprintf(L"Usage: ScaledDecodeBench <folder> [scaled|full|both]\n");
+        return 1;
+    }
+    const std::wstring folder = argv[1];
+    const std::wstring mode = argc > 2 ? argv[2] : L"both";
+    const bool runScaled = mode == L"scaled" || mode == L"both";
+    const bool runFull = mode == L"full" || mode == L"both";
+    if (!runScaled && !runFull) {
+        std::wprintf(L"Unknown mode %s\n", mode.c_str());
+        return 1;
+    }
+
+    std::vector<std::wstring> files;
+    for (auto& filePath : bench::ListImages(folder, 0)) {
+        if (IsJpeg(filePath)) {
+            files.push_back(std::move(filePath));
+        }
+    }
+    if (files.empty()) {
+        std::wprintf(L"No JPEGs in %s\n", folder.c_str());
+        return 1;
+    }
+
+    ImageLoader::InitializeWorkerThread();
+    IWICImagingFactory* wicFactory = ImageLoader::GetWorkerWicFactory();
+    if (!wicFactory) {
+        std::wprintf(L"Could not create a WIC factory\n");
+        return 1;
+    }
+    std::wprintf(L"%zu JPEGs, box %ux%u, working set before decoding %.1f MB\n", files.size(),
+        BOX_WIDTH, BOX_HEIGHT, bench::MemoryCounters().WorkingSetSize / bench::MB);
+
+    if (runScaled) {
+        Print(L"scaled", RunPass(wicFactory, files, BOX_WIDTH, BOX_HEIGHT));
+    }
+    if (runFull) {
+        Print(L"full", RunPass(wicFactory, files, 0, 0));
+    }
+
+    ImageLoader::UninitializeWorkerThread();
+    return 0;
+}
@@ -3,7 +3,12 @@
 #include "Window.h"
 #include "ImageLoader.h"
 #include "ImageCache.h"
+#include "TiledImage.h"
 #include "FolderNavigator.h"
+#include "NavigationPredictor.h"
+#include "TaskPool.h"
+#include "MemoryGovernor.h"
+#include "SessionStore.h"
 
 App* App::s_instance = nullptr;
 
@@ -12,10 +17,20 @@ App::App() {
 }
 
 App::~App() {
+    SaveSession();
     StopGifAnimation();
+    if (m_memoryTimerId != 0) {
+        KillTimer(m_window->GetHwnd(), m_memoryTimerId);
+    }
+    if (m_lowMemoryNotification) {
+        CloseHandle(m_lowMemoryNotification);
+    }
     if (m_imageCache) {
         m_imageCache->Shutdown();
     }
+    if (m_taskPool) {
+        m_taskPool->Stop();
+    }
     s_instance = nullptr;
 }
 
@@ -100,6 +115,19 @@ static std::vector<App::TextOverlay> TransformTextOverlaysForCrop(
     return result;
 }
 
+// Approximate heap bytes held by a set of markup strokes and text overlays
+static size_t EstimateOverlayBytes(const std::vector<App::MarkupStroke>& strokes,
+    const std::vector<App::TextOverlay>& texts) {
+    size_t bytes = 0;
+    for (const auto& stroke : strokes) {
+        bytes += sizeof(stroke) + stroke.points.capacity() * sizeof(D2D1_POINT_2F);
+    }
+    for (const auto& text : texts) {
+        bytes += sizeof(text) + text.text.capacity() * sizeof(wchar_t);
+    }
+    return bytes;
+}
+
 // Helper to flip buffer from top-down to bottom-up for Windows DIB format
 static void FlipBufferVertically(const std::vector<BYTE>& src, std::vector<BYTE>& dst, UINT width, UINT height) {
     UINT stride = App::GetBitmapStride(width);
@@ -161,14 +189,13 @@ static void RenderMarkupAndTextToTarget(
 ComPtr<IWICBitmapSource> App::LoadAndDecodeImage(IWICImagingFactory* wicFactory, WICPixelFormatGUID targetFormat) {
     if (!m_currentImage || m_currentImage->filePath.empty()) return nullptr;
 
-    ComPtr<IWICBitmapDecoder> decoder;
-    HRESULT hr = wicFactory->CreateDecoderFromFilename(
-        m_currentImage->filePath.c_str(), nullptr, GENERIC_READ,
-        WICDecodeMetadataCacheOnDemand, &decoder);
-    CHECK_HR_RETURN_NULL(hr);
+    // Usually the bytes the viewer already mapped, so saving does not read the file again
+    ComPtr<IWICBitmapDecoder> decoder = ImageLoader::CreateDecoder(wicFactory,
+        m_currentImage->filePath, m_imageCache->ReadEncoded(m_currentImage->filePath));
+    if (!decoder) return nullptr;
 
     ComPtr<IWICBitmapFrameDecode> frameDecode;
-    hr = decoder->GetFrame(0, &frameDecode);
+    HRESULT hr = decoder->GetFrame(0, &frameDecode);
     CHECK_HR_RETURN_NULL(hr);
 
     ComPtr<IWICFormatConverter> converter;
@@ -384,11 +411,15 @@ bool App::Initialize(HINSTANCE hInstance, int nCmdShow, const std::wstring& init
     }
 
     // Create components
+    m_taskPool = std::make_unique<TaskPool>();
+    m_memory = std::make_unique<MemoryGovernor>();
     m_window = std::make_unique<Window>(this);
     m_renderer = std::make_unique<Renderer>();
     m_imageLoader = std::make_unique<ImageLoader>();
     m_imageCache = std::make_unique<ImageCache>();
+    m_tiles = std::make_unique<TiledImage>();
     m_navigator = std::make_unique<FolderNavigator>();
+    m_navPredictor = std::make_unique<NavigationPredictor>();
 
     // Create window
     if (!m_window->Create(hInstance, nCmdShow)) {
@@ -398,6 +429,47 @@ bool App::Initialize(HINSTANCE hInstance, int nCmdShow, const std::wstring& init
     // Enable drag-drop
     DragAcceptFiles(m_window->GetHwnd(), TRUE);
 
+    // One worker per spare core, each with its own COM apartment and WIC factory
+    m_taskPool->Start(TaskPool::DefaultWorkerCount(),
+        &ImageLoader::InitializeWorkerThread, &ImageLoader::UninitializeWorkerThread);
+
+    // Initialize cache (workers notify the UI thread when decodes are ready for upload)
+    HWND hwnd = m_window->GetHwnd();
+    m_imageCache->Initialize(m_imageLoader.get(), m_taskPool.get(), [hwnd]() {
+        PostMessage(hwnd, Window::WM_APP_DECODE_COMPLETE, 0, 0);
+    });
+    m_tiles->Initialize(m_imageLoader.get(), m_taskPool.get(), [hwnd]() {
+        PostMessage(hwnd, Window::WM_APP_DECODE_COMPLETE, 0, 0);
+    });
+    UpdateScreenSize();
+
+    // Shed order when over the ceiling or short of memory: far prefetch, then GIF frames,
+    // then undo history
+    m_memory->SetShedHandler(ShedStage::FarPrefetch, [this](size_t bytes) {
+        return m_imageCache->ShedFarEntries(bytes);
+    });
+    m_memory->SetShedHandler(ShedStage::AnimationFrames, [this](size_t bytes) {
+        return ShedAnimationFrames(bytes);
+    });
+    m_memory->SetShedHandler(ShedStage::UndoHistory, [this](size_t bytes) {
+        return ShedUndoHistory(bytes);
+    });
+    m_imageCache->SetMemoryGovernor(m_memory.get());
+
+    m_lowMemoryNotification = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+    if (m_lowMemoryNotification) {
+        m_memoryTimerId = SetTimer(hwnd, MEMORY_TIMER_ID, MEMORY_CHECK_INTERVAL_MS, MemoryTimerProc);
+    }
+
+    // Folder listings are scanned on the pool as well
+    m_navigator->SetTaskPool(m_taskPool.get(), [hwnd]() {
+        PostMessage(hwnd, Window::WM_APP_FOLDER_SCANNED, 0, 0);
+    });
+
+    // Queue the last session's decodes before bringing up the device, so they overlap
+    // with it and the first frame can come from the cache
+    bool restored = RestoreSession(initialFile);
+
     // Initialize renderer
     if (!m_renderer->Initialize(m_window->GetHwnd())) {
         return false;
@@ -408,12 +480,13 @@ bool App::Initialize(HINSTANCE hInstance, int nCmdShow, const std::wstring& init
         m_renderer->GetDeviceContext(),
         m_renderer->GetWICFactory()
     );
-
-    // Initialize cache
-    m_imageCache->Initialize(m_imageLoader.get());
+    m_imageLoader->SetTaskPool(m_taskPool.get());
+    m_renderer->SetDeviceLostCallback([this]() { OnDeviceLost(); });
 
     // Open initial file if provided
-    if (!initialFile.empty()) {
+    if (restored) {
+        LoadCurrentImage();
+    } else if (!initialFile.empty()) {
         OpenFile(initialFile);
     }
 
@@ -435,10 +508,46 @@ void App::OpenFile(const std::wstring& filePath) {
     }
 
     m_navigator->SetCurrentFile(filePath);
+    m_navPredictor->Reset(m_navigator->GetCurrentIndex());
     LoadCurrentImage();
     PrefetchAdjacentImages();
 }
 
+bool App::RestoreSession(const std::wstring& initialFile) {
+    if (initialFile.empty()) return false;
+
+    SessionSnapshot session;
+    if (!SessionStore::Load(SessionStore::GetDefaultPath(), session)) {
+        return false;
+    }
+
+    // Only worth it when reopening the photo the last session closed on
+    if (_wcsicmp(initialFile.c_str(), session.currentFile.c_str()) != 0) {
+        return false;
+    }
+    if (!ImageLoader::IsSupportedFormat(initialFile) || !fs::exists(initialFile)) {
+        return false;
+    }
+
+    // The working set stands in for the folder listing until the scan arrives, so the
+    // window predicted now covers the same files as at exit
+    m_navigator->SetCurrentFile(initialFile, session.workingSet);
+    m_navPredictor->Reset(m_navigator->GetCurrentIndex());
+    PrefetchAdjacentImages();
+    return true;
+}
+
+void App::SaveSession() {
+    if (!m_navigator || !m_imageCache) return;
+
+    SessionSnapshot session;
+    session.currentFile = m_navigator->GetCurrentFilePath();
+    if (session.currentFile.empty()) return;
+
+    session.workingSet = m_imageCache->GetWorkingSet();
+    SessionStore::Save(SessionStore::GetDefaultPath(), session);
+}
+
 void App::LoadCurrentImage() {
     StopGifAnimation();
 
@@ -454,18 +563,33 @@ void App::LoadCurrentImage() {
         return;
     }
 
-    // Try cache first
-    m_currentImage = m_imageCache->Get(filePath);
+    if (m_tiles->GetFilePath() != filePath) {
+        m_tiles->Close();
+    }
 
+    // Try cache first, best resolution first
+    m_currentImage = m_imageCache->Get(filePath, ImageLevel::Full);
     if (!m_currentImage) {
-        // Load synchronously
-        m_currentImage = m_imageLoader->LoadImage(filePath);
+        m_currentImage = m_imageCache->Get(filePath, ImageLevel::Screen);
+    }
+    if (m_currentImage && !m_imageCache->EnsureResident(m_currentImage)) {
+        m_currentImage = nullptr;
+    }
 
-        // Note: Could add to cache here, but for simplicity we skip it
+    if (!m_currentImage) {
+        // Show the stored preview while the prefetch decodes the full image
+        m_currentImage = m_imageCache->GetPreview(filePath);
+    }
+
+    if (!m_currentImage) {
+        // Load synchronously, joining a background decode of this file if one is running
+        m_currentImage = m_imageCache->GetOrLoad({ filePath, m_navigator->GetCurrentIndex() });
     }
 
     if (m_currentImage) {
-        m_renderer->SetImage(m_currentImage->bitmap);
+        m_renderer->SetImage(m_currentImage->bitmap,
+            static_cast<float>(m_currentImage->width), static_cast<float>(m_currentImage->height),
+            D2D1::SizeU(m_currentImage->contentWidth, m_currentImage->contentHeight));
 
         // Start animation if GIF
         if (m_currentImage->isAnimated) {
@@ -477,6 +601,7 @@ void App::LoadCurrentImage() {
 
     UpdateTitle();
     Invalidate();
+    m_memory->Enforce();
 }
 
 void App::UpdateTitle() {
@@ -527,8 +652,29 @@ void App::NavigatePrevious() {
 }
 
 void App::PrefetchAdjacentImages() {
-    auto adjacent = m_navigator->GetAdjacentFiles(PREFETCH_ADJACENT_COUNT);
-    m_imageCache->Prefetch(adjacent);
+    size_t total = m_navigator->GetTotalCount();
+    if (total == 0) return;
+
+    size_t current = m_navigator->GetCurrentIndex();
+    ULONGLONG now = GetTickCount64();
+    m_navPredictor->OnNavigate(current, total, now);
+
+    // Size the window from how long images like this one take to decode, how much room
+    // they need and how quickly the user is moving through them
+    std::wstring currentPath = m_navigator->GetFilePath(current);
+    m_navPredictor->SetCounts(m_imageCache->GetPrefetchCount(currentPath, 0.0),
+        m_imageCache->GetPrefetchCount(currentPath, m_navPredictor->GetNavigationIntervalMs(now)));
+    PrefetchWindow window = m_navPredictor->Predict(current, total, now);
+
+    // The window includes the current image so it is always scheduled first
+    std::vector<DecodeRequest> requests;
+    for (size_t i = current - window.behind; i <= current + window.ahead; ++i) {
+        requests.push_back({ m_navigator->GetFilePath(i), i });
+    }
+    for (size_t target : window.jumpTargets) {
+        requests.push_back({ m_navigator->GetFilePath(target), target });
+    }
+    m_imageCache->Prefetch(requests, current);
 }
 
 bool App::TryNavigateWithDelay(std::function<bool()> navigateFn) {
@@ -544,12 +690,14 @@ bool App::TryNavigateWithDelay(std::function<bool()> navigateFn) {
 void App::NavigateFirst() {
     if (m_navigator->GoToFirst()) {
         LoadCurrentImage();
+        PrefetchAdjacentImages();
     }
 }
 
 void App::NavigateLast() {
     if (m_navigator->GoToLast()) {
         LoadCurrentImage();
+        PrefetchAdjacentImages();
     }
 }
 
@@ -558,25 +706,36 @@ void App::ToggleFullscreen() {
 }
 
 void App::DeleteCurrentFile() {
+    // Nothing may hold the file open while the shell moves it to the recycle bin
+    std::wstring filePath = m_navigator->GetCurrentFilePath();
+    if (!filePath.empty()) {
+        m_tiles->Close();
+        m_imageCache->ReleaseFile(filePath);
+    }
+
     if (m_navigator->DeleteCurrentFile()) {
         LoadCurrentImage();
+        PrefetchAdjacentImages();
     }
 }
 
 void App::ZoomIn() {
     float zoom = m_renderer->GetZoom();
     m_renderer->SetZoom(zoom * ZOOM_FACTOR);
+    UpdateImageLevel();
     Invalidate();
 }
 
 void App::ZoomOut() {
     float zoom = m_renderer->GetZoom();
     m_renderer->SetZoom(zoom / ZOOM_FACTOR);
+    UpdateImageLevel();
     Invalidate();
 }
 
 void App::ResetZoom() {
     m_renderer->ResetView();
+    UpdateTiles();
     Invalidate();
 }
 
@@ -591,13 +750,78 @@ float App::CalculateActualSizeZoom() const {
     return 1.0f / fitScale;
 }
 
+void App::UpdateScreenSize() {
+    MONITORINFO monitorInfo = { sizeof(monitorInfo) };
+    HMONITOR monitor = MonitorFromWindow(m_window->GetHwnd(), MONITOR_DEFAULTTONEAREST);
+    if (monitor && GetMonitorInfo(monitor, &monitorInfo)) {
+        m_imageCache->SetScreenSize(
+            static_cast<uint32_t>(monitorInfo.rcMonitor.right - monitorInfo.rcMonitor.left),
+            static_cast<uint32_t>(monitorInfo.rcMonitor.bottom - monitorInfo.rcMonitor.top));
+    }
+}
+
+void App::UpdateImageLevel() {
+    UpdateTiles();
+    if (!m_currentImage || m_currentImage->isFullResolution || m_hasCrop || IsTiledImage()) return;
+
+    // Only worth the memory once the screen level is being magnified
+    if (m_renderer->GetDisplayScale() > 1.0f) {
+        m_imageCache->Load({ m_currentImage->filePath, m_navigator->GetCurrentIndex(), ImageLevel::Full });
+    }
+}
+
+bool App::IsTiledImage() const {
+    auto deviceContext = m_renderer->GetDeviceContext();
+    return m_currentImage && !m_currentImage->isAnimated && deviceContext &&
+        TiledImage::NeedsTiling(static_cast<uint32_t>(m_currentImage->width),
+            static_cast<uint32_t>(m_currentImage->height), deviceContext->GetMaximumBitmapSize());
+}
+
+void App::UpdateTiles() {
+    if (!m_currentImage || m_currentImage->isFullResolution || m_hasCrop || !IsTiledImage() ||
+        m_renderer->GetDisplayScale() <= 1.0f) {
+        m_renderer->SetTiles({});
+        return;
+    }
+
+    m_tiles->Open(m_currentImage->filePath, static_cast<uint32_t>(m_currentImage->width),
+        static_cast<uint32_t>(m_currentImage->height));
+    m_renderer->SetTiles(m_tiles->Update(m_renderer->GetVisibleImageRect(), m_renderer->GetImageScale()));
+}
+
+void App::UpgradeCurrentImage() {
+    // Never replace a cropped copy; undo reloads the original
+    if (!m_currentImage || m_currentImage->isFullResolution || m_hasCrop) return;
+
+    const std::wstring& filePath = m_currentImage->filePath;
+    auto better = m_imageCache->Get(filePath, ImageLevel::Full);
+    if (!better && m_currentImage->isPreview) {
+        better = m_imageCache->Get(filePath, ImageLevel::Screen);
+    }
+    if (!better || !m_imageCache->EnsureResident(better)) return;
+
+    // Swap without disturbing zoom, pan or edits
+    bool wasPreview = m_currentImage->isPreview;
+    m_currentImage = better;
+    m_renderer->ReplaceImage(m_currentImage->bitmap,
+        D2D1::SizeU(m_currentImage->contentWidth, m_currentImage->contentHeight));
+    if (wasPreview && m_currentImage->isAnimated) {
+        StartGifAnimation();
+    }
+    UpdateImageLevel();
+    UpdateTitle();
+    Invalidate();
+}
+
 void App::StartGifAnimation() {
     if (!m_currentImage || !m_currentImage->isAnimated) {
         return;
     }
 
     m_gifPaused = false;
-    m_currentImage->currentFrame = 0;
+    if (m_currentImage->currentFrame != 0 && m_imageLoader->ShowFrame(*m_currentImage, 0)) {
+        m_renderer->ReplaceImage(m_currentImage->bitmap);
+    }
 
     UINT delay = m_currentImage->frameDelays.empty() ? DEFAULT_GIF_FRAME_DELAY_MS : m_currentImage->frameDelays[0];
     m_gifTimerId = SetTimer(m_window->GetHwnd(), GIF_TIMER_ID, delay, GifTimerProc);
@@ -615,22 +839,22 @@ void App::AdvanceGifFrame() {
         return;
     }
 
-    // Advance to next frame
-    m_currentImage->currentFrame++;
-    if (m_currentImage->currentFrame >= m_currentImage->frames.size()) {
-        m_currentImage->currentFrame = 0;
+    // Advance to next frame, compositing it into a display bitmap
+    UINT next = m_currentImage->currentFrame + 1;
+    if (next >= m_currentImage->GetFrameCount()) {
+        next = 0;
     }
-
-    // Update bitmap
-    if (m_currentImage->currentFrame < m_currentImage->frames.size()) {
-        m_currentImage->bitmap = m_currentImage->frames[m_currentImage->currentFrame];
-        m_renderer->SetImage(m_currentImage->bitmap);
+    bool shown = m_imageLoader->ShowFrame(*m_currentImage, next);
+    if (shown) {
+        m_renderer->ReplaceImage(m_currentImage->bitmap);
         Invalidate();
     }
 
-    // Schedule next frame
+    // Schedule next frame (soon, if a streamed frame was not composited in time)
     UINT delay = DEFAULT_GIF_FRAME_DELAY_MS;
-    if (m_currentImage->currentFrame < m_currentImage->frameDelays.size()) {
+    if (!shown && m_currentImage->stream) {
+        delay = GIF_STREAM_RETRY_MS;
+    } else if (m_currentImage->currentFrame < m_currentImage->frameDelays.size()) {
         delay = m_currentImage->frameDelays[m_currentImage->currentFrame];
     }
 
@@ -645,6 +869,84 @@ void CALLBACK App::GifTimerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
     }
 }
 
+void CALLBACK App::MemoryTimerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time) {
+    (void)hwnd; (void)msg; (void)id; (void)time;
+    if (s_instance) {
+        s_instance->CheckMemoryPressure();
+    }
+}
+
+void App::CheckMemoryPressure() {
+    BOOL lowMemory = FALSE;
+    if (QueryMemoryResourceNotification(m_lowMemoryNotification, &lowMemory) && lowMemory) {
+        m_memory->OnLowMemory();
+    }
+}
+
+void App::ReportEditMemory() {
+    size_t undoBytes = 0;
+    for (const auto& state : m_undoStack) {
+        undoBytes += sizeof(state) + EstimateOverlayBytes(state.strokes, state.texts);
+    }
+    m_memory->SetUsage(MemoryConsumer::UndoHistory, undoBytes);
+
+    // The renderer holds its own copy of the overlays
+    m_memory->SetUsage(MemoryConsumer::Overlays, 2 * EstimateOverlayBytes(m_markupStrokes, m_textOverlays));
+}
+
+size_t App::ShedAnimationFrames(size_t bytesToFree) {
+    size_t freed = m_imageCache->ShedAnimations(bytesToFree);
+    // A streamed animation on screen already holds only a few frames
+    if (freed >= bytesToFree || !m_currentImage || !m_currentImage->isAnimated ||
+        !m_currentImage->pixels || !m_currentImage->pixels->animation || m_currentImage->stream) {
+        return freed;
+    }
+
+    // Still short: stop the animation on screen and keep only the frame being shown
+    StopGifAnimation();
+    const DecodedImage& animation = *m_currentImage->pixels;
+    auto compositor = m_currentImage->compositor ? m_currentImage->compositor
+        : std::make_shared<GifCompositor>(animation.animation);
+
+    auto still = std::make_shared<DecodedImage>();
+    still->filePath = animation.filePath;
+    still->cacheKey = animation.cacheKey;
+    still->level = animation.level;
+    still->sourceWidth = animation.sourceWidth;
+    still->sourceHeight = animation.sourceHeight;
+    still->isFullResolution = animation.isFullResolution;
+    still->image = compositor->Compose(m_currentImage->currentFrame);
+
+    size_t before = m_currentImage->cpuBytes + m_currentImage->gpuBytes;
+    auto image = std::make_shared<ImageData>(*m_currentImage);
+    image->isAnimated = false;
+    image->frames.clear();
+    image->compositor.reset();
+    image->frameDelays.clear();
+    image->currentFrame = 0;
+    image->cpuBytes = still->ByteSize();
+    image->gpuBytes = image->bitmap ? still->ByteSize() : 0;
+    image->pixels = std::move(still);
+    m_currentImage = image;
+
+    UpdateTitle();
+    return freed + before - (image->cpuBytes + image->gpuBytes);
+}
+
+size_t App::ShedUndoHistory(size_t bytesToFree) {
+    // Oldest snapshots go first
+    size_t freed = 0;
+    size_t count = 0;
+    while (count < m_undoStack.size() && freed < bytesToFree) {
+        const EditState& state = m_undoStack[count];
+        freed += sizeof(state) + EstimateOverlayBytes(state.strokes, state.texts);
+        count++;
+    }
+    m_undoStack.erase(m_undoStack.begin(), m_undoStack.begin() + count);
+    ReportEditMemory();
+    return freed;
+}
+
 // Phase 2 feature implementations
 
 void App::CopyToClipboard() {
@@ -839,6 +1141,8 @@ void App::SaveImageOverwrite(const fs::path& origPath, const std::wstring& saved
     m_currentImage->bitmap.Reset();
     m_currentImage = nullptr;
     m_renderer->ClearImage();
+    m_tiles->Close();
+    m_imageCache->ReleaseFile(origPath.wstring());
 
     // Replace original with temp
     try {
@@ -854,6 +1158,7 @@ void App::SaveImageOverwrite(const fs::path& origPath, const std::wstring& saved
     // Reload the image
     m_navigator->SetCurrentFile(savedFilePath);
     LoadCurrentImage();
+    PrefetchAdjacentImages();
 
     FlashWindow(m_window->GetHwnd(), TRUE);
 }
@@ -1048,6 +1353,8 @@ void App::RotateAndSaveImage(int rotationDelta) {
         m_currentImage->bitmap.Reset();
         m_currentImage = nullptr;
         m_renderer->ClearImage();
+        m_tiles->Close();
+        m_imageCache->ReleaseFile(origPath.wstring());
 
         try {
             fs::remove(origPath);
@@ -1060,6 +1367,7 @@ void App::RotateAndSaveImage(int rotationDelta) {
         m_renderer->SetRotation(Rotation::NONE);
         m_navigator->SetCurrentFile(savedFilePath);
         LoadCurrentImage();
+        PrefetchAdjacentImages();
     }
 
     // Restore edit state
@@ -1092,6 +1400,7 @@ void App::CancelCurrentMode() {
 
 void App::UpdateRendererMarkup() {
     m_renderer->SetMarkupStrokes(m_markupStrokes);
+    ReportEditMemory();
 }
 
 void App::UpdateRendererText() {
@@ -1113,6 +1422,7 @@ void App::UpdateRendererText() {
     }
 
     m_renderer->SetTextOverlays(overlays);
+    ReportEditMemory();
 }
 
 bool App::ScreenToNormalizedImageCoords(int screenX, int screenY, float& normX, float& normY) const {
@@ -1193,6 +1503,8 @@ void App::PushUndoState() {
     if (m_undoStack.size() > MAX_UNDO_LEVELS) {
         m_undoStack.erase(m_undoStack.begin());
     }
+    ReportEditMemory();
+    m_memory->Enforce();
 }
 
 void App::Undo() {
@@ -1210,9 +1522,14 @@ void App::Undo() {
     // If undoing a crop, reload the original image
     if (wasCropped && !willBeCropped && m_currentImage) {
         std::wstring filePath = m_currentImage->filePath;
-        m_currentImage = m_imageLoader->LoadImage(filePath);
+        m_currentImage = m_imageCache->Get(filePath, ImageLevel::Full);
+        if (!m_currentImage || !m_imageCache->EnsureResident(m_currentImage)) {
+            m_currentImage = m_imageCache->GetOrLoad({ filePath, m_navigator->GetCurrentIndex() });
+        }
         if (m_currentImage) {
-            m_renderer->SetImage(m_currentImage->bitmap);
+            m_renderer->SetImage(m_currentImage->bitmap,
+                static_cast<float>(m_currentImage->width), static_cast<float>(m_currentImage->height),
+                D2D1::SizeU(m_currentImage->contentWidth, m_currentImage->contentHeight));
         }
     }
 
@@ -1251,6 +1568,7 @@ void App::ClearEditState(bool clearRotation) {
     m_markupStrokes.clear();
     m_textOverlays.clear();
     m_undoStack.clear();
+    ReportEditMemory();
 }
 
 void App::Invalidate() {
@@ -1275,6 +1593,14 @@ void App::ApplyCrop() {
 
     if (params.cropRectWidth <= 0 || params.cropRectHeight <= 0) return;
 
+    // Crop coordinates are in original pixels, so cut them from the full-resolution level
+    if (!m_currentImage->isFullResolution) {
+        auto fullImage = m_imageCache->GetOrLoad(
+            { m_currentImage->filePath, m_navigator->GetCurrentIndex(), ImageLevel::Full });
+        if (!fullImage) return;
+        m_currentImage = fullImage;
+    }
+
     float scaleFactor = params.originalWidth / params.cropRectWidth;
 
     // Transform markup and text to new cropped coordinate space
@@ -1285,33 +1611,45 @@ void App::ApplyCrop() {
     m_hasCrop = true;
     m_appliedCrop = { params.cropRectX, params.cropRectY, params.cropRectWidth, params.cropRectHeight };
 
+    // Create cropped bitmap for display
+    ComPtr<ID2D1Bitmap> croppedBitmap = CreateCroppedBitmap(m_currentImage->bitmap.Get(), m_appliedCrop);
+    if (!croppedBitmap) return;
+
+    // Update current image (a copy: the original stays in the cache for undo and revisits)
+    auto croppedImage = std::make_shared<ImageData>(*m_currentImage);
+    croppedImage->bitmap = croppedBitmap;
+    croppedImage->width = params.cropRectWidth;
+    croppedImage->height = params.cropRectHeight;
+    croppedImage->gpuBytes = 0;
+    m_currentImage = croppedImage;
+
+    m_renderer->SetImage(m_currentImage->bitmap,
+        static_cast<float>(m_currentImage->width), static_cast<float>(m_currentImage->height));
+    UpdateRendererMarkup();
+    UpdateRendererText();
+    CancelCurrentMode();
+}
+
+ComPtr<ID2D1Bitmap> App::CreateCroppedBitmap(ID2D1Bitmap* source, const WICRect& crop) {
     auto deviceContext = m_renderer->GetDeviceContext();
+    if (!source || !deviceContext) return nullptr;
 
-    // Create cropped bitmap for display
     D2D1_BITMAP_PROPERTIES1 bitmapProps = D2D1::BitmapProperties1(
         D2D1_BITMAP_OPTIONS_TARGET,
         D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED)
     );
 
     ComPtr<ID2D1Bitmap1> croppedBitmap;
-    HRESULT hr = deviceContext->CreateBitmap(D2D1::SizeU(params.cropRectWidth, params.cropRectHeight), nullptr, 0, bitmapProps, &croppedBitmap);
-    if (FAILED(hr)) return;
+    HRESULT hr = deviceContext->CreateBitmap(D2D1::SizeU(crop.Width, crop.Height), nullptr, 0, bitmapProps, &croppedBitmap);
+    CHECK_HR_RETURN_NULL(hr);
 
     D2D1_POINT_2U destPoint = {0, 0};
-    D2D1_RECT_U srcRect = {(UINT32)params.cropRectX, (UINT32)params.cropRectY,
-                           (UINT32)(params.cropRectX + params.cropRectWidth), (UINT32)(params.cropRectY + params.cropRectHeight)};
-    hr = croppedBitmap->CopyFromBitmap(&destPoint, m_currentImage->bitmap.Get(), &srcRect);
-    if (FAILED(hr)) return;
-
-    // Update current image
-    m_currentImage->bitmap = croppedBitmap;
-    m_currentImage->width = params.cropRectWidth;
-    m_currentImage->height = params.cropRectHeight;
+    D2D1_RECT_U srcRect = {(UINT32)crop.X, (UINT32)crop.Y,
+                           (UINT32)(crop.X + crop.Width), (UINT32)(crop.Y + crop.Height)};
+    hr = croppedBitmap->CopyFromBitmap(&destPoint, source, &srcRect);
+    CHECK_HR_RETURN_NULL(hr);
 
-    m_renderer->SetImage(m_currentImage->bitmap);
-    UpdateRendererMarkup();
-    UpdateRendererText();
-    CancelCurrentMode();
+    return croppedBitmap;
 }
 
 bool App::HandleTextEditingKey(UINT key) {
@@ -1414,6 +1752,7 @@ bool App::HandleZoomKey(UINT key, bool ctrl) {
 
     case '1':
         m_renderer->SetZoom(CalculateActualSizeZoom());
+        UpdateImageLevel();
         Invalidate();
         return true;
 
@@ -1559,6 +1898,9 @@ void App::OnKeyUp(UINT key) {
     case VK_RIGHT:
     case VK_LEFT:
         m_isNavigating = false;
+        // Scrubbing stopped: widen the prefetch window back to symmetric
+        m_navPredictor->OnScrubEnd();
+        PrefetchAdjacentImages();
         break;
     }
 }
@@ -1696,6 +2038,7 @@ void App::HandlePanMouseMove(int x, int y) {
     m_renderer->AddPan(dx, dy);
     m_lastMouseX = x;
     m_lastMouseY = y;
+    UpdateTiles();
     Invalidate();
 }
 
@@ -1714,8 +2057,65 @@ void App::OnMouseMove(int x, int y) {
 void App::OnResize(int width, int height) {
     if (m_renderer) {
         m_renderer->Resize(width, height);
+        UpdateScreenSize();
+        UpdateImageLevel();
+        Invalidate();
+    }
+}
+
+void App::OnDecodeComplete() {
+    if (!m_imageCache) return;
+    m_imageCache->ProcessQueue();
+    UpgradeCurrentImage();
+    if (m_tiles->ProcessQueue()) {
+        UpdateTiles();
+        Invalidate();
+    }
+    m_memory->Enforce();
+}
+
+void App::OnDeviceLost() {
+    // Bitmaps are recreated on the new device from the CPU pixels rather than re-decoded
+    m_imageLoader->Initialize(m_renderer->GetDeviceContext(), m_renderer->GetWICFactory());
+    if (m_currentImage) {
+        ImageLoader::Release(*m_currentImage);
+    }
+    m_imageCache->OnDeviceLost();
+    m_tiles->OnDeviceLost();
+
+    if (!m_currentImage) {
         Invalidate();
+        return;
+    }
+
+    if (m_hasCrop) {
+        // The cropped copy shares the original's pixels; cut the crop from them again
+        ImageData original = *m_currentImage;
+        if (m_imageLoader->Upload(original)) {
+            m_currentImage->bitmap = CreateCroppedBitmap(original.bitmap.Get(), m_appliedCrop);
+        }
+    } else {
+        // Cached images near the focus were re-uploaded above; previews are not cached
+        m_imageLoader->Upload(*m_currentImage);
+    }
+
+    if (m_currentImage->bitmap) {
+        m_renderer->ReplaceImage(m_currentImage->bitmap,
+            D2D1::SizeU(m_currentImage->contentWidth, m_currentImage->contentHeight));
     }
+    UpdateTiles();
+    Invalidate();
+}
+
+void App::OnFolderScanComplete() {
+    if (!m_navigator || !m_navigator->ApplyScanResult()) {
+        return;
+    }
+
+    // The current image is unchanged; only its position and neighbours are new
+    m_navPredictor->Reset(m_navigator->GetCurrentIndex());
+    UpdateTitle();
+    PrefetchAdjacentImages();
 }
 
 void App::Render() {
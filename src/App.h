@@ -7,6 +7,10 @@
 class Window;
 class ImageCache;
 class FolderNavigator;
+class NavigationPredictor;
+class TaskPool;
+class MemoryGovernor;
+class TiledImage;
 
 class App {
 public:
@@ -25,6 +29,9 @@ public:
     void OnMouseUp(int x, int y);
     void OnMouseMove(int x, int y);
     void OnResize(int width, int height);
+    void OnDecodeComplete();
+    void OnFolderScanComplete();
+    void OnDeviceLost();
     void Render();
 
     // File operations
@@ -60,6 +67,12 @@ private:
     void NavigateNext();
     void NavigatePrevious();
     void PrefetchAdjacentImages();
+
+    // Warm start: when launched on the file the last session closed on, re-queue the
+    // decodes of that session's working set (returns false if there is nothing to restore)
+    bool RestoreSession(const std::wstring& initialFile);
+    void SaveSession();
+
     bool TryNavigateWithDelay(std::function<bool()> navigateFn);
     void NavigateFirst();
     void NavigateLast();
@@ -70,6 +83,17 @@ private:
     void ResetZoom();
     float CalculateActualSizeZoom() const;
 
+    // Resolution levels: size the screen level to the monitor, fetch full resolution once the
+    // zoom magnifies the screen level, and swap in better levels as they arrive
+    void UpdateScreenSize();
+    void UpdateImageLevel();
+    void UpgradeCurrentImage();
+
+    // Images too large for a full-resolution bitmap are magnified through tiles of the
+    // visible region instead (call after zoom, pan or resize)
+    void UpdateTiles();
+    bool IsTiledImage() const;
+
     // Phase 2 features
     void CopyToClipboard();
     void SetAsWallpaper();
@@ -86,6 +110,7 @@ private:
     void ToggleEditMode(EditMode mode);  // Unified edit mode toggle
     void CancelCurrentMode();
     void ApplyCrop();
+    ComPtr<ID2D1Bitmap> CreateCroppedBitmap(ID2D1Bitmap* source, const WICRect& crop);
 
     // Image saving helper
     bool SaveImageToFile(const std::wstring& filePath);
@@ -136,6 +161,13 @@ private:
     void StopGifAnimation();
     void AdvanceGifFrame();
     static void CALLBACK GifTimerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time);
+    static void CALLBACK MemoryTimerProc(HWND hwnd, UINT msg, UINT_PTR id, DWORD time);
+
+    // Memory governor hooks: report what edits hold, react to pressure, and shed
+    void CheckMemoryPressure();
+    void ReportEditMemory();
+    size_t ShedAnimationFrames(size_t bytesToFree);
+    size_t ShedUndoHistory(size_t bytesToFree);
 
     // Keyboard handlers (extracted from OnKeyDown for clarity)
     bool HandleTextEditingKey(UINT key);
@@ -155,11 +187,17 @@ private:
     void HandleEraseMouseMove(int x, int y);
     void HandlePanMouseMove(int x, int y);
 
+    // Shared by decoding and folder scanning; stopped before the components that use it
+    std::unique_ptr<TaskPool> m_taskPool;
+    // Outlives the cache, which reports to it until destroyed
+    std::unique_ptr<MemoryGovernor> m_memory;
     std::unique_ptr<Window> m_window;
     std::unique_ptr<Renderer> m_renderer;
     std::unique_ptr<ImageLoader> m_imageLoader;
     std::unique_ptr<ImageCache> m_imageCache;
+    std::unique_ptr<TiledImage> m_tiles;
     std::unique_ptr<FolderNavigator> m_navigator;
+    std::unique_ptr<NavigationPredictor> m_navPredictor;
 
     // Current image
     std::shared_ptr<ImageData> m_currentImage;
@@ -169,6 +207,10 @@ private:
     bool m_gifPaused = false;
     static App* s_instance; // For timer callback
 
+    // Memory pressure (polled, since the OS only offers a waitable notification)
+    HANDLE m_lowMemoryNotification = nullptr;
+    UINT_PTR m_memoryTimerId = 0;
+
     // Mouse state for panning
     bool m_isPanning = false;
     int m_lastMouseX = 0;
@@ -181,12 +223,12 @@ private:
     DWORD m_lastNavigateTime = 0;
     static const DWORD NAVIGATE_DELAY_MS = 50;  // Fast navigation when holding key
 
-    // Image prefetch settings
-    static constexpr int PREFETCH_ADJACENT_COUNT = 3;
-
     // GIF animation constants
     static constexpr UINT_PTR GIF_TIMER_ID = 1;
+    static constexpr UINT_PTR MEMORY_TIMER_ID = 2;
+    static constexpr UINT MEMORY_CHECK_INTERVAL_MS = 2000;
     static constexpr UINT DEFAULT_GIF_FRAME_DELAY_MS = 100;
+    static constexpr UINT GIF_STREAM_RETRY_MS = 10;  // Streamed frame not composited yet
     static constexpr float DEFAULT_TEXT_FONT_SIZE = 24.0f;
     static constexpr float ERASE_HIT_RADIUS_PIXELS = 30.0f;
     static constexpr float ZOOM_FACTOR = 1.25f;
@@ -0,0 +1,283 @@
+#include "BlockCompressor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static uint16_t PackColor(int r, int g, int b) {
+    return static_cast<uint16_t>(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+static void UnpackColor(uint16_t color, int& r, int& g, int& b) {
+    r = (color >> 11) & 31;
+    g = (color >> 5) & 63;
+    b = color & 31;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+}
+
+void BlockCompressor::Prepare(const PixelBuffer& source, BlockImage& out) {
+    bool opaque = true;
+    for (uint32_t y = 0; y < source.height && opaque; ++y) {
+        const uint8_t* row = source.pixels.data() + static_cast<size_t>(y) * source.stride;
+        for (uint32_t x = 0; x < source.width; ++x) {
+            if (row[x * 4 + 3] != 0xFF) {
+                opaque = false;
+                break;
+            }
+        }
+    }
+
+    out.format = opaque ? BlockFormat::BC1 : BlockFormat::BC3;
+    out.width = source.width;
+    out.height = source.height;
+    out.blocks.assign(static_cast<size_t>(out.Pitch()) * out.BlocksHigh(), 0);
+}
+
+bool BlockCompressor::Compress(const PixelBuffer& source, BlockImage& out) {
+    if (source.IsEmpty() || source.width == 0 || source.height == 0) return false;
+    Prepare(source, out);
+    CompressRows(source, out, 0, out.BlocksHigh());
+    return true;
+}
+
+void BlockCompressor::CompressRows(const PixelBuffer& source, BlockImage& out, uint32_t firstBlockRow,
+    uint32_t endBlockRow) {
+    endBlockRow = std::min(endBlockRow, out.BlocksHigh());
+    uint8_t block[BLOCK_PIXELS][4];
+
+    for (uint32_t by = firstBlockRow; by < endBlockRow; ++by) {
+        uint8_t* dest = out.blocks.data() + static_cast<size_t>(by) * out.Pitch();
+        for (uint32_t bx = 0; bx < out.BlocksWide(); ++bx) {
+            // Blocks overhanging the edge repeat the last row and column
+            for (uint32_t i = 0; i < BLOCK_PIXELS; ++i) {
+                uint32_t x = std::min(bx * BLOCK_SIZE + i % BLOCK_SIZE, source.width - 1);
+                uint32_t y = std::min(by * BLOCK_SIZE + i / BLOCK_SIZE, source.height - 1);
+                std::memcpy(block[i], source.pixels.data() + static_cast<size_t>(y) * source.stride + x * 4, 4);
+            }
+
+            if (out.format == BlockFormat::BC3) {
+                EncodeAlphaBlock(block, dest);
+                dest += 8;
+            }
+            EncodeColorBlock(block, dest);
+            dest += 8;
+        }
+    }
+}
+
+void BlockCompressor::EncodeColorBlock(const uint8_t (*pixels)[4], uint8_t* out) {
+    // Mean and covariance of the block's colours (channels in r, g, b order)
+    float mean[3] = {};
+    for (uint32_t i = 0; i < BLOCK_PIXELS; ++i) {
+        mean[0] += pixels[i][2];
+        mean[1] += pixels[i][1];
+        mean[2] += pixels[i][0];
+    }
+    for (float& m : mean) m /= BLOCK_PIXELS;
+
+    float cov[6] = {};  // rr, rg, rb, gg, gb, bb
+    for (uint32_t i = 0; i < BLOCK_PIXELS; ++i) {
+        float r = pixels[i][2] - mean[0];
+        float g = pixels[i][1] - mean[1];
+        float b = pixels[i][0] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // Principal axis by power iteration
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < POWER_ITERATIONS; ++iteration) {
+        float next[3] = {
+            cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+            cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+            cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+        };
+        float length = std::max({ std::fabs(next[0]), std::fabs(next[1]), std::fabs(next[2]) });
+        if (length < 1e-6f) break;
+        for (int c = 0; c < 3; ++c) axis[c] = next[c] / length;
+    }
+
+    float low = 0.0f, high = 0.0f;
+    float lengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    for (uint32_t i = 0; i < BLOCK_PIXELS; ++i) {
+        float t = ((pixels[i][2] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] +
+            (pixels[i][0] - mean[2]) * axis[2]) / lengthSquared;
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+
+    // Pull the endpoints in by 1/16 of the range, which lowers the error of the interpolated colours
+    float inset = (high - low) / 16.0f;
+    low += inset;
+    high -= inset;
+    int ends[2][3];
+    for (int c = 0; c < 3; ++c) {
+        ends[0][c] = std::clamp(static_cast<int>(std::lround(mean[c] + axis[c] * high)), 0, 255);
+        ends[1][c] = std::clamp(static_cast<int>(std::lround(mean[c] + axis[c] * low)), 0, 255);
+    }
+    uint16_t color0 = PackColor(ends[0][0], ends[0][1], ends[0][2]);
+    uint16_t color1 = PackColor(ends[1][0], ends[1][1], ends[1][2]);
+
+    // color0 > color1 selects the four-colour mode
+    if (color0 < color1) std::swap(color0, color1);
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        UnpackColor(color0, palette[0][0], palette[0][1], palette[0][2]);
+        UnpackColor(color1, palette[1][0], palette[1][1], palette[1][2]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (uint32_t i = 0; i < BLOCK_PIXELS; ++i) {
+            int best = 0;
+            int bestError = INT32_MAX;
+            for (int p = 0; p < 4; ++p) {
+                int dr = pixels[i][2] - palette[p][0];
+                int dg = pixels[i][1] - palette[p][1];
+                int db = pixels[i][0] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+        }
+    }
+
+    out[0] = static_cast<uint8_t>(color0);
+    out[1] = static_cast<uint8_t>(color0 >> 8);
+    out[2] = static_cast<uint8_t>(color1);
+    out[3] = static_cast<uint8_t>(color1 >> 8);
+    for (int i = 0; i < 4; ++i) {
+        out[4 + i] = static_cast<uint8_t>(indices >> (8 * i));
+    }
+}
+
+void BlockCompressor::EncodeAlphaBlock(const uint8_t (*pixels)[4], uint8_t* out) {
+    int low = 255, high = 0;
+    for (uint32_t i = 0; i < BLOCK_PIXELS; ++i) {
+        low = std::min<int>(low, pixels[i][3]);
+        high = std::max<int>(high, pixels[i][3]);
+    }
+
+    // alpha0 > alpha1 selects eight interpolated values
+    uint64_t indices = 0;
+    if (high != low) {
+        int palette[8] = { high, low };
+        for (int i = 2; i < 8; ++i) {
+            palette[i] = ((8 - i) * high + (i - 1) * low) / 7;
+        }
+        for (uint32_t i = 0; i < BLOCK_PIXELS; ++i) {
+            int best = 0;
+            int bestError = 256;
+            for (int p = 0; p < 8; ++p) {
+                int error = std::abs(pixels[i][3] - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint64_t>(best) << (3 * i);
+        }
+    }
+
+    out[0] = static_cast<uint8_t>(high);
+    out[1] = static_cast<uint8_t>(low);
+    for (int i = 0; i < 6; ++i) {
+        out[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+    }
+}
+
+void BlockCompressor::DecodeColorBlock(const uint8_t* in, bool allowTransparent, uint8_t (*pixels)[4]) {
+    uint16_t color0 = static_cast<uint16_t>(in[0] | in[1] << 8);
+    uint16_t color1 = static_cast<uint16_t>(in[2] | in[3] << 8);
+    int palette[4][4];
+    UnpackColor(color0, palette[0][0], palette[0][1], palette[0][2]);
+    UnpackColor(color1, palette[1][0], palette[1][1], palette[1][2]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+
+    if (color0 > color1 || !allowTransparent) {
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+    } else {
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+        palette[3][3] = 0;
+    }
+
+    uint32_t indices = static_cast<uint32_t>(in[4]) | static_cast<uint32_t>(in[5]) << 8 |
+        static_cast<uint32_t>(in[6]) << 16 | static_cast<uint32_t>(in[7]) << 24;
+    for (uint32_t i = 0; i < BLOCK_PIXELS; ++i) {
+        const int* color = palette[(indices >> (2 * i)) & 3];
+        pixels[i][0] = static_cast<uint8_t>(color[2]);
+        pixels[i][1] = static_cast<uint8_t>(color[1]);
+        pixels[i][2] = static_cast<uint8_t>(color[0]);
+        pixels[i][3] = static_cast<uint8_t>(color[3]);
+    }
+}
+
+void BlockCompressor::DecodeAlphaBlock(const uint8_t* in, uint8_t (*pixels)[4]) {
+    int palette[8] = { in[0], in[1] };
+    if (palette[0] > palette[1]) {
+        for (int i = 2; i < 8; ++i) {
+            palette[i] = ((8 - i) * palette[0] + (i - 1) * palette[1]) / 7;
+        }
+    } else {
+        for (int i = 2; i < 6; ++i) {
+            palette[i] = ((6 - i) * palette[0] + (i - 1) * palette[1]) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i) {
+        indices |= static_cast<uint64_t>(in[2 + i]) << (8 * i);
+    }
+    for (uint32_t i = 0; i < BLOCK_PIXELS; ++i) {
+        pixels[i][3] = static_cast<uint8_t>(palette[(indices >> (3 * i)) & 7]);
+    }
+}
+
+bool BlockCompressor::Decompress(const BlockImage& source, PixelBuffer& out) {
+    if (source.IsEmpty() || source.blocks.size() < static_cast<size_t>(source.Pitch()) * source.BlocksHigh()) {
+        return false;
+    }
+
+    out.width = source.width;
+    out.height = source.height;
+    out.stride = source.width * 4;
+    out.pixels.assign(static_cast<size_t>(out.stride) * out.height, 0);
+
+    uint8_t block[BLOCK_PIXELS][4];
+    for (uint32_t by = 0; by < source.BlocksHigh(); ++by) {
+        const uint8_t* in = source.blocks.data() + static_cast<size_t>(by) * source.Pitch();
+        for (uint32_t bx = 0; bx < source.BlocksWide(); ++bx) {
+            if (source.format == BlockFormat::BC3) {
+                DecodeColorBlock(in + 8, false, block);
+                DecodeAlphaBlock(in, block);
+            } else {
+                DecodeColorBlock(in, true, block);
+            }
+            in += source.BlockBytes();
+
+            for (uint32_t i = 0; i < BLOCK_PIXELS; ++i) {
+                uint32_t x = bx * BLOCK_SIZE + i % BLOCK_SIZE;
+                uint32_t y = by * BLOCK_SIZE + i / BLOCK_SIZE;
+                if (x < out.width && y < out.height) {
+                    std::memcpy(out.pixels.data() + static_cast<size_t>(y) * out.stride + x * 4, block[i], 4);
+                }
+            }
+        }
+    }
+    return true;
+}
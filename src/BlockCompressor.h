@@ -0,0 +1,34 @@
+#pragma once
+// Platform-neutral BC1/BC3 block compression of decoded pixels, used to keep cached
+// images far from the focus at 1/8 (opaque) or 1/4 (with alpha) of their BGRA size. The
+// GPU samples these formats directly, so a compressed image uploads without expanding.
+// Endpoints come from the principal axis of each block's colours, inset slightly, and
+// every pixel takes the nearest palette entry. Rows of blocks are independent, so large
+// images can be split across threads with CompressRows.
+#include "DecodePipeline.h"
+
+class BlockCompressor {
+public:
+    // BC1 if every pixel is opaque, otherwise BC3
+    static bool Compress(const PixelBuffer& source, BlockImage& out);
+
+    // Size out for source (format chosen as Compress does), then fill any ranges of block
+    // rows, possibly concurrently
+    static void Prepare(const PixelBuffer& source, BlockImage& out);
+    static void CompressRows(const PixelBuffer& source, BlockImage& out, uint32_t firstBlockRow,
+        uint32_t endBlockRow);
+
+    // Expand back to premultiplied BGRA of the original size (for devices without BC
+    // support, and for measuring quality)
+    static bool Decompress(const BlockImage& source, PixelBuffer& out);
+
+private:
+    static constexpr uint32_t BLOCK_SIZE = BlockImage::BLOCK_SIZE;
+    static constexpr uint32_t BLOCK_PIXELS = BLOCK_SIZE * BLOCK_SIZE;
+    static constexpr int POWER_ITERATIONS = 4;
+
+    static void EncodeColorBlock(const uint8_t (*pixels)[4], uint8_t* out);
+    static void EncodeAlphaBlock(const uint8_t (*pixels)[4], uint8_t* out);
+    static void DecodeColorBlock(const uint8_t* in, bool allowTransparent, uint8_t (*pixels)[4]);
+    static void DecodeAlphaBlock(const uint8_t* in, uint8_t (*pixels)[4]);
+};
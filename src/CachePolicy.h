@@ -0,0 +1,129 @@
+#pragma once
+// Platform-neutral, byte-budgeted eviction policy (Greedy-Dual-Size-Frequency).
+// Each entry's priority is  H = L + hits * cost / max(bytes, MIN_CHARGED_BYTES),  where
+// cost is the measured re-decode time and L is an "inflation" value raised to the
+// priority of every evicted entry. The size floor means entries up to about a screen
+// image rank by absolute re-decode cost, so a small icon that decodes in 2 ms goes
+// before a 100 MP HEIC that takes seconds; only larger entries are charged per byte,
+// so a huge but fast format still yields its space first. L ages out entries that have
+// not been touched since it last rose. Entries are addressed by the caller's stable
+// handles (e.g. LruIndex handles), so all operations are O(log n) without key lookups.
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <utility>
+#include <vector>
+
+struct CacheEntryCost {
+    size_t cpuBytes = 0;     // Decoded pixel buffers held in system memory
+    size_t gpuBytes = 0;     // Device bitmaps
+    double decodeMs = 0.0;   // Measured cost of recreating the entry
+    uint32_t hits = 0;
+    double priority = 0.0;
+
+    size_t TotalBytes() const { return cpuBytes + gpuBytes; }
+};
+
+class GdsfPolicy {
+public:
+    using Handle = uint32_t;
+    static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+    // Minimum cost so entries decoded "instantly" (or with no timing) still rank by size
+    static constexpr double MIN_DECODE_MS = 0.1;
+
+    // Smaller entries are charged as this size: dividing by their real size would make a
+    // tiny, cheap entry outrank everything expensive
+    static constexpr size_t MIN_CHARGED_BYTES = 32ull * 1024 * 1024;
+
+    void Add(Handle handle, const CacheEntryCost& cost) {
+        if (handle >= m_entries.size()) {
+            m_entries.resize(static_cast<size_t>(handle) + 1);
+        }
+        Slot& slot = m_entries[handle];
+        if (slot.active) {
+            Remove(handle, false);
+        }
+
+        slot.cost = cost;
+        slot.cost.hits = std::max<uint32_t>(cost.hits, 1);
+        slot.active = true;
+        m_totalBytes += slot.cost.TotalBytes();
+        Reprioritize(handle);
+    }
+
+    void Touch(Handle handle) {
+        if (!IsActive(handle)) return;
+        m_entries[handle].cost.hits++;
+        m_order.erase({ m_entries[handle].cost.priority, handle });
+        Reprioritize(handle);
+    }
+
+    // Update byte accounting without affecting recency (e.g. a GPU upload was dropped)
+    void UpdateBytes(Handle handle, size_t cpuBytes, size_t gpuBytes) {
+        if (!IsActive(handle)) return;
+        CacheEntryCost& cost = m_entries[handle].cost;
+        m_totalBytes -= cost.TotalBytes();
+        cost.cpuBytes = cpuBytes;
+        cost.gpuBytes = gpuBytes;
+        m_totalBytes += cost.TotalBytes();
+        m_order.erase({ cost.priority, handle });
+        Reprioritize(handle);
+    }
+
+    // evicted=true raises the inflation value; explicit invalidation does not
+    void Remove(Handle handle, bool evicted) {
+        if (!IsActive(handle)) return;
+        Slot& slot = m_entries[handle];
+        m_order.erase({ slot.cost.priority, handle });
+        m_totalBytes -= slot.cost.TotalBytes();
+        if (evicted) {
+            m_inflation = std::max(m_inflation, slot.cost.priority);
+        }
+        slot = Slot();
+    }
+
+    // Lowest-priority entry, or INVALID_HANDLE when empty
+    Handle SelectVictim() const {
+        return m_order.empty() ? INVALID_HANDLE : m_order.begin()->second;
+    }
+
+    bool IsActive(Handle handle) const {
+        return handle < m_entries.size() && m_entries[handle].active;
+    }
+
+    const CacheEntryCost& GetCost(Handle handle) const { return m_entries[handle].cost; }
+    size_t GetTotalBytes() const { return m_totalBytes; }
+    size_t GetEntryCount() const { return m_order.size(); }
+    double GetInflation() const { return m_inflation; }
+
+    void Clear() {
+        m_entries.clear();
+        m_order.clear();
+        m_totalBytes = 0;
+        m_inflation = 0.0;
+    }
+
+private:
+    struct Slot {
+        CacheEntryCost cost;
+        bool active = false;
+    };
+
+    void Reprioritize(Handle handle) {
+        CacheEntryCost& cost = m_entries[handle].cost;
+        double bytes = static_cast<double>(std::max(cost.TotalBytes(), MIN_CHARGED_BYTES));
+        double decodeMs = std::max(cost.decodeMs, MIN_DECODE_MS);
+        // Cost per megabyte keeps the ratio well within double precision
+        cost.priority = m_inflation + cost.hits * decodeMs * BYTES_PER_MB / bytes;
+        m_order.insert({ cost.priority, handle });
+    }
+
+    static constexpr double BYTES_PER_MB = 1024.0 * 1024.0;
+
+    std::vector<Slot> m_entries;
+    std::set<std::pair<double, Handle>> m_order;  // Ascending priority
+    size_t m_totalBytes = 0;
+    double m_inflation = 0.0;
+};
@@ -0,0 +1,300 @@
+#include "DecodePipeline.h"
+#include <algorithm>
+#include <chrono>
+
+DecodePipeline::~DecodePipeline() {
+    Stop();
+}
+
+void DecodePipeline::Start(Callbacks callbacks, TaskPool* pool) {
+    Stop();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callbacks = std::move(callbacks);
+    m_pool = pool;
+    m_running = (pool != nullptr);
+}
+
+void DecodePipeline::Stop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_running = false;
+    m_pending.clear();
+    for (auto& [key, decode] : m_inFlight) {
+        decode.token->store(true);
+    }
+
+    // Tasks still queued in the pool find nothing pending and return immediately
+    m_idleCv.wait(lock, [this] { return m_activeDecodes == 0; });
+
+    m_inFlight.clear();
+    m_completed.clear();
+    m_completedKeys.clear();
+    ResolveOrphanedFlightsLocked();
+}
+
+bool DecodePipeline::IsInWindowLocked(size_t index) const {
+    return index == m_focusIndex || m_window.count(index) != 0;
+}
+
+size_t DecodePipeline::DistanceLocked(size_t index) const {
+    return index >= m_focusIndex ? index - m_focusIndex : m_focusIndex - index;
+}
+
+void DecodePipeline::SetWindow(size_t focusIndex, std::unordered_set<size_t> windowIndices) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_focusIndex = focusIndex;
+    m_window = std::move(windowIndices);
+
+    // Forget queued requests the user has already scrolled past
+    for (auto it = m_pending.begin(); it != m_pending.end(); ) {
+        if (!IsInWindowLocked(it->second.index)) {
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Abandon decodes that are no longer wanted so their worker frees up sooner
+    for (auto& [key, decode] : m_inFlight) {
+        if (!IsInWindowLocked(decode.index)) {
+            decode.token->store(true);
+        }
+    }
+    ResolveOrphanedFlightsLocked();
+}
+
+void DecodePipeline::Reindex(const std::vector<DecodeRequest>& requests) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& request : requests) {
+        std::wstring key = MakeKey(request.filePath, request.level);
+        auto pending = m_pending.find(key);
+        if (pending != m_pending.end()) {
+            pending->second.index = request.index;
+        }
+        auto inFlight = m_inFlight.find(key);
+        if (inFlight != m_inFlight.end()) {
+            inFlight->second.index = request.index;
+        }
+    }
+}
+
+void DecodePipeline::Enqueue(const DecodeRequest& request) {
+    TaskPriority priority = TaskPriority::Prefetch;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running || !IsInWindowLocked(request.index)) {
+            return;
+        }
+        std::wstring key = MakeKey(request.filePath, request.level);
+        if (m_completedKeys.count(key)) {
+            return;
+        }
+        auto inFlight = m_inFlight.find(key);
+        if (inFlight != m_inFlight.end()) {
+            if (!IsCancelled(inFlight->second.token)) {
+                inFlight->second.index = request.index;
+                return;
+            }
+            // A cancelled decode of this file is still unwinding; queue a fresh one
+        }
+        m_pending[key] = request;
+        if (request.index == m_focusIndex) {
+            priority = TaskPriority::Interactive;
+        }
+    }
+
+    m_pool->Submit(priority, [this]() { RunNextDecode(); });
+}
+
+DecodePipeline::DecodeFuture DecodePipeline::Request(const DecodeRequest& request, bool runInline) {
+    DecodeFuture future;
+    bool submit = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            std::promise<std::shared_ptr<DecodedImage>> failed;
+            failed.set_value(nullptr);
+            return failed.get_future().share();
+        }
+
+        // Already decoded and waiting for the UI thread
+        std::wstring key = MakeKey(request.filePath, request.level);
+        if (m_completedKeys.count(key)) {
+            for (const auto& decoded : m_completed) {
+                if (decoded->filePath == request.filePath && decoded->level == request.level) {
+                    std::promise<std::shared_ptr<DecodedImage>> ready;
+                    ready.set_value(decoded);
+                    return ready.get_future().share();
+                }
+            }
+        }
+
+        auto flight = m_flights.find(key);
+        if (flight == m_flights.end()) {
+            flight = m_flights.emplace(key, Flight()).first;
+            flight->second.future = flight->second.promise.get_future().share();
+        }
+        future = flight->second.future;
+
+        // Join a running decode rather than starting a second one
+        auto inFlight = m_inFlight.find(key);
+        if (inFlight != m_inFlight.end() && !IsCancelled(inFlight->second.token)) {
+            inFlight->second.index = request.index;
+            return future;
+        }
+
+        if (runInline) {
+            m_pending.erase(key);
+        } else {
+            submit = m_pending.count(key) == 0;
+            m_pending[key] = request;
+        }
+    }
+
+    if (runInline) {
+        RunDecode(request);
+    } else if (submit) {
+        m_pool->Submit(TaskPriority::Interactive, [this]() { RunNextDecode(); });
+    }
+    return future;
+}
+
+void DecodePipeline::ClearPending() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.clear();
+    for (auto& [key, decode] : m_inFlight) {
+        decode.token->store(true);
+    }
+    ResolveOrphanedFlightsLocked();
+}
+
+void DecodePipeline::ResolveOrphanedFlightsLocked() {
+    // Anyone waiting on a file that is neither queued nor being decoded would wait forever
+    for (auto it = m_flights.begin(); it != m_flights.end(); ) {
+        auto inFlight = m_inFlight.find(it->first);
+        bool live = m_pending.count(it->first) != 0 ||
+            (inFlight != m_inFlight.end() && !IsCancelled(inFlight->second.token));
+        if (!live) {
+            it->second.promise.set_value(nullptr);
+            it = m_flights.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::vector<std::shared_ptr<DecodedImage>> DecodePipeline::TakeCompleted() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::shared_ptr<DecodedImage>> result;
+    result.swap(m_completed);
+    m_completedKeys.clear();
+    return result;
+}
+
+bool DecodePipeline::PopNearestLocked(DecodeRequest& request) {
+    // The pending set is bounded by the prefetch window, so a linear scan is cheap
+    auto best = m_pending.end();
+    size_t bestDistance = SIZE_MAX;
+    for (auto it = m_pending.begin(); it != m_pending.end(); ++it) {
+        const DecodeRequest& candidate = it->second;
+        size_t distance = DistanceLocked(candidate.index);
+        if (best == m_pending.end() || distance < bestDistance) {
+            best = it;
+            bestDistance = distance;
+            continue;
+        }
+        if (distance > bestDistance) {
+            continue;
+        }
+
+        // Ties go to the image ahead of the focus (the usual browsing direction), then to
+        // the screen level, which is cheaper and shown first
+        const DecodeRequest& current = best->second;
+        if (candidate.index != current.index) {
+            if (candidate.index > current.index) {
+                best = it;
+            }
+        } else if (candidate.level == ImageLevel::Screen) {
+            best = it;
+        }
+    }
+    if (best == m_pending.end()) {
+        return false;
+    }
+
+    request = best->second;
+    m_pending.erase(best);
+    return true;
+}
+
+void DecodePipeline::RunNextDecode() {
+    DecodeRequest request;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running || !PopNearestLocked(request)) {
+            return;
+        }
+    }
+    RunDecode(request);
+}
+
+void DecodePipeline::RunDecode(const DecodeRequest& request) {
+    std::wstring key = MakeKey(request.filePath, request.level);
+    CancellationToken token = std::make_shared<std::atomic<bool>>(false);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            ResolveOrphanedFlightsLocked();
+            return;
+        }
+        // Replaces the entry of a cancelled decode of the same file, if any
+        m_inFlight[key] = { request.index, token };
+        m_activeDecodes++;
+    }
+
+    // Decode outside the lock so other workers and the UI thread are not blocked
+    std::shared_ptr<DecodedImage> decoded;
+    if (m_callbacks.decode) {
+        auto start = std::chrono::steady_clock::now();
+        decoded = m_callbacks.decode(request, token);
+        if (decoded) {
+            decoded->decodeMs = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+    }
+
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_inFlight.find(key);
+        if (it != m_inFlight.end() && it->second.token == token) {
+            m_inFlight.erase(it);
+        }
+
+        if (decoded && m_running && !IsCancelled(token)) {
+            decoded->filePath = request.filePath;
+            decoded->level = request.level;
+            // Only wake the UI thread on the empty -> non-empty transition so a burst
+            // of finished decodes is handed over in a single batch
+            notify = m_completed.empty();
+            m_completedKeys.insert(key);
+            m_completed.push_back(decoded);
+
+            auto flight = m_flights.find(key);
+            if (flight != m_flights.end()) {
+                flight->second.promise.set_value(decoded);
+                m_flights.erase(flight);
+            }
+        }
+        ResolveOrphanedFlightsLocked();
+    }
+
+    if (notify && m_callbacks.onCompleted) {
+        m_callbacks.onCompleted();
+    }
+
+    // Last touch of this object: Stop may return (and the owner be destroyed) right after
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_activeDecodes--;
+    m_idleCv.notify_all();
+}
@@ -0,0 +1,219 @@
+#pragma once
+// Platform-neutral decode/handoff core. Deliberately free of Windows headers so the
+// queueing and threading logic can be exercised headlessly with a fake decoder.
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "TaskPool.h"
+#include "GifAnimation.h"
+
+// CPU-side pixel buffer (32bpp premultiplied BGRA, top-down rows)
+struct PixelBuffer {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t stride = 0;
+    std::vector<uint8_t> pixels;
+
+    size_t ByteSize() const { return pixels.size(); }
+    bool IsEmpty() const { return pixels.empty(); }
+};
+
+// JPEG pixels kept as decoded 8-bit Y, Cb and Cr planes (full-range BT.601, chroma
+// usually subsampled 2x in each direction). Converted to BGRA only when uploaded.
+struct PlanarYCbCr {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t chromaWidth = 0;
+    uint32_t chromaHeight = 0;
+    std::vector<uint8_t> y;   // width * height
+    std::vector<uint8_t> cb;  // chromaWidth * chromaHeight
+    std::vector<uint8_t> cr;
+
+    size_t ByteSize() const { return y.size() + cb.size() + cr.size(); }
+    bool IsEmpty() const { return y.empty(); }
+};
+
+// Pixels kept block-compressed (see BlockCompressor): BC1 for opaque images, BC3 when
+// there is alpha. Colours are premultiplied BGRA as in PixelBuffer. The block grid covers
+// width x height rounded up to whole 4x4 blocks.
+enum class BlockFormat : uint8_t {
+    BC1 = 0,  // 8 bytes per block
+    BC3 = 1,  // 16 bytes per block
+};
+
+struct BlockImage {
+    BlockFormat format = BlockFormat::BC1;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> blocks;  // Row-major, BlocksWide() blocks per row
+
+    static constexpr uint32_t BLOCK_SIZE = 4;
+
+    uint32_t BlocksWide() const { return (width + BLOCK_SIZE - 1) / BLOCK_SIZE; }
+    uint32_t BlocksHigh() const { return (height + BLOCK_SIZE - 1) / BLOCK_SIZE; }
+    uint32_t BlockBytes() const { return format == BlockFormat::BC1 ? 8 : 16; }
+    uint32_t Pitch() const { return BlocksWide() * BlockBytes(); }
+    size_t ByteSize() const { return blocks.size(); }
+    bool IsEmpty() const { return blocks.empty(); }
+};
+
+// Resolution levels cached per image: a screen-fit level that is decoded and shown first,
+// and full resolution, loaded only once the user zooms past the screen level's scale
+enum class ImageLevel {
+    Screen = 0,
+    Full = 1,
+};
+inline constexpr size_t IMAGE_LEVEL_COUNT = 2;
+
+// Result of a worker-thread decode, waiting to be turned into GPU bitmaps on the UI thread
+struct DecodedImage {
+    std::wstring filePath;
+    std::wstring cacheKey;  // Version of the file the pixels came from (empty: do not cache)
+    ImageLevel level = ImageLevel::Full;
+    PixelBuffer image;  // Static image (empty for animations, see animation)
+    PlanarYCbCr planar; // Used instead of image for JPEGs kept in planar form
+    BlockImage compressed;  // Used instead of image for entries compressed for the cache
+
+    // Size of the original image; the pixels are smaller for a downscaled screen level
+    uint32_t sourceWidth = 0;
+    uint32_t sourceHeight = 0;
+    bool isFullResolution = true;
+
+    // For animated GIF: palette-indexed frames, composited when shown
+    bool isAnimated = false;
+    std::shared_ptr<const GifAnimation> animation;
+    std::vector<uint32_t> frameDelays; // in milliseconds (one per frame, streamed or not)
+
+    // Set for an animation too long to keep whole: animation then holds only the first
+    // frame and the rest are read from here as it plays (see GifStream)
+    std::shared_ptr<GifFrameSource> frameSource;
+
+    // Wall-clock decode time measured by the worker (used as re-decode cost)
+    double decodeMs = 0.0;
+
+    size_t ByteSize() const {
+        return image.ByteSize() + planar.ByteSize() + compressed.ByteSize() +
+            (animation ? animation->ByteSize() : 0);
+    }
+};
+
+// Shared flag a decode polls so it can abandon work nobody wants any more
+using CancellationToken = std::shared_ptr<std::atomic<bool>>;
+
+inline bool IsCancelled(const CancellationToken& token) {
+    return token && token->load(std::memory_order_relaxed);
+}
+
+// A file to decode, its position in the folder (used for distance ordering) and the
+// resolution wanted
+struct DecodeRequest {
+    std::wstring filePath;
+    size_t index = 0;
+    ImageLevel level = ImageLevel::Screen;
+};
+
+// Decodes run nearest-first relative to a focus index (the image being viewed). Each
+// navigation moves the focus and the wanted window (a set of folder indices, usually a
+// run around the focus plus predicted jump targets); queued requests that fall outside
+// the window are dropped and in-flight ones are cancelled through their token.
+// Work runs on a shared TaskPool: every request submits a task that picks the nearest
+// pending request only when it starts, so the order always reflects the latest focus.
+// Each file has at most one decode queued or running; callers that need the result wait
+// on a shared future for that decode instead of starting their own.
+class DecodePipeline {
+public:
+    using DecodeFn = std::function<std::shared_ptr<DecodedImage>(const DecodeRequest&,
+        const CancellationToken&)>;
+    using NotifyFn = std::function<void()>;
+    using DecodeFuture = std::shared_future<std::shared_ptr<DecodedImage>>;
+
+    struct Callbacks {
+        DecodeFn decode;             // Runs on a pool worker thread
+        NotifyFn onCompleted;        // Called when the completed list becomes non-empty
+    };
+
+    DecodePipeline() = default;
+    ~DecodePipeline();
+
+    DecodePipeline(const DecodePipeline&) = delete;
+    DecodePipeline& operator=(const DecodePipeline&) = delete;
+
+    void Start(Callbacks callbacks, TaskPool* pool);
+
+    // Cancel everything and wait for running decodes to finish (the pool keeps running)
+    void Stop();
+
+    // Move the focus and replace the set of wanted folder indices
+    void SetWindow(size_t focusIndex, std::unordered_set<size_t> windowIndices);
+
+    // Move queued and running decodes of these files to the indices given, so a changed
+    // folder listing does not make SetWindow drop work that is still wanted
+    void Reindex(const std::vector<DecodeRequest>& requests);
+
+    // Queue a file for decoding (ignored if that level is already decoding or completed;
+    // a queued request just has its index updated)
+    void Enqueue(const DecodeRequest& request);
+
+    // Single-flight request for a file's pixels, regardless of the window. Joins a decode
+    // that is queued, running or finished-but-not-yet-taken. With runInline, a decode that
+    // has not started yet runs on the calling thread before this returns. The future
+    // resolves to nullptr if the decode fails or is abandoned. A successful result is also
+    // handed over through TakeCompleted as usual.
+    DecodeFuture Request(const DecodeRequest& request, bool runInline);
+
+    // Drop queued work and cancel in-flight decodes
+    void ClearPending();
+
+    // Take all finished decodes (called from the UI thread)
+    std::vector<std::shared_ptr<DecodedImage>> TakeCompleted();
+
+    bool IsRunning() const { return m_running; }
+
+    // Identifies one level of one file in the queues ('|' cannot appear in a path)
+    static std::wstring MakeKey(const std::wstring& filePath, ImageLevel level) {
+        return level == ImageLevel::Full ? filePath : filePath + L"|screen";
+    }
+
+private:
+    struct InFlightDecode {
+        size_t index = 0;
+        CancellationToken token;
+    };
+
+    struct Flight {
+        std::promise<std::shared_ptr<DecodedImage>> promise;
+        DecodeFuture future;
+    };
+
+    void RunNextDecode();
+    void RunDecode(const DecodeRequest& request);
+    void ResolveOrphanedFlightsLocked();
+    bool IsInWindowLocked(size_t index) const;
+    size_t DistanceLocked(size_t index) const;
+    bool PopNearestLocked(DecodeRequest& request);
+
+    Callbacks m_callbacks;
+    TaskPool* m_pool = nullptr;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_idleCv;
+    size_t m_activeDecodes = 0;
+    // All keyed by MakeKey
+    std::unordered_map<std::wstring, DecodeRequest> m_pending;
+    std::unordered_map<std::wstring, InFlightDecode> m_inFlight;
+    std::vector<std::shared_ptr<DecodedImage>> m_completed;
+    std::unordered_set<std::wstring> m_completedKeys;             // Awaiting TakeCompleted
+    std::unordered_map<std::wstring, Flight> m_flights;            // Decodes someone waits on
+
+    size_t m_focusIndex = 0;
+    std::unordered_set<size_t> m_window;
+    std::atomic<bool> m_running{ false };
+};
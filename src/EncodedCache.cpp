@@ -0,0 +1,217 @@
+#include "EncodedCache.h"
+#include <algorithm>
+#include <fstream>
+
+EncodedCache::~EncodedCache() {
+    Stop();
+}
+
+void EncodedCache::Start(size_t queueDepth) {
+    Stop();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running = true;
+    queueDepth = std::max<size_t>(queueDepth, 1);
+    for (size_t i = 0; i < queueDepth; ++i) {
+        m_threads.emplace_back(&EncodedCache::IoThread, this);
+    }
+}
+
+void EncodedCache::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+        m_queue.clear();
+    }
+    m_queueCv.notify_all();
+
+    for (auto& thread : m_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    m_threads.clear();
+}
+
+void EncodedCache::ReadAhead(const std::vector<std::wstring>& paths) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) return;
+
+        // Whatever was queued for the previous position is no longer the priority
+        m_queue.clear();
+        for (const auto& path : paths) {
+            if (m_cache.Find(path) == m_cache.INVALID_HANDLE && !m_reading.count(path)) {
+                m_queue.push_back(path);
+            }
+        }
+    }
+    m_queueCv.notify_all();
+}
+
+void EncodedCache::IoThread() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_queueCv.wait(lock, [this] { return !m_running || !m_queue.empty(); });
+        if (!m_running) return;
+
+        std::wstring path = std::move(m_queue.front());
+        m_queue.pop_front();
+        if (m_cache.Find(path) != m_cache.INVALID_HANDLE || m_reading.count(path)) {
+            continue;
+        }
+        m_reading.insert(path);
+        size_t maxBytes = m_maxBytes;
+
+        // Read outside the lock so lookups and other reads are not held up by the disk
+        lock.unlock();
+        Entry entry;
+        bool ok = ReadFromDisk(path, maxBytes, entry);
+        lock.lock();
+
+        m_reading.erase(path);
+        if (ok) {
+            InsertLocked(path, std::move(entry));
+        }
+        m_readCv.notify_all();
+    }
+}
+
+EncodedBuffer EncodedCache::Read(const std::wstring& filePath) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_readCv.wait(lock, [&] { return m_reading.count(filePath) == 0; });
+
+    auto handle = m_cache.Find(filePath);
+    if (handle != m_cache.INVALID_HANDLE) {
+        Entry entry = m_cache.GetValue(handle);
+        m_cache.Touch(handle);
+
+        // Check the file has not been rewritten since it was read (stat outside the lock)
+        lock.unlock();
+        if (IsCurrent(filePath, entry)) {
+            return entry.bytes;
+        }
+        lock.lock();
+
+        handle = m_cache.Find(filePath);
+        if (handle != m_cache.INVALID_HANDLE && m_cache.GetValue(handle).bytes == entry.bytes) {
+            EraseLocked(handle);
+        }
+    }
+
+    m_reading.insert(filePath);
+    size_t maxBytes = m_maxBytes;
+    lock.unlock();
+
+    Entry entry;
+    bool ok = ReadFromDisk(filePath, maxBytes, entry);
+    EncodedBuffer bytes = entry.bytes;
+
+    lock.lock();
+    m_reading.erase(filePath);
+    if (ok) {
+        InsertLocked(filePath, std::move(entry));
+    }
+    m_readCv.notify_all();
+    return bytes;
+}
+
+bool EncodedCache::ReadFromDisk(const std::wstring& filePath, size_t maxBytes, Entry& entry) const {
+    std::filesystem::path path(filePath);
+    std::error_code ec;
+    entry.fileSize = std::filesystem::file_size(path, ec);
+    if (ec || entry.fileSize == 0 || entry.fileSize > maxBytes) return false;
+
+    entry.lastWriteTime = std::filesystem::last_write_time(path, ec);
+    if (ec) return false;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    std::vector<uint8_t> bytes(static_cast<size_t>(entry.fileSize));
+    file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (static_cast<size_t>(file.gcount()) != bytes.size()) return false;
+
+    entry.bytes = std::make_shared<EncodedBytes>(std::move(bytes));
+    return true;
+}
+
+EncodedBuffer EncodedCache::Find(const std::wstring& filePath) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto handle = m_cache.Find(filePath);
+    if (handle == m_cache.INVALID_HANDLE) return nullptr;
+
+    Entry entry = m_cache.GetValue(handle);
+    m_cache.Touch(handle);
+    lock.unlock();
+    return IsCurrent(filePath, entry) ? entry.bytes : nullptr;
+}
+
+void EncodedCache::Erase(const std::wstring& filePath) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto handle = m_cache.Find(filePath);
+    if (handle != m_cache.INVALID_HANDLE) {
+        EraseLocked(handle);
+    }
+}
+
+bool EncodedCache::IsCurrent(const std::wstring& filePath, const Entry& entry) {
+    std::filesystem::path path(filePath);
+    std::error_code ec;
+    uintmax_t fileSize = std::filesystem::file_size(path, ec);
+    if (ec || fileSize != entry.fileSize) return false;
+
+    auto lastWriteTime = std::filesystem::last_write_time(path, ec);
+    return !ec && lastWriteTime == entry.lastWriteTime;
+}
+
+void EncodedCache::InsertLocked(const std::wstring& filePath, Entry entry) {
+    size_t size = entry.bytes->size();
+
+    auto existing = m_cache.Find(filePath);
+    if (existing != m_cache.INVALID_HANDLE) {
+        EraseLocked(existing);
+    }
+    if (size > m_maxBytes) return;
+
+    m_cache.Insert(filePath, std::move(entry));
+    m_totalBytes += size;
+
+    while (m_totalBytes > m_maxBytes) {
+        EraseLocked(m_cache.LeastRecent());
+    }
+}
+
+void EncodedCache::EraseLocked(LruIndex<Entry>::Handle handle) {
+    m_totalBytes -= m_cache.GetValue(handle).bytes->size();
+    m_cache.Erase(handle);
+}
+
+void EncodedCache::SetMaxBytes(size_t maxBytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxBytes = maxBytes;
+    while (m_totalBytes > m_maxBytes && !m_cache.IsEmpty()) {
+        EraseLocked(m_cache.LeastRecent());
+    }
+}
+
+size_t EncodedCache::Shed(size_t bytesToFree) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t before = m_totalBytes;
+    while (before - m_totalBytes < bytesToFree && !m_cache.IsEmpty()) {
+        EraseLocked(m_cache.LeastRecent());
+    }
+    return before - m_totalBytes;
+}
+
+size_t EncodedCache::GetTotalBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_totalBytes;
+}
+
+void EncodedCache::Clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.clear();
+    m_cache.Clear();
+    m_totalBytes = 0;
+}
@@ -0,0 +1,120 @@
+#pragma once
+// Platform-neutral cache of raw (still encoded) file bytes, filled ahead of the decoders
+// by dedicated I/O threads. Reading is kept off the decode workers so disk or network
+// latency overlaps with CPU work, and a decoded image that was evicted can be rebuilt
+// from memory instead of going back to the disk.
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "LruIndex.h"
+
+// Read-only bytes of a file: either a private copy, or a view of memory (such as a file
+// mapping) that owner keeps alive. A mapping stops the file from being overwritten or
+// truncated while it exists, so mapped bytes are only held for the length of a decode.
+class EncodedBytes {
+public:
+    explicit EncodedBytes(std::vector<uint8_t> bytes)
+        : m_copy(std::move(bytes)), m_data(m_copy.data()), m_size(m_copy.size()) {}
+    EncodedBytes(const uint8_t* data, size_t size, std::shared_ptr<const void> owner, bool mapped = false)
+        : m_data(data), m_size(size), m_owner(std::move(owner)), m_mapped(mapped) {}
+
+    EncodedBytes(const EncodedBytes&) = delete;
+    EncodedBytes& operator=(const EncodedBytes&) = delete;
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    // Whether the bytes are a view of a file mapping (directly or through a slice)
+    bool IsMapped() const { return m_mapped; }
+
+    // Part of bytes, sharing its storage (nullptr if out of range)
+    static std::shared_ptr<const EncodedBytes> Slice(const std::shared_ptr<const EncodedBytes>& bytes,
+        size_t offset, size_t size) {
+        if (!bytes || offset > bytes->size() || size > bytes->size() - offset) return nullptr;
+        return std::make_shared<EncodedBytes>(bytes->data() + offset, size, bytes, bytes->IsMapped());
+    }
+
+private:
+    std::vector<uint8_t> m_copy;
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    std::shared_ptr<const void> m_owner;
+    bool m_mapped = false;
+};
+
+using EncodedBuffer = std::shared_ptr<const EncodedBytes>;
+
+class EncodedCache {
+public:
+    EncodedCache() = default;
+    ~EncodedCache();
+
+    EncodedCache(const EncodedCache&) = delete;
+    EncodedCache& operator=(const EncodedCache&) = delete;
+
+    // queueDepth is the number of reads kept outstanding at once (one I/O thread each).
+    // Slow network shares benefit from a deeper queue than local disks.
+    void Start(size_t queueDepth);
+    void Stop();
+
+    // Replace the read-ahead queue; paths are read in the order given (nearest first)
+    void ReadAhead(const std::vector<std::wstring>& paths);
+
+    // Bytes of a file, from memory if cached and still current, otherwise waiting for a
+    // read already in progress or reading it on the calling thread. nullptr on failure or
+    // if the file is larger than the whole budget (the caller should read it directly).
+    EncodedBuffer Read(const std::wstring& filePath);
+
+    // Bytes of a file only if already in memory and current; never reads
+    EncodedBuffer Find(const std::wstring& filePath);
+
+    // Forget a file, e.g. before it is replaced or deleted
+    void Erase(const std::wstring& filePath);
+
+    // Byte budget for cached files
+    void SetMaxBytes(size_t maxBytes);
+    size_t GetTotalBytes() const;
+
+    // Drop least recently used files until about bytesToFree are released; returns bytes freed
+    size_t Shed(size_t bytesToFree);
+
+    void Clear();
+
+    static constexpr size_t DEFAULT_QUEUE_DEPTH = 2;
+    static constexpr size_t DEFAULT_MAX_BYTES = 128ull * 1024 * 1024;
+
+private:
+    // Size and modification time identify the version of a file that was read
+    struct Entry {
+        EncodedBuffer bytes;
+        uintmax_t fileSize = 0;
+        std::filesystem::file_time_type lastWriteTime;
+    };
+
+    void IoThread();
+    bool ReadFromDisk(const std::wstring& filePath, size_t maxBytes, Entry& entry) const;
+    static bool IsCurrent(const std::wstring& filePath, const Entry& entry);
+    void InsertLocked(const std::wstring& filePath, Entry entry);
+    void EraseLocked(LruIndex<Entry>::Handle handle);
+
+    std::vector<std::thread> m_threads;
+    bool m_running = false;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_queueCv;     // I/O threads wait for work
+    std::condition_variable m_readCv;      // Read waits for an in-progress read
+    std::deque<std::wstring> m_queue;
+    std::unordered_set<std::wstring> m_reading;
+
+    LruIndex<Entry> m_cache;
+    size_t m_totalBytes = 0;
+    size_t m_maxBytes = DEFAULT_MAX_BYTES;
+};
@@ -0,0 +1,213 @@
+#include "ExifPreview.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// JPEG markers
+static constexpr uint8_t MARKER_PREFIX = 0xFF;
+static constexpr uint8_t MARKER_SOI = 0xD8;
+static constexpr uint8_t MARKER_SOS = 0xDA;
+static constexpr uint8_t MARKER_EOI = 0xD9;
+static constexpr uint8_t MARKER_APP1 = 0xE1;
+static constexpr uint8_t MARKER_APP2 = 0xE2;
+
+// TIFF tags
+static constexpr uint16_t TAG_JPEG_OFFSET = 0x0201;
+static constexpr uint16_t TAG_JPEG_LENGTH = 0x0202;
+static constexpr uint16_t TAG_MP_ENTRY = 0xB002;
+static constexpr size_t IFD_ENTRY_BYTES = 12;
+static constexpr size_t MP_ENTRY_BYTES = 16;
+
+// Bounds-checked reads from a TIFF block in either byte order
+struct ExifPreview::TiffReader {
+    const uint8_t* data;
+    size_t size;
+    bool bigEndian = false;
+
+    bool Init() {
+        if (size < 8) return false;
+        if (data[0] == 'I' && data[1] == 'I') {
+            bigEndian = false;
+        } else if (data[0] == 'M' && data[1] == 'M') {
+            bigEndian = true;
+        } else {
+            return false;
+        }
+        uint16_t magic = 0;
+        return Read16(2, magic) && magic == 42;
+    }
+
+    // Compared against what is left rather than offset + bytes, which can wrap on 32-bit
+    bool Fits(size_t offset, size_t bytes) const {
+        return offset <= size && bytes <= size - offset;
+    }
+
+    bool Read16(size_t offset, uint16_t& value) const {
+        if (!Fits(offset, 2)) return false;
+        value = bigEndian ? static_cast<uint16_t>(data[offset] << 8 | data[offset + 1])
+                          : static_cast<uint16_t>(data[offset + 1] << 8 | data[offset]);
+        return true;
+    }
+
+    bool Read32(size_t offset, uint32_t& value) const {
+        if (!Fits(offset, 4)) return false;
+        const uint8_t* p = data + offset;
+        value = bigEndian
+            ? static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | p[2] << 8 | p[3]
+            : static_cast<uint32_t>(p[3]) << 24 | static_cast<uint32_t>(p[2]) << 16 | p[1] << 8 | p[0];
+        return true;
+    }
+
+    // Value of a LONG or SHORT tag in the IFD at ifdOffset
+    bool FindValue(uint32_t ifdOffset, uint16_t tag, uint32_t& value) const {
+        uint16_t count = 0;
+        if (!Read16(ifdOffset, count)) return false;
+        for (uint16_t i = 0; i < count; ++i) {
+            size_t entry = ifdOffset + 2 + i * IFD_ENTRY_BYTES;
+            uint16_t entryTag = 0, type = 0;
+            if (!Read16(entry, entryTag) || !Read16(entry + 2, type)) return false;
+            if (entryTag != tag) continue;
+
+            if (type == 3) {  // SHORT
+                uint16_t shortValue = 0;
+                if (!Read16(entry + 8, shortValue)) return false;
+                value = shortValue;
+                return true;
+            }
+            return Read32(entry + 8, value);
+        }
+        return false;
+    }
+
+    // Offset of the IFD that follows the one at ifdOffset (0 if none)
+    uint32_t NextIfd(uint32_t ifdOffset) const {
+        uint16_t count = 0;
+        uint32_t next = 0;
+        if (!Read16(ifdOffset, count) || !Read32(ifdOffset + 2 + count * IFD_ENTRY_BYTES, next)) return 0;
+        return next;
+    }
+};
+
+bool ExifPreview::Locate(const uint8_t* header, size_t headerSize, uint64_t fileSize, uint32_t maxBytes,
+    ExifPreviewInfo& out) {
+    if (headerSize < 4 || header[0] != MARKER_PREFIX || header[1] != MARKER_SOI) return false;
+
+    ExifPreviewInfo best;
+    size_t pos = 2;
+    while (pos + 4 <= headerSize) {
+        if (header[pos] != MARKER_PREFIX) break;
+        uint8_t marker = header[pos + 1];
+        if (marker == MARKER_PREFIX) {  // Fill byte
+            ++pos;
+            continue;
+        }
+        if (marker == MARKER_SOS || marker == MARKER_EOI) break;
+
+        size_t length = static_cast<size_t>(header[pos + 2]) << 8 | header[pos + 3];
+        if (length < 2) break;
+        const uint8_t* segment = header + pos + 4;
+        size_t segmentSize = std::min(length - 2, headerSize - (pos + 4));
+        uint64_t segmentOffset = pos + 4;
+
+        if (marker == MARKER_APP1 && segmentSize >= 6 && std::memcmp(segment, "Exif\0\0", 6) == 0) {
+            ParseExif(segment + 6, segmentSize - 6, segmentOffset + 6, fileSize, maxBytes, best);
+        } else if (marker == MARKER_APP2 && segmentSize >= 4 && std::memcmp(segment, "MPF\0", 4) == 0) {
+            ParseMpf(segment + 4, segmentSize - 4, segmentOffset + 4, fileSize, maxBytes, best);
+        } else if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 &&
+            marker != 0xCC && segmentSize >= 5) {
+            // Start of frame: precision, height, width
+            best.imageHeight = static_cast<uint32_t>(segment[1]) << 8 | segment[2];
+            best.imageWidth = static_cast<uint32_t>(segment[3]) << 8 | segment[4];
+        }
+        pos += 2 + length;
+    }
+
+    if (best.length == 0 || best.imageWidth == 0 || best.imageHeight == 0) return false;
+    out = best;
+    return true;
+}
+
+void ExifPreview::ParseExif(const uint8_t* tiff, size_t size, uint64_t tiffOffset, uint64_t fileSize,
+    uint32_t maxBytes, ExifPreviewInfo& best) {
+    TiffReader reader{ tiff, size };
+    uint32_t ifd0 = 0;
+    if (!reader.Init() || !reader.Read32(4, ifd0)) return;
+
+    // IFD1 describes the thumbnail
+    uint32_t ifd1 = reader.NextIfd(ifd0);
+    uint32_t offset = 0, length = 0;
+    if (ifd1 == 0 || !reader.FindValue(ifd1, TAG_JPEG_OFFSET, offset) ||
+        !reader.FindValue(ifd1, TAG_JPEG_LENGTH, length)) {
+        return;
+    }
+    Consider(tiffOffset + offset, length, fileSize, maxBytes, best);
+}
+
+void ExifPreview::ParseMpf(const uint8_t* tiff, size_t size, uint64_t tiffOffset, uint64_t fileSize,
+    uint32_t maxBytes, ExifPreviewInfo& best) {
+    TiffReader reader{ tiff, size };
+    uint32_t ifd = 0;
+    if (!reader.Init() || !reader.Read32(4, ifd)) return;
+
+    // The MP entry tag's value is an offset to 16 bytes per image
+    uint16_t count = 0;
+    if (!reader.Read16(ifd, count)) return;
+    for (uint16_t i = 0; i < count; ++i) {
+        size_t entry = ifd + 2 + i * IFD_ENTRY_BYTES;
+        uint16_t tag = 0;
+        uint32_t entriesBytes = 0, entriesOffset = 0;
+        if (!reader.Read16(entry, tag)) return;
+        if (tag != TAG_MP_ENTRY) continue;
+        if (!reader.Read32(entry + 4, entriesBytes) || !reader.Read32(entry + 8, entriesOffset)) return;
+        if (!reader.Fits(entriesOffset, 0)) return;  // Entries then run off the end before they can wrap
+
+        // The first image is the main one; offsets of the others are from the MPF header
+        for (uint32_t image = 1; image < entriesBytes / MP_ENTRY_BYTES; ++image) {
+            size_t mpEntry = entriesOffset + static_cast<size_t>(image) * MP_ENTRY_BYTES;
+            uint32_t imageSize = 0, imageOffset = 0;
+            if (!reader.Read32(mpEntry + 4, imageSize) || !reader.Read32(mpEntry + 8, imageOffset)) return;
+            if (imageOffset != 0) {
+                Consider(tiffOffset + imageOffset, imageSize, fileSize, maxBytes, best);
+            }
+        }
+        return;
+    }
+}
+
+void ExifPreview::Consider(uint64_t offset, uint64_t length, uint64_t fileSize, uint32_t maxBytes,
+    ExifPreviewInfo& best) {
+    // Bigger previews have more pixels; anything past the end of the file is corrupt
+    if (length < 4 || length > maxBytes || offset + length > fileSize || length <= best.length) return;
+    best.offset = offset;
+    best.length = static_cast<uint32_t>(length);
+}
+
+bool ExifPreview::Read(const std::wstring& filePath, uint32_t maxBytes, ExifPreviewInfo& info,
+    std::vector<uint8_t>& preview) {
+    std::filesystem::path path(filePath);
+    std::error_code ec;
+    uint64_t fileSize = std::filesystem::file_size(path, ec);
+    if (ec) return false;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    std::vector<uint8_t> header(static_cast<size_t>(std::min<uint64_t>(HEADER_BYTES, fileSize)));
+    file.read(reinterpret_cast<char*>(header.data()), static_cast<std::streamsize>(header.size()));
+    if (static_cast<size_t>(file.gcount()) != header.size()) return false;
+    if (!Locate(header.data(), header.size(), fileSize, maxBytes, info)) return false;
+
+    // Usually already inside the header (EXIF thumbnail); MPF previews follow the main image
+    preview.resize(info.length);
+    if (info.offset + info.length <= header.size()) {
+        std::memcpy(preview.data(), header.data() + info.offset, info.length);
+    } else {
+        file.seekg(static_cast<std::streamoff>(info.offset));
+        file.read(reinterpret_cast<char*>(preview.data()), static_cast<std::streamsize>(preview.size()));
+        if (static_cast<size_t>(file.gcount()) != preview.size()) return false;
+    }
+
+    // Must itself be a JPEG
+    return preview[0] == MARKER_PREFIX && preview[1] == MARKER_SOI;
+}
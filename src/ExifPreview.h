@@ -0,0 +1,39 @@
+#pragma once
+// Platform-neutral locator for the JPEG previews cameras embed in their files: the EXIF
+// thumbnail (IFD1 of the APP1 segment, usually 160x120) and the larger previews listed in
+// a Multi-Picture Format index (APP2). Only the file header is parsed, so a preview can
+// be shown long before the main image would finish decoding.
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ExifPreviewInfo {
+    uint64_t offset = 0;        // Absolute file offset of the embedded JPEG
+    uint32_t length = 0;
+    uint32_t imageWidth = 0;    // Size of the main image, from its frame header
+    uint32_t imageHeight = 0;
+};
+
+class ExifPreview {
+public:
+    // Find the largest embedded preview of at most maxBytes, given the first bytes of a
+    // JPEG file and its total size
+    static bool Locate(const uint8_t* header, size_t headerSize, uint64_t fileSize, uint32_t maxBytes,
+        ExifPreviewInfo& out);
+
+    // Read a file's header and the bytes of its largest embedded preview
+    static bool Read(const std::wstring& filePath, uint32_t maxBytes, ExifPreviewInfo& info,
+        std::vector<uint8_t>& preview);
+
+    static constexpr size_t HEADER_BYTES = 128 * 1024;
+    static constexpr uint32_t DEFAULT_MAX_BYTES = 1024 * 1024;
+
+private:
+    struct TiffReader;
+    static void ParseExif(const uint8_t* tiff, size_t size, uint64_t tiffOffset, uint64_t fileSize,
+        uint32_t maxBytes, ExifPreviewInfo& best);
+    static void ParseMpf(const uint8_t* tiff, size_t size, uint64_t tiffOffset, uint64_t fileSize,
+        uint32_t maxBytes, ExifPreviewInfo& best);
+    static void Consider(uint64_t offset, uint64_t length, uint64_t fileSize, uint32_t maxBytes,
+        ExifPreviewInfo& best);
+};
@@ -0,0 +1,112 @@
+#include "pch.h"
+#include "FileIdentity.h"
+
+std::wstring FileIdentity::ToKey() const {
+    wchar_t key[64];
+    swprintf_s(key, L"%08x:%016llx:%llx:%llx", volumeSerial,
+        static_cast<unsigned long long>(fileIndex),
+        static_cast<unsigned long long>(fileSize),
+        static_cast<unsigned long long>(lastWriteTime));
+    return fileIndex != 0 ? std::wstring(key) : std::wstring(key) + L":" + filePath;
+}
+
+bool FileIdentityResolver::Resolve(const std::wstring& filePath, FileIdentity& identity,
+    std::wstring* previousKey) {
+    uint64_t fileSize = 0;
+    uint64_t lastWriteTime = 0;
+    if (!QueryAttributes(filePath, fileSize, lastWriteTime)) {
+        return false;
+    }
+
+    // Unchanged since last seen: the file ID cannot have changed either
+    auto known = m_known.Find(filePath);
+    if (known && known->fileSize == fileSize && known->lastWriteTime == lastWriteTime) {
+        identity = *known;
+        return true;
+    }
+
+    if (!QueryFileId(filePath, identity)) {
+        return false;
+    }
+    if (previousKey && known) {
+        *previousKey = known->ToKey();
+    }
+
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    m_known.Set(filePath, std::make_shared<const FileIdentity>(identity));
+    return true;
+}
+
+bool FileIdentityResolver::Lookup(const std::wstring& filePath, FileIdentity& identity) const {
+    auto known = m_known.Find(filePath);
+    if (!known) {
+        return false;
+    }
+    identity = *known;
+    return true;
+}
+
+bool FileIdentityResolver::Validate(const std::wstring& filePath, FileIdentity& identity,
+    std::wstring* previousKey) const {
+    auto known = m_known.Find(filePath);
+    if (!known) {
+        return false;
+    }
+
+    uint64_t fileSize = 0;
+    uint64_t lastWriteTime = 0;
+    if (!QueryAttributes(filePath, fileSize, lastWriteTime)) {
+        return false;
+    }
+    if (known->fileSize != fileSize || known->lastWriteTime != lastWriteTime) {
+        if (previousKey) {
+            *previousKey = known->ToKey();
+        }
+        return false;
+    }
+    identity = *known;
+    return true;
+}
+
+bool FileIdentityResolver::QueryAttributes(const std::wstring& filePath, uint64_t& fileSize,
+    uint64_t& lastWriteTime) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+    if (!GetFileAttributesExW(filePath.c_str(), GetFileExInfoStandard, &attributes)) {
+        return false;
+    }
+    fileSize = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+    lastWriteTime = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) |
+        attributes.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+bool FileIdentityResolver::QueryFileId(const std::wstring& filePath, FileIdentity& identity) {
+    // No access rights are needed to read the ID, so this works even while another
+    // program has the file open for writing
+    HANDLE file = CreateFileW(filePath.c_str(), 0,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    BY_HANDLE_FILE_INFORMATION info = {};
+    BOOL ok = GetFileInformationByHandle(file, &info);
+    CloseHandle(file);
+    if (!ok) {
+        return false;
+    }
+
+    identity.volumeSerial = info.dwVolumeSerialNumber;
+    identity.fileIndex = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    identity.fileSize = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    identity.lastWriteTime = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) |
+        info.ftLastWriteTime.dwLowDateTime;
+    identity.filePath = identity.fileIndex != 0 ? std::wstring() : filePath;
+    return true;
+}
+
+void FileIdentityResolver::Clear() {
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    m_known.Clear();
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "pch.h"
+#include "SnapshotMap.h"
+
+// A particular version of a particular file: the volume and file ID survive renames and
+// moves within a volume, while size and last-write time change whenever it is rewritten
+struct FileIdentity {
+    uint32_t volumeSerial = 0;
+    uint64_t fileIndex = 0;
+    uint64_t fileSize = 0;
+    uint64_t lastWriteTime = 0;  // FILETIME ticks
+
+    // Part of the key only on file systems that report no file IDs (some network shares)
+    std::wstring filePath;
+
+    // Cache key for this version of the file
+    std::wstring ToKey() const;
+};
+
+// Maps paths to file identities. Resolving a path the resolver has seen before costs one
+// attribute query; the file is only opened (to read its ID) for a new path or a file
+// whose size or write time has changed. Safe to call from any thread.
+class FileIdentityResolver {
+public:
+    // Identity of the file currently at filePath (false if it cannot be read). If the
+    // file was rewritten since the last call, previousKey receives the key it had.
+    bool Resolve(const std::wstring& filePath, FileIdentity& identity,
+        std::wstring* previousKey = nullptr);
+
+    // Last identity Resolve found for filePath, without touching the file system
+    bool Lookup(const std::wstring& filePath, FileIdentity& identity) const;
+
+    // Checks filePath against its last resolved identity with one attribute query, never
+    // opening the file. False for a path not resolved yet, or a file changed since (in
+    // which case previousKey receives the key it had); Resolve must then run, off the UI thread.
+    bool Validate(const std::wstring& filePath, FileIdentity& identity,
+        std::wstring* previousKey = nullptr) const;
+
+    void Clear();
+
+private:
+    static bool QueryAttributes(const std::wstring& filePath, uint64_t& fileSize, uint64_t& lastWriteTime);
+    static bool QueryFileId(const std::wstring& filePath, FileIdentity& identity);
+
+    // Lookups never wait on m_writeMutex, which serialises updates
+    SnapshotMap<std::shared_ptr<const FileIdentity>> m_known;
+    std::mutex m_writeMutex;
+};
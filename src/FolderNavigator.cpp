@@ -2,49 +2,151 @@
 #include "FolderNavigator.h"
 #include "ImageLoader.h"
 
-void FolderNavigator::SetCurrentFile(const std::wstring& filePath) {
+static bool FileNameLess(const std::wstring& a, const std::wstring& b) {
+    return _wcsicmp(a.c_str(), b.c_str()) < 0;
+}
+
+void FolderNavigator::SetTaskPool(TaskPool* pool, std::function<void()> onScanComplete) {
+    m_pool = pool;
+    m_onScanComplete = std::move(onScanComplete);
+}
+
+void FolderNavigator::SetCurrentFile(const std::wstring& filePath, const std::vector<std::wstring>& knownFiles) {
     fs::path path(filePath);
 
     if (!fs::exists(path)) {
         return;
     }
 
-    m_currentFolder = path.parent_path().wstring();
-    ScanFolder(m_currentFolder);
+    std::wstring folder = path.parent_path().wstring();
+
+    if (!m_pool) {
+        m_currentFolder = folder;
+        m_imageFiles = ScanFolder(m_currentFolder);
+        SelectFile(filePath);
+        return;
+    }
+
+    if (folder == m_currentFolder && !m_imageFiles.empty()) {
+        // Same folder: the list is already known, so only pick up external changes
+        std::wstring fullPath = path.wstring();
+        auto it = std::lower_bound(m_imageFiles.begin(), m_imageFiles.end(), fullPath, FileNameLess);
+        if (it == m_imageFiles.end() || _wcsicmp(it->c_str(), fullPath.c_str()) != 0) {
+            it = m_imageFiles.insert(it, fullPath);  // e.g. a copy we just saved
+        }
+        m_currentIndex = static_cast<size_t>(it - m_imageFiles.begin());
+        RequestScan(TaskPriority::Background);
+        return;
+    }
+
+    // New folder: show the file right away and list its neighbours off the UI thread
+    m_currentFolder = folder;
+    m_imageFiles = { path.wstring() };
+    for (const auto& known : knownFiles) {
+        if (fs::path(known).parent_path().wstring() == folder && _wcsicmp(known.c_str(), filePath.c_str()) != 0) {
+            m_imageFiles.push_back(known);
+        }
+    }
+    std::sort(m_imageFiles.begin(), m_imageFiles.end(), FileNameLess);
+    SelectFile(filePath);
+    RequestScan(TaskPriority::Interactive);
+}
+
+void FolderNavigator::RequestScan(TaskPriority priority) {
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(m_scanMutex);
+        generation = ++m_scanGeneration;
+        m_scanOutstanding = true;
+        m_hasScanResult = false;
+        m_scanResult.clear();
+    }
+
+    std::wstring folder = m_currentFolder;
+    m_pool->Submit(priority, [this, folder, generation]() {
+        auto files = ScanFolder(folder);
+        {
+            std::lock_guard<std::mutex> lock(m_scanMutex);
+            if (generation != m_scanGeneration) {
+                return;  // Superseded by a newer scan or a different folder
+            }
+            m_scanResult = std::move(files);
+            m_hasScanResult = true;
+        }
+        if (m_onScanComplete) {
+            m_onScanComplete();
+        }
+    });
+}
+
+void FolderNavigator::RescanIfOutstanding() {
+    // A scan that started before a local change may list the old folder contents
+    bool outstanding;
+    {
+        std::lock_guard<std::mutex> lock(m_scanMutex);
+        outstanding = m_scanOutstanding;
+    }
+    if (m_pool && outstanding) {
+        RequestScan(TaskPriority::Background);
+    }
+}
+
+bool FolderNavigator::ApplyScanResult() {
+    std::vector<std::wstring> files;
+    {
+        std::lock_guard<std::mutex> lock(m_scanMutex);
+        if (!m_hasScanResult) {
+            return false;
+        }
+        files.swap(m_scanResult);
+        m_hasScanResult = false;
+        m_scanOutstanding = false;
+    }
+
+    std::wstring currentFile = GetCurrentFilePath();
+    m_imageFiles = std::move(files);
+    SelectFile(currentFile);
+    return true;
+}
 
+void FolderNavigator::SelectFile(const std::wstring& filePath) {
     // Find current file in list
-    std::wstring filename = path.filename().wstring();
+    std::wstring filename = fs::path(filePath).filename().wstring();
     for (size_t i = 0; i < m_imageFiles.size(); ++i) {
         fs::path imgPath(m_imageFiles[i]);
         if (imgPath.filename().wstring() == filename) {
             m_currentIndex = i;
-            break;
+            return;
         }
     }
+
+    // If not found, clamp index
+    if (m_currentIndex >= m_imageFiles.size()) {
+        m_currentIndex = m_imageFiles.empty() ? 0 : m_imageFiles.size() - 1;
+    }
 }
 
-void FolderNavigator::ScanFolder(const std::wstring& folderPath) {
-    m_imageFiles.clear();
+std::vector<std::wstring> FolderNavigator::ScanFolder(const std::wstring& folderPath) {
+    std::vector<std::wstring> imageFiles;
 
     try {
         for (const auto& entry : fs::directory_iterator(folderPath)) {
             if (entry.is_regular_file()) {
                 std::wstring path = entry.path().wstring();
                 if (ImageLoader::IsSupportedFormat(path)) {
-                    m_imageFiles.push_back(path);
+                    imageFiles.push_back(path);
                 }
             }
         }
 
         // Sort alphabetically (case-insensitive)
-        std::sort(m_imageFiles.begin(), m_imageFiles.end(),
-            [](const std::wstring& a, const std::wstring& b) {
-                return _wcsicmp(a.c_str(), b.c_str()) < 0;
-            });
+        std::sort(imageFiles.begin(), imageFiles.end(), FileNameLess);
     }
     catch (const std::exception&) {
         // Handle permission errors, etc.
     }
+
+    return imageFiles;
 }
 
 bool FolderNavigator::GoToNext() {
@@ -94,24 +196,11 @@ std::wstring FolderNavigator::GetCurrentFilePath() const {
     return L"";
 }
 
-std::vector<std::wstring> FolderNavigator::GetAdjacentFiles(size_t count) const {
-    std::vector<std::wstring> result;
-
-    if (m_imageFiles.empty()) {
-        return result;
-    }
-
-    // Get files before current
-    for (size_t i = 1; i <= count && m_currentIndex >= i; ++i) {
-        result.push_back(m_imageFiles[m_currentIndex - i]);
-    }
-
-    // Get files after current
-    for (size_t i = 1; i <= count && m_currentIndex + i < m_imageFiles.size(); ++i) {
-        result.push_back(m_imageFiles[m_currentIndex + i]);
+std::wstring FolderNavigator::GetFilePath(size_t index) const {
+    if (index < m_imageFiles.size()) {
+        return m_imageFiles[index];
     }
-
-    return result;
+    return L"";
 }
 
 bool FolderNavigator::DeleteCurrentFile() {
@@ -141,6 +230,8 @@ bool FolderNavigator::DeleteCurrentFile() {
             m_currentIndex--;
         }
 
+        RescanIfOutstanding();
+
         return true;
     }
 
@@ -158,6 +249,7 @@ bool FolderNavigator::RenameCurrentFile(const std::wstring& newName) {
     try {
         fs::rename(currentPath, newPath);
         m_imageFiles[m_currentIndex] = newPath.wstring();
+        RescanIfOutstanding();
         return true;
     }
     catch (const std::exception&) {
@@ -170,24 +262,25 @@ void FolderNavigator::Refresh() {
         return;
     }
 
-    std::wstring currentFile = GetCurrentFilePath();
-    ScanFolder(m_currentFolder);
-
-    // Try to find the same file again
-    for (size_t i = 0; i < m_imageFiles.size(); ++i) {
-        if (m_imageFiles[i] == currentFile) {
-            m_currentIndex = i;
-            return;
-        }
+    if (m_pool) {
+        RequestScan(TaskPriority::Background);
+        return;
     }
 
-    // If not found, clamp index
-    if (m_currentIndex >= m_imageFiles.size() && !m_imageFiles.empty()) {
-        m_currentIndex = m_imageFiles.size() - 1;
-    }
+    std::wstring currentFile = GetCurrentFilePath();
+    m_imageFiles = ScanFolder(m_currentFolder);
+    SelectFile(currentFile);
 }
 
 void FolderNavigator::Clear() {
+    {
+        // Drop any scan still running for the old folder
+        std::lock_guard<std::mutex> lock(m_scanMutex);
+        ++m_scanGeneration;
+        m_scanOutstanding = false;
+        m_hasScanResult = false;
+        m_scanResult.clear();
+    }
     m_imageFiles.clear();
     m_currentIndex = 0;
     m_currentFolder.clear();
@@ -1,13 +1,25 @@
 #pragma once
 #include "pch.h"
+#include "TaskPool.h"
 
 class FolderNavigator {
 public:
     FolderNavigator() = default;
     ~FolderNavigator() = default;
 
-    // Set current file and scan folder for images
-    void SetCurrentFile(const std::wstring& filePath);
+    // Scan folders on the pool instead of the UI thread. onScanComplete is invoked from a
+    // worker when a listing is ready; the owner should call ApplyScanResult on the UI thread.
+    void SetTaskPool(TaskPool* pool, std::function<void()> onScanComplete);
+
+    // Set current file and scan folder for images. With a pool, the file is available
+    // immediately and the rest of the folder arrives with the scan.
+    // knownFiles (e.g. the last session's working set) stand in for the listing of a newly
+    // opened folder until the scan arrives; entries from other folders are ignored.
+    void SetCurrentFile(const std::wstring& filePath, const std::vector<std::wstring>& knownFiles = {});
+
+    // Replace the file list with a finished scan, keeping the current file selected.
+    // Returns false if no scan result was waiting (UI thread only).
+    bool ApplyScanResult();
 
     // Navigation
     bool GoToNext();
@@ -23,8 +35,8 @@ public:
     bool HasNext() const { return m_currentIndex + 1 < m_imageFiles.size(); }
     bool HasPrevious() const { return m_currentIndex > 0; }
 
-    // Get adjacent file paths for pre-loading
-    std::vector<std::wstring> GetAdjacentFiles(size_t count = 3) const;
+    // Get file path by folder index (empty if out of range)
+    std::wstring GetFilePath(size_t index) const;
 
     // File operations
     bool DeleteCurrentFile();  // Moves to recycle bin
@@ -37,9 +49,21 @@ public:
     void Clear();
 
 private:
-    void ScanFolder(const std::wstring& folderPath);
+    static std::vector<std::wstring> ScanFolder(const std::wstring& folderPath);
+    void RequestScan(TaskPriority priority);
+    void RescanIfOutstanding();
+    void SelectFile(const std::wstring& filePath);
 
     std::vector<std::wstring> m_imageFiles;
     size_t m_currentIndex = 0;
     std::wstring m_currentFolder;
+
+    // Background scanning; results from superseded scans are dropped by generation
+    TaskPool* m_pool = nullptr;
+    std::function<void()> m_onScanComplete;
+    std::mutex m_scanMutex;
+    uint64_t m_scanGeneration = 0;
+    bool m_scanOutstanding = false;  // Submitted but not yet applied
+    bool m_hasScanResult = false;
+    std::vector<std::wstring> m_scanResult;
 };
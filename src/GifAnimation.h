@@ -0,0 +1,58 @@
+#pragma once
+// Platform-neutral storage for GIF animations as the file describes them: 8-bit palette
+// indices for each frame's sub-rectangle, plus the palettes they refer to. An animation
+// costs about one byte per changed pixel per frame instead of four bytes for the whole
+// canvas; GifCompositor turns it back into BGRA one frame at a time.
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What happens to a frame's rectangle before the next frame is drawn
+enum class GifDisposal : uint8_t {
+    None = 0,        // Unspecified: treated like Keep
+    Keep = 1,
+    Background = 2,  // Cleared to transparent (as browsers do, ignoring the background colour)
+    Previous = 3,    // Restored to what was there before the frame was drawn
+};
+
+struct GifFrame {
+    uint32_t left = 0;
+    uint32_t top = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    GifDisposal disposal = GifDisposal::None;
+    int transparentIndex = -1;     // Palette index left undrawn (-1 if none)
+    uint32_t palette = 0;          // Index into GifAnimation::palettes
+    std::vector<uint8_t> indices;  // width * height, top-down
+
+    size_t ByteSize() const { return indices.size(); }
+};
+
+struct GifAnimation {
+    uint32_t width = 0;   // Logical screen (canvas) size
+    uint32_t height = 0;
+
+    // Premultiplied BGRA colours, PALETTE_SIZE each. Frames usually share the global one.
+    std::vector<std::vector<uint32_t>> palettes;
+    std::vector<GifFrame> frames;
+
+    static constexpr size_t PALETTE_SIZE = 256;
+
+    size_t ByteSize() const {
+        size_t total = palettes.size() * PALETTE_SIZE * sizeof(uint32_t);
+        for (const auto& frame : frames) {
+            total += frame.ByteSize();
+        }
+        return total;
+    }
+};
+
+// Reads single frames of an animation on demand, for playback that does not keep every
+// frame in memory (see GifStream). Safe to call from any thread.
+class GifFrameSource {
+public:
+    virtual ~GifFrameSource() = default;
+
+    // Indices of frame index, and its palette as PALETTE_SIZE premultiplied BGRA colours
+    virtual bool ReadFrame(size_t index, GifFrame& frame, std::vector<uint32_t>& palette) = 0;
+};
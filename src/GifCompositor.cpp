@@ -0,0 +1,175 @@
+#include "GifCompositor.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define GIF_USE_SSE2 1
+#endif
+
+namespace {
+
+// Write the colours of one row of indices, leaving transparent ones undrawn. GIF
+// transparency is all or nothing, so this is a select rather than a blend. SSE2 tests
+// sixteen indices at once: runs that are wholly transparent (most of a typical delta
+// frame) are skipped and wholly opaque runs are written without per-pixel tests.
+void ExpandRow(const uint8_t* source, uint32_t* dest, size_t count, const uint32_t* palette,
+    int transparent) {
+    size_t x = 0;
+#ifdef GIF_USE_SSE2
+    if (transparent >= 0) {
+        const __m128i key = _mm_set1_epi8(static_cast<char>(transparent));
+        constexpr int ALL_LANES = 0xFFFF;
+        for (; x + 16 <= count; x += 16) {
+            __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + x));
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(indices, key));
+            if (mask == ALL_LANES) continue;
+            for (int i = 0; i < 16; ++i) {
+                if (!(mask & (1 << i))) {
+                    dest[x + i] = palette[source[x + i]];
+                }
+            }
+        }
+    }
+#endif
+    if (transparent < 0) {
+        for (; x < count; ++x) {
+            dest[x] = palette[source[x]];
+        }
+        return;
+    }
+    for (; x < count; ++x) {
+        if (source[x] != transparent) {
+            dest[x] = palette[source[x]];
+        }
+    }
+}
+
+}  // namespace
+
+GifCompositor::Rect GifCompositor::Union(const Rect& a, const Rect& b) {
+    if (a.IsEmpty()) return b;
+    if (b.IsEmpty()) return a;
+    return { std::min(a.left, b.left), std::min(a.top, b.top),
+        std::max(a.right, b.right), std::max(a.bottom, b.bottom) };
+}
+
+GifCompositor::GifCompositor(std::shared_ptr<const GifAnimation> animation)
+    : m_animation(std::move(animation)) {
+    if (m_animation) {
+        m_width = m_animation->width;
+        m_height = m_animation->height;
+    }
+    Reset();
+}
+
+GifCompositor::GifCompositor(uint32_t width, uint32_t height)
+    : m_width(width), m_height(height) {
+    Reset();
+}
+
+void GifCompositor::Reset() {
+    m_canvas = PixelBuffer();
+    m_saved.clear();
+    m_next = 0;
+    m_lastRect = {};
+    m_lastDisposal = GifDisposal::None;
+    m_dirty = {};
+    if (m_width == 0 || m_height == 0) return;
+
+    m_canvas.width = m_width;
+    m_canvas.height = m_height;
+    m_canvas.stride = m_width * sizeof(uint32_t);
+    m_canvas.pixels.assign(static_cast<size_t>(m_canvas.stride) * m_canvas.height, 0);
+    m_dirty = { 0, 0, m_width, m_height };
+}
+
+GifCompositor::Rect GifCompositor::TakeDirtyRect() {
+    Rect dirty = m_dirty;
+    m_dirty = {};
+    return dirty;
+}
+
+GifCompositor::Rect GifCompositor::Clip(const GifFrame& frame) const {
+    Rect rect;
+    rect.left = std::min(frame.left, m_canvas.width);
+    rect.top = std::min(frame.top, m_canvas.height);
+    rect.right = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(frame.left) + frame.width, m_canvas.width));
+    rect.bottom = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(frame.top) + frame.height, m_canvas.height));
+    return rect;
+}
+
+const PixelBuffer& GifCompositor::Compose(size_t index) {
+    size_t count = GetFrameCount();
+    if (count == 0 || m_canvas.IsEmpty()) return m_canvas;
+    index = std::min(index, count - 1);
+
+    if (index + 1 < m_next) {
+        Reset();
+    }
+    while (m_next <= index) {
+        const GifFrame& frame = m_animation->frames[m_next];
+        const uint32_t* palette = frame.palette < m_animation->palettes.size()
+            ? m_animation->palettes[frame.palette].data() : nullptr;
+        ComposeNext(frame, palette);
+    }
+    return m_canvas;
+}
+
+const PixelBuffer& GifCompositor::ComposeNext(const GifFrame& frame, const uint32_t* palette) {
+    if (m_canvas.IsEmpty()) return m_canvas;
+
+    if (m_next > 0) {
+        Dispose(m_lastRect, m_lastDisposal);
+        if (m_lastDisposal == GifDisposal::Background || m_lastDisposal == GifDisposal::Previous) {
+            m_dirty = Union(m_dirty, m_lastRect);
+        }
+    }
+    Rect rect = Clip(frame);
+    Draw(frame, rect, palette);
+    if (palette) {
+        m_dirty = Union(m_dirty, rect);
+    }
+    m_lastRect = rect;
+    m_lastDisposal = frame.disposal;
+    ++m_next;
+    return m_canvas;
+}
+
+void GifCompositor::Draw(const GifFrame& frame, const Rect& rect, const uint32_t* palette) {
+    // Keep what the frame covers so it can be put back afterwards
+    m_saved.clear();
+    if (frame.disposal == GifDisposal::Previous) {
+        for (uint32_t y = rect.top; y < rect.bottom; ++y) {
+            const uint32_t* row = Row(y);
+            m_saved.insert(m_saved.end(), row + rect.left, row + rect.right);
+        }
+    }
+
+    if (!palette || frame.indices.size() < static_cast<size_t>(frame.width) * frame.height) {
+        return;
+    }
+    if (rect.IsEmpty()) return;
+
+    for (uint32_t y = rect.top; y < rect.bottom; ++y) {
+        const uint8_t* source = frame.indices.data() + static_cast<size_t>(y - frame.top) * frame.width +
+            (rect.left - frame.left);
+        ExpandRow(source, Row(y) + rect.left, rect.right - rect.left, palette, frame.transparentIndex);
+    }
+}
+
+void GifCompositor::Dispose(const Rect& rect, GifDisposal disposal) {
+    if (rect.IsEmpty()) return;
+    size_t rowPixels = rect.right - rect.left;
+
+    if (disposal == GifDisposal::Background) {
+        for (uint32_t y = rect.top; y < rect.bottom; ++y) {
+            std::fill_n(Row(y) + rect.left, rowPixels, 0u);
+        }
+    } else if (disposal == GifDisposal::Previous && m_saved.size() == rowPixels * (rect.bottom - rect.top)) {
+        const uint32_t* saved = m_saved.data();
+        for (uint32_t y = rect.top; y < rect.bottom; ++y, saved += rowPixels) {
+            std::memcpy(Row(y) + rect.left, saved, rowPixels * sizeof(uint32_t));
+        }
+    }
+}
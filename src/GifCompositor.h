@@ -0,0 +1,66 @@
+#pragma once
+// Platform-neutral compositing of an indexed GifAnimation onto a persistent BGRA canvas,
+// applying each frame's offset, transparency and disposal. Playing forward costs one
+// frame's rectangle per step; going back restarts from the first frame. The area each
+// step changes is tracked so a display copy of the canvas can be updated in place.
+#include <memory>
+#include "DecodePipeline.h"
+#include "GifAnimation.h"
+
+class GifCompositor {
+public:
+    // Canvas rectangle, right and bottom exclusive
+    struct Rect {
+        uint32_t left, top, right, bottom;
+
+        bool IsEmpty() const { return left >= right || top >= bottom; }
+    };
+
+    // Smallest rectangle holding both (either may be empty)
+    static Rect Union(const Rect& a, const Rect& b);
+
+    explicit GifCompositor(std::shared_ptr<const GifAnimation> animation);
+
+    // Canvas for frames supplied one at a time through ComposeNext (see GifStream)
+    GifCompositor(uint32_t width, uint32_t height);
+
+    // Canvas showing frame index (valid until the next call)
+    const PixelBuffer& Compose(size_t index);
+
+    // Draw the frame after the last one composed, with its palette (PALETTE_SIZE colours).
+    // A frame that could not be read is passed with a null palette and leaves the canvas as is.
+    const PixelBuffer& ComposeNext(const GifFrame& frame, const uint32_t* palette);
+
+    // Back to an empty canvas before the first frame
+    void Reset();
+
+    size_t GetFrameCount() const { return m_animation ? m_animation->frames.size() : 0; }
+
+    // Frame the canvas is ready to draw next
+    size_t GetNextFrame() const { return m_next; }
+
+    // Area changed since the last call (the whole canvas after a reset)
+    Rect TakeDirtyRect();
+
+    // Canvas plus the saved area for restore-to-previous frames
+    size_t ByteSize() const { return m_canvas.ByteSize() + m_saved.size() * sizeof(uint32_t); }
+
+private:
+    // Frame rectangle clipped to the canvas
+    Rect Clip(const GifFrame& frame) const;
+    void Draw(const GifFrame& frame, const Rect& rect, const uint32_t* palette);
+    void Dispose(const Rect& rect, GifDisposal disposal);
+    uint32_t* Row(uint32_t y) { return reinterpret_cast<uint32_t*>(m_canvas.pixels.data() + static_cast<size_t>(y) * m_canvas.stride); }
+
+    std::shared_ptr<const GifAnimation> m_animation;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    PixelBuffer m_canvas;
+    std::vector<uint32_t> m_saved;  // Pixels under the last frame if it restores to previous
+    size_t m_next = 0;              // Frame the canvas is ready to draw next
+
+    // Where the last frame was drawn and what happens to it before the next one
+    Rect m_lastRect = {};
+    GifDisposal m_lastDisposal = GifDisposal::None;
+    Rect m_dirty = {};
+};
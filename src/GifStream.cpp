@@ -0,0 +1,107 @@
+#include "GifStream.h"
+#include <algorithm>
+
+GifStream::GifStream(std::shared_ptr<GifFrameSource> source, size_t frameCount, uint32_t width,
+    uint32_t height, TaskPool* pool, size_t firstFrame)
+    : m_shared(std::make_shared<Shared>(width, height)), m_pool(pool), m_frameCount(frameCount),
+      m_canvasBytes(static_cast<size_t>(width) * height * sizeof(uint32_t)) {
+    std::lock_guard<std::mutex> lock(m_shared->mutex);
+    m_shared->source = std::move(source);
+    m_shared->frameCount = width > 0 && height > 0 ? frameCount : 0;
+    m_shared->nextIndex = frameCount > 0 ? firstFrame % frameCount : 0;
+    StartFillLocked();
+}
+
+GifStream::~GifStream() {
+    std::lock_guard<std::mutex> lock(m_shared->mutex);
+    m_shared->closed = true;
+    m_shared->ring.clear();
+}
+
+bool GifStream::TakeFrame(size_t index, PixelBuffer& out, GifCompositor::Rect& changed) {
+    std::lock_guard<std::mutex> lock(m_shared->mutex);
+    if (index >= m_shared->frameCount) return false;
+
+    auto found = std::find_if(m_shared->ring.begin(), m_shared->ring.end(),
+        [index](const ReadyFrame& frame) { return frame.index == index; });
+    if (found != m_shared->ring.end()) {
+        // Frames queued before it were skipped (playback fell behind); their changes count
+        changed = {};
+        for (auto frame = m_shared->ring.begin(); frame != found + 1; ++frame) {
+            changed = GifCompositor::Union(changed, frame->changed);
+        }
+        if (m_shared->jumped) {
+            changed = { 0, 0, found->canvas.width, found->canvas.height };
+            m_shared->jumped = false;
+        }
+        out = std::move(found->canvas);
+        m_shared->ring.erase(m_shared->ring.begin(), found + 1);
+        StartFillLocked();
+        return true;
+    }
+
+    // Not composited yet: wait if it is the next one coming, otherwise jump there
+    bool pending = m_shared->ring.empty() && m_shared->nextIndex == index;
+    if (!pending) {
+        m_shared->ring.clear();
+        m_shared->nextIndex = index;
+        ++m_shared->generation;
+        m_shared->jumped = true;
+    }
+    StartFillLocked();
+    return false;
+}
+
+void GifStream::StartFillLocked() {
+    if (m_shared->filling || m_shared->closed || !m_pool || m_shared->frameCount == 0 ||
+        m_shared->ring.size() >= RING_SIZE) {
+        return;
+    }
+
+    // One task fills the ring at a time, so the compositor only moves forward
+    m_shared->filling = true;
+    std::shared_ptr<Shared> shared = m_shared;
+    m_pool->Submit(TaskPriority::Interactive, [shared]() { Fill(shared); });
+}
+
+void GifStream::Fill(const std::shared_ptr<Shared>& shared) {
+    GifFrame frame;
+    std::vector<uint32_t> palette;
+
+    while (true) {
+        size_t target = 0;
+        uint64_t generation = 0;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (shared->closed || shared->ring.size() >= RING_SIZE) {
+                shared->filling = false;
+                return;
+            }
+            target = shared->nextIndex;
+            generation = shared->generation;
+        }
+
+        // Frames build on the ones before them, so going back (or wrapping around)
+        // composites again from the first frame
+        GifCompositor& compositor = shared->compositor;
+        if (target < compositor.GetNextFrame()) {
+            compositor.Reset();
+        }
+        const PixelBuffer* canvas = nullptr;
+        while (compositor.GetNextFrame() <= target) {
+            bool ok = shared->source->ReadFrame(compositor.GetNextFrame(), frame, palette) &&
+                palette.size() >= GifAnimation::PALETTE_SIZE;
+            canvas = &compositor.ComposeNext(ok ? frame : GifFrame(), ok ? palette.data() : nullptr);
+        }
+
+        ReadyFrame ready;
+        ready.index = target;
+        ready.canvas = *canvas;
+        ready.changed = compositor.TakeDirtyRect();
+
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        if (shared->closed || generation != shared->generation) continue;
+        shared->ring.push_back(std::move(ready));
+        shared->nextIndex = (target + 1) % shared->frameCount;
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+// Platform-neutral playback of animations too long to keep decoded. A pool task reads
+// frames in order from a GifFrameSource, composites them and keeps a small ring of the
+// canvases just ahead of the one on screen, so memory is a few canvases whatever the
+// frame count. A frame that is not ready in time is simply shown late.
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "DecodePipeline.h"
+#include "GifAnimation.h"
+#include "GifCompositor.h"
+#include "TaskPool.h"
+
+class GifStream {
+public:
+    // Starts filling the ring from firstFrame
+    GifStream(std::shared_ptr<GifFrameSource> source, size_t frameCount, uint32_t width,
+        uint32_t height, TaskPool* pool, size_t firstFrame = 0);
+    ~GifStream();
+
+    GifStream(const GifStream&) = delete;
+    GifStream& operator=(const GifStream&) = delete;
+
+    // Take the canvas of frame index once it is composited (false while it is on its way),
+    // with the area that differs from the frame taken before it. Frames are expected in
+    // playback order, wrapping after the last; asking for any other frame drops the ring
+    // and restarts compositing there.
+    bool TakeFrame(size_t index, PixelBuffer& out, GifCompositor::Rect& changed);
+
+    size_t GetFrameCount() const { return m_frameCount; }
+
+    // Most the ring and the compositor hold at once
+    size_t ByteSize() const { return (RING_SIZE + 1) * m_canvasBytes; }
+
+    static constexpr size_t RING_SIZE = 4;
+
+private:
+    struct ReadyFrame {
+        size_t index = 0;
+        PixelBuffer canvas;
+        GifCompositor::Rect changed = {};  // Since the frame before it in the ring
+    };
+
+    // State shared with the fill task, which can outlive the stream. The generation
+    // changes whenever playback jumps, so frames composited for the old position are dropped.
+    struct Shared {
+        std::mutex mutex;
+        std::shared_ptr<GifFrameSource> source;
+        size_t frameCount = 0;
+        GifCompositor compositor;  // Used only by the fill task (one at a time)
+        std::deque<ReadyFrame> ring;
+        size_t nextIndex = 0;      // Next frame to add to the ring
+        uint64_t generation = 0;
+        bool filling = false;
+        bool closed = false;
+        bool jumped = true;        // The next frame taken replaces the whole canvas
+
+        Shared(uint32_t width, uint32_t height) : compositor(width, height) {}
+    };
+
+    void StartFillLocked();
+    static void Fill(const std::shared_ptr<Shared>& shared);
+
+    std::shared_ptr<Shared> m_shared;
+    TaskPool* m_pool = nullptr;
+    size_t m_frameCount = 0;
+    size_t m_canvasBytes = 0;
+};
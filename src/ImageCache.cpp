@@ -1,127 +1,634 @@
 #include "pch.h"
 #include "ImageCache.h"
+#include "YCbCrConverter.h"
+#include "BlockCompressor.h"
+#include "MappedFile.h"
 
-ImageCache::ImageCache() {}
+ImageCache::ImageCache() {
+    GetTier(ImageLevel::Screen).maxBytes = DEFAULT_SCREEN_MAX_BYTES;
+    GetTier(ImageLevel::Full).maxBytes = DEFAULT_FULL_MAX_BYTES;
+}
 
 ImageCache::~ImageCache() {
     Shutdown();
 }
 
-void ImageCache::Initialize(ImageLoader* loader) {
+void ImageCache::Initialize(ImageLoader* loader, TaskPool* pool, std::function<void()> onDecodeComplete) {
     m_loader = loader;
-    m_running = true;
-    m_workerThread = std::thread(&ImageCache::WorkerThread, this);
+    m_previews.Open(PreviewStore::GetDefaultPath());
+    m_encoded.Start(EncodedCache::DEFAULT_QUEUE_DEPTH);
+
+    DecodePipeline::Callbacks callbacks;
+    callbacks.decode = [this](const DecodeRequest& request, const CancellationToken& token) {
+        return DecodeOnWorker(request, token);
+    };
+    callbacks.onCompleted = std::move(onDecodeComplete);
+    m_pipeline.Start(std::move(callbacks), pool);
+
+    PrefetchSizer::Limits limits = m_sizer.GetLimits();
+    limits.workerCount = pool ? pool->GetWorkerCount() : 1;
+    limits.memoryBytes = GetTier(ImageLevel::Screen).maxBytes;
+    m_sizer.SetLimits(limits);
 }
 
 void ImageCache::Shutdown() {
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_running = false;
+    m_pipeline.Stop();
+    m_encoded.Stop();
+    m_previews.Close();
+    Clear();
+}
+
+void ImageCache::SetPlanarJpeg(bool enabled) {
+    m_planarJpeg = enabled;
+}
+
+void ImageCache::SetBlockCompression(bool enabled) {
+    m_blockCompression = enabled;
+}
+
+void ImageCache::SetAnimationCacheBytes(size_t maxBytes) {
+    m_animationCacheBytes = maxBytes;
+}
+
+void ImageCache::SetScreenSize(uint32_t width, uint32_t height) {
+    if (width > 0 && height > 0) {
+        m_screenWidth = width;
+        m_screenHeight = height;
     }
-    m_cv.notify_all();
+}
+
+std::shared_ptr<DecodedImage> ImageCache::DecodeOnWorker(const DecodeRequest& request,
+    const CancellationToken& token) {
+    const std::wstring& filePath = request.filePath;
 
-    if (m_workerThread.joinable()) {
-        m_workerThread.join();
+    // Pool workers have their own factory; single-flight loads may also run on the UI thread
+    IWICImagingFactory* wicFactory = ImageLoader::GetWorkerWicFactory();
+    if (!wicFactory && m_loader) {
+        wicFactory = m_loader->GetWicFactory();
     }
 
-    Clear();
+    UINT maxWidth = 0;
+    UINT maxHeight = 0;
+    if (request.level == ImageLevel::Screen) {
+        maxWidth = m_screenWidth;
+        maxHeight = m_screenHeight;
+    }
+
+    // Identities are resolved here rather than on the UI thread. A renamed file is found
+    // under its new path from now on and needs no decode.
+    std::wstring cacheKey = ResolveKey(filePath);
+    if (!cacheKey.empty() && GetTier(request.level).lookup.Find(cacheKey)) {
+        return nullptr;
+    }
+
+    // A local file is mapped for this decode only: no private copy, and the pages are the
+    // ones the probe and save paths read. Network and removable files come from the tier,
+    // usually already read ahead.
+    EncodedBuffer encoded = MappedFile::Map(filePath);
+    if (!encoded) {
+        encoded = m_encoded.Read(filePath);
+    }
+    if (IsCancelled(token)) {
+        return nullptr;
+    }
+
+    auto decoded = ImageLoader::DecodeImage(wicFactory, filePath, token, maxWidth, maxHeight, encoded,
+        m_planarJpeg, m_animationCacheBytes);
+    if (!decoded || IsCancelled(token)) {
+        return decoded;
+    }
+
+    // Only cache pixels known to match one version of the file
+    if (!cacheKey.empty() && ResolveKey(filePath) == cacheKey) {
+        decoded->cacheKey = cacheKey;
+    }
+
+    // Remember a preview so the next visit to this folder can show the image instantly
+    if (!decoded->cacheKey.empty() && !m_previews.Contains(decoded->cacheKey)) {
+        PixelBuffer expanded;
+        if (!decoded->planar.IsEmpty()) {
+            YCbCrConverter::ConvertToBgra(decoded->planar, expanded);
+        } else if (decoded->isAnimated && decoded->animation) {
+            expanded = GifCompositor(decoded->animation).Compose(0);
+        }
+        const PixelBuffer& source = expanded.IsEmpty() ? decoded->image : expanded;
+        BlockImage preview;
+        if (PreviewStore::MakePreview(source, preview)) {
+            m_previews.Put(decoded->cacheKey, preview, decoded->sourceWidth, decoded->sourceHeight);
+        }
+    }
+
+    // Images that will not be drawn soon are kept compressed; the focus and its neighbours
+    // stay exact. Full-resolution levels are left alone since crops and zoom read them.
+    size_t focusIndex = m_focusIndex;
+    size_t distance = request.index >= focusIndex ? request.index - focusIndex : focusIndex - request.index;
+    if (m_blockCompression && request.level == ImageLevel::Screen && !decoded->isFullResolution &&
+        !decoded->image.IsEmpty() && distance > GPU_RESIDENT_RADIUS) {
+        if (BlockCompressor::Compress(decoded->image, decoded->compressed)) {
+            decoded->image = PixelBuffer();
+        }
+    }
+    return decoded;
 }
 
-std::shared_ptr<ImageData> ImageCache::Get(const std::wstring& filePath) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+std::shared_ptr<ImageData> ImageCache::GetPreview(const std::wstring& filePath) {
+    if (!m_loader) return nullptr;
+
+    // Runs on the UI thread, so the file is never opened here: a path whose identity the
+    // decode worker has not resolved yet (or that changed since) uses the embedded preview
+    FileIdentity identity;
+    auto preview = std::make_shared<DecodedImage>();
+    uint32_t sourceWidth = 0;
+    uint32_t sourceHeight = 0;
+    if (m_identities.Validate(filePath, identity) &&
+        m_previews.Find(identity.ToKey(), preview->compressed, sourceWidth, sourceHeight)) {
+        preview->filePath = filePath;
+        preview->level = ImageLevel::Screen;
+        preview->sourceWidth = sourceWidth;
+        preview->sourceHeight = sourceHeight;
+        preview->isFullResolution = false;
+    } else {
+        // Not resolved or not stored: a camera JPEG usually carries its own preview in the header
+        preview = ImageLoader::DecodeEmbeddedPreview(m_loader->GetWicFactory(), filePath,
+            m_screenWidth, m_screenHeight, m_encoded.Find(filePath));
+        if (!preview) return nullptr;
+    }
 
-    auto it = m_cache.find(filePath);
-    if (it != m_cache.end()) {
-        // Move to end of access order (most recently used)
-        auto orderIt = std::find(m_accessOrder.begin(), m_accessOrder.end(), filePath);
-        if (orderIt != m_accessOrder.end()) {
-            m_accessOrder.erase(orderIt);
-            m_accessOrder.push_back(filePath);
+    auto image = m_loader->CreateImageData(preview);
+    if (image) {
+        image->isPreview = true;
+    }
+    return image;
+}
+
+std::shared_ptr<ImageData> ImageCache::Get(const std::wstring& filePath, ImageLevel level) {
+    // One attribute query; a new or changed file misses and is resolved by the decode worker
+    FileIdentity identity;
+    std::wstring previousKey;
+    if (!m_identities.Validate(filePath, identity, &previousKey)) {
+        if (!previousKey.empty()) {
+            QueueUpdate({ nullptr, nullptr, previousKey });
         }
-        return it->second;
+        return nullptr;
+    }
+
+    auto image = GetTier(level).lookup.Find(identity.ToKey());
+    if (!image) {
+        return nullptr;
+    }
+    if (image->filePath != filePath) {
+        // The file was renamed: the pixels are still valid, only the path has changed.
+        // Entries are shared with callers, so the cache switches to an updated copy.
+        auto renamed = std::make_shared<ImageData>(*image);
+        renamed->filePath = filePath;
+        QueueUpdate({ image, renamed, std::wstring() });
+        return renamed;
+    }
+
+    QueueUpdate({ image, nullptr, std::wstring() });
+    return image;
+}
+
+void ImageCache::QueueUpdate(PendingUpdate update) {
+    std::unique_lock<std::mutex> lock(m_touchMutex, std::try_to_lock);
+    if (lock.owns_lock() && m_pendingUpdates.size() < MAX_PENDING_UPDATES) {
+        m_pendingUpdates.push_back(std::move(update));
     }
+}
 
-    return nullptr;
+std::wstring ImageCache::ResolveKey(const std::wstring& filePath) {
+    FileIdentity identity;
+    std::wstring previousKey;
+    if (!m_identities.Resolve(filePath, identity, &previousKey)) {
+        return std::wstring();
+    }
+    if (!previousKey.empty()) {
+        // The resolver has moved on, so this must not be dropped like a hit
+        std::lock_guard<std::mutex> lock(m_touchMutex);
+        m_pendingUpdates.push_back({ nullptr, nullptr, previousKey });
+    }
+    return identity.ToKey();
 }
 
-void ImageCache::Prefetch(const std::vector<std::wstring>& filePaths) {
+void ImageCache::EraseKey(const std::wstring& key) {
     std::lock_guard<std::mutex> lock(m_mutex);
+    ApplyPendingLocked();
+    EraseKeyLocked(key);
+    ReportMemoryLocked();
+}
+
+void ImageCache::EraseKeyLocked(const std::wstring& key) {
+    for (auto& tier : m_tiers) {
+        auto handle = tier.cache.Find(key);
+        if (handle != tier.cache.INVALID_HANDLE) {
+            tier.policy.Remove(handle, false);
+            tier.lookup.Erase(key);
+            tier.cache.Erase(handle);
+        }
+    }
+}
 
-    for (const auto& path : filePaths) {
-        // Skip if already cached or queued
-        if (m_cache.find(path) != m_cache.end()) {
+void ImageCache::ApplyPendingLocked() {
+    std::vector<PendingUpdate> updates;
+    {
+        std::lock_guard<std::mutex> lock(m_touchMutex);
+        updates.swap(m_pendingUpdates);
+    }
+
+    for (const auto& update : updates) {
+        if (!update.staleKey.empty()) {
+            EraseKeyLocked(update.staleKey);
+            continue;
+        }
+
+        // Skip hits on entries that were evicted or replaced since
+        Tier& tier = GetTier(update.image->level);
+        auto handle = tier.cache.Find(update.image->cacheKey);
+        if (handle == tier.cache.INVALID_HANDLE || tier.cache.GetValue(handle) != update.image) {
             continue;
         }
+        if (update.renamed) {
+            tier.cache.GetValue(handle) = update.renamed;
+            tier.lookup.Set(update.image->cacheKey, update.renamed);
+        }
+        tier.cache.Touch(handle);
+        tier.policy.Touch(handle);
+    }
+}
+
+DecodePipeline::DecodeFuture ImageCache::Load(const DecodeRequest& request) {
+    return m_pipeline.Request(request, false);
+}
+
+std::shared_ptr<ImageData> ImageCache::GetOrLoad(const DecodeRequest& request) {
+    auto image = Get(request.filePath, request.level);
+    if (image || !m_loader) {
+        return image;
+    }
+
+    // A null result with no failure means the worker found the file already cached under
+    // another path (a rename); the lookup below then finds it
+    auto decoded = m_pipeline.Request(request, true).get();
+
+    // The result is queued for the cache like any other decode; insert it now
+    ProcessQueue();
+    image = Get(request.filePath, request.level);
+    if (!image) {
+        if (!decoded) {
+            return nullptr;
+        }
+        // Evicted straight away (larger than the whole budget): show it uncached
+        return m_loader->CreateImageData(decoded);
+    }
+    return EnsureResident(image) ? image : nullptr;
+}
+
+void ImageCache::Prefetch(const std::vector<DecodeRequest>& requests, size_t focusIndex) {
+    m_focusIndex = focusIndex;
+    std::unordered_set<size_t> window;
+    std::unordered_set<std::wstring> residentPaths;
+    std::vector<const DecodeRequest*> toDecode;
+
+    for (const auto& request : requests) {
+        window.insert(request.index);
+
+        size_t distance = request.index >= focusIndex ? request.index - focusIndex : focusIndex - request.index;
+        if (distance <= GPU_RESIDENT_RADIUS) {
+            residentPaths.insert(request.filePath);
+        }
+
+        // Skip if known to be cached (the pipeline skips anything already queued). Only the
+        // last resolved identity is consulted; the worker checks the file itself.
+        FileIdentity identity;
+        if (!m_identities.Lookup(request.filePath, identity) ||
+            !GetTier(request.level).lookup.Find(identity.ToKey())) {
+            toDecode.push_back(&request);
+        }
+    }
+
+    SetResidentPaths(std::move(residentPaths));
+
+    std::vector<const DecodeRequest*> ordered;
+    for (const auto& request : requests) {
+        ordered.push_back(&request);
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const DecodeRequest* a, const DecodeRequest* b) {
+        return a->index < b->index;
+    });
+    m_windowPaths.clear();
+    for (const auto* request : ordered) {
+        if (m_windowPaths.empty() || m_windowPaths.back() != request->filePath) {
+            m_windowPaths.push_back(request->filePath);
+        }
+    }
+
+    // Start the reads nearest the focus first, to stay ahead of the decoders
+    auto distance = [focusIndex](size_t index) {
+        return index >= focusIndex ? index - focusIndex : focusIndex - index;
+    };
+    std::stable_sort(toDecode.begin(), toDecode.end(), [&](const DecodeRequest* a, const DecodeRequest* b) {
+        return distance(a->index) < distance(b->index);
+    });
+    std::vector<std::wstring> readAhead;
+    for (const auto* request : toDecode) {
+        if (NeedsReadAhead(request->filePath)) {
+            readAhead.push_back(request->filePath);
+        }
+    }
+    m_encoded.ReadAhead(readAhead);
+
+    // Indices shift when a folder scan lands; keep decodes that are only renumbered
+    m_pipeline.Reindex(requests);
+    m_pipeline.SetWindow(focusIndex, std::move(window));
+    for (const auto* request : toDecode) {
+        m_pipeline.Enqueue(*request);
+    }
+}
+
+size_t ImageCache::GetPrefetchCount(const std::wstring& filePath, double intervalMs) const {
+    fs::path path(filePath);
+    return m_sizer.GetWindowCount(path.parent_path().wstring(),
+        ToLowerCase(path.extension().wstring()), intervalMs);
+}
+
+std::vector<std::wstring> ImageCache::GetWorkingSet() {
+    std::vector<std::wstring> paths;
+    for (const auto& path : m_windowPaths) {
+        FileIdentity identity;
+        if (m_identities.Lookup(path, identity) && GetTier(ImageLevel::Screen).lookup.Find(identity.ToKey())) {
+            paths.push_back(path);
+        }
+    }
+    return paths;
+}
+
+void ImageCache::ProcessQueue() {
+    if (!m_loader) return;
+
+    // Upload the whole batch in one pass so a burst of decodes costs a single UI wake-up
+    auto completed = m_pipeline.TakeCompleted();
+    for (const auto& decoded : completed) {
+        if (decoded->level == ImageLevel::Screen) {
+            fs::path path(decoded->filePath);
+            m_sizer.Record(path.parent_path().wstring(), ToLowerCase(path.extension().wstring()),
+                decoded->decodeMs, decoded->ByteSize());
+        }
+
+        // Only images near the current one get device bitmaps straight away
+        bool upload = m_residentPaths.count(decoded->filePath) != 0;
+        auto image = m_loader->CreateImageData(decoded, upload);
+        if (image && !image->cacheKey.empty()) {
+            Insert(std::move(image), decoded->decodeMs);
+        }
+    }
+}
+
+void ImageCache::Insert(std::shared_ptr<ImageData> image, double decodeMs) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ApplyPendingLocked();
+
+    CacheEntryCost cost;
+    cost.cpuBytes = image->cpuBytes;
+    cost.gpuBytes = image->gpuBytes;
+    cost.decodeMs = decodeMs;
+
+    Tier& tier = GetTier(image->level);
+    std::wstring key = image->cacheKey;
+    tier.lookup.Set(key, image);
+    auto handle = tier.cache.Insert(key, std::move(image));
+    tier.policy.Add(handle, cost);
+
+    EvictToBudgetLocked(tier);
+}
+
+void ImageCache::EvictToBudgetLocked(Tier& tier) {
+    while (tier.policy.GetTotalBytes() > tier.maxBytes) {
+        auto victim = tier.policy.SelectVictim();
+        if (victim == tier.policy.INVALID_HANDLE) break;
+
+        tier.policy.Remove(victim, true);
+        tier.lookup.Erase(tier.cache.GetKey(victim));
+        tier.cache.Erase(victim);
+    }
+    ReportMemoryLocked();
+}
+
+void ImageCache::SetMemoryGovernor(MemoryGovernor* governor) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_governor = governor;
+    ReportMemoryLocked();
+}
+
+void ImageCache::ReportMemoryLocked() {
+    if (!m_governor) return;
+
+    size_t total = 0;
+    for (const auto& tier : m_tiers) {
+        total += tier.policy.GetTotalBytes();
+    }
+    m_governor->SetUsage(MemoryConsumer::DecodedImages, total);
+    m_governor->SetUsage(MemoryConsumer::EncodedBytes, m_encoded.GetTotalBytes());
+}
+
+size_t ImageCache::ShedFarEntries(size_t bytesToFree) {
+    size_t freed = m_encoded.Shed(bytesToFree);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ApplyPendingLocked();
+    if (freed < bytesToFree) {
+        freed += ShedLocked(bytesToFree - freed, [this](const ImageData& image) {
+            return m_residentPaths.count(image.filePath) == 0;
+        });
+    }
+    ReportMemoryLocked();
+    return freed;
+}
 
-        // Check if already in queue
-        bool inQueue = false;
-        std::queue<std::wstring> tempQueue = m_loadQueue;
-        while (!tempQueue.empty()) {
-            if (tempQueue.front() == path) {
-                inQueue = true;
-                break;
+size_t ImageCache::ShedAnimations(size_t bytesToFree) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ApplyPendingLocked();
+    size_t freed = ShedLocked(bytesToFree, [](const ImageData& image) {
+        return image.isAnimated;
+    });
+    ReportMemoryLocked();
+    return freed;
+}
+
+size_t ImageCache::ShedLocked(size_t bytesToFree,
+    const std::function<bool(const ImageData&)>& canShed) {
+    // Collect candidates in least-recently-used order, then drop them until enough is free
+    size_t freed = 0;
+    for (auto& tier : m_tiers) {
+        std::vector<LruIndex<std::shared_ptr<ImageData>>::Handle> victims;
+        for (auto handle = tier.cache.LeastRecent(); handle != tier.cache.INVALID_HANDLE;
+             handle = tier.cache.NextNewer(handle)) {
+            if (canShed(*tier.cache.GetValue(handle))) {
+                victims.push_back(handle);
             }
-            tempQueue.pop();
         }
 
-        if (!inQueue) {
-            m_loadQueue.push(path);
+        for (auto handle : victims) {
+            if (freed >= bytesToFree) return freed;
+
+            auto cost = tier.policy.GetCost(handle);
+            freed += cost.TotalBytes();
+            tier.policy.Remove(handle, false);
+            tier.lookup.Erase(tier.cache.GetKey(handle));
+            tier.cache.Erase(handle);
         }
     }
+    return freed;
+}
+
+void ImageCache::SetMaxBytes(ImageLevel level, size_t maxBytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Tier& tier = GetTier(level);
+    tier.maxBytes = maxBytes;
+    ApplyPendingLocked();
+    EvictToBudgetLocked(tier);
+
+    // The prefetch window is decoded at the screen level, so that budget bounds its width
+    if (level == ImageLevel::Screen) {
+        PrefetchSizer::Limits limits = m_sizer.GetLimits();
+        limits.memoryBytes = maxBytes;
+        m_sizer.SetLimits(limits);
+    }
+}
 
-    m_cv.notify_one();
+size_t ImageCache::GetTotalBytes(ImageLevel level) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return GetTier(level).policy.GetTotalBytes();
 }
 
-void ImageCache::Clear() {
+std::optional<CacheEntryCost> ImageCache::GetEntryCost(const std::wstring& filePath, ImageLevel level) {
+    std::wstring key = ResolveKey(filePath);
+
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_cache.clear();
-    m_accessOrder.clear();
+    ApplyPendingLocked();
 
-    // Clear queue
-    std::queue<std::wstring> empty;
-    std::swap(m_loadQueue, empty);
+    Tier& tier = GetTier(level);
+    auto handle = tier.cache.Find(key);
+    if (handle == tier.cache.INVALID_HANDLE || !tier.policy.IsActive(handle)) {
+        return std::nullopt;
+    }
+    return tier.policy.GetCost(handle);
 }
 
-void ImageCache::WorkerThread() {
-    // Note: This is a simplified implementation
-    // For true async D2D bitmap creation, we'd need to:
-    // 1. Decode image to CPU memory on worker thread
-    // 2. Send message to main thread to create D2D bitmap
-    // For now, we load synchronously but on demand
+bool ImageCache::EnsureResident(const std::shared_ptr<ImageData>& image) {
+    if (!image || image->IsResident()) return image != nullptr;
+    if (!m_loader || !m_loader->Upload(*image)) return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    UpdateBytesLocked(*image);
+    return true;
+}
 
-    while (m_running) {
-        std::wstring pathToLoad;
+void ImageCache::SetResidentPaths(std::unordered_set<std::wstring> paths) {
+    m_residentPaths = std::move(paths);
 
-        {
-            std::unique_lock<std::mutex> lock(m_mutex);
-            m_cv.wait(lock, [this] {
-                return !m_running || !m_loadQueue.empty();
-            });
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& tier : m_tiers) {
+        for (auto handle = tier.cache.MostRecent(); handle != tier.cache.INVALID_HANDLE;
+             handle = tier.cache.NextOlder(handle)) {
+            auto& image = tier.cache.GetValue(handle);
+            bool wanted = m_residentPaths.count(image->filePath) != 0;
+            if (wanted == image->IsResident()) continue;
 
-            if (!m_running) {
-                break;
+            if (wanted) {
+                if (!m_loader || !m_loader->Upload(*image)) continue;
+            } else {
+                ImageLoader::Release(*image);
             }
+            tier.policy.UpdateBytes(handle, image->cpuBytes, image->gpuBytes);
+        }
+        EvictToBudgetLocked(tier);
+    }
+}
 
-            if (!m_loadQueue.empty()) {
-                pathToLoad = m_loadQueue.front();
-                m_loadQueue.pop();
+void ImageCache::OnDeviceLost() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& tier : m_tiers) {
+            for (auto handle = tier.cache.MostRecent(); handle != tier.cache.INVALID_HANDLE;
+                 handle = tier.cache.NextOlder(handle)) {
+                auto& image = tier.cache.GetValue(handle);
+                ImageLoader::Release(*image);
+                tier.policy.UpdateBytes(handle, image->cpuBytes, image->gpuBytes);
             }
         }
+        ReportMemoryLocked();
+    }
+
+    // Re-upload the images around the current one from their CPU pixels
+    SetResidentPaths(m_residentPaths);
+}
+
+void ImageCache::UpdateBytesLocked(const ImageData& image) {
+    Tier& tier = GetTier(image.level);
+    auto handle = tier.cache.Find(image.cacheKey);
+    if (handle != tier.cache.INVALID_HANDLE && tier.cache.GetValue(handle).get() == &image) {
+        tier.policy.UpdateBytes(handle, image.cpuBytes, image.gpuBytes);
+        EvictToBudgetLocked(tier);
+    }
+}
+
+void ImageCache::SetReadAheadDepth(size_t queueDepth) {
+    m_encoded.Start(queueDepth);
+}
+
+void ImageCache::SetEncodedMaxBytes(size_t maxBytes) {
+    m_encoded.SetMaxBytes(maxBytes);
+}
+
+EncodedBuffer ImageCache::ReadEncoded(const std::wstring& filePath) {
+    EncodedBuffer encoded = MappedFile::Map(filePath);
+    return encoded ? encoded : m_encoded.Read(filePath);
+}
+
+bool ImageCache::NeedsReadAhead(const std::wstring& filePath) {
+    // A window rarely leaves one folder, so the drive is only queried when it does
+    std::wstring folder = fs::path(filePath).parent_path().wstring();
+    if (folder != m_readAheadFolder) {
+        m_readAheadFolder = folder;
+        m_readAheadNeeded = !MappedFile::IsOnFixedDrive(folder);
+    }
+    return m_readAheadNeeded;
+}
 
-        if (!pathToLoad.empty() && m_loader) {
-            // Load the image
-            // Note: In a full implementation, this would need thread synchronization
-            // with D2D resources. For now, we'll skip background loading
-            // and rely on fast synchronous loading instead.
+void ImageCache::ReleaseFile(const std::wstring& filePath) {
+    m_encoded.Erase(filePath);
 
-            // The proper way would be to:
-            // 1. Use WIC to decode to IWICBitmap on this thread
-            // 2. Post message to main thread to convert to ID2D1Bitmap
+    std::vector<std::wstring> streamed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& tier : m_tiers) {
+            for (auto handle = tier.cache.LeastRecent(); handle != tier.cache.INVALID_HANDLE;
+                 handle = tier.cache.NextNewer(handle)) {
+                const auto& image = tier.cache.GetValue(handle);
+                if (image->filePath == filePath && image->pixels && image->pixels->frameSource) {
+                    streamed.push_back(image->cacheKey);
+                }
+            }
         }
     }
+    for (const auto& key : streamed) {
+        EraseKey(key);
+    }
 }
 
-void ImageCache::ProcessQueue() {
-    // This would be called from the main thread to process loaded images
-    // and create D2D bitmaps from WIC bitmaps decoded on the worker thread
+void ImageCache::Clear() {
+    m_pipeline.ClearPending();
+    m_encoded.Clear();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& tier : m_tiers) {
+        tier.lookup.Clear();
+        tier.cache.Clear();
+        tier.policy.Clear();
+    }
+    ReportMemoryLocked();
+    {
+        std::lock_guard<std::mutex> touchLock(m_touchMutex);
+        m_pendingUpdates.clear();
+    }
 }
@@ -1,42 +1,218 @@
 #pragma once
 #include "pch.h"
 #include "ImageLoader.h"
+#include "DecodePipeline.h"
+#include "LruIndex.h"
+#include "SnapshotMap.h"
+#include "CachePolicy.h"
+#include "PreviewStore.h"
+#include "EncodedCache.h"
+#include "FileIdentity.h"
+#include "MemoryGovernor.h"
+#include "PrefetchSizer.h"
 
 class ImageCache {
 public:
     ImageCache();
     ~ImageCache();
 
-    void Initialize(ImageLoader* loader);
+    // Decodes run on the shared pool, whose workers must be set up with
+    // ImageLoader::InitializeWorkerThread. onDecodeComplete is invoked from a worker
+    // whenever finished decodes are waiting; the owner should respond by calling
+    // ProcessQueue on the UI thread.
+    void Initialize(ImageLoader* loader, TaskPool* pool, std::function<void()> onDecodeComplete);
     void Shutdown();
 
-    // Get cached image (returns nullptr if not cached)
-    std::shared_ptr<ImageData> Get(const std::wstring& filePath);
+    // Get cached image at a resolution level (returns nullptr if not cached). Entries are
+    // keyed by file identity, so a renamed file keeps its entry and a rewritten one misses.
+    // Never waits on m_mutex: the lookup reads a published snapshot and validates the file
+    // with one attribute query. Recency updates, renames and entries for a changed file are
+    // queued for the next writer; a path not yet resolved misses until a decode worker
+    // resolves it. The image may hold only CPU pixels; see EnsureResident.
+    std::shared_ptr<ImageData> Get(const std::wstring& filePath, ImageLevel level);
 
-    // Request background loading of files
-    void Prefetch(const std::vector<std::wstring>& filePaths);
+    // Box the screen level is decoded to fit (usually the monitor size in pixels)
+    void SetScreenSize(uint32_t width, uint32_t height);
+
+    // Keep JPEGs decoded at their own size as YCbCr planes (about 2.6x smaller than BGRA
+    // for 4:2:0), converting at upload. Applies to decodes started afterwards.
+    void SetPlanarJpeg(bool enabled);
+
+    // Keep screen-level decodes of images outside GPU_RESIDENT_RADIUS block-compressed (BC1,
+    // or BC3 with alpha: 1/8 or 1/4 of BGRA), compressed by the decode worker and uploaded
+    // as is. Costs some quality, so it is off by default. Applies to decodes started afterwards.
+    void SetBlockCompression(bool enabled);
+
+    // Animations whose palette-indexed frames fit in maxBytes are decoded whole and cached;
+    // longer ones are streamed, keeping a few composited frames at a time (0 streams every
+    // animation). Applies to decodes started afterwards.
+    void SetAnimationCacheBytes(size_t maxBytes);
+
+    // Single-flight load: a future for one level of a file's decoded pixels that joins any
+    // decode of it already queued or running rather than starting a second one. The result
+    // is inserted into the cache by ProcessQueue like any background decode.
+    DecodePipeline::DecodeFuture Load(const DecodeRequest& request);
+
+    // Cached image, or load it now and cache it (UI thread only). A decode that has not
+    // started yet runs on the calling thread; one already running is waited on.
+    std::shared_ptr<ImageData> GetOrLoad(const DecodeRequest& request);
+
+    // Stored preview of an uncached image, for instant display while it decodes, else the
+    // preview embedded in the file's EXIF/MPF header (nullptr if neither; UI thread only).
+    // Previews are not added to the cache.
+    std::shared_ptr<ImageData> GetPreview(const std::wstring& filePath);
+
+    // Request background loading of the images around focusIndex. Replaces the previous
+    // request: queued decodes outside the new window are dropped and running ones cancelled.
+    void Prefetch(const std::vector<DecodeRequest>& requests, size_t focusIndex);
+
+    // Images to prefetch on each side of filePath when navigating every intervalMs (0 when
+    // idle), sized from the measured decode time and size of images like it: same format
+    // in the same folder, else the same format anywhere
+    size_t GetPrefetchCount(const std::wstring& filePath, double intervalMs) const;
+
+    // Files of the current prefetch window whose screen level is cached, in folder order
+    // (UI thread only). Saved with the session so the next launch can decode them early.
+    std::vector<std::wstring> GetWorkingSet();
+
+    // Add finished background decodes to the cache (UI thread only). Only images within
+    // GPU_RESIDENT_RADIUS of the focus get device bitmaps; the rest keep CPU pixels.
+    void ProcessQueue();
+
+    // Make sure a cached image has device bitmaps before it is drawn (UI thread only)
+    bool EnsureResident(const std::shared_ptr<ImageData>& image);
+
+    // Every device bitmap belongs to the lost device: drop them all and re-upload the
+    // resident images from CPU pixels (UI thread only, after the loader has the new device)
+    void OnDeviceLost();
 
     // Clear cache
     void Clear();
 
-    // Set maximum cache size (number of images)
-    void SetMaxSize(size_t maxSize) { m_maxSize = maxSize; }
+    // Set maximum decoded bytes (CPU + GPU) held at each level; levels are budgeted
+    // separately so zooming into a few images cannot push out the browsing window
+    void SetMaxBytes(ImageLevel level, size_t maxBytes);
+    size_t GetTotalBytes(ImageLevel level);
+
+    // Per-entry cost accounting (nullopt if not cached)
+    std::optional<CacheEntryCost> GetEntryCost(const std::wstring& filePath, ImageLevel level);
+
+    // Encoded-bytes tier beneath the decoded levels, for files on network and removable
+    // drives (local files are mapped per decode instead): how many file reads run ahead of
+    // the decoders at once, and how many raw bytes are kept for re-decoding without the disk
+    void SetReadAheadDepth(size_t queueDepth);
+    void SetEncodedMaxBytes(size_t maxBytes);
+    size_t GetEncodedBytes() const { return m_encoded.GetTotalBytes(); }
+
+    // A file's bytes: a read-only mapping for a local file, otherwise through the encoded
+    // tier (nullptr if it cannot be read). Hold the result only while decoding it, since a
+    // mapping stops the file being overwritten. Safe to call from any thread.
+    EncodedBuffer ReadEncoded(const std::wstring& filePath);
+
+    // Forget a file before it is replaced or deleted: its bytes in the encoded tier and the
+    // cached streamed animations still reading frames from it
+    void ReleaseFile(const std::wstring& filePath);
+
+    // Report usage to a process-wide governor (may be null). The shed functions free about
+    // bytesToFree for it and return what was actually released (UI thread only):
+    // ShedFarEntries drops raw bytes and decoded images outside the GPU-resident window,
+    // ShedAnimations drops decoded animations.
+    void SetMemoryGovernor(MemoryGovernor* governor);
+    size_t ShedFarEntries(size_t bytesToFree);
+    size_t ShedAnimations(size_t bytesToFree);
 
 private:
-    void WorkerThread();
-    void ProcessQueue();
+    // Storage for one resolution level
+    struct Tier {
+        // Cache storage (O(1) lookup by handle) and byte-budgeted cost-aware eviction
+        LruIndex<std::shared_ptr<ImageData>> cache;
+        GdsfPolicy policy;
+        size_t maxBytes = 0;
 
-    ImageLoader* m_loader = nullptr;
+        // Lookup mirror of cache that never waits on m_mutex; writers update it under m_mutex
+        SnapshotMap<std::shared_ptr<ImageData>> lookup;
+    };
+
+    Tier& GetTier(ImageLevel level) { return m_tiers[static_cast<size_t>(level)]; }
+    void Insert(std::shared_ptr<ImageData> image, double decodeMs);
+
+    // Cache key of the file's current version (empty if it cannot be read). Entries for a
+    // version the file no longer has are queued for the next writer to drop. Opens the
+    // file when the path is new or the file has changed, so Get and Prefetch leave it to
+    // the decode workers.
+    std::wstring ResolveKey(const std::wstring& filePath);
+    void EraseKey(const std::wstring& key);
+    void EraseKeyLocked(const std::wstring& key);
+    void EvictToBudgetLocked(Tier& tier);
+    size_t ShedLocked(size_t bytesToFree, const std::function<bool(const ImageData&)>& canShed);
+    void ReportMemoryLocked();
+    void ApplyPendingLocked();
+
+    // Promote images in paths to the GPU and demote all others (UI thread only)
+    void SetResidentPaths(std::unordered_set<std::wstring> paths);
+    void UpdateBytesLocked(const ImageData& image);
 
-    // Cache storage (LRU-style)
-    std::unordered_map<std::wstring, std::shared_ptr<ImageData>> m_cache;
-    std::vector<std::wstring> m_accessOrder; // Most recent at back
-    size_t m_maxSize = 10;
+    std::shared_ptr<DecodedImage> DecodeOnWorker(const DecodeRequest& request,
+        const CancellationToken& token);
 
-    // Background loading
-    std::thread m_workerThread;
+    ImageLoader* m_loader = nullptr;
+    MemoryGovernor* m_governor = nullptr;
+    FileIdentityResolver m_identities;
+
+    Tier m_tiers[IMAGE_LEVEL_COUNT];
+    static constexpr size_t DEFAULT_SCREEN_MAX_BYTES = 256ull * 1024 * 1024;
+    static constexpr size_t DEFAULT_FULL_MAX_BYTES = 512ull * 1024 * 1024;
     std::mutex m_mutex;
-    std::condition_variable m_cv;
-    std::queue<std::wstring> m_loadQueue;
-    std::atomic<bool> m_running{ false };
+
+    static constexpr uint32_t DEFAULT_SCREEN_WIDTH = 1920;
+    static constexpr uint32_t DEFAULT_SCREEN_HEIGHT = 1080;
+    std::atomic<uint32_t> m_screenWidth{ DEFAULT_SCREEN_WIDTH };
+    std::atomic<uint32_t> m_screenHeight{ DEFAULT_SCREEN_HEIGHT };
+    std::atomic<bool> m_planarJpeg{ true };
+    std::atomic<bool> m_blockCompression{ false };
+    std::atomic<size_t> m_animationCacheBytes{ ImageLoader::DEFAULT_ANIMATION_CACHE_BYTES };
+
+    // Work recorded by Get and applied by the next writer under m_mutex: a hit on image, a
+    // renamed file's copy of it (renamed replaces image), or the key of a version the file
+    // no longer has (staleKey). Get only try-locks m_touchMutex; a dropped hit just makes
+    // recency slightly approximate, and a dropped rename or stale key is queued again by the
+    // next Get of that file.
+    struct PendingUpdate {
+        std::shared_ptr<ImageData> image;
+        std::shared_ptr<ImageData> renamed;
+        std::wstring staleKey;
+    };
+    void QueueUpdate(PendingUpdate update);
+
+    std::mutex m_touchMutex;
+    std::vector<PendingUpdate> m_pendingUpdates;
+    static constexpr size_t MAX_PENDING_UPDATES = 64;
+
+    // Background decoding (CPU pixels only; GPU upload happens in ProcessQueue)
+    DecodePipeline m_pipeline;
+
+    // Persistent previews, written by decode workers after each full decode
+    PreviewStore m_previews;
+
+    // Paths whose cached images hold device bitmaps (the focus and its neighbours)
+    std::unordered_set<std::wstring> m_residentPaths;
+    static constexpr size_t GPU_RESIDENT_RADIUS = 1;
+
+    // Focus of the last prefetch, read by decode workers
+    std::atomic<size_t> m_focusIndex{ 0 };
+
+    // Paths of the last prefetch window, in folder order (UI thread only)
+    std::vector<std::wstring> m_windowPaths;
+
+    // Decode cost measured per folder and format, for sizing the prefetch window
+    PrefetchSizer m_sizer;
+
+    // Raw bytes of network and removable files, read ahead on dedicated I/O threads
+    EncodedCache m_encoded;
+
+    // Whether files in a folder go through the tier rather than a mapping; the last folder
+    // checked is remembered (UI thread only)
+    bool NeedsReadAhead(const std::wstring& filePath);
+    std::wstring m_readAheadFolder;
+    bool m_readAheadNeeded = false;
 };
@@ -1,11 +1,19 @@
 #include "pch.h"
 #include "ImageLoader.h"
+#include "YCbCrConverter.h"
+#include "BlockCompressor.h"
+#include "ExifPreview.h"
+#include "MappedFile.h"
 
 const std::vector<std::wstring> ImageLoader::s_supportedExtensions = {
     L".jpg", L".jpeg", L".png", L".bmp", L".gif", L".tiff", L".tif",
     L".webp", L".heic", L".heif", L".ico", L".jfif"
 };
 
+// Each pool worker owns its COM apartment and WIC factory
+static thread_local ComPtr<IWICImagingFactory> t_wicFactory;
+static thread_local bool t_comInitialized = false;
+
 void ImageLoader::Initialize(ID2D1DeviceContext* deviceContext, IWICImagingFactory* wicFactory) {
     m_deviceContext = deviceContext;
     m_wicFactory = wicFactory;
@@ -19,39 +27,283 @@ bool ImageLoader::IsSupportedFormat(const std::wstring& filePath) {
         != s_supportedExtensions.end();
 }
 
-std::shared_ptr<ImageData> ImageLoader::LoadImage(const std::wstring& filePath) {
+void ImageLoader::InitializeWorkerThread() {
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    t_comInitialized = SUCCEEDED(hr);
+    if (!t_comInitialized) return;
+
+    CoCreateInstance(
+        CLSID_WICImagingFactory,
+        nullptr,
+        CLSCTX_INPROC_SERVER,
+        IID_PPV_ARGS(&t_wicFactory)
+    );
+}
+
+void ImageLoader::UninitializeWorkerThread() {
+    t_wicFactory.Reset();
+    if (t_comInitialized) {
+        CoUninitialize();
+        t_comInitialized = false;
+    }
+}
+
+IWICImagingFactory* ImageLoader::GetWorkerWicFactory() {
+    return t_wicFactory.Get();
+}
+
+std::shared_ptr<ImageData> ImageLoader::LoadImage(const std::wstring& filePath, UINT maxWidth,
+    UINT maxHeight) {
     if (!m_deviceContext || !m_wicFactory) {
         return nullptr;
     }
 
+    auto decoded = DecodeImage(m_wicFactory, filePath, nullptr, maxWidth, maxHeight);
+    if (!decoded) {
+        return nullptr;
+    }
+
+    return CreateImageData(std::move(decoded));
+}
+
+std::shared_ptr<DecodedImage> ImageLoader::DecodeImage(IWICImagingFactory* wicFactory,
+    const std::wstring& filePath, const CancellationToken& token, UINT maxWidth, UINT maxHeight,
+    const EncodedBuffer& encoded, bool keepPlanar, size_t animationCacheBytes) {
+    if (!wicFactory) {
+        return nullptr;
+    }
+
     fs::path path(filePath);
     std::wstring ext = ToLowerCase(path.extension().wstring());
 
     // Check for animated GIF
     if (ext == L".gif") {
-        auto gifData = LoadAnimatedGif(filePath);
+        auto gifData = DecodeAnimatedGif(wicFactory, filePath, encoded, animationCacheBytes, token);
         if (gifData && gifData->isAnimated) {
             return gifData;
         }
     }
 
-    // Load as static image
-    auto bitmap = LoadBitmapFromFile(filePath);
-    if (!bitmap) {
+    // Decode as static image
+    auto decoded = std::make_shared<DecodedImage>();
+    if (!DecodeBitmapFromFile(wicFactory, filePath, encoded, maxWidth, maxHeight, keepPlanar, *decoded, token)) {
+        return nullptr;
+    }
+    decoded->filePath = filePath;
+    decoded->isAnimated = false;
+
+    return decoded;
+}
+
+std::shared_ptr<DecodedImage> ImageLoader::DecodeEmbeddedPreview(IWICImagingFactory* wicFactory,
+    const std::wstring& filePath, UINT maxWidth, UINT maxHeight, const EncodedBuffer& encoded) {
+    if (!wicFactory) return nullptr;
+
+    std::wstring ext = ToLowerCase(fs::path(filePath).extension().wstring());
+    if (ext != L".jpg" && ext != L".jpeg" && ext != L".jfif") return nullptr;
+
+    // Bytes already in memory (usually a mapping) are sliced rather than read again
+    ExifPreviewInfo info;
+    EncodedBuffer bytes;
+    if (encoded && !encoded->empty()) {
+        if (!ExifPreview::Locate(encoded->data(), std::min(encoded->size(), ExifPreview::HEADER_BYTES),
+            encoded->size(), ExifPreview::DEFAULT_MAX_BYTES, info)) {
+            return nullptr;
+        }
+        bytes = EncodedBytes::Slice(encoded, static_cast<size_t>(info.offset), info.length);
+    } else {
+        std::vector<uint8_t> preview;
+        if (!ExifPreview::Read(filePath, ExifPreview::DEFAULT_MAX_BYTES, info, preview)) return nullptr;
+        bytes = std::make_shared<EncodedBytes>(std::move(preview));
+    }
+    if (!bytes) return nullptr;
+
+    // No file path, so a preview that fails to decode never falls back to the main image
+    auto decoded = std::make_shared<DecodedImage>();
+    if (!DecodeBitmapFromFile(wicFactory, std::wstring(), bytes, maxWidth, maxHeight, false, *decoded, nullptr)) {
+        return nullptr;
+    }
+    decoded->filePath = filePath;
+    decoded->level = ImageLevel::Screen;
+    decoded->sourceWidth = info.imageWidth;
+    decoded->sourceHeight = info.imageHeight;
+    decoded->isFullResolution = false;
+    return decoded;
+}
+
+std::shared_ptr<ImageData> ImageLoader::CreateImageData(std::shared_ptr<const DecodedImage> decoded,
+    bool upload) {
+    if (!decoded || !m_deviceContext) {
+        return nullptr;
+    }
+
+    uint32_t pixelWidth = decoded->image.width;
+    uint32_t pixelHeight = decoded->image.height;
+    if (decoded->isAnimated && decoded->animation && !decoded->animation->frames.empty()) {
+        pixelWidth = decoded->animation->width;
+        pixelHeight = decoded->animation->height;
+    } else if (!decoded->planar.IsEmpty()) {
+        pixelWidth = decoded->planar.width;
+        pixelHeight = decoded->planar.height;
+    } else if (!decoded->compressed.IsEmpty()) {
+        pixelWidth = decoded->compressed.width;
+        pixelHeight = decoded->compressed.height;
+    } else if (decoded->image.IsEmpty()) {
         return nullptr;
     }
 
     auto imageData = std::make_shared<ImageData>();
-    imageData->bitmap = bitmap;
-    imageData->filePath = filePath;
-    auto size = bitmap->GetSize();
-    imageData->width = static_cast<int>(size.width);
-    imageData->height = static_cast<int>(size.height);
-    imageData->isAnimated = false;
+    imageData->filePath = decoded->filePath;
+    imageData->cacheKey = decoded->cacheKey;
+    imageData->isAnimated = decoded->isAnimated;
+    imageData->width = static_cast<int>(decoded->sourceWidth ? decoded->sourceWidth : pixelWidth);
+    imageData->height = static_cast<int>(decoded->sourceHeight ? decoded->sourceHeight : pixelHeight);
+    imageData->level = decoded->level;
+    imageData->isFullResolution = decoded->isFullResolution;
+
+    if (decoded->isAnimated) {
+        size_t frameCount = decoded->frameSource ? decoded->frameDelays.size() : decoded->animation->frames.size();
+        for (size_t i = 0; i < frameCount; ++i) {
+            imageData->frameDelays.push_back(i < decoded->frameDelays.size()
+                ? decoded->frameDelays[i] : DEFAULT_FRAME_DELAY_MS);
+        }
+    }
+
+    imageData->cpuBytes = decoded->ByteSize();
+    imageData->pixels = std::move(decoded);
 
+    if (upload && !Upload(*imageData)) {
+        return nullptr;
+    }
     return imageData;
 }
 
+bool ImageLoader::Upload(ImageData& image) {
+    if (image.IsResident()) return true;
+    if (!image.pixels || !m_deviceContext) return false;
+
+    const DecodedImage& decoded = *image.pixels;
+    if (decoded.isAnimated) {
+        // A few canvas-sized bitmaps, refilled as the animation plays
+        auto compositor = std::make_shared<GifCompositor>(decoded.animation);
+        if (compositor->GetFrameCount() == 0) return false;
+
+        UINT frame = image.currentFrame < compositor->GetFrameCount() ? image.currentFrame : 0;
+        const PixelBuffer& canvas = compositor->Compose(frame);
+        compositor->TakeDirtyRect();  // Every bitmap starts with the whole canvas
+        std::vector<ComPtr<ID2D1Bitmap>> ring;
+        for (UINT i = 0; i < DISPLAY_RING_SIZE; ++i) {
+            auto bitmap = CreateBitmapFromBuffer(canvas);
+            if (!bitmap) return false;
+            ring.push_back(bitmap);
+        }
+
+        // A streamed animation starts again from its first frame (the only one held) and
+        // has the frames after it composited ahead on the pool
+        size_t compositeBytes = compositor->ByteSize();
+        if (decoded.frameSource && m_pool) {
+            image.stream = std::make_shared<GifStream>(decoded.frameSource, decoded.frameDelays.size(),
+                canvas.width, canvas.height, m_pool, frame + 1);
+            compositeBytes = image.stream->ByteSize();
+        } else {
+            image.compositor = std::move(compositor);
+        }
+
+        image.frames = std::move(ring);
+        image.staleRects.assign(image.frames.size(), GifCompositor::Rect{});
+        image.currentFrame = frame;
+        image.bitmap = image.frames.front();
+        image.gpuBytes = DISPLAY_RING_SIZE * canvas.ByteSize() + compositeBytes;
+        return true;
+    } else if (!decoded.planar.IsEmpty()) {
+        // Expanded only for the upload; the cache keeps the smaller planes
+        PixelBuffer expanded;
+        if (!YCbCrConverter::ConvertToBgra(decoded.planar, expanded)) return false;
+        image.bitmap = CreateBitmapFromBuffer(expanded);
+        if (!image.bitmap) return false;
+        image.gpuBytes = expanded.ByteSize();
+        return true;
+    } else if (!decoded.compressed.IsEmpty()) {
+        image.bitmap = CreateBitmapFromBlocks(decoded.compressed);
+        if (image.bitmap) {
+            image.contentWidth = decoded.compressed.width;
+            image.contentHeight = decoded.compressed.height;
+        } else {
+            // Device without block-compressed bitmaps: expand for the upload instead
+            PixelBuffer expanded;
+            if (!BlockCompressor::Decompress(decoded.compressed, expanded)) return false;
+            image.bitmap = CreateBitmapFromBuffer(expanded);
+            if (!image.bitmap) return false;
+            image.contentWidth = 0;
+            image.contentHeight = 0;
+            image.gpuBytes = expanded.ByteSize();
+            return true;
+        }
+    } else {
+        image.bitmap = CreateBitmapFromBuffer(decoded.image);
+        if (!image.bitmap) return false;
+    }
+
+    image.gpuBytes = decoded.ByteSize();
+    return true;
+}
+
+void ImageLoader::Release(ImageData& image) {
+    image.bitmap.Reset();
+    image.contentWidth = 0;
+    image.contentHeight = 0;
+    image.frames.clear();
+    image.staleRects.clear();
+    image.compositor.reset();
+    image.stream.reset();
+    image.gpuBytes = 0;
+}
+
+bool ImageLoader::ShowFrame(ImageData& image, UINT frame) {
+    if (!image.isAnimated || image.frames.empty() || image.staleRects.size() != image.frames.size()) {
+        return false;
+    }
+
+    // A streamed frame may still be on its way; the caller tries again shortly
+    PixelBuffer streamed;
+    const PixelBuffer* source = nullptr;
+    GifCompositor::Rect changed = {};
+    if (image.stream) {
+        if (!image.stream->TakeFrame(frame, streamed, changed)) return false;
+        source = &streamed;
+    } else {
+        if (!image.compositor || frame >= image.compositor->GetFrameCount()) return false;
+        source = &image.compositor->Compose(frame);
+        changed = image.compositor->TakeDirtyRect();
+    }
+    const PixelBuffer& canvas = *source;
+
+    // Every display bitmap now lags the canvas by what changed
+    for (auto& stale : image.staleRects) {
+        stale = GifCompositor::Union(stale, changed);
+    }
+
+    // Fill the ring slot not on screen, so drawing never waits for the copy
+    auto slot = std::find_if(image.frames.begin(), image.frames.end(),
+        [&image](const ComPtr<ID2D1Bitmap>& bitmap) { return bitmap != image.bitmap; });
+    if (slot == image.frames.end()) slot = image.frames.begin();
+    size_t slotIndex = static_cast<size_t>(slot - image.frames.begin());
+
+    GifCompositor::Rect& stale = image.staleRects[slotIndex];
+    if (!stale.IsEmpty()) {
+        D2D1_RECT_U rect = D2D1::RectU(stale.left, stale.top, stale.right, stale.bottom);
+        const uint8_t* first = canvas.pixels.data() + static_cast<size_t>(stale.top) * canvas.stride +
+            static_cast<size_t>(stale.left) * BYTES_PER_PIXEL;
+        HRESULT hr = (*slot)->CopyFromMemory(&rect, first, canvas.stride);
+        if (FAILED(hr)) return false;
+        stale = {};
+    }
+
+    image.currentFrame = frame;
+    image.bitmap = *slot;
+    return true;
+}
+
 void ImageLoader::LoadImageAsync(const std::wstring& filePath,
     std::function<void(std::shared_ptr<ImageData>)> callback) {
     // Note: For true async loading, we'd need to handle D2D resources on the main thread
@@ -63,39 +315,94 @@ void ImageLoader::LoadImageAsync(const std::wstring& filePath,
     }
 }
 
-ComPtr<ID2D1Bitmap> ImageLoader::LoadBitmapFromFile(const std::wstring& filePath) {
-    ComPtr<IWICBitmapDecoder> decoder;
-    HRESULT hr = m_wicFactory->CreateDecoderFromFilename(
-        filePath.c_str(),
-        nullptr,
-        GENERIC_READ,
-        WICDecodeMetadataCacheOnDemand,
-        &decoder
-    );
-    if (FAILED(hr)) return nullptr;
-
-    ComPtr<IWICBitmapFrameDecode> frame;
-    hr = decoder->GetFrame(0, &frame);
-    if (FAILED(hr)) return nullptr;
-
+bool ImageLoader::CopyToPixelBuffer(IWICImagingFactory* wicFactory, IWICBitmapSource* source,
+    PixelBuffer& out, const CancellationToken& token) {
     ComPtr<IWICFormatConverter> converter;
-    hr = m_wicFactory->CreateFormatConverter(&converter);
-    if (FAILED(hr)) return nullptr;
+    HRESULT hr = wicFactory->CreateFormatConverter(&converter);
+    if (FAILED(hr)) return false;
 
     hr = converter->Initialize(
-        frame.Get(),
+        source,
         WIC_PIXEL_FORMAT_PREMULTIPLIED,
         WICBitmapDitherTypeNone,
         nullptr,
         0.0f,
         WICBitmapPaletteTypeMedianCut
     );
+    if (FAILED(hr)) return false;
+
+    UINT width = 0, height = 0;
+    hr = converter->GetSize(&width, &height);
+    if (FAILED(hr) || width == 0 || height == 0) return false;
+
+    UINT stride = width * BYTES_PER_PIXEL;
+    size_t bufferSize = static_cast<size_t>(stride) * height;
+    if (bufferSize > UINT_MAX) return false;
+
+    out.pixels.resize(bufferSize);
+
+    // Copy in horizontal bands so an unwanted decode can be abandoned part-way
+    for (UINT y = 0; y < height; y += DECODE_BAND_ROWS) {
+        if (IsCancelled(token)) {
+            out.pixels.clear();
+            return false;
+        }
+
+        UINT rows = std::min(DECODE_BAND_ROWS, height - y);
+        WICRect band = { 0, static_cast<INT>(y), static_cast<INT>(width), static_cast<INT>(rows) };
+        BYTE* dest = out.pixels.data() + static_cast<size_t>(y) * stride;
+        hr = converter->CopyPixels(&band, stride, stride * rows, dest);
+        if (FAILED(hr)) {
+            out.pixels.clear();
+            return false;
+        }
+    }
+
+    out.width = width;
+    out.height = height;
+    out.stride = stride;
+    return true;
+}
+
+ComPtr<ID2D1Bitmap> ImageLoader::CreateBitmapFromBuffer(const PixelBuffer& buffer) {
+    if (buffer.IsEmpty()) return nullptr;
+
+    D2D1_BITMAP_PROPERTIES1 bitmapProps = D2D1::BitmapProperties1(
+        D2D1_BITMAP_OPTIONS_NONE,
+        D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED)
+    );
+
+    ComPtr<ID2D1Bitmap1> bitmap;
+    HRESULT hr = m_deviceContext->CreateBitmap(
+        D2D1::SizeU(buffer.width, buffer.height),
+        buffer.pixels.data(),
+        buffer.stride,
+        bitmapProps,
+        &bitmap
+    );
     if (FAILED(hr)) return nullptr;
 
-    ComPtr<ID2D1Bitmap> bitmap;
-    hr = m_deviceContext->CreateBitmapFromWicBitmap(
-        converter.Get(),
-        nullptr,
+    return bitmap;
+}
+
+ComPtr<ID2D1Bitmap> ImageLoader::CreateBitmapFromBlocks(const BlockImage& blocks) {
+    if (blocks.IsEmpty()) return nullptr;
+
+    DXGI_FORMAT format = blocks.format == BlockFormat::BC1 ? DXGI_FORMAT_BC1_UNORM : DXGI_FORMAT_BC3_UNORM;
+    if (!m_deviceContext->IsDxgiFormatSupported(format)) return nullptr;
+
+    // Block-compressed bitmaps must cover whole blocks; the padding is never drawn
+    D2D1_BITMAP_PROPERTIES1 bitmapProps = D2D1::BitmapProperties1(
+        D2D1_BITMAP_OPTIONS_NONE,
+        D2D1::PixelFormat(format, D2D1_ALPHA_MODE_PREMULTIPLIED)
+    );
+
+    ComPtr<ID2D1Bitmap1> bitmap;
+    HRESULT hr = m_deviceContext->CreateBitmap(
+        D2D1::SizeU(blocks.BlocksWide() * BlockImage::BLOCK_SIZE, blocks.BlocksHigh() * BlockImage::BLOCK_SIZE),
+        blocks.blocks.data(),
+        blocks.Pitch(),
+        bitmapProps,
         &bitmap
     );
     if (FAILED(hr)) return nullptr;
@@ -103,106 +410,428 @@ ComPtr<ID2D1Bitmap> ImageLoader::LoadBitmapFromFile(const std::wstring& filePath
     return bitmap;
 }
 
-std::shared_ptr<ImageData> ImageLoader::LoadAnimatedGif(const std::wstring& filePath) {
+ComPtr<IWICBitmapDecoder> ImageLoader::CreateDecoder(IWICImagingFactory* wicFactory,
+    const std::wstring& filePath, const EncodedBuffer& encoded) {
     ComPtr<IWICBitmapDecoder> decoder;
-    HRESULT hr = m_wicFactory->CreateDecoderFromFilename(
+    if (encoded && !encoded->empty()) {
+        // The stream holds a reference to the bytes (a mapped file is read in place), so
+        // the decoder and any frames it hands out keep them alive on their own
+        ComPtr<IStream> stream = MappedFile::CreateStream(encoded);
+        if (stream && SUCCEEDED(wicFactory->CreateDecoderFromStream(stream.Get(), nullptr,
+            WICDecodeMetadataCacheOnDemand, &decoder))) {
+            return decoder;
+        }
+    }
+
+    HRESULT hr = wicFactory->CreateDecoderFromFilename(
         filePath.c_str(),
         nullptr,
         GENERIC_READ,
         WICDecodeMetadataCacheOnDemand,
         &decoder
     );
+    CHECK_HR_RETURN_NULL(hr);
+    return decoder;
+}
+
+bool ImageLoader::DecodeBitmapFromFile(IWICImagingFactory* wicFactory, const std::wstring& filePath,
+    const EncodedBuffer& encoded, UINT maxWidth, UINT maxHeight, bool keepPlanar,
+    DecodedImage& out, const CancellationToken& token) {
+    ComPtr<IWICBitmapDecoder> decoder = CreateDecoder(wicFactory, filePath, encoded);
+    if (!decoder) return false;
+
+    ComPtr<IWICBitmapFrameDecode> frame;
+    HRESULT hr = decoder->GetFrame(0, &frame);
+    if (FAILED(hr)) return false;
+
+    UINT width = 0, height = 0;
+    hr = frame->GetSize(&width, &height);
+    if (FAILED(hr) || width == 0 || height == 0) return false;
+
+    out.sourceWidth = width;
+    out.sourceHeight = height;
+    out.isFullResolution = true;
+
+    // A JPEG shown at its own size can stay in YCbCr, at about 1.5 bytes per pixel
+    bool fits = maxWidth == 0 || maxHeight == 0 || (width <= maxWidth && height <= maxHeight);
+    GUID container = {};
+    if (keepPlanar && fits && SUCCEEDED(decoder->GetContainerFormat(&container)) &&
+        container == GUID_ContainerFormatJpeg) {
+        if (CopyToPlanar(frame.Get(), width, height, out.planar, token)) {
+            return true;
+        }
+        if (IsCancelled(token)) return false;
+    }
+
+    // Scale to fit the requested box while decoding, so large photos never materialise at
+    // full size just to be shown fit-to-window
+    ComPtr<IWICBitmapSource> source = frame;
+    if (maxWidth > 0 && maxHeight > 0 && (width > maxWidth || height > maxHeight)) {
+        double scale = std::min(static_cast<double>(maxWidth) / width,
+            static_cast<double>(maxHeight) / height);
+        UINT scaledWidth = std::max<UINT>(1, static_cast<UINT>(width * scale + 0.5));
+        UINT scaledHeight = std::max<UINT>(1, static_cast<UINT>(height * scale + 0.5));
+
+        // Let the decoder do most of the reduction, so the full-size image is never produced
+        ComPtr<IWICBitmapSource> reduced = DecodeAtNativeScale(wicFactory, frame.Get(), width, height,
+            scaledWidth, scaledHeight);
+        if (IsCancelled(token)) return false;
+        if (reduced) {
+            source = reduced;
+        }
+
+        UINT sourceWidth = 0, sourceHeight = 0;
+        hr = source->GetSize(&sourceWidth, &sourceHeight);
+        if (SUCCEEDED(hr) && (sourceWidth != scaledWidth || sourceHeight != scaledHeight)) {
+            ComPtr<IWICBitmapScaler> scaler;
+            hr = wicFactory->CreateBitmapScaler(&scaler);
+            if (SUCCEEDED(hr)) {
+                hr = scaler->Initialize(source.Get(), scaledWidth, scaledHeight, WICBitmapInterpolationModeFant);
+            }
+            if (SUCCEEDED(hr)) {
+                source = scaler;
+            }
+        }
+        if (SUCCEEDED(hr)) {
+            out.isFullResolution = false;
+        } else {
+            source = frame;
+        }
+    }
+
+    return CopyToPixelBuffer(wicFactory, source.Get(), out.image, token);
+}
+
+ComPtr<IWICBitmapSource> ImageLoader::DecodeAtNativeScale(IWICImagingFactory* wicFactory,
+    IWICBitmapFrameDecode* frame, UINT width, UINT height, UINT minWidth, UINT minHeight) {
+    ComPtr<IWICBitmapSourceTransform> transform;
+    if (FAILED(frame->QueryInterface(IID_PPV_ARGS(&transform)))) return nullptr;
+
+    // Smallest size the decoder can produce directly that still covers the target, so the
+    // resample after it only ever reduces
+    UINT nativeWidth = 0, nativeHeight = 0;
+    for (UINT factor : NATIVE_SCALE_FACTORS) {
+        UINT candidateWidth = (width + factor - 1) / factor;
+        UINT candidateHeight = (height + factor - 1) / factor;
+        if (candidateWidth < minWidth || candidateHeight < minHeight) continue;
+
+        HRESULT hr = transform->GetClosestSize(&candidateWidth, &candidateHeight);
+        if (SUCCEEDED(hr) && candidateWidth >= minWidth && candidateHeight >= minHeight &&
+            candidateWidth < width && candidateHeight < height) {
+            nativeWidth = candidateWidth;
+            nativeHeight = candidateHeight;
+            break;
+        }
+    }
+    if (nativeWidth == 0) return nullptr;
+
+    WICPixelFormatGUID format = WIC_PIXEL_FORMAT_PREMULTIPLIED;
+    HRESULT hr = transform->GetClosestPixelFormat(&format);
     if (FAILED(hr)) return nullptr;
 
-    UINT frameCount = 0;
-    hr = decoder->GetFrameCount(&frameCount);
-    if (FAILED(hr) || frameCount == 0) return nullptr;
+    ComPtr<IWICBitmap> bitmap;
+    hr = wicFactory->CreateBitmap(nativeWidth, nativeHeight, format, WICBitmapCacheOnLoad, &bitmap);
+    if (FAILED(hr)) return nullptr;
 
-    auto imageData = std::make_shared<ImageData>();
-    imageData->filePath = filePath;
-    imageData->isAnimated = (frameCount > 1);
+    {
+        WICRect rect = { 0, 0, static_cast<INT>(nativeWidth), static_cast<INT>(nativeHeight) };
+        ComPtr<IWICBitmapLock> lock;
+        hr = bitmap->Lock(&rect, WICBitmapLockWrite, &lock);
+        if (FAILED(hr)) return nullptr;
+
+        UINT stride = 0, bufferSize = 0;
+        BYTE* data = nullptr;
+        hr = lock->GetStride(&stride);
+        if (SUCCEEDED(hr)) {
+            hr = lock->GetDataPointer(&bufferSize, &data);
+        }
+        if (SUCCEEDED(hr)) {
+            hr = transform->CopyPixels(nullptr, nativeWidth, nativeHeight, &format,
+                WICBitmapTransformRotate0, stride, bufferSize, data);
+        }
+        if (FAILED(hr)) return nullptr;
+    }
 
-    // Get global metadata for canvas size
-    UINT canvasWidth = 0, canvasHeight = 0;
+    return bitmap;
+}
 
-    ComPtr<IWICMetadataQueryReader> globalMetadata;
-    if (SUCCEEDED(decoder->GetMetadataQueryReader(&globalMetadata))) {
-        PROPVARIANT propValue;
-        PropVariantInit(&propValue);
+bool ImageLoader::CopyToPlanar(IWICBitmapFrameDecode* frame, UINT width, UINT height,
+    PlanarYCbCr& out, const CancellationToken& token) {
+    // Needs the Windows 8.1 JPEG decoder; anything else falls back to BGRA
+    ComPtr<IWICPlanarBitmapSourceTransform> transform;
+    if (FAILED(frame->QueryInterface(IID_PPV_ARGS(&transform)))) return false;
+
+    const WICPixelFormatGUID formats[PLANE_COUNT] = {
+        GUID_WICPixelFormat8bppY, GUID_WICPixelFormat8bppCb, GUID_WICPixelFormat8bppCr
+    };
+    WICBitmapPlaneDescription descriptions[PLANE_COUNT] = {};
+    UINT planeWidth = width, planeHeight = height;
+    BOOL supported = FALSE;
+    HRESULT hr = transform->DoesSupportTransform(&planeWidth, &planeHeight, WICBitmapTransformRotate0,
+        WICPlanarOptionsDefault, formats, descriptions, PLANE_COUNT, &supported);
+    if (FAILED(hr) || !supported || planeWidth != width || planeHeight != height ||
+        descriptions[0].Width != width || descriptions[0].Height != height) {
+        return false;
+    }
 
-        if (SUCCEEDED(globalMetadata->GetMetadataByName(GIF_METADATA_WIDTH, &propValue))) {
-            canvasWidth = propValue.uiVal;
-            PropVariantClear(&propValue);
+    UINT chromaWidth = descriptions[1].Width;
+    UINT chromaHeight = descriptions[1].Height;
+    if (chromaWidth == 0 || chromaHeight == 0 ||
+        descriptions[2].Width != chromaWidth || descriptions[2].Height != chromaHeight) {
+        return false;
+    }
+
+    out.y.resize(static_cast<size_t>(width) * height);
+    out.cb.resize(static_cast<size_t>(chromaWidth) * chromaHeight);
+    out.cr.resize(out.cb.size());
+
+    // Copy in bands like CopyToPixelBuffer; DECODE_BAND_ROWS is a multiple of the JPEG
+    // block height, so each band starts on a whole chroma row
+    UINT verticalFactor = (height + chromaHeight - 1) / chromaHeight;
+    for (UINT y = 0; y < height; y += DECODE_BAND_ROWS) {
+        if (IsCancelled(token)) {
+            out = PlanarYCbCr();
+            return false;
+        }
+
+        UINT rows = std::min(DECODE_BAND_ROWS, height - y);
+        UINT chromaY = y / verticalFactor;
+        UINT chromaRows = std::min((rows + verticalFactor - 1) / verticalFactor, chromaHeight - chromaY);
+        size_t chromaOffset = static_cast<size_t>(chromaY) * chromaWidth;
+
+        WICBitmapPlane planes[PLANE_COUNT] = {
+            { formats[0], out.y.data() + static_cast<size_t>(y) * width, width, width * rows },
+            { formats[1], out.cb.data() + chromaOffset, chromaWidth, chromaWidth * chromaRows },
+            { formats[2], out.cr.data() + chromaOffset, chromaWidth, chromaWidth * chromaRows },
+        };
+        WICRect band = { 0, static_cast<INT>(y), static_cast<INT>(width), static_cast<INT>(rows) };
+        hr = transform->CopyPixels(&band, width, rows, WICBitmapTransformRotate0,
+            WICPlanarOptionsDefault, planes, PLANE_COUNT);
+        if (FAILED(hr)) {
+            out = PlanarYCbCr();
+            return false;
+        }
+    }
+
+    out.width = width;
+    out.height = height;
+    out.chromaWidth = chromaWidth;
+    out.chromaHeight = chromaHeight;
+    return true;
+}
+
+// Read a small unsigned metadata value, whatever integer or boolean type it is stored as
+static bool ReadMetadataUInt(IWICMetadataQueryReader* reader, LPCWSTR name, UINT& value) {
+    PROPVARIANT propValue;
+    PropVariantInit(&propValue);
+    if (FAILED(reader->GetMetadataByName(name, &propValue))) return false;
+
+    bool ok = true;
+    switch (propValue.vt) {
+    case VT_UI1:  value = propValue.bVal; break;
+    case VT_UI2:  value = propValue.uiVal; break;
+    case VT_UI4:  value = propValue.ulVal; break;
+    case VT_BOOL: value = propValue.boolVal ? 1 : 0; break;
+    default:      ok = false; break;
+    }
+    PropVariantClear(&propValue);
+    return ok;
+}
+
+// Frames of a streamed GIF, read through the decoder that found them. That decoder reads
+// the file's encoded bytes (see CreateDecoder), so no file handle stays open while it plays.
+class ImageLoader::StreamedGifSource : public GifFrameSource {
+public:
+    StreamedGifSource(ComPtr<IWICImagingFactory> wicFactory, ComPtr<IWICBitmapDecoder> decoder)
+        : m_wicFactory(std::move(wicFactory)), m_decoder(std::move(decoder)) {}
+
+    bool ReadFrame(size_t index, GifFrame& frame, std::vector<uint32_t>& palette) override {
+        // Pool workers share the MTA, but one decoder must not be used by two at once
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ComPtr<IWICBitmapFrameDecode> source;
+        if (index > UINT_MAX || FAILED(m_decoder->GetFrame(static_cast<UINT>(index), &source))) {
+            return false;
         }
-        if (SUCCEEDED(globalMetadata->GetMetadataByName(GIF_METADATA_HEIGHT, &propValue))) {
-            canvasHeight = propValue.uiVal;
-            PropVariantClear(&propValue);
+
+        GifAnimation scratch;
+        frame = GifFrame();
+        if (!ReadGifFrame(m_wicFactory.Get(), source.Get(), scratch, frame) ||
+            frame.palette >= scratch.palettes.size()) {
+            return false;
         }
+        palette = std::move(scratch.palettes[frame.palette]);
+        return true;
     }
 
-    // Create a canvas bitmap for compositing frames
-    ComPtr<IWICBitmap> canvas;
-    if (canvasWidth > 0 && canvasHeight > 0) {
-        m_wicFactory->CreateBitmap(canvasWidth, canvasHeight,
-            WIC_PIXEL_FORMAT_PREMULTIPLIED, WICBitmapCacheOnLoad, &canvas);
+private:
+    std::mutex m_mutex;
+    ComPtr<IWICImagingFactory> m_wicFactory;
+    ComPtr<IWICBitmapDecoder> m_decoder;
+};
+
+std::shared_ptr<DecodedImage> ImageLoader::DecodeAnimatedGif(IWICImagingFactory* wicFactory,
+    const std::wstring& filePath, const EncodedBuffer& encoded, size_t animationCacheBytes,
+    const CancellationToken& token) {
+    ComPtr<IWICBitmapDecoder> decoder = CreateDecoder(wicFactory, filePath, encoded);
+    if (!decoder) return nullptr;
+
+    // A single frame is decoded as a still image
+    UINT frameCount = 0;
+    HRESULT hr = decoder->GetFrameCount(&frameCount);
+    if (FAILED(hr) || frameCount < 2) return nullptr;
+
+    auto decoded = std::make_shared<DecodedImage>();
+    decoded->filePath = filePath;
+    decoded->isAnimated = true;
+
+    // Get global metadata for canvas size
+    auto animation = std::make_shared<GifAnimation>();
+    ComPtr<IWICMetadataQueryReader> globalMetadata;
+    if (SUCCEEDED(decoder->GetMetadataQueryReader(&globalMetadata))) {
+        ReadMetadataUInt(globalMetadata.Get(), GIF_METADATA_WIDTH, animation->width);
+        ReadMetadataUInt(globalMetadata.Get(), GIF_METADATA_HEIGHT, animation->height);
     }
 
+    // Too long to keep whole (judged by its canvas, which bounds every frame): read the
+    // delays now but only the first frame's indices. Frames are then numbered as in the
+    // file, and one that fails to read later just repeats the previous canvas.
+    uint64_t indexedBytes = static_cast<uint64_t>(animation->width) * animation->height * frameCount;
+    bool streamed = encoded && animation->width > 0 && animation->height > 0 &&
+        indexedBytes > animationCacheBytes;
+
     for (UINT i = 0; i < frameCount; ++i) {
+        if (IsCancelled(token)) return nullptr;
+
         ComPtr<IWICBitmapFrameDecode> frame;
         hr = decoder->GetFrame(i, &frame);
-        if (FAILED(hr)) continue;
+        if (FAILED(hr)) {
+            if (streamed && i > 0) decoded->frameDelays.push_back(DEFAULT_FRAME_DELAY_MS);
+            continue;
+        }
 
         // Get frame delay
         UINT delay = DEFAULT_FRAME_DELAY_MS;
         ComPtr<IWICMetadataQueryReader> frameMetadata;
-        if (SUCCEEDED(frame->GetMetadataQueryReader(&frameMetadata))) {
-            PROPVARIANT propValue;
-            PropVariantInit(&propValue);
-            if (SUCCEEDED(frameMetadata->GetMetadataByName(GIF_METADATA_DELAY, &propValue))) {
-                delay = propValue.uiVal * CENTISECONDS_TO_MS;
-                if (delay < MIN_FRAME_DELAY_MS) delay = DEFAULT_FRAME_DELAY_MS;
-                PropVariantClear(&propValue);
-            }
+        UINT centiseconds = 0;
+        if (SUCCEEDED(frame->GetMetadataQueryReader(&frameMetadata)) &&
+            ReadMetadataUInt(frameMetadata.Get(), GIF_METADATA_DELAY, centiseconds)) {
+            delay = centiseconds * CENTISECONDS_TO_MS;
+            if (delay < MIN_FRAME_DELAY_MS) delay = DEFAULT_FRAME_DELAY_MS;
         }
-        imageData->frameDelays.push_back(delay);
 
-        // Convert frame to BGRA
-        ComPtr<IWICFormatConverter> converter;
-        hr = m_wicFactory->CreateFormatConverter(&converter);
-        if (FAILED(hr)) continue;
+        if (streamed && i > 0) {
+            decoded->frameDelays.push_back(delay);
+            continue;
+        }
 
-        hr = converter->Initialize(
-            frame.Get(),
-            WIC_PIXEL_FORMAT_PREMULTIPLIED,
-            WICBitmapDitherTypeNone,
-            nullptr,
-            0.0f,
-            WICBitmapPaletteTypeMedianCut
-        );
-        if (FAILED(hr)) continue;
+        // Keep the palette indices of the frame's rectangle
+        GifFrame gifFrame;
+        if (!ReadGifFrame(wicFactory, frame.Get(), *animation, gifFrame)) {
+            if (streamed) return nullptr;
+            continue;
+        }
 
-        ComPtr<ID2D1Bitmap> bitmap;
-        hr = m_deviceContext->CreateBitmapFromWicBitmap(
-            converter.Get(),
-            nullptr,
-            &bitmap
-        );
-        if (FAILED(hr)) continue;
+        decoded->frameDelays.push_back(delay);
+        animation->frames.push_back(std::move(gifFrame));
+    }
 
-        imageData->frames.push_back(bitmap);
+    if (animation->frames.empty()) {
+        return nullptr;
+    }
+    if (streamed) {
+        // The source lives as long as the cached animation, so it must not keep the file
+        // mapped (that would stop anyone overwriting it); it reads from a copy instead
+        ComPtr<IWICBitmapDecoder> frameDecoder = decoder;
+        if (encoded->IsMapped()) {
+            auto copy = std::make_shared<EncodedBytes>(
+                std::vector<uint8_t>(encoded->data(), encoded->data() + encoded->size()));
+            frameDecoder = CreateDecoder(wicFactory, std::wstring(), copy);
+            if (!frameDecoder) return nullptr;
+        }
+        decoded->frameSource = std::make_shared<StreamedGifSource>(wicFactory, frameDecoder);
+    }
 
-        // Set first frame as current bitmap
-        if (i == 0) {
-            imageData->bitmap = bitmap;
-            auto size = bitmap->GetSize();
-            imageData->width = static_cast<int>(size.width);
-            imageData->height = static_cast<int>(size.height);
+    // Without a logical screen size, make the canvas big enough for every frame
+    if (animation->width == 0 || animation->height == 0) {
+        for (const auto& frame : animation->frames) {
+            animation->width = std::max(animation->width, frame.left + frame.width);
+            animation->height = std::max(animation->height, frame.top + frame.height);
         }
     }
+    decoded->sourceWidth = animation->width;
+    decoded->sourceHeight = animation->height;
+    decoded->animation = std::move(animation);
 
-    if (imageData->frames.empty()) {
-        return nullptr;
+    return decoded;
+}
+
+bool ImageLoader::ReadGifFrame(IWICImagingFactory* wicFactory, IWICBitmapFrameDecode* frame,
+    GifAnimation& animation, GifFrame& out) {
+    WICPixelFormatGUID format = {};
+    HRESULT hr = frame->GetPixelFormat(&format);
+    if (FAILED(hr) || format != GUID_WICPixelFormat8bppIndexed) return false;
+
+    UINT width = 0, height = 0;
+    hr = frame->GetSize(&width, &height);
+    if (FAILED(hr) || width == 0 || height == 0) return false;
+    out.width = width;
+    out.height = height;
+
+    // Placement, disposal and transparency from the image descriptor and control extension
+    bool hasTransparency = false;
+    UINT transparentIndex = 0;
+    ComPtr<IWICMetadataQueryReader> metadata;
+    if (SUCCEEDED(frame->GetMetadataQueryReader(&metadata))) {
+        UINT value = 0;
+        if (ReadMetadataUInt(metadata.Get(), GIF_METADATA_LEFT, value)) out.left = value;
+        if (ReadMetadataUInt(metadata.Get(), GIF_METADATA_TOP, value)) out.top = value;
+        if (ReadMetadataUInt(metadata.Get(), GIF_METADATA_DISPOSAL, value) &&
+            value <= static_cast<UINT>(GifDisposal::Previous)) {
+            out.disposal = static_cast<GifDisposal>(value);
+        }
+        if (ReadMetadataUInt(metadata.Get(), GIF_METADATA_TRANSPARENCY_FLAG, value) && value) {
+            hasTransparency = ReadMetadataUInt(metadata.Get(), GIF_METADATA_TRANSPARENT_INDEX, transparentIndex) &&
+                transparentIndex < GifAnimation::PALETTE_SIZE;
+        }
     }
 
-    return imageData;
+    // Frame palette (local, or the global one) as premultiplied BGRA
+    ComPtr<IWICPalette> wicPalette;
+    hr = wicFactory->CreatePalette(&wicPalette);
+    if (SUCCEEDED(hr)) hr = frame->CopyPalette(wicPalette.Get());
+    if (FAILED(hr)) return false;
+
+    WICColor colors[GifAnimation::PALETTE_SIZE] = {};
+    UINT colorCount = 0;
+    hr = wicPalette->GetColors(GifAnimation::PALETTE_SIZE, colors, &colorCount);
+    if (FAILED(hr)) return false;
+
+    std::vector<uint32_t> palette(GifAnimation::PALETTE_SIZE, 0);
+    for (UINT i = 0; i < colorCount; ++i) {
+        uint32_t alpha = colors[i] >> 24;
+        if (alpha == 0xFF) {
+            palette[i] = colors[i];
+        } else if (alpha != 0) {
+            auto premultiply = [alpha](uint32_t channel) { return (channel * alpha + 127) / 255; };
+            palette[i] = (alpha << 24) | (premultiply((colors[i] >> 16) & 0xFF) << 16) |
+                (premultiply((colors[i] >> 8) & 0xFF) << 8) | premultiply(colors[i] & 0xFF);
+        }
+    }
+    if (hasTransparency) {
+        palette[transparentIndex] = 0;
+        out.transparentIndex = static_cast<int>(transparentIndex);
+    }
+
+    // Frames nearly always share the global palette; store each distinct one once
+    auto existing = std::find(animation.palettes.rbegin(), animation.palettes.rend(), palette);
+    if (existing != animation.palettes.rend()) {
+        out.palette = static_cast<uint32_t>(animation.palettes.rend() - existing - 1);
+    } else {
+        out.palette = static_cast<uint32_t>(animation.palettes.size());
+        animation.palettes.push_back(std::move(palette));
+    }
+
+    out.indices.resize(static_cast<size_t>(width) * height);
+    hr = frame->CopyPixels(nullptr, width, width * height, out.indices.data());
+    return SUCCEEDED(hr);
 }
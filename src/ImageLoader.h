@@ -1,17 +1,54 @@
 #pragma once
 #include "pch.h"
+#include "DecodePipeline.h"
+#include "EncodedCache.h"
+#include "GifCompositor.h"
+#include "GifStream.h"
+#include "TaskPool.h"
 
 struct ImageData {
-    ComPtr<ID2D1Bitmap> bitmap;
+    ComPtr<ID2D1Bitmap> bitmap;  // Null while not resident on the GPU (see pixels)
     std::wstring filePath;
+    std::wstring cacheKey;       // File version this was decoded from (see FileIdentity)
     int width = 0;
     int height = 0;
 
-    // For animated GIF
+    // Resolution level held by bitmap (width/height are always the original image size)
+    ImageLevel level = ImageLevel::Full;
+    bool isFullResolution = true;
+
+    // For animated GIF. Frames are composited from pixels->animation when shown, into a
+    // small ring of display bitmaps (see ImageLoader::ShowFrame). A streamed animation
+    // takes its frames from stream instead, composited ahead on the task pool.
     bool isAnimated = false;
-    std::vector<ComPtr<ID2D1Bitmap>> frames;
+    std::vector<ComPtr<ID2D1Bitmap>> frames;  // Display ring, not one bitmap per frame
     std::vector<UINT> frameDelays; // in milliseconds
     UINT currentFrame = 0;
+    std::shared_ptr<GifCompositor> compositor;
+    std::shared_ptr<GifStream> stream;
+    std::vector<GifCompositor::Rect> staleRects;  // Per display bitmap: area it lags the canvas by
+
+    UINT GetFrameCount() const { return static_cast<UINT>(frameDelays.size()); }
+
+    // CPU copy of the decoded pixels. Device bitmaps are only kept for images near the
+    // current one and are recreated from this (not re-decoded) when promoted again or
+    // after the device is lost.
+    std::shared_ptr<const DecodedImage> pixels;
+
+    // Memory held by pixels and by bitmap/frames (for cache accounting)
+    size_t cpuBytes = 0;
+    size_t gpuBytes = 0;
+
+    // Pixels of bitmap holding the image when it is block-compressed and padded to whole
+    // blocks (0: the whole bitmap). Draw with this as the source rect.
+    UINT contentWidth = 0;
+    UINT contentHeight = 0;
+
+    bool IsResident() const { return bitmap != nullptr; }
+
+    // Downscaled stand-in from the preview store, shown until the full decode arrives
+    // (width/height still describe the original image)
+    bool isPreview = false;
 };
 
 class ImageLoader {
@@ -21,8 +58,64 @@ public:
 
     void Initialize(ID2D1DeviceContext* deviceContext, IWICImagingFactory* wicFactory);
 
-    // Load image from file path (synchronous)
-    std::shared_ptr<ImageData> LoadImage(const std::wstring& filePath);
+    // Pool that composites streamed animations ahead of playback (without one they show
+    // only their first frame)
+    void SetTaskPool(TaskPool* pool) { m_pool = pool; }
+
+    // Load image from file path (synchronous). A non-zero maxWidth/maxHeight decodes it
+    // straight to the size that fits that box (see DecodeImage) rather than at full size.
+    std::shared_ptr<ImageData> LoadImage(const std::wstring& filePath, UINT maxWidth = 0,
+        UINT maxHeight = 0);
+
+    // Decode image to CPU pixel buffers (safe to call from any thread with its own WIC factory).
+    // A non-zero maxWidth/maxHeight scales still images down to fit that box while decoding:
+    // the decoder reduces what it can natively (JPEG DCT scaling to 1/2, 1/4 or 1/8) and a
+    // Fant resample takes it the rest of the way.
+    // If encoded holds the file's bytes (a copy or a mapping) they are decoded in place
+    // instead of opening the file again.
+    // With keepPlanar, a JPEG decoded at its full size is kept as YCbCr planes (see
+    // PlanarYCbCr) and only expanded to BGRA by Upload.
+    // An animated GIF whose indexed frames would take more than animationCacheBytes is
+    // streamed: only its first frame is decoded here, and the rest are read from encoded
+    // as it plays. Without encoded bytes every frame is decoded.
+    // Returns nullptr early if the token is cancelled mid-decode.
+    static std::shared_ptr<DecodedImage> DecodeImage(IWICImagingFactory* wicFactory,
+        const std::wstring& filePath, const CancellationToken& token = nullptr,
+        UINT maxWidth = 0, UINT maxHeight = 0, const EncodedBuffer& encoded = nullptr,
+        bool keepPlanar = false, size_t animationCacheBytes = DEFAULT_ANIMATION_CACHE_BYTES);
+
+    // Device bitmap from CPU pixels (UI thread only; nullptr on failure)
+    ComPtr<ID2D1Bitmap> CreateBitmapFromBuffer(const PixelBuffer& buffer);
+
+    // Decode the preview a camera embedded in a JPEG's header (see ExifPreview), fitted to
+    // the box, as a stand-in for the image (sourceWidth/sourceHeight give the main image's
+    // size). Reads only the header and the preview, or slices them out of encoded when the
+    // file's bytes are already in memory; nullptr if there is none.
+    static std::shared_ptr<DecodedImage> DecodeEmbeddedPreview(IWICImagingFactory* wicFactory,
+        const std::wstring& filePath, UINT maxWidth, UINT maxHeight,
+        const EncodedBuffer& encoded = nullptr);
+
+    // Per-thread COM apartment and WIC factory for pool workers (pass as TaskPool thread hooks)
+    static void InitializeWorkerThread();
+    static void UninitializeWorkerThread();
+    static IWICImagingFactory* GetWorkerWicFactory();
+
+    // Factory for decodes on the UI thread
+    IWICImagingFactory* GetWicFactory() const { return m_wicFactory; }
+
+    // Wrap a decoded image, creating its GPU bitmaps unless upload is false (UI thread only)
+    std::shared_ptr<ImageData> CreateImageData(std::shared_ptr<const DecodedImage> decoded,
+        bool upload = true);
+
+    // Create the device bitmaps of an image from its CPU pixels, or drop them again
+    // (UI thread only)
+    bool Upload(ImageData& image);
+    static void Release(ImageData& image);
+
+    // Composite an animation frame into the next display bitmap and make it current,
+    // copying only the area that bitmap has not caught up with (UI thread only, image
+    // must be resident)
+    bool ShowFrame(ImageData& image, UINT frame);
 
     // Load image asynchronously
     void LoadImageAsync(const std::wstring& filePath,
@@ -31,16 +124,53 @@ public:
     // Check if file is a supported image format
     static bool IsSupportedFormat(const std::wstring& filePath);
 
+    // Animations up to this size (as palette indices) are decoded whole and kept
+    static constexpr size_t DEFAULT_ANIMATION_CACHE_BYTES = 16ull * 1024 * 1024;
+
+    // Decoder over encoded when given (the decoder keeps the bytes alive), otherwise
+    // over the file
+    static ComPtr<IWICBitmapDecoder> CreateDecoder(IWICImagingFactory* wicFactory,
+        const std::wstring& filePath, const EncodedBuffer& encoded = nullptr);
+
 private:
-    ComPtr<ID2D1Bitmap> LoadBitmapFromFile(const std::wstring& filePath);
-    std::shared_ptr<ImageData> LoadAnimatedGif(const std::wstring& filePath);
+    class StreamedGifSource;
+
+    static bool DecodeBitmapFromFile(IWICImagingFactory* wicFactory, const std::wstring& filePath,
+        const EncodedBuffer& encoded, UINT maxWidth, UINT maxHeight, bool keepPlanar,
+        DecodedImage& out, const CancellationToken& token);
+    static ComPtr<IWICBitmapSource> DecodeAtNativeScale(IWICImagingFactory* wicFactory,
+        IWICBitmapFrameDecode* frame, UINT width, UINT height, UINT minWidth, UINT minHeight);
+    static bool CopyToPlanar(IWICBitmapFrameDecode* frame, UINT width, UINT height,
+        PlanarYCbCr& out, const CancellationToken& token);
+    static std::shared_ptr<DecodedImage> DecodeAnimatedGif(IWICImagingFactory* wicFactory,
+        const std::wstring& filePath, const EncodedBuffer& encoded, size_t animationCacheBytes,
+        const CancellationToken& token);
+    static bool CopyToPixelBuffer(IWICImagingFactory* wicFactory, IWICBitmapSource* source,
+        PixelBuffer& out, const CancellationToken& token);
+    ComPtr<ID2D1Bitmap> CreateBitmapFromBlocks(const BlockImage& blocks);
+    static bool ReadGifFrame(IWICImagingFactory* wicFactory, IWICBitmapFrameDecode* frame,
+        GifAnimation& animation, GifFrame& out);
 
     ID2D1DeviceContext* m_deviceContext = nullptr;
     IWICImagingFactory* m_wicFactory = nullptr;
+    TaskPool* m_pool = nullptr;
 
     static const std::vector<std::wstring> s_supportedExtensions;
 
+    // Decoded pixel format (32bpp premultiplied BGRA)
+    static constexpr UINT BYTES_PER_PIXEL = 4;
+
+    // Rows copied per CopyPixels call; cancellation is checked between bands
+    static constexpr UINT DECODE_BAND_ROWS = 256;
+
+    // Decoder-native reductions tried for scaled decodes, largest first (JPEG supports these)
+    static constexpr UINT NATIVE_SCALE_FACTORS[] = { 8, 4, 2 };
+
+    // Y, Cb and Cr for planar JPEG decodes
+    static constexpr UINT PLANE_COUNT = 3;
+
     // GIF animation constants
+    static constexpr UINT DISPLAY_RING_SIZE = 2;  // Draw one while the next is filled
     static constexpr UINT DEFAULT_FRAME_DELAY_MS = 100;
     static constexpr UINT MIN_FRAME_DELAY_MS = 20;
     static constexpr UINT CENTISECONDS_TO_MS = 10;
@@ -49,4 +179,9 @@ private:
     static constexpr wchar_t GIF_METADATA_WIDTH[] = L"/logscrdesc/Width";
     static constexpr wchar_t GIF_METADATA_HEIGHT[] = L"/logscrdesc/Height";
     static constexpr wchar_t GIF_METADATA_DELAY[] = L"/grctlext/Delay";
+    static constexpr wchar_t GIF_METADATA_DISPOSAL[] = L"/grctlext/Disposal";
+    static constexpr wchar_t GIF_METADATA_TRANSPARENCY_FLAG[] = L"/grctlext/TransparencyFlag";
+    static constexpr wchar_t GIF_METADATA_TRANSPARENT_INDEX[] = L"/grctlext/TransparentColorIndex";
+    static constexpr wchar_t GIF_METADATA_LEFT[] = L"/imgdesc/Left";
+    static constexpr wchar_t GIF_METADATA_TOP[] = L"/imgdesc/Top";
 };
@@ -0,0 +1,137 @@
+#pragma once
+// Platform-neutral O(1) LRU index: a hash map from key to a stable handle, plus an
+// intrusive doubly linked recency list threaded through a slab of nodes. Touch, insert
+// and evict never copy or compare key strings beyond the initial hash lookup.
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template <typename Value>
+class LruIndex {
+public:
+    using Handle = uint32_t;
+    static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+    // Look up a key without changing recency
+    Handle Find(const std::wstring& key) const {
+        auto it = m_map.find(key);
+        return it != m_map.end() ? it->second : INVALID_HANDLE;
+    }
+
+    Value& GetValue(Handle handle) { return m_nodes[handle].value; }
+    const Value& GetValue(Handle handle) const { return m_nodes[handle].value; }
+    const std::wstring& GetKey(Handle handle) const { return *m_nodes[handle].key; }
+
+    // Mark as most recently used
+    void Touch(Handle handle) {
+        if (handle == m_head) return;
+        Unlink(handle);
+        LinkFront(handle);
+    }
+
+    // Insert or replace; the entry becomes most recently used
+    Handle Insert(const std::wstring& key, Value value) {
+        auto [it, inserted] = m_map.try_emplace(key, INVALID_HANDLE);
+        if (!inserted) {
+            Handle handle = it->second;
+            m_nodes[handle].value = std::move(value);
+            Touch(handle);
+            return handle;
+        }
+
+        Handle handle = AllocateNode();
+        Node& node = m_nodes[handle];
+        node.value = std::move(value);
+        node.key = &it->first;  // Map node addresses are stable across rehashing
+        it->second = handle;
+        LinkFront(handle);
+        return handle;
+    }
+
+    void Erase(Handle handle) {
+        Unlink(handle);
+        m_map.erase(m_map.find(*m_nodes[handle].key));
+
+        Node& node = m_nodes[handle];
+        node.value = Value();
+        node.key = nullptr;
+        node.next = m_freeList;
+        m_freeList = handle;
+    }
+
+    bool Erase(const std::wstring& key) {
+        Handle handle = Find(key);
+        if (handle == INVALID_HANDLE) return false;
+        Erase(handle);
+        return true;
+    }
+
+    Handle MostRecent() const { return m_head; }
+    Handle LeastRecent() const { return m_tail; }
+    Handle NextOlder(Handle handle) const { return m_nodes[handle].next; }
+    Handle NextNewer(Handle handle) const { return m_nodes[handle].prev; }
+
+    size_t Size() const { return m_map.size(); }
+    bool IsEmpty() const { return m_map.empty(); }
+
+    void Clear() {
+        m_map.clear();
+        m_nodes.clear();
+        m_head = m_tail = m_freeList = INVALID_HANDLE;
+    }
+
+private:
+    struct Node {
+        Value value{};
+        const std::wstring* key = nullptr;
+        Handle prev = INVALID_HANDLE;
+        Handle next = INVALID_HANDLE;  // Doubles as free-list link for unused nodes
+    };
+
+    Handle AllocateNode() {
+        if (m_freeList != INVALID_HANDLE) {
+            Handle handle = m_freeList;
+            m_freeList = m_nodes[handle].next;
+            m_nodes[handle].next = INVALID_HANDLE;
+            return handle;
+        }
+        m_nodes.emplace_back();
+        return static_cast<Handle>(m_nodes.size() - 1);
+    }
+
+    void LinkFront(Handle handle) {
+        Node& node = m_nodes[handle];
+        node.prev = INVALID_HANDLE;
+        node.next = m_head;
+        if (m_head != INVALID_HANDLE) {
+            m_nodes[m_head].prev = handle;
+        }
+        m_head = handle;
+        if (m_tail == INVALID_HANDLE) {
+            m_tail = handle;
+        }
+    }
+
+    void Unlink(Handle handle) {
+        Node& node = m_nodes[handle];
+        if (node.prev != INVALID_HANDLE) {
+            m_nodes[node.prev].next = node.next;
+        } else {
+            m_head = node.next;
+        }
+        if (node.next != INVALID_HANDLE) {
+            m_nodes[node.next].prev = node.prev;
+        } else {
+            m_tail = node.prev;
+        }
+        node.prev = node.next = INVALID_HANDLE;
+    }
+
+    std::unordered_map<std::wstring, Handle> m_map;
+    std::vector<Node> m_nodes;
+    Handle m_head = INVALID_HANDLE;   // Most recently used
+    Handle m_tail = INVALID_HANDLE;   // Least recently used
+    Handle m_freeList = INVALID_HANDLE;
+};
@@ -0,0 +1,136 @@
+#include "pch.h"
+#include "MappedFile.h"
+#include <wrl/implements.h>
+
+namespace {
+
+// Read-only IStream over encoded bytes. Reads copy only into the decoder's own buffer.
+class EncodedStream : public Microsoft::WRL::RuntimeClass<
+    Microsoft::WRL::RuntimeClassFlags<Microsoft::WRL::ClassicCom>,
+    Microsoft::WRL::ChainInterfaces<IStream, ISequentialStream>> {
+public:
+    EncodedStream(EncodedBuffer bytes, uint64_t position) : m_bytes(std::move(bytes)), m_position(position) {}
+
+    STDMETHODIMP Read(void* buffer, ULONG count, ULONG* read) override {
+        if (!buffer) return STG_E_INVALIDPOINTER;
+        uint64_t available = m_position < m_bytes->size() ? m_bytes->size() - m_position : 0;
+        ULONG copied = static_cast<ULONG>(std::min<uint64_t>(count, available));
+        if (copied > 0) {
+            memcpy(buffer, m_bytes->data() + m_position, copied);
+            m_position += copied;
+        }
+        if (read) *read = copied;
+        return copied == count ? S_OK : S_FALSE;
+    }
+
+    STDMETHODIMP Write(const void*, ULONG, ULONG*) override { return STG_E_ACCESSDENIED; }
+
+    STDMETHODIMP Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) override {
+        int64_t base = 0;
+        switch (origin) {
+        case STREAM_SEEK_SET: base = 0; break;
+        case STREAM_SEEK_CUR: base = static_cast<int64_t>(m_position); break;
+        case STREAM_SEEK_END: base = static_cast<int64_t>(m_bytes->size()); break;
+        default: return STG_E_INVALIDFUNCTION;
+        }
+        int64_t target = base + move.QuadPart;
+        if (target < 0) return STG_E_INVALIDFUNCTION;
+
+        m_position = static_cast<uint64_t>(target);
+        if (newPosition) newPosition->QuadPart = m_position;
+        return S_OK;
+    }
+
+    STDMETHODIMP SetSize(ULARGE_INTEGER) override { return STG_E_ACCESSDENIED; }
+
+    STDMETHODIMP CopyTo(IStream* target, ULARGE_INTEGER count, ULARGE_INTEGER* read,
+        ULARGE_INTEGER* written) override {
+        if (!target) return STG_E_INVALIDPOINTER;
+        uint64_t available = m_position < m_bytes->size() ? m_bytes->size() - m_position : 0;
+        uint64_t toCopy = std::min<uint64_t>(count.QuadPart, available);
+
+        uint64_t total = 0;
+        while (total < toCopy) {
+            ULONG chunk = static_cast<ULONG>(std::min<uint64_t>(toCopy - total, ULONG_MAX));
+            ULONG chunkWritten = 0;
+            HRESULT hr = target->Write(m_bytes->data() + m_position + total, chunk, &chunkWritten);
+            total += chunkWritten;
+            if (FAILED(hr) || chunkWritten != chunk) break;
+        }
+        m_position += total;
+        if (read) read->QuadPart = total;
+        if (written) written->QuadPart = total;
+        return total == toCopy ? S_OK : STG_E_WRITEFAULT;
+    }
+
+    STDMETHODIMP Commit(DWORD) override { return S_OK; }
+    STDMETHODIMP Revert() override { return S_OK; }
+    STDMETHODIMP LockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) override { return STG_E_INVALIDFUNCTION; }
+    STDMETHODIMP UnlockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) override { return STG_E_INVALIDFUNCTION; }
+
+    STDMETHODIMP Stat(STATSTG* stat, DWORD) override {
+        if (!stat) return STG_E_INVALIDPOINTER;
+        *stat = {};
+        stat->type = STGTY_STREAM;
+        stat->cbSize.QuadPart = m_bytes->size();
+        stat->grfMode = STGM_READ | STGM_SHARE_DENY_NONE;
+        return S_OK;
+    }
+
+    STDMETHODIMP Clone(IStream** stream) override {
+        if (!stream) return STG_E_INVALIDPOINTER;
+        auto clone = Microsoft::WRL::Make<EncodedStream>(m_bytes, m_position);
+        if (!clone) return E_OUTOFMEMORY;
+        *stream = clone.Detach();
+        return S_OK;
+    }
+
+private:
+    EncodedBuffer m_bytes;
+    uint64_t m_position = 0;
+};
+
+}  // namespace
+
+bool MappedFile::IsOnFixedDrive(const std::wstring& path) {
+    wchar_t volume[MAX_PATH] = {};
+    if (!GetVolumePathNameW(path.c_str(), volume, MAX_PATH)) return false;
+    return GetDriveTypeW(volume) == DRIVE_FIXED;
+}
+
+EncodedBuffer MappedFile::Map(const std::wstring& filePath) {
+    if (!IsOnFixedDrive(filePath)) return nullptr;
+
+    // Sharing everything leaves other programs free to rename, delete or rewrite the file
+    HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0 ||
+        static_cast<uint64_t>(size.QuadPart) > SIZE_MAX) {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    // The view keeps the mapping, and the mapping the file, open after the handles close
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) return nullptr;
+
+    std::shared_ptr<const void> owner(view, [](const void* address) { UnmapViewOfFile(address); });
+    return std::make_shared<EncodedBytes>(static_cast<const uint8_t*>(view),
+        static_cast<size_t>(size.QuadPart), std::move(owner), true);
+}
+
+ComPtr<IStream> MappedFile::CreateStream(const EncodedBuffer& bytes) {
+    if (!bytes || bytes->empty()) return nullptr;
+
+    ComPtr<IStream> stream = Microsoft::WRL::Make<EncodedStream>(bytes, 0);
+    return stream;
+}
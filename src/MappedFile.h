@@ -0,0 +1,22 @@
+#pragma once
+#include "pch.h"
+#include "EncodedCache.h"
+
+// Read-only memory mappings of image files, and streams over encoded bytes for WIC. A
+// mapped file is read straight from the page cache, with no private copy and no read
+// calls beyond the page faults. Windows refuses to overwrite or truncate a file while a
+// view of it exists, so callers hold a mapping only for one decode and never cache it.
+// Files on network or removable drives are not mapped, because a vanished file would
+// fault inside the decoder; those fall back to ordinary reads.
+class MappedFile {
+public:
+    // Whole-file view (nullptr if the file is empty, unmappable or not on a fixed drive)
+    static EncodedBuffer Map(const std::wstring& filePath);
+
+    // IStream over bytes that holds a reference to them, so the bytes live exactly as long
+    // as whatever decoder reads them
+    static ComPtr<IStream> CreateStream(const EncodedBuffer& bytes);
+
+    // Whether a file or folder is on a local fixed drive, i.e. whether Map will map it
+    static bool IsOnFixedDrive(const std::wstring& path);
+};
@@ -0,0 +1,44 @@
+#include "MemoryGovernor.h"
+
+void MemoryGovernor::SetUsage(MemoryConsumer consumer, size_t bytes) {
+    m_usage[static_cast<size_t>(consumer)].store(bytes, std::memory_order_relaxed);
+}
+
+size_t MemoryGovernor::GetUsage(MemoryConsumer consumer) const {
+    return m_usage[static_cast<size_t>(consumer)].load(std::memory_order_relaxed);
+}
+
+size_t MemoryGovernor::GetTotalUsage() const {
+    size_t total = 0;
+    for (const auto& usage : m_usage) {
+        total += usage.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void MemoryGovernor::SetShedHandler(ShedStage stage, ShedFn handler) {
+    std::lock_guard<std::mutex> lock(m_shedMutex);
+    m_handlers[static_cast<size_t>(stage)] = std::move(handler);
+}
+
+size_t MemoryGovernor::Enforce() {
+    return ShedTo(m_ceiling);
+}
+
+size_t MemoryGovernor::OnLowMemory() {
+    return ShedTo(static_cast<size_t>(m_ceiling * LOW_MEMORY_FRACTION));
+}
+
+size_t MemoryGovernor::ShedTo(size_t target) {
+    std::lock_guard<std::mutex> lock(m_shedMutex);
+
+    size_t freed = 0;
+    for (const auto& handler : m_handlers) {
+        size_t total = GetTotalUsage();
+        if (total <= target) break;
+        if (handler) {
+            freed += handler(total - target);
+        }
+    }
+    return freed;
+}
@@ -0,0 +1,64 @@
+#pragma once
+// Platform-neutral process-wide memory accountant. Each subsystem reports how many bytes
+// it holds; when the total passes the ceiling, or the OS reports memory pressure, the
+// governor asks registered handlers to free memory in a fixed order, cheapest loss first.
+// The OS hook lives with the caller: anything that detects pressure (a Windows memory
+// resource notification, or a test) just calls OnLowMemory.
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+enum class MemoryConsumer {
+    DecodedImages = 0,  // Cached CPU pixels and device bitmaps, GIF frames included
+    EncodedBytes = 1,   // Raw file bytes read ahead
+    UndoHistory = 2,
+    Overlays = 3,       // Markup and text copies held for rendering
+};
+
+// Shedding order: images far from the focus are re-fetched cheaply, animation frames can
+// be rebuilt by decoding again, but dropped undo history is gone for good
+enum class ShedStage {
+    FarPrefetch = 0,
+    AnimationFrames = 1,
+    UndoHistory = 2,
+};
+
+class MemoryGovernor {
+public:
+    // Asked to free about bytesToFree; returns the bytes actually freed
+    using ShedFn = std::function<size_t(size_t bytesToFree)>;
+
+    void SetCeiling(size_t bytes) { m_ceiling = bytes; }
+    size_t GetCeiling() const { return m_ceiling; }
+
+    // Report a subsystem's current total (absolute, not a delta); safe from any thread
+    void SetUsage(MemoryConsumer consumer, size_t bytes);
+    size_t GetUsage(MemoryConsumer consumer) const;
+    size_t GetTotalUsage() const;
+
+    void SetShedHandler(ShedStage stage, ShedFn handler);
+
+    // Shed in stage order until usage is back under the ceiling. Handlers run on the
+    // calling thread (the UI thread in the app). Returns bytes freed.
+    size_t Enforce();
+
+    // Memory is short system-wide: shed down to LOW_MEMORY_FRACTION of the ceiling
+    size_t OnLowMemory();
+
+    static constexpr size_t DEFAULT_CEILING = 1536ull * 1024 * 1024;
+    static constexpr double LOW_MEMORY_FRACTION = 0.5;
+
+private:
+    static constexpr size_t CONSUMER_COUNT = 4;
+    static constexpr size_t STAGE_COUNT = 3;
+
+    size_t ShedTo(size_t target);
+
+    std::atomic<size_t> m_usage[CONSUMER_COUNT] = {};
+    std::atomic<size_t> m_ceiling{ DEFAULT_CEILING };
+
+    // Serialises shedding (handlers update usage, so they must not run concurrently)
+    std::mutex m_shedMutex;
+    ShedFn m_handlers[STAGE_COUNT];
+};
@@ -0,0 +1,109 @@
+#include "NavigationPredictor.h"
+#include <algorithm>
+#include <cmath>
+
+void NavigationPredictor::Reset(size_t index) {
+    m_lastIndex = index;
+    m_lastTimeMs = 0;
+    m_hasHistory = false;
+    m_scrubEnded = true;
+    m_velocity = 0.0;
+    m_usedEndJumps = false;
+}
+
+void NavigationPredictor::OnNavigate(size_t index, size_t totalCount, uint64_t timeMs) {
+    if (!m_hasHistory) {
+        m_lastIndex = index;
+        m_lastTimeMs = timeMs;
+        m_hasHistory = true;
+        return;
+    }
+
+    if (index == m_lastIndex) {
+        return;
+    }
+
+    size_t step = index > m_lastIndex ? index - m_lastIndex : m_lastIndex - index;
+    bool forward = index > m_lastIndex;
+
+    if (step > 1) {
+        // A jump rather than a step; once the user jumps to an end they tend to go back
+        // and forth between the ends, so keep predicting both
+        if (totalCount > 0 && (index == 0 || index == totalCount - 1)) {
+            m_usedEndJumps = true;
+        }
+        m_velocity = 0.0;
+    } else {
+        uint64_t elapsed = std::max<uint64_t>(timeMs - m_lastTimeMs, 1);
+        double sample = (forward ? 1000.0 : -1000.0) / static_cast<double>(elapsed);
+
+        bool sameDirection = (sample > 0) == (m_velocity > 0);
+        if (m_scrubEnded || elapsed > IDLE_TIMEOUT_MS || !sameDirection || m_velocity == 0.0) {
+            // First step of a new run: only trust the direction, not the speed
+            m_velocity = elapsed > IDLE_TIMEOUT_MS ? (forward ? 1.0 : -1.0) : sample;
+        } else {
+            m_velocity = VELOCITY_SMOOTHING * sample + (1.0 - VELOCITY_SMOOTHING) * m_velocity;
+        }
+    }
+
+    m_scrubEnded = false;
+    m_lastIndex = index;
+    m_lastTimeMs = timeMs;
+}
+
+void NavigationPredictor::OnScrubEnd() {
+    m_scrubEnded = true;
+}
+
+void NavigationPredictor::SetCounts(size_t baseCount, size_t maxAheadCount) {
+    m_baseCount = baseCount;
+    m_maxAheadCount = std::max(baseCount, maxAheadCount);
+}
+
+double NavigationPredictor::GetNavigationIntervalMs(uint64_t nowMs) const {
+    if (IsIdle(nowMs)) return 0.0;
+    return 1000.0 / std::abs(m_velocity);
+}
+
+bool NavigationPredictor::IsIdle(uint64_t nowMs) const {
+    return !m_hasHistory || m_scrubEnded || m_velocity == 0.0 ||
+        nowMs - m_lastTimeMs > IDLE_TIMEOUT_MS;
+}
+
+PrefetchWindow NavigationPredictor::Predict(size_t index, size_t totalCount, uint64_t nowMs) const {
+    PrefetchWindow window;
+    window.behind = m_baseCount;
+    window.ahead = m_baseCount;
+
+    if (!IsIdle(nowMs)) {
+        double speed = std::abs(m_velocity);
+        size_t lead = static_cast<size_t>(std::lround(speed * LOOKAHEAD_SECONDS));
+        size_t along = std::clamp(m_baseCount + lead, m_baseCount, m_maxAheadCount);
+        size_t against = speed >= SCRUB_SPEED ? std::min(SCRUB_BEHIND_COUNT, m_baseCount) : m_baseCount;
+
+        bool forward = m_velocity > 0;
+        window.ahead = forward ? along : against;
+        window.behind = forward ? against : along;
+    }
+
+    // Clamp to the folder bounds
+    window.behind = std::min(window.behind, index);
+    if (totalCount > 0) {
+        window.ahead = std::min(window.ahead, totalCount - 1 - std::min(index, totalCount - 1));
+    } else {
+        window.ahead = 0;
+    }
+
+    if (m_usedEndJumps && totalCount > 0) {
+        size_t first = 0;
+        size_t last = totalCount - 1;
+        if (index > window.behind) {
+            window.jumpTargets.push_back(first);
+        }
+        if (index + window.ahead < last) {
+            window.jumpTargets.push_back(last);
+        }
+    }
+
+    return window;
+}
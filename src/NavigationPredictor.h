@@ -0,0 +1,68 @@
+#pragma once
+// Platform-neutral prefetch window predictor. Tracks navigation direction and speed
+// and skews the prefetch window ahead of the user while they scrub, falling back to a
+// symmetric window when idle. Time is passed in by the caller so navigation traces
+// can be replayed deterministically.
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct PrefetchWindow {
+    size_t behind = 0;                  // Images before the current one
+    size_t ahead = 0;                   // Images after the current one
+    std::vector<size_t> jumpTargets;    // Predicted non-adjacent targets (e.g. Home/End)
+};
+
+class NavigationPredictor {
+public:
+    explicit NavigationPredictor(size_t baseCount = DEFAULT_BASE_COUNT)
+        : m_baseCount(baseCount), m_maxAheadCount(std::max(baseCount, DEFAULT_MAX_AHEAD_COUNT)) {}
+
+    // Forget history (e.g. a different folder was opened)
+    void Reset(size_t index);
+
+    // Record that the current index changed at timeMs
+    void OnNavigate(size_t index, size_t totalCount, uint64_t timeMs);
+
+    // The user released the navigation key; treat as idle from now on
+    void OnScrubEnd();
+
+    // Predict the window around index for a folder of totalCount images
+    PrefetchWindow Predict(size_t index, size_t totalCount, uint64_t nowMs) const;
+
+    // Resize the window: baseCount images each side when idle, growing to at most
+    // maxAheadCount in the direction of travel while moving
+    void SetCounts(size_t baseCount, size_t maxAheadCount);
+
+    // Milliseconds between navigations at the current speed (0 when idle)
+    double GetNavigationIntervalMs(uint64_t nowMs) const;
+
+    // Smoothed navigation speed in images per second (signed: positive = forward)
+    double GetVelocity() const { return m_velocity; }
+
+    static constexpr size_t DEFAULT_BASE_COUNT = 3;
+    static constexpr size_t DEFAULT_MAX_AHEAD_COUNT = 8;
+
+private:
+    bool IsIdle(uint64_t nowMs) const;
+
+    size_t m_baseCount;
+    size_t m_maxAheadCount;
+    size_t m_lastIndex = 0;
+    uint64_t m_lastTimeMs = 0;
+    bool m_hasHistory = false;
+    bool m_scrubEnded = true;
+    double m_velocity = 0.0;
+    bool m_usedEndJumps = false;
+
+    // Navigation slower than this is treated as idle
+    static constexpr uint64_t IDLE_TIMEOUT_MS = 600;
+    // Smoothing factor for the velocity EWMA
+    static constexpr double VELOCITY_SMOOTHING = 0.5;
+    // How far ahead (in seconds of travel) to cover while moving
+    static constexpr double LOOKAHEAD_SECONDS = 0.4;
+    // Above this speed (images/sec) the user is scrubbing and will not look back
+    static constexpr double SCRUB_SPEED = 8.0;
+    static constexpr size_t SCRUB_BEHIND_COUNT = 1;
+};
@@ -0,0 +1,87 @@
+#include "PrefetchSizer.h"
+#include <algorithm>
+#include <cmath>
+
+static std::wstring FolderKey(const std::wstring& folder, const std::wstring& format) {
+    return folder + L'|' + format;  // '|' cannot appear in a path
+}
+
+void PrefetchSizer::SetLimits(const Limits& limits) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_limits = limits;
+}
+
+PrefetchSizer::Limits PrefetchSizer::GetLimits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limits;
+}
+
+void PrefetchSizer::Update(Profile& profile, double decodeMs, double bytes) {
+    if (profile.samples == 0) {
+        profile.decodeMs = decodeMs;
+        profile.bytes = bytes;
+    } else {
+        profile.decodeMs += SAMPLE_WEIGHT * (decodeMs - profile.decodeMs);
+        profile.bytes += SAMPLE_WEIGHT * (bytes - profile.bytes);
+    }
+    ++profile.samples;
+}
+
+void PrefetchSizer::Record(const std::wstring& folder, const std::wstring& format, double decodeMs, size_t bytes) {
+    if (decodeMs < 0.0 || bytes == 0) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Update(m_formats[format], decodeMs, static_cast<double>(bytes));
+
+    if (m_folders.size() >= MAX_FOLDER_PROFILES && !m_folders.count(FolderKey(folder, format))) {
+        m_folders.clear();
+    }
+    Update(m_folders[FolderKey(folder, format)], decodeMs, static_cast<double>(bytes));
+}
+
+PrefetchSizer::Profile PrefetchSizer::GetProfile(const std::wstring& folder, const std::wstring& format) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_folders.find(FolderKey(folder, format));
+    if (it != m_folders.end()) {
+        return it->second;
+    }
+    it = m_formats.find(format);
+    if (it != m_formats.end()) {
+        return it->second;
+    }
+    return Profile();
+}
+
+size_t PrefetchSizer::GetWindowCount(const std::wstring& folder, const std::wstring& format, double intervalMs) const {
+    return ComputeWindowCount(GetProfile(folder, format), intervalMs, GetLimits());
+}
+
+size_t PrefetchSizer::ComputeWindowCount(const Profile& profile, double intervalMs, const Limits& limits) {
+    double interval = intervalMs > 0.0 ? std::max(intervalMs, 1.0) : IDLE_INTERVAL_MS;
+
+    // Images the user will pass during the covered span
+    double count = std::ceil(limits.coverMs / interval);
+
+    // Images the decoders can finish in that span; anything further would not be ready
+    // before the user got there and only takes a worker from a nearer image
+    double decodeMs = std::max(profile.decodeMs, 1.0);
+    double workers = static_cast<double>(std::max<size_t>(limits.workerCount, 1));
+    count = std::min(count, std::floor(limits.coverMs * workers / decodeMs));
+
+    // The current image and both sides of the window must fit in the budget
+    if (limits.memoryBytes > 0 && profile.bytes > 0.0) {
+        double images = static_cast<double>(limits.memoryBytes) * MEMORY_FRACTION / profile.bytes;
+        count = std::min(count, std::floor((images - 1.0) / 2.0));
+    }
+
+    if (!(count >= static_cast<double>(MIN_COUNT))) {
+        return MIN_COUNT;
+    }
+    return std::min(static_cast<size_t>(count), MAX_COUNT);
+}
+
+void PrefetchSizer::Clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_formats.clear();
+    m_folders.clear();
+}
@@ -0,0 +1,66 @@
+#pragma once
+// Platform-neutral sizing of the prefetch window from measured decode cost. Decode time
+// and decoded bytes are tracked per (folder, format) profile, and the window is made just
+// wide enough to cover a span of navigation at the user's current pace, no wider than the
+// decoders can keep up with or the cache budget can hold. The sizing itself is a pure
+// function of a profile, so recorded timings can be replayed against it.
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class PrefetchSizer {
+public:
+    // Smoothed cost of decoding one image of a profile
+    struct Profile {
+        double decodeMs = DEFAULT_DECODE_MS;
+        double bytes = DEFAULT_BYTES;
+        uint32_t samples = 0;
+    };
+
+    struct Limits {
+        double coverMs = DEFAULT_COVER_MS;  // Navigation time the window should cover
+        size_t workerCount = 1;             // Decodes that run at once
+        size_t memoryBytes = 0;             // Budget the whole window must fit in (0: unlimited)
+    };
+
+    void SetLimits(const Limits& limits);
+    Limits GetLimits() const;
+
+    // Record one finished decode (any thread)
+    void Record(const std::wstring& folder, const std::wstring& format, double decodeMs, size_t bytes);
+
+    // Profile for a folder and format, falling back to the format alone and then to defaults
+    Profile GetProfile(const std::wstring& folder, const std::wstring& format) const;
+
+    // Images to prefetch on each side of the current one. intervalMs is the time between
+    // navigations (0 when idle, which assumes an unhurried browsing pace).
+    size_t GetWindowCount(const std::wstring& folder, const std::wstring& format, double intervalMs) const;
+    static size_t ComputeWindowCount(const Profile& profile, double intervalMs, const Limits& limits);
+
+    void Clear();
+
+    static constexpr double DEFAULT_COVER_MS = 1200.0;
+    static constexpr double IDLE_INTERVAL_MS = 400.0;
+    static constexpr size_t MIN_COUNT = 1;
+    static constexpr size_t MAX_COUNT = 20;
+
+private:
+    static constexpr double DEFAULT_DECODE_MS = 50.0;
+    static constexpr double DEFAULT_BYTES = 1920.0 * 1080.0 * 4.0;
+    // Weight of a new sample in the running averages
+    static constexpr double SAMPLE_WEIGHT = 0.3;
+    // Share of the memory budget the window may fill; the rest is left for jump targets
+    // and images the user zoomed into
+    static constexpr double MEMORY_FRACTION = 0.75;
+    // Folder profiles are forgotten wholesale past this many, which only costs re-measuring
+    static constexpr size_t MAX_FOLDER_PROFILES = 256;
+
+    static void Update(Profile& profile, double decodeMs, double bytes);
+
+    mutable std::mutex m_mutex;
+    Limits m_limits;
+    std::unordered_map<std::wstring, Profile> m_formats;  // Keyed by format
+    std::unordered_map<std::wstring, Profile> m_folders;  // Keyed by folder and format
+};
@@ -0,0 +1,455 @@
+#include "pch.h"
+#include "PreviewStore.h"
+#include "BlockCompressor.h"
+#include <shlobj.h>
+#include <array>
+
+// CRC-32 (IEEE) lookup table, built on first use
+static uint32_t Crc32(const uint8_t* data, size_t size) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Bytes of blocks covering a width x height preview
+static uint64_t BlockBytes(uint32_t width, uint32_t height, uint32_t format) {
+    BlockImage shape;
+    shape.format = static_cast<BlockFormat>(format);
+    shape.width = width;
+    shape.height = height;
+    return static_cast<uint64_t>(shape.Pitch()) * shape.BlocksHigh();
+}
+
+PreviewStore::~PreviewStore() {
+    Close();
+}
+
+std::wstring PreviewStore::GetDefaultPath() {
+    PWSTR localAppData = nullptr;
+    if (FAILED(SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, nullptr, &localAppData))) {
+        return L"";
+    }
+    fs::path folder = fs::path(localAppData) / L"AngelFoto";
+    CoTaskMemFree(localAppData);
+
+    std::error_code ec;
+    fs::create_directories(folder, ec);
+    if (ec) {
+        return L"";
+    }
+    return (folder / L"previews.pack").wstring();
+}
+
+bool PreviewStore::Open(const std::wstring& packPath, uint64_t maxBytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    CloseLocked();
+    m_packPath = packPath;
+    m_maxBytes = maxBytes;
+    return OpenLocked();
+}
+
+void PreviewStore::Close() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_file != INVALID_HANDLE_VALUE && NeedsCompactionLocked()) {
+        CompactLocked();
+    }
+    CloseLocked();
+}
+
+bool PreviewStore::IsOpen() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_file != INVALID_HANDLE_VALUE;
+}
+
+bool PreviewStore::OpenLocked() {
+    if (m_packPath.empty()) {
+        return false;
+    }
+
+    // Exclusive writer: a second instance simply runs without previews
+    m_file = CreateFileW(m_packPath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+        nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size = {};
+    GetFileSizeEx(m_file, &size);
+    m_fileBytes = static_cast<uint64_t>(size.QuadPart);
+
+    bool headerValid = false;
+    if (m_fileBytes >= sizeof(PackHeader) && MapLocked()) {
+        PackHeader header;
+        memcpy(&header, m_view, sizeof(header));
+        headerValid = header.magic == PACK_MAGIC && header.version == PACK_VERSION;
+    }
+
+    if (!headerValid) {
+        // New, foreign or outdated pack: start over
+        if (!TruncateLocked(0) || !WriteHeaderLocked()) {
+            CloseLocked();
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t intactEnd = ScanRecordsLocked();
+    if (intactEnd < m_fileBytes) {
+        // Torn append from a crash (or corruption): drop everything after the last good record
+        TruncateLocked(intactEnd);
+    }
+
+    if (NeedsCompactionLocked()) {
+        CompactLocked();
+    }
+    return m_file != INVALID_HANDLE_VALUE;
+}
+
+void PreviewStore::CloseLocked() {
+    UnmapLocked();
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    m_index.clear();
+    m_fileBytes = 0;
+    m_liveBytes = 0;
+}
+
+bool PreviewStore::MapLocked() {
+    UnmapLocked();
+
+    LARGE_INTEGER size = {};
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+        return false;
+    }
+
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        return false;
+    }
+
+    m_view = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_view) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+        return false;
+    }
+
+    m_mappedBytes = static_cast<uint64_t>(size.QuadPart);
+    return true;
+}
+
+void PreviewStore::UnmapLocked() {
+    if (m_view) {
+        UnmapViewOfFile(m_view);
+        m_view = nullptr;
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+    }
+    m_mappedBytes = 0;
+}
+
+bool PreviewStore::EnsureMappedLocked(uint64_t endOffset) {
+    // Appends grow the file past the current view; remap lazily on the next read
+    if (m_view && endOffset <= m_mappedBytes) {
+        return true;
+    }
+    return MapLocked() && endOffset <= m_mappedBytes;
+}
+
+bool PreviewStore::TruncateLocked(uint64_t size) {
+    // A file with an open mapping cannot be shortened
+    UnmapLocked();
+
+    LARGE_INTEGER position = {};
+    position.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFilePointerEx(m_file, position, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file)) {
+        return false;
+    }
+    m_fileBytes = size;
+    return true;
+}
+
+bool PreviewStore::WriteHeaderLocked() {
+    PackHeader header = { PACK_MAGIC, PACK_VERSION, 0 };
+    DWORD written = 0;
+    if (!WriteFile(m_file, &header, sizeof(header), &written, nullptr) || written != sizeof(header)) {
+        return false;
+    }
+    m_fileBytes = sizeof(header);
+    return true;
+}
+
+const PreviewStore::RecordHeader* PreviewStore::ValidateRecordLocked(uint64_t offset) const {
+    if (offset + sizeof(RecordHeader) > m_mappedBytes) {
+        return nullptr;
+    }
+
+    const auto* header = reinterpret_cast<const RecordHeader*>(m_view + offset);
+    if (header->magic != RECORD_MAGIC || header->recordBytes > m_mappedBytes - offset) {
+        return nullptr;
+    }
+
+    if (header->keyChars == 0 || header->width == 0 || header->height == 0 ||
+        header->format > static_cast<uint32_t>(BlockFormat::BC3) ||
+        BlockOffset(header->keyChars) + BlockBytes(header->width, header->height, header->format) >
+            header->recordBytes) {
+        return nullptr;
+    }
+
+    const uint8_t* crcStart = m_view + offset + CRC_START;
+    if (Crc32(crcStart, header->recordBytes - CRC_START) != header->crc) {
+        return nullptr;
+    }
+    return header;
+}
+
+uint64_t PreviewStore::ScanRecordsLocked() {
+    m_index.clear();
+    m_liveBytes = 0;
+
+    uint64_t offset = sizeof(PackHeader);
+    while (offset < m_fileBytes) {
+        const RecordHeader* header = ValidateRecordLocked(offset);
+        if (!header) {
+            break;
+        }
+
+        const auto* keyData = reinterpret_cast<const wchar_t*>(m_view + offset + sizeof(RecordHeader));
+        std::wstring key(keyData, header->keyChars);
+
+        // Later records supersede earlier ones for the same key
+        auto& entry = m_index[key];
+        m_liveBytes -= entry.recordBytes;
+        entry = { offset, header->recordBytes };
+        m_liveBytes += header->recordBytes;
+
+        offset += header->recordBytes;
+    }
+    return offset;
+}
+
+bool PreviewStore::Contains(const std::wstring& identityKey) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_index.count(identityKey) != 0;
+}
+
+bool PreviewStore::Find(const std::wstring& identityKey, BlockImage& preview,
+    uint32_t& sourceWidth, uint32_t& sourceHeight) {
+    std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    auto it = m_index.find(identityKey);
+    if (it == m_index.end() || !EnsureMappedLocked(it->second.offset + it->second.recordBytes)) {
+        return false;
+    }
+
+    const auto* header = reinterpret_cast<const RecordHeader*>(m_view + it->second.offset);
+    const uint8_t* blocks = m_view + it->second.offset + BlockOffset(header->keyChars);
+
+    preview.format = static_cast<BlockFormat>(header->format);
+    preview.width = header->width;
+    preview.height = header->height;
+    size_t blockBytes = static_cast<size_t>(BlockBytes(header->width, header->height, header->format));
+    preview.blocks.assign(blocks, blocks + blockBytes);
+    sourceWidth = header->sourceWidth;
+    sourceHeight = header->sourceHeight;
+    return true;
+}
+
+bool PreviewStore::Put(const std::wstring& identityKey, const BlockImage& preview,
+    uint32_t sourceWidth, uint32_t sourceHeight) {
+    if (preview.IsEmpty() || identityKey.empty()) {
+        return false;
+    }
+
+    uint32_t keyChars = static_cast<uint32_t>(identityKey.size());
+    uint64_t blockOffset = BlockOffset(keyChars);
+
+    // Build the whole record first so it lands in the pack with a single write
+    std::vector<uint8_t> record(AlignRecord(blockOffset + preview.ByteSize()), 0);
+    RecordHeader header = {};
+    header.magic = RECORD_MAGIC;
+    header.recordBytes = record.size();
+    header.keyChars = keyChars;
+    header.sourceWidth = sourceWidth;
+    header.sourceHeight = sourceHeight;
+    header.width = preview.width;
+    header.height = preview.height;
+    header.format = static_cast<uint32_t>(preview.format);
+    memcpy(record.data(), &header, sizeof(header));
+    memcpy(record.data() + sizeof(header), identityKey.data(), keyChars * sizeof(wchar_t));
+    memcpy(record.data() + blockOffset, preview.blocks.data(), preview.ByteSize());
+
+    header.crc = Crc32(record.data() + CRC_START, record.size() - CRC_START);
+    memcpy(record.data() + offsetof(RecordHeader, crc), &header.crc, sizeof(header.crc));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    // Compaction waits for Close; until then the pack only grows so far
+    if (m_fileBytes + record.size() > static_cast<uint64_t>(m_maxBytes * MAX_GROWTH_FRACTION)) {
+        return false;
+    }
+
+    LARGE_INTEGER position = {};
+    position.QuadPart = static_cast<LONGLONG>(m_fileBytes);
+    DWORD written = 0;
+    if (!SetFilePointerEx(m_file, position, nullptr, FILE_BEGIN) ||
+        !WriteFile(m_file, record.data(), static_cast<DWORD>(record.size()), &written, nullptr) ||
+        written != record.size()) {
+        // Leave no partial record behind (the CRC would reject it on the next open anyway)
+        TruncateLocked(m_fileBytes);
+        return false;
+    }
+
+    auto& entry = m_index[identityKey];
+    m_liveBytes -= entry.recordBytes;
+    entry = { m_fileBytes, record.size() };
+    m_liveBytes += record.size();
+    m_fileBytes += record.size();
+    return true;
+}
+
+bool PreviewStore::NeedsCompactionLocked() const {
+    return m_fileBytes > m_maxBytes || m_fileBytes - m_liveBytes > m_fileBytes / 2;
+}
+
+void PreviewStore::CompactLocked() {
+    if (!EnsureMappedLocked(m_fileBytes)) {
+        return;
+    }
+
+    // Keep the newest previews (highest offsets) within the target size
+    std::vector<const IndexEntry*> entries;
+    entries.reserve(m_index.size());
+    for (const auto& [key, entry] : m_index) {
+        entries.push_back(&entry);
+    }
+    std::sort(entries.begin(), entries.end(),
+        [](const IndexEntry* a, const IndexEntry* b) { return a->offset > b->offset; });
+
+    uint64_t targetBytes = static_cast<uint64_t>(m_maxBytes * COMPACT_TARGET_FRACTION);
+    uint64_t keptBytes = sizeof(PackHeader);
+    size_t keepCount = 0;
+    while (keepCount < entries.size() && keptBytes + entries[keepCount]->recordBytes <= targetBytes) {
+        keptBytes += entries[keepCount]->recordBytes;
+        keepCount++;
+    }
+    entries.resize(keepCount);
+
+    // Restore append order so the rewritten pack is still oldest-first
+    std::reverse(entries.begin(), entries.end());
+
+    // Write the survivors to a side file and swap it in; a crash leaves the old pack intact
+    std::wstring tempPath = m_packPath + L".tmp";
+    HANDLE temp = CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (temp == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    PackHeader packHeader = { PACK_MAGIC, PACK_VERSION, 0 };
+    DWORD written = 0;
+    bool ok = WriteFile(temp, &packHeader, sizeof(packHeader), &written, nullptr) &&
+        written == sizeof(packHeader);
+    for (size_t i = 0; ok && i < entries.size(); ++i) {
+        DWORD bytes = static_cast<DWORD>(entries[i]->recordBytes);
+        ok = WriteFile(temp, m_view + entries[i]->offset, bytes, &written, nullptr) && written == bytes;
+    }
+    CloseHandle(temp);
+
+    if (!ok) {
+        DeleteFileW(tempPath.c_str());
+        return;
+    }
+
+    CloseLocked();
+    MoveFileExW(tempPath.c_str(), m_packPath.c_str(), MOVEFILE_REPLACE_EXISTING);
+
+    // Reopen (without compacting again) and rebuild the index from the new pack
+    uint64_t maxBytes = m_maxBytes;
+    m_maxBytes = UINT64_MAX;
+    OpenLocked();
+    m_maxBytes = maxBytes;
+}
+
+uint64_t PreviewStore::GetFileBytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_fileBytes;
+}
+
+uint64_t PreviewStore::GetLiveBytes() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_liveBytes;
+}
+
+bool PreviewStore::MakePreview(const PixelBuffer& source, BlockImage& compressed) {
+    if (source.IsEmpty()) {
+        return false;
+    }
+
+    uint32_t longSide = std::max(source.width, source.height);
+    if (longSide <= PREVIEW_MAX_DIMENSION) {
+        return BlockCompressor::Compress(source, compressed);
+    }
+
+    PixelBuffer preview;
+    preview.width = std::max<uint32_t>(1, static_cast<uint32_t>(
+        static_cast<uint64_t>(source.width) * PREVIEW_MAX_DIMENSION / longSide));
+    preview.height = std::max<uint32_t>(1, static_cast<uint32_t>(
+        static_cast<uint64_t>(source.height) * PREVIEW_MAX_DIMENSION / longSide));
+    preview.stride = preview.width * BYTES_PER_PIXEL;
+    preview.pixels.resize(static_cast<size_t>(preview.stride) * preview.height);
+
+    // Average each destination pixel's source block; premultiplied alpha averages correctly
+    for (uint32_t y = 0; y < preview.height; ++y) {
+        uint32_t y0 = static_cast<uint32_t>(static_cast<uint64_t>(y) * source.height / preview.height);
+        uint32_t y1 = static_cast<uint32_t>(static_cast<uint64_t>(y + 1) * source.height / preview.height);
+
+        for (uint32_t x = 0; x < preview.width; ++x) {
+            uint32_t x0 = static_cast<uint32_t>(static_cast<uint64_t>(x) * source.width / preview.width);
+            uint32_t x1 = static_cast<uint32_t>(static_cast<uint64_t>(x + 1) * source.width / preview.width);
+
+            uint32_t sum[BYTES_PER_PIXEL] = {};
+            for (uint32_t sy = y0; sy < y1; ++sy) {
+                const uint8_t* row = source.pixels.data() + static_cast<size_t>(sy) * source.stride;
+                for (uint32_t sx = x0; sx < x1; ++sx) {
+                    const uint8_t* pixel = row + static_cast<size_t>(sx) * BYTES_PER_PIXEL;
+                    for (uint32_t c = 0; c < BYTES_PER_PIXEL; ++c) {
+                        sum[c] += pixel[c];
+                    }
+                }
+            }
+
+            uint32_t count = (y1 - y0) * (x1 - x0);
+            uint8_t* out = preview.pixels.data() + static_cast<size_t>(y) * preview.stride +
+                static_cast<size_t>(x) * BYTES_PER_PIXEL;
+            for (uint32_t c = 0; c < BYTES_PER_PIXEL; ++c) {
+                out[c] = static_cast<uint8_t>((sum[c] + count / 2) / count);
+            }
+        }
+    }
+    return BlockCompressor::Compress(preview, compressed);
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "pch.h"
+#include "DecodePipeline.h"
+
+// Persistent store of small screen-sized previews, so reopening a folder can show every
+// image instantly while the full decode runs. Previews are block-compressed (BC1, or BC3
+// with alpha) and keyed by the file's identity (FileIdentity::ToKey), so a renamed file
+// keeps its preview and a rewritten one misses. They are appended to a single pack file
+// that is read through a memory mapping; the index is rebuilt by scanning the pack on open.
+// Each record carries a CRC, and a pack truncated by a crash is cut back to its last
+// intact record. The pack is compacted on open and close, never while decoding; between
+// the two it may grow past its byte budget up to MAX_GROWTH_FRACTION, then stops accepting
+// previews.
+class PreviewStore {
+public:
+    PreviewStore() = default;
+    ~PreviewStore();
+
+    PreviewStore(const PreviewStore&) = delete;
+    PreviewStore& operator=(const PreviewStore&) = delete;
+
+    // Open or create the pack file (fails if another instance holds it)
+    bool Open(const std::wstring& packPath, uint64_t maxBytes = DEFAULT_MAX_BYTES);
+
+    // Compacts the pack first if it is over budget or mostly superseded records, so call
+    // it once decoding has stopped
+    void Close();
+    bool IsOpen();
+
+    // %LOCALAPPDATA%\AngelFoto\previews.pack (empty if unavailable)
+    static std::wstring GetDefaultPath();
+
+    // Copy a stored preview out of the pack. Never blocks: returns false while the
+    // store is busy writing, since a preview is only a shortcut.
+    bool Find(const std::wstring& identityKey, BlockImage& preview, uint32_t& sourceWidth,
+        uint32_t& sourceHeight);
+    bool Contains(const std::wstring& identityKey);
+
+    // Append a preview, replacing any older one for the same key
+    bool Put(const std::wstring& identityKey, const BlockImage& preview, uint32_t sourceWidth,
+        uint32_t sourceHeight);
+
+    // Downscale a decoded image to preview size (box filter over premultiplied BGRA) and
+    // block-compress it
+    static bool MakePreview(const PixelBuffer& source, BlockImage& compressed);
+
+    uint64_t GetFileBytes();
+    uint64_t GetLiveBytes();
+
+    // A 4:3 preview is 320x240, 38 KB as BC1, so about 5,000 fit in the compacted pack
+    static constexpr uint32_t PREVIEW_MAX_DIMENSION = 320;
+    static constexpr uint64_t DEFAULT_MAX_BYTES = 256ull * 1024 * 1024;
+
+private:
+    struct PackHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t reserved;
+    };
+
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t crc;            // CRC-32 of the record after this field
+        uint64_t recordBytes;    // Whole record including padding
+        uint32_t keyChars;       // Identity key follows the header
+        uint32_t sourceWidth;
+        uint32_t sourceHeight;
+        uint32_t width;          // Blocks follow the key, 8-byte aligned
+        uint32_t height;
+        uint32_t format;         // BlockFormat
+    };
+
+    // The CRC covers everything after the crc field itself
+    static constexpr size_t CRC_START = offsetof(RecordHeader, recordBytes);
+
+    struct IndexEntry {
+        uint64_t offset;
+        uint64_t recordBytes;
+    };
+
+    bool OpenLocked();
+    void CloseLocked();
+    bool MapLocked();
+    void UnmapLocked();
+    bool EnsureMappedLocked(uint64_t endOffset);
+    bool TruncateLocked(uint64_t size);
+    bool WriteHeaderLocked();
+    uint64_t ScanRecordsLocked();
+    const RecordHeader* ValidateRecordLocked(uint64_t offset) const;
+    bool NeedsCompactionLocked() const;
+    void CompactLocked();
+
+    static uint64_t AlignRecord(uint64_t bytes) { return (bytes + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1); }
+    static uint64_t BlockOffset(uint32_t keyChars) {
+        return AlignRecord(sizeof(RecordHeader) + keyChars * sizeof(wchar_t));
+    }
+
+    std::mutex m_mutex;
+    std::wstring m_packPath;
+    uint64_t m_maxBytes = DEFAULT_MAX_BYTES;
+
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+    const uint8_t* m_view = nullptr;
+    uint64_t m_mappedBytes = 0;
+
+    uint64_t m_fileBytes = 0;   // End of the last intact record
+    uint64_t m_liveBytes = 0;   // Bytes of records still referenced by the index
+    std::unordered_map<std::wstring, IndexEntry> m_index;  // Keyed by identity key
+
+    static constexpr uint32_t PACK_MAGIC = 0x56504641;    // "AFPV"
+    static constexpr uint32_t RECORD_MAGIC = 0x43455250;  // "PREC"
+    static constexpr uint32_t PACK_VERSION = 2;  // 1 held uncompressed BGRA keyed by path
+    static constexpr uint64_t RECORD_ALIGNMENT = 8;
+    static constexpr uint32_t BYTES_PER_PIXEL = 4;
+
+    // Compaction keeps the newest previews up to this fraction of the budget, and also
+    // runs when more than half of the pack is superseded records
+    static constexpr double COMPACT_TARGET_FRACTION = 0.75;
+    static constexpr double MAX_GROWTH_FRACTION = 1.5;
+};
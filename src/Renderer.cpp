@@ -179,6 +179,8 @@ void Renderer::CreateDeviceResources() {
 }
 
 void Renderer::DiscardDeviceResources() {
+    m_cropBrush.Reset();
+    m_cropDimBrush.Reset();
     m_targetBitmap.Reset();
     m_swapChain.Reset();
     m_deviceContext.Reset();
@@ -222,13 +224,80 @@ void Renderer::Resize(int width, int height) {
     }
 }
 
-void Renderer::SetImage(ComPtr<ID2D1Bitmap> bitmap) {
+void Renderer::SetImage(ComPtr<ID2D1Bitmap> bitmap, float width, float height, D2D1_SIZE_U content) {
     m_currentImage = bitmap;
+    m_imageContent = content;
+    m_tiles.clear();
+    m_imageWidth = width;
+    m_imageHeight = height;
+    if (m_currentImage && (m_imageWidth <= 0.0f || m_imageHeight <= 0.0f)) {
+        auto size = m_currentImage->GetSize();
+        m_imageWidth = size.width;
+        m_imageHeight = size.height;
+    }
     ResetView();
 }
 
+void Renderer::ReplaceImage(ComPtr<ID2D1Bitmap> bitmap, D2D1_SIZE_U content) {
+    m_currentImage = bitmap;
+    m_imageContent = content;
+}
+
 void Renderer::ClearImage() {
     m_currentImage.Reset();
+    m_imageContent = {};
+    m_tiles.clear();
+}
+
+void Renderer::SetTiles(std::vector<ImageTile> tiles) {
+    m_tiles = std::move(tiles);
+}
+
+D2D1_RECT_F Renderer::GetVisibleImageRect() const {
+    if (!m_currentImage) return D2D1::RectF(0, 0, 0, 0);
+
+    // Visible part of the laid-out image, normalised to it (rotated orientation)
+    D2D1_RECT_F imageRect = CalculateImageRect();
+    float layoutWidth = imageRect.right - imageRect.left;
+    float layoutHeight = imageRect.bottom - imageRect.top;
+    if (layoutWidth <= 0.0f || layoutHeight <= 0.0f) return D2D1::RectF(0, 0, 0, 0);
+
+    float u0 = std::clamp(-imageRect.left / layoutWidth, 0.0f, 1.0f);
+    float v0 = std::clamp(-imageRect.top / layoutHeight, 0.0f, 1.0f);
+    float u1 = std::clamp((m_width - imageRect.left) / layoutWidth, 0.0f, 1.0f);
+    float v1 = std::clamp((m_height - imageRect.top) / layoutHeight, 0.0f, 1.0f);
+
+    // Undo the clockwise rotation to get unrotated image fractions
+    float left = u0, top = v0, right = u1, bottom = v1;
+    switch (m_rotation) {
+    case Rotation::CW_90:  left = v0; right = v1; top = 1.0f - u1; bottom = 1.0f - u0; break;
+    case Rotation::CW_180: left = 1.0f - u1; right = 1.0f - u0; top = 1.0f - v1; bottom = 1.0f - v0; break;
+    case Rotation::CW_270: left = 1.0f - v1; right = 1.0f - v0; top = u0; bottom = u1; break;
+    default: break;
+    }
+    return D2D1::RectF(left * m_imageWidth, top * m_imageHeight, right * m_imageWidth, bottom * m_imageHeight);
+}
+
+float Renderer::GetImageScale() const {
+    if (!m_currentImage || m_imageWidth <= 0.0f) return 0.0f;
+
+    D2D1_RECT_F imageRect = CalculateImageRect();
+    bool swapped = m_rotation == Rotation::CW_90 || m_rotation == Rotation::CW_270;
+    float displayedWidth = swapped ? imageRect.bottom - imageRect.top : imageRect.right - imageRect.left;
+    return displayedWidth / m_imageWidth;
+}
+
+float Renderer::GetDisplayScale() const {
+    if (!m_currentImage) return 0.0f;
+
+    auto pixelSize = m_imageContent.width ? m_imageContent : m_currentImage->GetPixelSize();
+    if (pixelSize.width == 0) return 0.0f;
+
+    // The rect is laid out in the rotated orientation
+    D2D1_RECT_F imageRect = CalculateImageRect();
+    bool swapped = m_rotation == Rotation::CW_90 || m_rotation == Rotation::CW_270;
+    float displayedWidth = swapped ? imageRect.bottom - imageRect.top : imageRect.right - imageRect.left;
+    return displayedWidth / static_cast<float>(pixelSize.width);
 }
 
 void Renderer::SetZoom(float zoom) {
@@ -262,14 +331,19 @@ void Renderer::SetCropMode(bool enabled) {
     }
 
     // Create brushes for crop overlay if needed
-    if (enabled && !m_cropBrush && m_deviceContext) {
-        m_deviceContext->CreateSolidColorBrush(
-            D2D1::ColorF(D2D1::ColorF::White), &m_cropBrush);
-        m_deviceContext->CreateSolidColorBrush(
-            D2D1::ColorF(0, 0, 0, CROP_DIM_OPACITY), &m_cropDimBrush);
+    if (enabled && !m_cropBrush) {
+        CreateCropBrushes();
     }
 }
 
+void Renderer::CreateCropBrushes() {
+    if (!m_deviceContext) return;
+    m_deviceContext->CreateSolidColorBrush(
+        D2D1::ColorF(D2D1::ColorF::White), &m_cropBrush);
+    m_deviceContext->CreateSolidColorBrush(
+        D2D1::ColorF(0, 0, 0, CROP_DIM_OPACITY), &m_cropDimBrush);
+}
+
 void Renderer::SetCropRect(D2D1_RECT_F rect) {
     m_cropRect = rect;
 }
@@ -293,8 +367,8 @@ D2D1_RECT_F Renderer::GetCropRectInImageCoords() const {
     D2D1_RECT_F imageRect = CalculateImageRect();
 
     // Convert screen crop rect to image coordinates
-    float scaleX = m_currentImage->GetSize().width / (imageRect.right - imageRect.left);
-    float scaleY = m_currentImage->GetSize().height / (imageRect.bottom - imageRect.top);
+    float scaleX = m_imageWidth / (imageRect.right - imageRect.left);
+    float scaleY = m_imageHeight / (imageRect.bottom - imageRect.top);
 
     D2D1_RECT_F result;
     result.left = (m_cropRect.left - imageRect.left) * scaleX;
@@ -303,8 +377,8 @@ D2D1_RECT_F Renderer::GetCropRectInImageCoords() const {
     result.bottom = (m_cropRect.bottom - imageRect.top) * scaleY;
 
     // Clamp to image bounds
-    float imgWidth = m_currentImage->GetSize().width;
-    float imgHeight = m_currentImage->GetSize().height;
+    float imgWidth = m_imageWidth;
+    float imgHeight = m_imageHeight;
     result.left = ClampToBounds(result.left, imgWidth);
     result.top = ClampToBounds(result.top, imgHeight);
     result.right = ClampToBounds(result.right, imgWidth);
@@ -318,9 +392,9 @@ D2D1_RECT_F Renderer::CalculateImageRect() const {
         return D2D1::RectF(0, 0, 0, 0);
     }
 
-    auto imageSize = m_currentImage->GetSize();
-    float imageWidth = imageSize.width;
-    float imageHeight = imageSize.height;
+    // Layout uses the original image size so swapping resolution levels does not move it
+    float imageWidth = m_imageWidth;
+    float imageHeight = m_imageHeight;
 
     // Swap dimensions for 90/270 degree rotations
     if (m_rotation == Rotation::CW_90 || m_rotation == Rotation::CW_270) {
@@ -447,13 +521,31 @@ void Renderer::Render() {
         }
 
         // Use high quality interpolation for better image quality
+        D2D1_RECT_F sourceRect = D2D1::RectF(0.0f, 0.0f,
+            static_cast<float>(m_imageContent.width), static_cast<float>(m_imageContent.height));
         m_deviceContext->DrawBitmap(
             m_currentImage.Get(),
             destRect,
             1.0f,
-            D2D1_INTERPOLATION_MODE_HIGH_QUALITY_CUBIC
+            D2D1_INTERPOLATION_MODE_HIGH_QUALITY_CUBIC,
+            m_imageContent.width ? &sourceRect : nullptr
         );
 
+        // Tiles are placed in image pixels within the same (unrotated) rect
+        float tileScaleX = (destRect.right - destRect.left) / m_imageWidth;
+        float tileScaleY = (destRect.bottom - destRect.top) / m_imageHeight;
+        for (const auto& tile : m_tiles) {
+            m_deviceContext->DrawBitmap(
+                tile.bitmap.Get(),
+                D2D1::RectF(destRect.left + tile.imageRect.left * tileScaleX,
+                    destRect.top + tile.imageRect.top * tileScaleY,
+                    destRect.left + tile.imageRect.right * tileScaleX,
+                    destRect.top + tile.imageRect.bottom * tileScaleY),
+                1.0f,
+                D2D1_INTERPOLATION_MODE_HIGH_QUALITY_CUBIC
+            );
+        }
+
         // Reset transform
         m_deviceContext->SetTransform(D2D1::Matrix3x2F::Identity());
 
@@ -465,13 +557,33 @@ void Renderer::Render() {
     }
 
     HRESULT hr = m_deviceContext->EndDraw();
-
     if (hr == D2DERR_RECREATE_TARGET) {
-        DiscardDeviceResources();
-        CreateDeviceResources();
+        HandleDeviceLost();
+        return;
     }
 
     // Present
     DXGI_PRESENT_PARAMETERS presentParams = {};
-    m_swapChain->Present1(1, 0, &presentParams);
+    hr = m_swapChain->Present1(1, 0, &presentParams);
+    if (hr == DXGI_ERROR_DEVICE_REMOVED || hr == DXGI_ERROR_DEVICE_RESET) {
+        HandleDeviceLost();
+    }
+}
+
+void Renderer::HandleDeviceLost() {
+    DiscardDeviceResources();
+    m_currentImage.Reset();
+    m_tiles.clear();
+    try {
+        CreateDeviceResources();
+    } catch (...) {
+        return;
+    }
+    if (m_cropMode) {
+        CreateCropBrushes();
+    }
+
+    if (m_onDeviceLost) {
+        m_onDeviceLost();
+    }
 }
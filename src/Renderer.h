@@ -10,10 +10,37 @@ public:
     void Resize(int width, int height);
     void Render();
 
-    // Set the current image to display
-    void SetImage(ComPtr<ID2D1Bitmap> bitmap);
+    // Called after the device was lost and recreated. Every bitmap made on the old device
+    // is unusable; the current image is cleared and must be set again.
+    void SetDeviceLostCallback(std::function<void()> callback) { m_onDeviceLost = std::move(callback); }
+
+    // Set the current image to display. width/height are the original image's size, which
+    // layout and crop coordinates use; the bitmap may be a smaller level of it. A non-zero
+    // content size draws only that top-left part of the bitmap (block-compressed bitmaps
+    // are padded to whole blocks).
+    void SetImage(ComPtr<ID2D1Bitmap> bitmap, float width, float height,
+        D2D1_SIZE_U content = D2D1::SizeU(0, 0));
     void ClearImage();
 
+    // Swap in another resolution of the same image, keeping zoom and pan
+    void ReplaceImage(ComPtr<ID2D1Bitmap> bitmap, D2D1_SIZE_U content = D2D1::SizeU(0, 0));
+
+    // Screen pixels per bitmap pixel at the current zoom (above 1 the bitmap is upscaled)
+    float GetDisplayScale() const;
+
+    // Tiles of a large image drawn over the current bitmap, placed in original image
+    // pixels (see TiledImage). Cleared by SetImage.
+    struct ImageTile {
+        ComPtr<ID2D1Bitmap> bitmap;
+        D2D1_RECT_F imageRect;
+    };
+    void SetTiles(std::vector<ImageTile> tiles);
+
+    // Part of the image on screen in original image pixels, and screen pixels per original
+    // pixel at the current zoom
+    D2D1_RECT_F GetVisibleImageRect() const;
+    float GetImageScale() const;
+
     // Zoom and pan
     void SetZoom(float zoom);
     void SetPan(float panX, float panY);
@@ -64,6 +91,8 @@ public:
 private:
     void CreateDeviceResources();
     void DiscardDeviceResources();
+    void HandleDeviceLost();
+    void CreateCropBrushes();
     D2D1_RECT_F CalculateImageRect() const;
 
     // Rendering sub-routines (extracted from Render for clarity)
@@ -85,8 +114,14 @@ private:
     // WIC
     ComPtr<IWICImagingFactory> m_wicFactory;
 
+    std::function<void()> m_onDeviceLost;
+
     // Current image
     ComPtr<ID2D1Bitmap> m_currentImage;
+    float m_imageWidth = 0.0f;
+    float m_imageHeight = 0.0f;
+    D2D1_SIZE_U m_imageContent = {};  // Drawn part of m_currentImage (0: all of it)
+    std::vector<ImageTile> m_tiles;
     float m_zoom = 1.0f;
     float m_panX = 0.0f;
     float m_panY = 0.0f;
@@ -0,0 +1,102 @@
+#include "pch.h"
+#include "SessionStore.h"
+#include <shlobj.h>
+#include <fstream>
+
+static void WriteValue(std::ofstream& file, uint32_t value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void WriteString(std::ofstream& file, const std::wstring& value) {
+    WriteValue(file, static_cast<uint32_t>(value.size()));
+    file.write(reinterpret_cast<const char*>(value.data()),
+        static_cast<std::streamsize>(value.size() * sizeof(wchar_t)));
+}
+
+static bool ReadValue(std::ifstream& file, uint32_t& value) {
+    file.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return static_cast<size_t>(file.gcount()) == sizeof(value);
+}
+
+static bool ReadString(std::ifstream& file, uint32_t maxChars, std::wstring& value) {
+    uint32_t chars = 0;
+    if (!ReadValue(file, chars) || chars == 0 || chars > maxChars) {
+        return false;
+    }
+    value.resize(chars);
+    std::streamsize bytes = static_cast<std::streamsize>(chars * sizeof(wchar_t));
+    file.read(reinterpret_cast<char*>(value.data()), bytes);
+    return file.gcount() == bytes;
+}
+
+std::wstring SessionStore::GetDefaultPath() {
+    PWSTR localAppData = nullptr;
+    if (FAILED(SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, nullptr, &localAppData))) {
+        return L"";
+    }
+    fs::path folder = fs::path(localAppData) / L"AngelFoto";
+    CoTaskMemFree(localAppData);
+
+    std::error_code ec;
+    fs::create_directories(folder, ec);
+    if (ec) {
+        return L"";
+    }
+    return (folder / L"session.dat").wstring();
+}
+
+bool SessionStore::Load(const std::wstring& path, SessionSnapshot& snapshot) {
+    std::ifstream file(fs::path(path), std::ios::binary);
+    if (!file) return false;
+
+    uint32_t magic = 0, version = 0, count = 0;
+    if (!ReadValue(file, magic) || magic != SESSION_MAGIC ||
+        !ReadValue(file, version) || version != SESSION_VERSION) {
+        return false;
+    }
+
+    SessionSnapshot result;
+    if (!ReadString(file, MAX_PATH_CHARS, result.currentFile) ||
+        !ReadValue(file, count) || count > MAX_WORKING_SET) {
+        return false;
+    }
+    result.workingSet.resize(count);
+    for (auto& entry : result.workingSet) {
+        if (!ReadString(file, MAX_PATH_CHARS, entry)) {
+            return false;
+        }
+    }
+
+    snapshot = std::move(result);
+    return true;
+}
+
+bool SessionStore::Save(const std::wstring& path, const SessionSnapshot& snapshot) {
+    if (path.empty() || snapshot.currentFile.empty()) return false;
+
+    fs::path target(path);
+    fs::path temp = target;
+    temp += L".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+
+        size_t count = std::min<size_t>(snapshot.workingSet.size(), MAX_WORKING_SET);
+        WriteValue(file, SESSION_MAGIC);
+        WriteValue(file, SESSION_VERSION);
+        WriteString(file, snapshot.currentFile);
+        WriteValue(file, static_cast<uint32_t>(count));
+        for (size_t i = 0; i < count; ++i) {
+            WriteString(file, snapshot.workingSet[i]);
+        }
+        if (!file.flush()) return false;
+    }
+
+    std::error_code ec;
+    fs::rename(temp, target, ec);
+    if (ec) {
+        fs::remove(temp, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "pch.h"
+
+// What was on screen when the app last closed: the current file and the files around it
+// whose screen level was cached, in folder order. Enough to re-queue the same decodes on
+// the next launch before the folder has been scanned.
+struct SessionSnapshot {
+    std::wstring currentFile;
+    std::vector<std::wstring> workingSet;  // Includes currentFile
+};
+
+// Small versioned file holding the last session. Anything unreadable is treated as no
+// session, so a stale or damaged file only costs the warm start.
+class SessionStore {
+public:
+    // %LOCALAPPDATA%\AngelFoto\session.dat (empty if unavailable)
+    static std::wstring GetDefaultPath();
+
+    static bool Load(const std::wstring& path, SessionSnapshot& snapshot);
+
+    // Written to a temporary file and renamed over the old one, so a crash mid-write
+    // leaves the previous session intact
+    static bool Save(const std::wstring& path, const SessionSnapshot& snapshot);
+
+    static constexpr uint32_t MAX_WORKING_SET = 256;
+
+private:
+    static constexpr uint32_t SESSION_MAGIC = 0x53534641;  // "AFSS"
+    static constexpr uint32_t SESSION_VERSION = 1;
+    static constexpr uint32_t MAX_PATH_CHARS = 32767;
+};
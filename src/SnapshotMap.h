@@ -0,0 +1,62 @@
+#pragma once
+// Platform-neutral read-copy-update hash map for read-mostly lookups. Keys are spread
+// over a fixed number of shards, each published as an immutable snapshot; readers load
+// a shard and search it without ever waiting on the writers' lock, while writers
+// (serialised by the caller) copy only the affected shard and publish the new version.
+// Not lock-free in the strict sense: std::atomic<std::shared_ptr> is implemented with a
+// brief internal lock by the common standard libraries, held only for the pointer copy.
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+template <typename Value>
+class SnapshotMap {
+public:
+    // Safe from any thread; returns a default Value if the key is absent
+    Value Find(const std::wstring& key) const {
+        auto shard = m_shards[ShardIndex(key)].load(std::memory_order_acquire);
+        if (!shard) return Value();
+
+        auto it = shard->find(key);
+        return it != shard->end() ? it->second : Value();
+    }
+
+    // Writers must hold the owner's lock
+    void Set(const std::wstring& key, Value value) {
+        auto& slot = m_shards[ShardIndex(key)];
+        auto current = slot.load(std::memory_order_relaxed);
+        auto next = current ? std::make_shared<Shard>(*current) : std::make_shared<Shard>();
+        (*next)[key] = std::move(value);
+        slot.store(std::move(next), std::memory_order_release);
+    }
+
+    void Erase(const std::wstring& key) {
+        auto& slot = m_shards[ShardIndex(key)];
+        auto current = slot.load(std::memory_order_relaxed);
+        if (!current || current->find(key) == current->end()) return;
+
+        auto next = std::make_shared<Shard>(*current);
+        next->erase(key);
+        slot.store(std::move(next), std::memory_order_release);
+    }
+
+    void Clear() {
+        for (auto& slot : m_shards) {
+            slot.store(nullptr, std::memory_order_release);
+        }
+    }
+
+private:
+    using Shard = std::unordered_map<std::wstring, Value>;
+
+    // Enough shards that a write copies only a handful of entries
+    static constexpr size_t SHARD_COUNT = 16;
+
+    static size_t ShardIndex(const std::wstring& key) {
+        return std::hash<std::wstring>{}(key) % SHARD_COUNT;
+    }
+
+    std::atomic<std::shared_ptr<const Shard>> m_shards[SHARD_COUNT];
+};
@@ -0,0 +1,145 @@
+#include "TaskPool.h"
+#include <algorithm>
+
+// Identifies the pool and queue owned by the current thread, if it is a pool worker
+static thread_local TaskPool* t_currentPool = nullptr;
+static thread_local size_t t_workerIndex = 0;
+
+TaskPool::~TaskPool() {
+    Stop();
+}
+
+size_t TaskPool::DefaultWorkerCount() {
+    size_t hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+}
+
+void TaskPool::Start(size_t workerCount, ThreadHook onThreadStart, ThreadHook onThreadExit) {
+    Stop();
+
+    m_onThreadStart = std::move(onThreadStart);
+    m_onThreadExit = std::move(onThreadExit);
+    m_running = true;
+
+    workerCount = std::max<size_t>(workerCount, 1);
+    for (size_t i = 0; i < workerCount; ++i) {
+        m_localQueues.push_back(std::make_unique<TaskQueues>());
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        m_workers.emplace_back(&TaskPool::WorkerThread, this, i);
+    }
+}
+
+void TaskPool::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_running = false;
+    }
+    m_cv.notify_all();
+
+    for (auto& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    m_workers.clear();
+    m_localQueues.clear();
+
+    // Under the sleep lock, so no Submit that saw the pool running can still be pushing
+    std::lock_guard<std::mutex> sleepLock(m_sleepMutex);
+    std::lock_guard<std::mutex> lock(m_injectionQueue.mutex);
+    for (auto& queue : m_injectionQueue.queues) {
+        queue.clear();
+    }
+    m_queuedCount = 0;
+}
+
+void TaskPool::Submit(TaskPriority priority, Task task) {
+    size_t p = static_cast<size_t>(priority);
+
+    // Count the task before it becomes poppable, so a worker that takes it straight away
+    // never decrements the count below zero. The sleep lock also keeps a worker between
+    // its empty check and wait from missing it.
+    std::unique_lock<std::mutex> sleepLock(m_sleepMutex);
+    if (!m_running) return;
+    m_queuedCount++;
+
+    if (t_currentPool == this) {
+        // Workers are joined before Stop clears their queues, so this push cannot outlive it
+        sleepLock.unlock();
+        std::lock_guard<std::mutex> lock(m_localQueues[t_workerIndex]->mutex);
+        m_localQueues[t_workerIndex]->queues[p].push_back(std::move(task));
+    } else {
+        // Pushed while still holding the running check: a Stop in between would clear the
+        // task and reset the count, and a later Start would run it against freed state
+        std::lock_guard<std::mutex> lock(m_injectionQueue.mutex);
+        m_injectionQueue.queues[p].push_back(std::move(task));
+        sleepLock.unlock();
+    }
+    m_cv.notify_one();
+}
+
+bool TaskPool::PopFrom(TaskQueues& source, size_t priority, bool fromBack, Task& task) {
+    std::lock_guard<std::mutex> lock(source.mutex);
+    auto& queue = source.queues[priority];
+    if (queue.empty()) return false;
+
+    if (fromBack) {
+        task = std::move(queue.back());
+        queue.pop_back();
+    } else {
+        task = std::move(queue.front());
+        queue.pop_front();
+    }
+    return true;
+}
+
+bool TaskPool::TryPop(size_t self, Task& task) {
+    size_t workerCount = m_localQueues.size();
+
+    for (size_t p = 0; p < PRIORITY_COUNT; ++p) {
+        // Own queue newest-first (still hot in cache), then shared submissions oldest-first
+        if (PopFrom(*m_localQueues[self], p, true, task)) return true;
+        if (PopFrom(m_injectionQueue, p, false, task)) return true;
+
+        // Steal the oldest task from a peer
+        for (size_t offset = 1; offset < workerCount; ++offset) {
+            size_t victim = (self + offset) % workerCount;
+            if (PopFrom(*m_localQueues[victim], p, false, task)) return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::WorkerThread(size_t index) {
+    t_currentPool = this;
+    t_workerIndex = index;
+
+    if (m_onThreadStart) {
+        m_onThreadStart();
+    }
+
+    // Checked before every pop, so Stop discards queued tasks instead of draining them
+    while (m_running) {
+        Task task;
+        if (TryPop(index, task)) {
+            m_queuedCount--;
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_cv.wait(lock, [this] {
+            return !m_running || m_queuedCount > 0;
+        });
+        if (!m_running) {
+            break;
+        }
+    }
+
+    if (m_onThreadExit) {
+        m_onThreadExit();
+    }
+
+    t_currentPool = nullptr;
+}
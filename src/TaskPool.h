@@ -0,0 +1,69 @@
+#pragma once
+// Platform-neutral work-stealing task pool shared by image decoding, folder scanning
+// and any other background work. Each worker owns a deque per priority class; tasks
+// submitted from a worker go to its own deque, tasks from other threads go to a shared
+// injection queue, and idle workers steal from their peers. Higher priority classes
+// are always drained first across all queues.
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class TaskPriority {
+    Interactive = 0,  // The user is waiting on it (current image, folder listing)
+    Prefetch = 1,     // Likely needed soon (neighbouring images)
+    Background = 2,   // Opportunistic (refreshes, thumbnails)
+};
+
+class TaskPool {
+public:
+    using Task = std::function<void()>;
+    using ThreadHook = std::function<void()>;
+
+    TaskPool() = default;
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    // onThreadStart/onThreadExit run on every worker (e.g. COM apartment and codec factory)
+    void Start(size_t workerCount, ThreadHook onThreadStart = nullptr, ThreadHook onThreadExit = nullptr);
+
+    // Join all workers; tasks that have not started are discarded
+    void Stop();
+
+    void Submit(TaskPriority priority, Task task);
+
+    size_t GetWorkerCount() const { return m_workers.size(); }
+
+    // One worker per hardware thread, leaving one for the UI thread
+    static size_t DefaultWorkerCount();
+
+private:
+    static constexpr size_t PRIORITY_COUNT = 3;
+
+    struct TaskQueues {
+        std::mutex mutex;
+        std::deque<Task> queues[PRIORITY_COUNT];
+    };
+
+    void WorkerThread(size_t index);
+    bool TryPop(size_t self, Task& task);
+    static bool PopFrom(TaskQueues& source, size_t priority, bool fromBack, Task& task);
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<TaskQueues>> m_localQueues;  // One per worker
+    TaskQueues m_injectionQueue;                             // Submissions from non-workers
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_cv;
+    std::atomic<size_t> m_queuedCount{ 0 };
+    std::atomic<bool> m_running{ false };
+
+    ThreadHook m_onThreadStart;
+    ThreadHook m_onThreadExit;
+};
@@ -0,0 +1,111 @@
+#include "TileGrid.h"
+#include <algorithm>
+#include <cmath>
+
+TileGrid::TileGrid(uint32_t imageWidth, uint32_t imageHeight, uint32_t tileSize)
+    : m_width(imageWidth), m_height(imageHeight), m_tileSize(std::max<uint32_t>(tileSize, 1)) {
+    if (m_width == 0 || m_height == 0) return;
+
+    m_levelCount = 1;
+    while (m_levelCount < MAX_LEVELS &&
+        (GetLevelWidth(m_levelCount - 1) > m_tileSize || GetLevelHeight(m_levelCount - 1) > m_tileSize)) {
+        ++m_levelCount;
+    }
+}
+
+uint32_t TileGrid::GetLevelWidth(uint32_t level) const {
+    uint64_t divisor = 1ull << level;
+    return std::max<uint32_t>(1, static_cast<uint32_t>((m_width + divisor - 1) / divisor));
+}
+
+uint32_t TileGrid::GetLevelHeight(uint32_t level) const {
+    uint64_t divisor = 1ull << level;
+    return std::max<uint32_t>(1, static_cast<uint32_t>((m_height + divisor - 1) / divisor));
+}
+
+uint32_t TileGrid::GetColumnCount(uint32_t level) const {
+    return (GetLevelWidth(level) + m_tileSize - 1) / m_tileSize;
+}
+
+uint32_t TileGrid::GetRowCount(uint32_t level) const {
+    return (GetLevelHeight(level) + m_tileSize - 1) / m_tileSize;
+}
+
+uint32_t TileGrid::SelectLevel(double scale) const {
+    if (m_levelCount == 0 || !(scale > 0.0) || scale >= 1.0) return 0;
+
+    // Level n holds 2^-n pixels per image pixel
+    uint32_t level = static_cast<uint32_t>(std::floor(std::log2(1.0 / scale)));
+    return std::min(level, m_levelCount - 1);
+}
+
+TileBounds TileGrid::GetBounds(const TileKey& key) const {
+    TileBounds bounds;
+    bounds.x = key.column * m_tileSize;
+    bounds.y = key.row * m_tileSize;
+    uint32_t levelWidth = GetLevelWidth(key.level);
+    uint32_t levelHeight = GetLevelHeight(key.level);
+    bounds.width = bounds.x < levelWidth ? std::min(m_tileSize, levelWidth - bounds.x) : 0;
+    bounds.height = bounds.y < levelHeight ? std::min(m_tileSize, levelHeight - bounds.y) : 0;
+    return bounds;
+}
+
+ImageRegion TileGrid::GetImageRegion(const TileKey& key) const {
+    // Scale by the exact level size, so the last tile ends on the image edge
+    TileBounds bounds = GetBounds(key);
+    double scaleX = static_cast<double>(m_width) / GetLevelWidth(key.level);
+    double scaleY = static_cast<double>(m_height) / GetLevelHeight(key.level);
+    return {
+        bounds.x * scaleX,
+        bounds.y * scaleY,
+        (bounds.x + bounds.width) * scaleX,
+        (bounds.y + bounds.height) * scaleY,
+    };
+}
+
+std::vector<TileKey> TileGrid::GetVisibleTiles(uint32_t level, const ImageRegion& region) const {
+    std::vector<TileKey> tiles;
+    if (level >= m_levelCount) return tiles;
+
+    ImageRegion clipped = {
+        std::max(region.left, 0.0),
+        std::max(region.top, 0.0),
+        std::min(region.right, static_cast<double>(m_width)),
+        std::min(region.bottom, static_cast<double>(m_height)),
+    };
+    if (clipped.IsEmpty()) return tiles;
+
+    // Region in tile units of this level
+    double unitsX = static_cast<double>(GetLevelWidth(level)) / m_width / m_tileSize;
+    double unitsY = static_cast<double>(GetLevelHeight(level)) / m_height / m_tileSize;
+    uint32_t columns = GetColumnCount(level);
+    uint32_t rows = GetRowCount(level);
+    uint32_t firstColumn = std::min(static_cast<uint32_t>(clipped.left * unitsX), columns - 1);
+    uint32_t firstRow = std::min(static_cast<uint32_t>(clipped.top * unitsY), rows - 1);
+    uint32_t lastColumn = std::min(static_cast<uint32_t>(std::ceil(clipped.right * unitsX)), columns) - 1;
+    uint32_t lastRow = std::min(static_cast<uint32_t>(std::ceil(clipped.bottom * unitsY)), rows) - 1;
+    lastColumn = std::max(lastColumn, firstColumn);
+    lastRow = std::max(lastRow, firstRow);
+
+    for (uint32_t row = firstRow; row <= lastRow; ++row) {
+        for (uint32_t column = firstColumn; column <= lastColumn; ++column) {
+            tiles.push_back({ level, column, row });
+        }
+    }
+
+    double centerX = (clipped.left + clipped.right) / 2.0 * unitsX;
+    double centerY = (clipped.top + clipped.bottom) / 2.0 * unitsY;
+    auto distance = [centerX, centerY](const TileKey& key) {
+        double dx = key.column + 0.5 - centerX;
+        double dy = key.row + 0.5 - centerY;
+        return dx * dx + dy * dy;
+    };
+    std::stable_sort(tiles.begin(), tiles.end(), [&distance](const TileKey& a, const TileKey& b) {
+        return distance(a) < distance(b);
+    });
+    return tiles;
+}
+
+std::wstring TileGrid::MakeKey(const TileKey& key) {
+    return std::to_wstring(key.level) + L'/' + std::to_wstring(key.column) + L'/' + std::to_wstring(key.row);
+}
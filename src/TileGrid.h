@@ -0,0 +1,77 @@
+#pragma once
+// Platform-neutral tile pyramid for images too large to hold as one bitmap. Level 0 is
+// the full image and each further level halves it, down to one that fits in a single
+// tile. For a view the grid picks the coarsest level that still has a pixel for every
+// screen pixel and lists the tiles of it that the view touches, nearest the centre first.
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct TileKey {
+    uint32_t level = 0;
+    uint32_t column = 0;
+    uint32_t row = 0;
+
+    bool operator==(const TileKey& other) const {
+        return level == other.level && column == other.column && row == other.row;
+    }
+};
+
+// Pixels of a tile within its level
+struct TileBounds {
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Axis-aligned rectangle in original image pixels
+struct ImageRegion {
+    double left = 0.0;
+    double top = 0.0;
+    double right = 0.0;
+    double bottom = 0.0;
+
+    bool IsEmpty() const { return right <= left || bottom <= top; }
+};
+
+class TileGrid {
+public:
+    TileGrid() = default;
+    TileGrid(uint32_t imageWidth, uint32_t imageHeight, uint32_t tileSize = DEFAULT_TILE_SIZE);
+
+    uint32_t GetImageWidth() const { return m_width; }
+    uint32_t GetImageHeight() const { return m_height; }
+    uint32_t GetTileSize() const { return m_tileSize; }
+    uint32_t GetLevelCount() const { return m_levelCount; }
+
+    uint32_t GetLevelWidth(uint32_t level) const;
+    uint32_t GetLevelHeight(uint32_t level) const;
+    uint32_t GetColumnCount(uint32_t level) const;
+    uint32_t GetRowCount(uint32_t level) const;
+
+    // Coarsest level with at least one pixel per screen pixel at scale (screen pixels per
+    // original image pixel)
+    uint32_t SelectLevel(double scale) const;
+
+    TileBounds GetBounds(const TileKey& key) const;
+
+    // Area of the original image a tile covers
+    ImageRegion GetImageRegion(const TileKey& key) const;
+
+    // Tiles of a level overlapping region, nearest its centre first
+    std::vector<TileKey> GetVisibleTiles(uint32_t level, const ImageRegion& region) const;
+
+    // Cache key of a tile
+    static std::wstring MakeKey(const TileKey& key);
+
+    static constexpr uint32_t DEFAULT_TILE_SIZE = 512;
+
+private:
+    static constexpr uint32_t MAX_LEVELS = 32;
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_tileSize = DEFAULT_TILE_SIZE;
+    uint32_t m_levelCount = 0;
+};
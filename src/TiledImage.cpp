@@ -0,0 +1,336 @@
+#include "pch.h"
+#include "TiledImage.h"
+#include "MappedFile.h"
+
+TiledImage::TiledImage() : m_shared(std::make_shared<Shared>()) {
+}
+
+TiledImage::~TiledImage() {
+    // A running decode task keeps the shared state alive and finds it closed
+    std::lock_guard<std::mutex> lock(m_shared->mutex);
+    m_shared->closed = true;
+    m_shared->queue.clear();
+    m_shared->ready.clear();
+    m_shared->onTileReady = nullptr;
+}
+
+void TiledImage::Initialize(ImageLoader* loader, TaskPool* pool, std::function<void()> onTileReady) {
+    m_loader = loader;
+    m_pool = pool;
+    std::lock_guard<std::mutex> lock(m_shared->mutex);
+    m_shared->onTileReady = std::move(onTileReady);
+}
+
+bool TiledImage::NeedsTiling(uint32_t width, uint32_t height, uint32_t maxBitmapSize) {
+    return width > maxBitmapSize || height > maxBitmapSize ||
+        static_cast<uint64_t>(width) * height > TILING_MIN_PIXELS;
+}
+
+void TiledImage::Open(const std::wstring& filePath, uint32_t width, uint32_t height) {
+    if (filePath == m_filePath && width == m_grid.GetImageWidth() && height == m_grid.GetImageHeight()) {
+        return;
+    }
+
+    DropTiles();
+    m_filePath = filePath;
+    m_grid = TileGrid(width, height);
+
+    std::lock_guard<std::mutex> lock(m_shared->mutex);
+    m_shared->generation = ++m_generation;
+    m_shared->filePath = filePath;
+    m_shared->grid = m_grid;
+    m_shared->queue.clear();
+    m_shared->busy.clear();
+    m_shared->ready.clear();
+}
+
+void TiledImage::Close() {
+    if (m_filePath.empty()) return;
+
+    DropTiles();
+    m_filePath.clear();
+    m_grid = TileGrid();
+
+    std::lock_guard<std::mutex> lock(m_shared->mutex);
+    m_shared->generation = ++m_generation;
+    m_shared->filePath.clear();
+    m_shared->grid = m_grid;
+    m_shared->queue.clear();
+    m_shared->busy.clear();
+    m_shared->ready.clear();
+}
+
+std::vector<Renderer::ImageTile> TiledImage::Update(const D2D1_RECT_F& region, float scale) {
+    std::vector<Renderer::ImageTile> result;
+    if (m_filePath.empty() || m_grid.GetLevelCount() == 0) return result;
+
+    ImageRegion view = { region.left, region.top, region.right, region.bottom };
+    uint32_t level = m_grid.SelectLevel(scale);
+    std::vector<TileKey> visible = m_grid.GetVisibleTiles(level, view);
+
+    std::vector<TileKey> missing;
+    std::vector<Renderer::ImageTile> ready;
+    for (const auto& key : visible) {
+        auto handle = m_tiles.Find(TileGrid::MakeKey(key));
+        if (handle == m_tiles.INVALID_HANDLE) {
+            missing.push_back(key);
+            continue;
+        }
+        m_tiles.Touch(handle);
+        ImageRegion area = m_grid.GetImageRegion(key);
+        ready.push_back({ m_tiles.GetValue(handle).bitmap, D2D1::RectF(static_cast<float>(area.left),
+            static_cast<float>(area.top), static_cast<float>(area.right), static_cast<float>(area.bottom)) });
+    }
+
+    // Gaps show whatever coarser tiles are still cached, coarsest first
+    if (!missing.empty()) {
+        for (uint32_t coarser = m_grid.GetLevelCount() - 1; coarser > level; --coarser) {
+            for (const auto& key : m_grid.GetVisibleTiles(coarser, view)) {
+                auto handle = m_tiles.Find(TileGrid::MakeKey(key));
+                if (handle == m_tiles.INVALID_HANDLE) continue;
+                ImageRegion area = m_grid.GetImageRegion(key);
+                result.push_back({ m_tiles.GetValue(handle).bitmap, D2D1::RectF(static_cast<float>(area.left),
+                    static_cast<float>(area.top), static_cast<float>(area.right), static_cast<float>(area.bottom)) });
+            }
+        }
+    }
+    result.insert(result.end(), ready.begin(), ready.end());
+
+    std::lock_guard<std::mutex> lock(m_shared->mutex);
+    m_shared->queue.clear();
+    for (const auto& key : missing) {
+        if (!m_shared->busy.count(TileGrid::MakeKey(key))) {
+            m_shared->queue.push_back(key);
+        }
+    }
+    StartDrainLocked();
+    return result;
+}
+
+void TiledImage::StartDrainLocked() {
+    if (m_shared->draining || m_shared->queue.empty() || !m_pool) return;
+
+    // One task works through the queue, so a decoder's sources are reused across tiles
+    m_shared->draining = true;
+    std::shared_ptr<Shared> shared = m_shared;
+    m_pool->Submit(TaskPriority::Interactive, [shared]() { Drain(shared); });
+}
+
+void TiledImage::Drain(const std::shared_ptr<Shared>& shared) {
+    IWICImagingFactory* wicFactory = ImageLoader::GetWorkerWicFactory();
+    LevelSources sources;
+
+    while (true) {
+        TileKey key;
+        TileGrid grid;
+        uint64_t generation = 0;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (shared->closed || shared->queue.empty() || !wicFactory) {
+                shared->draining = false;
+                return;
+            }
+            key = shared->queue.front();
+            shared->queue.pop_front();
+            shared->busy.insert(TileGrid::MakeKey(key));
+            generation = shared->generation;
+            grid = shared->grid;
+            if (sources.filePath != shared->filePath) {
+                sources = LevelSources();
+                sources.filePath = shared->filePath;
+            }
+        }
+
+        DecodedTile tile;
+        tile.generation = generation;
+        tile.key = key;
+        bool ok = DecodeTile(wicFactory, sources, grid, key, tile.pixels);
+
+        std::function<void()> notify;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (generation != shared->generation) continue;
+            if (ok) {
+                shared->ready.push_back(std::move(tile));
+                notify = shared->onTileReady;
+            } else {
+                shared->busy.erase(TileGrid::MakeKey(key));
+            }
+        }
+        if (notify) {
+            notify();
+        }
+    }
+}
+
+bool TiledImage::DecodeTile(IWICImagingFactory* wicFactory, LevelSources& sources, const TileGrid& grid,
+    const TileKey& key, PixelBuffer& out) {
+    if (!sources.frame) {
+        // Tiles read scattered parts of the file; mapped, those come from the page cache.
+        // The mapping goes with the sources when this drain finishes.
+        ComPtr<IWICBitmapDecoder> decoder = ImageLoader::CreateDecoder(wicFactory, sources.filePath,
+            MappedFile::Map(sources.filePath));
+        if (!decoder || FAILED(decoder->GetFrame(0, &sources.frame))) return false;
+        sources.frame.As(&sources.transform);
+        sources.levels.assign(grid.GetLevelCount(), nullptr);
+    }
+    if (key.level >= sources.levels.size()) return false;
+
+    TileBounds bounds = grid.GetBounds(key);
+    if (bounds.width == 0 || bounds.height == 0) return false;
+    WICRect rect = { static_cast<INT>(bounds.x), static_cast<INT>(bounds.y),
+        static_cast<INT>(bounds.width), static_cast<INT>(bounds.height) };
+    UINT levelWidth = grid.GetLevelWidth(key.level);
+    UINT levelHeight = grid.GetLevelHeight(key.level);
+
+    // Levels the decoder produces itself (JPEG DCT scaling down to 1/8) skip the scaler
+    if (key.level > 0 && sources.transform) {
+        UINT nativeWidth = levelWidth, nativeHeight = levelHeight;
+        if (SUCCEEDED(sources.transform->GetClosestSize(&nativeWidth, &nativeHeight)) &&
+            nativeWidth == levelWidth && nativeHeight == levelHeight &&
+            CopyNativeRegion(wicFactory, sources.transform.Get(), levelWidth, levelHeight, rect, out)) {
+            return true;
+        }
+    }
+
+    ComPtr<IWICBitmapSource>& source = sources.levels[key.level];
+    if (!source) {
+        ComPtr<IWICBitmapSource> scaled = sources.frame;
+        if (key.level > 0) {
+            ComPtr<IWICBitmapScaler> scaler;
+            HRESULT hr = wicFactory->CreateBitmapScaler(&scaler);
+            if (SUCCEEDED(hr)) {
+                hr = scaler->Initialize(sources.frame.Get(), levelWidth, levelHeight, WICBitmapInterpolationModeFant);
+            }
+            if (FAILED(hr)) return false;
+            scaled = scaler;
+        }
+
+        ComPtr<IWICFormatConverter> converter;
+        HRESULT hr = wicFactory->CreateFormatConverter(&converter);
+        if (SUCCEEDED(hr)) {
+            hr = converter->Initialize(scaled.Get(), WIC_PIXEL_FORMAT_PREMULTIPLIED, WICBitmapDitherTypeNone,
+                nullptr, 0.0f, WICBitmapPaletteTypeMedianCut);
+        }
+        if (FAILED(hr)) return false;
+        source = converter;
+    }
+
+    out.width = bounds.width;
+    out.height = bounds.height;
+    out.stride = bounds.width * 4;
+    out.pixels.resize(static_cast<size_t>(out.stride) * out.height);
+    HRESULT hr = source->CopyPixels(&rect, out.stride, static_cast<UINT>(out.pixels.size()), out.pixels.data());
+    return SUCCEEDED(hr);
+}
+
+bool TiledImage::CopyNativeRegion(IWICImagingFactory* wicFactory, IWICBitmapSourceTransform* transform,
+    UINT levelWidth, UINT levelHeight, const WICRect& rect, PixelBuffer& out) {
+    // The transform writes its closest format; convert from there
+    WICPixelFormatGUID format = WIC_PIXEL_FORMAT_PREMULTIPLIED;
+    HRESULT hr = transform->GetClosestPixelFormat(&format);
+    if (FAILED(hr)) return false;
+
+    ComPtr<IWICBitmap> region;
+    hr = wicFactory->CreateBitmap(rect.Width, rect.Height, format, WICBitmapCacheOnLoad, &region);
+    if (FAILED(hr)) return false;
+    {
+        WICRect whole = { 0, 0, rect.Width, rect.Height };
+        ComPtr<IWICBitmapLock> lock;
+        hr = region->Lock(&whole, WICBitmapLockWrite, &lock);
+        UINT stride = 0, bufferSize = 0;
+        BYTE* data = nullptr;
+        if (SUCCEEDED(hr)) {
+            hr = lock->GetStride(&stride);
+        }
+        if (SUCCEEDED(hr)) {
+            hr = lock->GetDataPointer(&bufferSize, &data);
+        }
+        if (SUCCEEDED(hr)) {
+            hr = transform->CopyPixels(&rect, levelWidth, levelHeight, &format, WICBitmapTransformRotate0,
+                stride, bufferSize, data);
+        }
+        if (FAILED(hr)) return false;
+    }
+
+    WICRect whole = { 0, 0, rect.Width, rect.Height };
+    return CopyRegion(wicFactory, region.Get(), whole, out);
+}
+
+bool TiledImage::CopyRegion(IWICImagingFactory* wicFactory, IWICBitmapSource* source, const WICRect& rect,
+    PixelBuffer& out) {
+    ComPtr<IWICFormatConverter> converter;
+    HRESULT hr = wicFactory->CreateFormatConverter(&converter);
+    if (SUCCEEDED(hr)) {
+        hr = converter->Initialize(source, WIC_PIXEL_FORMAT_PREMULTIPLIED, WICBitmapDitherTypeNone,
+            nullptr, 0.0f, WICBitmapPaletteTypeMedianCut);
+    }
+    if (FAILED(hr)) return false;
+
+    out.width = static_cast<uint32_t>(rect.Width);
+    out.height = static_cast<uint32_t>(rect.Height);
+    out.stride = out.width * 4;
+    out.pixels.resize(static_cast<size_t>(out.stride) * out.height);
+    hr = converter->CopyPixels(&rect, out.stride, static_cast<UINT>(out.pixels.size()), out.pixels.data());
+    return SUCCEEDED(hr);
+}
+
+bool TiledImage::ProcessQueue() {
+    std::vector<DecodedTile> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_shared->mutex);
+        ready.swap(m_shared->ready);
+        for (const auto& tile : ready) {
+            m_shared->busy.erase(TileGrid::MakeKey(tile.key));
+        }
+    }
+
+    bool added = false;
+    for (auto& tile : ready) {
+        if (tile.generation != m_generation || !m_loader) continue;
+
+        ComPtr<ID2D1Bitmap> bitmap = m_loader->CreateBitmapFromBuffer(tile.pixels);
+        if (!bitmap) continue;
+
+        Tile entry;
+        entry.bitmap = bitmap;
+        entry.key = tile.key;
+        entry.bytes = tile.pixels.ByteSize();
+        std::wstring key = TileGrid::MakeKey(tile.key);
+        auto existing = m_tiles.Find(key);
+        if (existing != m_tiles.INVALID_HANDLE) {
+            m_totalBytes -= m_tiles.GetValue(existing).bytes;
+        }
+        m_totalBytes += entry.bytes;
+        m_tiles.Insert(key, std::move(entry));
+        added = true;
+    }
+
+    // Tiles just uploaded are the newest; the oldest go first
+    if (added) {
+        EvictToBudget(ready.size());
+    }
+    return added;
+}
+
+void TiledImage::EvictToBudget(size_t keep) {
+    while (m_totalBytes > m_maxBytes && m_tiles.Size() > keep) {
+        auto handle = m_tiles.LeastRecent();
+        m_totalBytes -= m_tiles.GetValue(handle).bytes;
+        m_tiles.Erase(handle);
+    }
+}
+
+void TiledImage::DropTiles() {
+    m_tiles.Clear();
+    m_totalBytes = 0;
+}
+
+void TiledImage::OnDeviceLost() {
+    DropTiles();
+}
+
+void TiledImage::SetMaxBytes(size_t maxBytes) {
+    m_maxBytes = maxBytes;
+    EvictToBudget(0);
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "pch.h"
+#include "Renderer.h"
+#include "ImageLoader.h"
+#include "TileGrid.h"
+#include "LruIndex.h"
+#include "TaskPool.h"
+
+// Tiled view of an image too large for one bitmap (Direct2D bitmaps stop at about 16384
+// pixels a side, and a 30000x20000 scan would need 2.4 GB as BGRA). Only the tiles that
+// cover the visible region are decoded, at the pyramid level that matches the zoom. They
+// are decoded on the task pool through WIC region copies and uploaded on the UI thread.
+// A byte-budgeted LRU holds them, so memory stays bounded whatever the image size.
+class TiledImage {
+public:
+    TiledImage();
+    ~TiledImage();
+
+    TiledImage(const TiledImage&) = delete;
+    TiledImage& operator=(const TiledImage&) = delete;
+
+    // onTileReady is invoked from a worker when decoded tiles are waiting; the owner should
+    // respond by calling ProcessQueue on the UI thread
+    void Initialize(ImageLoader* loader, TaskPool* pool, std::function<void()> onTileReady);
+
+    // Whether an image should be magnified through tiles rather than a full-resolution bitmap
+    static bool NeedsTiling(uint32_t width, uint32_t height, uint32_t maxBitmapSize);
+
+    // Start tiling a file (keeps the tiles if it is already open); Close drops everything
+    void Open(const std::wstring& filePath, uint32_t width, uint32_t height);
+    void Close();
+    const std::wstring& GetFilePath() const { return m_filePath; }
+
+    // Tiles for a region of the image (original pixels) shown at scale screen pixels per
+    // image pixel. Missing tiles are queued nearest the centre first, replacing the previous
+    // request. Returns what can be drawn now: cached coarser tiles stand in for missing
+    // ones and come first, so finer tiles paint over them.
+    std::vector<Renderer::ImageTile> Update(const D2D1_RECT_F& region, float scale);
+
+    // Upload finished tiles (UI thread only); true if any arrived for the open image
+    bool ProcessQueue();
+
+    // Every tile bitmap belongs to the lost device; they are decoded again as needed
+    void OnDeviceLost();
+
+    void SetMaxBytes(size_t maxBytes);
+    size_t GetTotalBytes() const { return m_totalBytes; }
+
+    static constexpr size_t DEFAULT_MAX_BYTES = 192ull * 1024 * 1024;
+
+    // Above this many pixels a full-resolution level costs too much even if it fits
+    static constexpr uint64_t TILING_MIN_PIXELS = 64ull * 1024 * 1024;
+
+private:
+    struct Tile {
+        ComPtr<ID2D1Bitmap> bitmap;
+        TileKey key;
+        size_t bytes = 0;
+    };
+
+    struct DecodedTile {
+        uint64_t generation = 0;
+        TileKey key;
+        PixelBuffer pixels;
+    };
+
+    // State shared with the decode task, which can outlive a Close or the object itself.
+    // The generation changes with every Open and Close so stale tiles are dropped.
+    struct Shared {
+        std::mutex mutex;
+        uint64_t generation = 0;
+        std::wstring filePath;
+        TileGrid grid;
+        std::deque<TileKey> queue;
+        std::unordered_set<std::wstring> busy;  // Decoding, or decoded and not yet uploaded
+        std::vector<DecodedTile> ready;
+        bool draining = false;
+        bool closed = false;
+        std::function<void()> onTileReady;
+    };
+
+    // WIC sources a decode task reads tiles through, one per pyramid level
+    struct LevelSources {
+        std::wstring filePath;
+        ComPtr<IWICBitmapFrameDecode> frame;
+        ComPtr<IWICBitmapSourceTransform> transform;
+        std::vector<ComPtr<IWICBitmapSource>> levels;
+    };
+
+    static void Drain(const std::shared_ptr<Shared>& shared);
+    static bool DecodeTile(IWICImagingFactory* wicFactory, LevelSources& sources, const TileGrid& grid,
+        const TileKey& key, PixelBuffer& out);
+    static bool CopyNativeRegion(IWICImagingFactory* wicFactory, IWICBitmapSourceTransform* transform,
+        UINT levelWidth, UINT levelHeight, const WICRect& rect, PixelBuffer& out);
+    static bool CopyRegion(IWICImagingFactory* wicFactory, IWICBitmapSource* source, const WICRect& rect,
+        PixelBuffer& out);
+    void StartDrainLocked();
+    void EvictToBudget(size_t keep);
+    void DropTiles();
+
+    ImageLoader* m_loader = nullptr;
+    TaskPool* m_pool = nullptr;
+    std::shared_ptr<Shared> m_shared;
+
+    // UI thread state
+    std::wstring m_filePath;
+    TileGrid m_grid;
+    uint64_t m_generation = 0;
+    LruIndex<Tile> m_tiles;
+    size_t m_totalBytes = 0;
+    size_t m_maxBytes = DEFAULT_MAX_BYTES;
+};
@@ -216,6 +216,18 @@ LRESULT Window::HandleMessage(UINT msg, WPARAM wParam, LPARAM lParam) {
         }
         return 0;
 
+    case WM_APP_DECODE_COMPLETE:
+        if (m_app) {
+            m_app->OnDecodeComplete();
+        }
+        return 0;
+
+    case WM_APP_FOLDER_SCANNED:
+        if (m_app) {
+            m_app->OnFolderScanComplete();
+        }
+        return 0;
+
     case WM_DESTROY:
         PostQuitMessage(0);
         return 0;
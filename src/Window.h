@@ -23,6 +23,11 @@ public:
     int GetHeight() const { return m_height; }
     float GetDpiScale() const { return m_dpiScale; }
 
+    // Posted by background decode workers when finished images are ready for upload
+    static constexpr UINT WM_APP_DECODE_COMPLETE = WM_APP + 1;
+    // Posted by the task pool when a folder listing is ready
+    static constexpr UINT WM_APP_FOLDER_SCANNED = WM_APP + 2;
+
 private:
     static LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
     LRESULT HandleMessage(UINT msg, WPARAM wParam, LPARAM lParam);
@@ -0,0 +1,148 @@
+#include "YCbCrConverter.h"
+#include <algorithm>
+#include <climits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define YCBCR_USE_SSE2 1
+#endif
+
+YCbCrConverter::Tap YCbCrConverter::MakeTap(uint32_t position, uint32_t outputSize, uint32_t sourceSize) {
+    // Centre of output sample position in source coordinates: (position + 0.5) * source / output - 0.5
+    int64_t numerator = (2 * static_cast<int64_t>(position) + 1) * sourceSize - outputSize;
+    int64_t denominator = 2 * static_cast<int64_t>(outputSize);
+    if (numerator <= 0) {
+        return { 0, 0, 0 };
+    }
+
+    uint32_t first = static_cast<uint32_t>(numerator / denominator);
+    if (first >= sourceSize - 1) {
+        return { sourceSize - 1, sourceSize - 1, 0 };
+    }
+    uint32_t weight = static_cast<uint32_t>((numerator % denominator) * WEIGHT_ONE / denominator);
+    return { first, first + 1, weight };
+}
+
+void YCbCrConverter::ConvertPixels(const uint8_t* y, const uint8_t* cb, const uint8_t* cr,
+    uint8_t* bgra, uint32_t count) {
+    constexpr int round = 1 << (COEF_BITS - 1);
+    for (uint32_t i = 0; i < count; ++i) {
+        int luma = y[i];
+        int blue = cb[i] - CHROMA_BIAS;
+        int red = cr[i] - CHROMA_BIAS;
+        bgra[0] = static_cast<uint8_t>(std::clamp(luma + ((CB_TO_B * blue + round) >> COEF_BITS), 0, 255));
+        bgra[1] = static_cast<uint8_t>(std::clamp(luma + ((CB_TO_G * blue + CR_TO_G * red + round) >> COEF_BITS), 0, 255));
+        bgra[2] = static_cast<uint8_t>(std::clamp(luma + ((CR_TO_R * red + round) >> COEF_BITS), 0, 255));
+        bgra[3] = 255;
+        bgra += 4;
+    }
+}
+
+#ifdef YCBCR_USE_SSE2
+// Coefficients for _mm_madd_epi16 over interleaved (cb, cr) pairs
+static __m128i PairCoefficients(int cbCoef, int crCoef) {
+    return _mm_set_epi16(
+        static_cast<short>(crCoef), static_cast<short>(cbCoef), static_cast<short>(crCoef), static_cast<short>(cbCoef),
+        static_cast<short>(crCoef), static_cast<short>(cbCoef), static_cast<short>(crCoef), static_cast<short>(cbCoef));
+}
+#endif
+
+void YCbCrConverter::ConvertRow(const uint8_t* y, const uint8_t* cb, const uint8_t* cr,
+    uint8_t* bgra, uint32_t width) {
+    uint32_t x = 0;
+#ifdef YCBCR_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(CHROMA_BIAS);
+    const __m128i round = _mm_set1_epi32(1 << (COEF_BITS - 1));
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+    const __m128i toRed = PairCoefficients(0, CR_TO_R);
+    const __m128i toGreen = PairCoefficients(CB_TO_G, CR_TO_G);
+    const __m128i toBlue = PairCoefficients(CB_TO_B, 0);
+
+    for (; x + 8 <= width; x += 8) {
+        __m128i luma = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + x)), zero);
+        __m128i blue = _mm_sub_epi16(
+            _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cb + x)), zero), bias);
+        __m128i red = _mm_sub_epi16(
+            _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(cr + x)), zero), bias);
+        __m128i pairsLow = _mm_unpacklo_epi16(blue, red);
+        __m128i pairsHigh = _mm_unpackhi_epi16(blue, red);
+
+        // Same rounding and clamping as ConvertPixels, so both paths agree exactly
+        auto channel = [&](__m128i coefficients) {
+            __m128i low = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(pairsLow, coefficients), round), COEF_BITS);
+            __m128i high = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(pairsHigh, coefficients), round), COEF_BITS);
+            __m128i value = _mm_adds_epi16(_mm_packs_epi32(low, high), luma);
+            return _mm_packus_epi16(value, value);
+        };
+        __m128i b = channel(toBlue);
+        __m128i g = channel(toGreen);
+        __m128i r = channel(toRed);
+
+        __m128i blueGreen = _mm_unpacklo_epi8(b, g);
+        __m128i redAlpha = _mm_unpacklo_epi8(r, alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bgra + x * 4), _mm_unpacklo_epi16(blueGreen, redAlpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bgra + x * 4 + 16), _mm_unpackhi_epi16(blueGreen, redAlpha));
+    }
+#endif
+    ConvertPixels(y + x, cb + x, cr + x, bgra + static_cast<size_t>(x) * 4, width - x);
+}
+
+bool YCbCrConverter::ConvertToBgra(const PlanarYCbCr& source, PixelBuffer& out) {
+    uint32_t width = source.width;
+    uint32_t height = source.height;
+    uint32_t chromaWidth = source.chromaWidth;
+    uint32_t chromaHeight = source.chromaHeight;
+    if (width == 0 || height == 0 || chromaWidth == 0 || chromaHeight == 0 ||
+        source.y.size() < static_cast<size_t>(width) * height ||
+        source.cb.size() < static_cast<size_t>(chromaWidth) * chromaHeight ||
+        source.cr.size() < static_cast<size_t>(chromaWidth) * chromaHeight) {
+        return false;
+    }
+
+    size_t stride = static_cast<size_t>(width) * 4;
+    if (stride * height > UINT_MAX) return false;
+
+    std::vector<Tap> columns(width);
+    for (uint32_t x = 0; x < width; ++x) {
+        columns[x] = MakeTap(x, width, chromaWidth);
+    }
+
+    out.pixels.resize(stride * height);
+    std::vector<uint8_t> blendedCb(chromaWidth), blendedCr(chromaWidth);
+    std::vector<uint8_t> rowCb(width), rowCr(width);
+
+    for (uint32_t y = 0; y < height; ++y) {
+        // Blend the two nearest chroma rows, then widen to full resolution
+        Tap row = MakeTap(y, height, chromaHeight);
+        const uint8_t* cb0 = source.cb.data() + static_cast<size_t>(row.first) * chromaWidth;
+        const uint8_t* cb1 = source.cb.data() + static_cast<size_t>(row.second) * chromaWidth;
+        const uint8_t* cr0 = source.cr.data() + static_cast<size_t>(row.first) * chromaWidth;
+        const uint8_t* cr1 = source.cr.data() + static_cast<size_t>(row.second) * chromaWidth;
+        uint32_t keep = WEIGHT_ONE - row.weight;
+        for (uint32_t x = 0; x < chromaWidth; ++x) {
+            blendedCb[x] = static_cast<uint8_t>((cb0[x] * keep + cb1[x] * row.weight + WEIGHT_ONE / 2) / WEIGHT_ONE);
+            blendedCr[x] = static_cast<uint8_t>((cr0[x] * keep + cr1[x] * row.weight + WEIGHT_ONE / 2) / WEIGHT_ONE);
+        }
+
+        if (chromaWidth == width) {
+            rowCb = blendedCb;
+            rowCr = blendedCr;
+        } else {
+            for (uint32_t x = 0; x < width; ++x) {
+                const Tap& tap = columns[x];
+                uint32_t first = WEIGHT_ONE - tap.weight;
+                rowCb[x] = static_cast<uint8_t>((blendedCb[tap.first] * first + blendedCb[tap.second] * tap.weight + WEIGHT_ONE / 2) / WEIGHT_ONE);
+                rowCr[x] = static_cast<uint8_t>((blendedCr[tap.first] * first + blendedCr[tap.second] * tap.weight + WEIGHT_ONE / 2) / WEIGHT_ONE);
+            }
+        }
+
+        ConvertRow(source.y.data() + static_cast<size_t>(y) * width, rowCb.data(), rowCr.data(),
+            out.pixels.data() + static_cast<size_t>(y) * stride, width);
+    }
+
+    out.width = width;
+    out.height = height;
+    out.stride = static_cast<uint32_t>(stride);
+    return true;
+}
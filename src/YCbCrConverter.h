@@ -0,0 +1,36 @@
+#pragma once
+// Platform-neutral conversion of planar JPEG YCbCr to the BGRA pixels the renderer
+// uploads. Chroma is upsampled bilinearly with centred siting (for 2x subsampling this is
+// the 3/4-1/4 "fancy" upsampling of common JPEG decoders), then each row is converted
+// with integer BT.601 full-range coefficients: SSE2 eight pixels at a time where
+// available, with a scalar path that gives bit-identical results.
+#include "DecodePipeline.h"
+
+class YCbCrConverter {
+public:
+    // Returns false if source is empty or inconsistent
+    static bool ConvertToBgra(const PlanarYCbCr& source, PixelBuffer& out);
+
+private:
+    // Source index pair and weight of the second (0-256) for one upsampled position
+    struct Tap {
+        uint32_t first;
+        uint32_t second;
+        uint32_t weight;
+    };
+
+    static Tap MakeTap(uint32_t position, uint32_t outputSize, uint32_t sourceSize);
+    static void ConvertRow(const uint8_t* y, const uint8_t* cb, const uint8_t* cr,
+        uint8_t* bgra, uint32_t width);
+    static void ConvertPixels(const uint8_t* y, const uint8_t* cb, const uint8_t* cr,
+        uint8_t* bgra, uint32_t count);
+
+    // Coefficients scaled by 2^COEF_BITS
+    static constexpr int COEF_BITS = 14;
+    static constexpr int CR_TO_R = 22970;    // 1.402
+    static constexpr int CB_TO_G = -5638;    // -0.344136
+    static constexpr int CR_TO_G = -11700;   // -0.714136
+    static constexpr int CB_TO_B = 29032;    // 1.772
+    static constexpr int CHROMA_BIAS = 128;
+    static constexpr uint32_t WEIGHT_ONE = 256;
+};
@@ -0,0 +1,225 @@
+#include "BlockCompressor.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+// Measured at about 42 dB and 7 levels on the test images; the bounds leave headroom for
+// encoder changes without letting visible banding through
+constexpr double MIN_PSNR_DB = 38.0;
+constexpr int MAX_COLOR_ERROR = 12;
+
+struct Quality {
+    double psnr = 0.0;       // Colour channels
+    int maxColorError = 0;
+    int maxAlphaError = 0;
+};
+
+PixelBuffer MakeBuffer(uint32_t width, uint32_t height) {
+    PixelBuffer buffer;
+    buffer.width = width;
+    buffer.height = height;
+    buffer.stride = width * 4;
+    buffer.pixels.resize(static_cast<size_t>(buffer.stride) * height);
+    return buffer;
+}
+
+uint32_t Noise(uint32_t x, uint32_t y) {
+    uint32_t n = x * 374761393u + y * 668265263u;
+    n = (n ^ (n >> 13)) * 1274126177u;
+    return n ^ (n >> 16);
+}
+
+// Smooth gradients with mild noise, like a downscaled photo
+PixelBuffer MakePhoto(uint32_t width, uint32_t height) {
+    PixelBuffer photo = MakeBuffer(width, height);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            uint8_t* pixel = photo.pixels.data() + static_cast<size_t>(y) * photo.stride + x * 4;
+            int grain = static_cast<int>(Noise(x, y) % 9) - 4;
+            double fx = static_cast<double>(x) / width;
+            double fy = static_cast<double>(y) / height;
+            pixel[0] = static_cast<uint8_t>(std::clamp(static_cast<int>(40 + 150 * fy) + grain, 0, 255));
+            pixel[1] = static_cast<uint8_t>(std::clamp(static_cast<int>(90 + 100 * std::sin(6 * fx)) + grain, 0, 255));
+            pixel[2] = static_cast<uint8_t>(std::clamp(static_cast<int>(200 * fx * fy + 30) + grain, 0, 255));
+            pixel[3] = 255;
+        }
+    }
+    return photo;
+}
+
+// The photo faded to transparent along x, premultiplied as decoded images are
+PixelBuffer MakeTranslucent(uint32_t width, uint32_t height) {
+    PixelBuffer image = MakePhoto(width, height);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            uint8_t* pixel = image.pixels.data() + static_cast<size_t>(y) * image.stride + x * 4;
+            uint32_t alpha = 255 * x / (width - 1);
+            for (int c = 0; c < 3; ++c) {
+                pixel[c] = static_cast<uint8_t>((pixel[c] * alpha + 127) / 255);
+            }
+            pixel[3] = static_cast<uint8_t>(alpha);
+        }
+    }
+    return image;
+}
+
+PixelBuffer Crop(const PixelBuffer& source, uint32_t width, uint32_t height) {
+    PixelBuffer crop = MakeBuffer(width, height);
+    for (uint32_t y = 0; y < height; ++y) {
+        std::copy_n(source.pixels.data() + static_cast<size_t>(y) * source.stride, crop.stride,
+            crop.pixels.data() + static_cast<size_t>(y) * crop.stride);
+    }
+    return crop;
+}
+
+Quality Measure(const PixelBuffer& original, const PixelBuffer& decoded) {
+    Quality quality;
+    double squaredError = 0.0;
+    size_t samples = 0;
+    for (uint32_t y = 0; y < original.height; ++y) {
+        for (uint32_t x = 0; x < original.width; ++x) {
+            const uint8_t* a = original.pixels.data() + static_cast<size_t>(y) * original.stride + x * 4;
+            const uint8_t* b = decoded.pixels.data() + static_cast<size_t>(y) * decoded.stride + x * 4;
+            for (int c = 0; c < 3; ++c) {
+                int difference = std::abs(a[c] - b[c]);
+                squaredError += static_cast<double>(difference) * difference;
+                quality.maxColorError = std::max(quality.maxColorError, difference);
+                samples++;
+            }
+            quality.maxAlphaError = std::max(quality.maxAlphaError, std::abs(a[3] - b[3]));
+        }
+    }
+    quality.psnr = squaredError == 0.0 ? INFINITY :
+        10.0 * std::log10(255.0 * 255.0 / (squaredError / samples));
+    return quality;
+}
+
+bool RoundTrip(const PixelBuffer& source, BlockImage& compressed, Quality& quality) {
+    PixelBuffer decoded;
+    if (!BlockCompressor::Compress(source, compressed) || !BlockCompressor::Decompress(compressed, decoded)) {
+        return false;
+    }
+    if (decoded.width != source.width || decoded.height != source.height) {
+        return false;
+    }
+    quality = Measure(source, decoded);
+    return true;
+}
+
+void TestOpaquePhotoUsesBc1() {
+    PixelBuffer photo = MakePhoto(256, 192);
+    BlockImage compressed;
+    Quality quality;
+    CHECK(RoundTrip(photo, compressed, quality));
+    std::printf("  BC1 photo: %.1f dB, max error %d\n", quality.psnr, quality.maxColorError);
+
+    CHECK(compressed.format == BlockFormat::BC1);
+    CHECK(compressed.ByteSize() * 8 == photo.ByteSize());
+    CHECK(quality.psnr >= MIN_PSNR_DB);
+    CHECK(quality.maxColorError <= MAX_COLOR_ERROR);
+    CHECK(quality.maxAlphaError == 0);
+}
+
+void TestTranslucentUsesBc3() {
+    PixelBuffer image = MakeTranslucent(256, 192);
+    BlockImage compressed;
+    Quality quality;
+    CHECK(RoundTrip(image, compressed, quality));
+    std::printf("  BC3 translucent: %.1f dB, max error %d, max alpha error %d\n", quality.psnr,
+        quality.maxColorError, quality.maxAlphaError);
+
+    CHECK(compressed.format == BlockFormat::BC3);
+    CHECK(compressed.ByteSize() * 4 == image.ByteSize());
+    CHECK(quality.psnr >= MIN_PSNR_DB);
+    CHECK(quality.maxColorError <= MAX_COLOR_ERROR);
+    // Eight interpolated alphas across a block's range: at most half a step off
+    CHECK(quality.maxAlphaError <= 2);
+}
+
+// Blocks of one colour the 5:6:5 endpoints can hold exactly come back unchanged
+void TestFlatBlocksAreExact() {
+    PixelBuffer flat = MakeBuffer(32, 32);
+    for (uint32_t y = 0; y < flat.height; ++y) {
+        for (uint32_t x = 0; x < flat.width; ++x) {
+            uint32_t block = (y / 4) * 8 + x / 4;
+            int r5 = static_cast<int>(block * 7 % 32);
+            int g6 = static_cast<int>(block * 13 % 64);
+            int b5 = static_cast<int>(block * 3 % 32);
+            uint8_t* pixel = flat.pixels.data() + static_cast<size_t>(y) * flat.stride + x * 4;
+            pixel[0] = static_cast<uint8_t>((b5 << 3) | (b5 >> 2));
+            pixel[1] = static_cast<uint8_t>((g6 << 2) | (g6 >> 4));
+            pixel[2] = static_cast<uint8_t>((r5 << 3) | (r5 >> 2));
+            pixel[3] = 255;
+        }
+    }
+
+    BlockImage compressed;
+    Quality quality;
+    CHECK(RoundTrip(flat, compressed, quality));
+    CHECK(quality.maxColorError == 0);
+}
+
+// Sizes that are not whole blocks decode back to their own size
+void TestPartialBlocks() {
+    PixelBuffer full = MakePhoto(256, 192);
+    for (uint32_t size : { 1u, 3u, 5u, 13u }) {
+        PixelBuffer photo = Crop(full, size, size + 2);
+        BlockImage compressed;
+        Quality quality;
+        CHECK(RoundTrip(photo, compressed, quality));
+        CHECK(compressed.BlocksWide() == (size + 3) / 4 && compressed.BlocksHigh() == (size + 5) / 4);
+        CHECK(quality.maxColorError <= MAX_COLOR_ERROR);
+    }
+
+    BlockImage compressed;
+    CHECK(!BlockCompressor::Compress(PixelBuffer(), compressed));
+}
+
+// Block rows split across threads give the same output as one pass, and the speed is
+// reported for comparison across machines
+void TestThreadedRowsMatchAndThroughput() {
+    PixelBuffer photo = MakePhoto(2048, 2048);
+    BlockImage single;
+
+    auto start = std::chrono::steady_clock::now();
+    CHECK(BlockCompressor::Compress(photo, single));
+    double singleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    BlockImage split;
+    BlockCompressor::Prepare(photo, split);
+    const uint32_t threadCount = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+    const uint32_t rowsPerThread = (split.BlocksHigh() + threadCount - 1) / threadCount;
+    start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t] {
+            BlockCompressor::CompressRows(photo, split, t * rowsPerThread, (t + 1) * rowsPerThread);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double splitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK(split.format == single.format && split.blocks == single.blocks);
+
+    double megabytes = photo.ByteSize() / (1024.0 * 1024.0);
+    std::printf("  BC1 2048x2048: %.0f MB/s on one thread, %.0f MB/s on %u\n", megabytes / singleSeconds,
+        megabytes / splitSeconds, threadCount);
+}
+
+}  // namespace
+
+int main() {
+    TestOpaquePhotoUsesBc1();
+    TestTranslucentUsesBc3();
+    TestFlatBlocksAreExact();
+    TestPartialBlocks();
+    TestThreadedRowsMatchAndThroughput();
+    return test::Finish("BlockCompressorTests");
+}
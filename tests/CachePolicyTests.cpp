@@ -0,0 +1,107 @@
+#include "CachePolicy.h"
+#include "TestSupport.h"
+#include <vector>
+
+namespace {
+
+constexpr size_t KB = 1024;
+constexpr size_t MB = 1024 * KB;
+
+CacheEntryCost MakeCost(size_t bytes, double decodeMs) {
+    CacheEntryCost cost;
+    cost.cpuBytes = bytes;
+    cost.decodeMs = decodeMs;
+    return cost;
+}
+
+// Evict until the policy is within budget, as ImageCache does; returns the victims in order
+std::vector<GdsfPolicy::Handle> EvictToBudget(GdsfPolicy& policy, size_t maxBytes) {
+    std::vector<GdsfPolicy::Handle> victims;
+    while (policy.GetTotalBytes() > maxBytes) {
+        GdsfPolicy::Handle victim = policy.SelectVictim();
+        if (victim == GdsfPolicy::INVALID_HANDLE) break;
+        victims.push_back(victim);
+        policy.Remove(victim, true);
+    }
+    return victims;
+}
+
+// The request's example: a cheap-to-redecode icon must go before an expensive HEIC
+void TestIconEvictedBeforeHeic() {
+    GdsfPolicy policy;
+    const GdsfPolicy::Handle icon = 0;
+    const GdsfPolicy::Handle heic = 1;
+    policy.Add(icon, MakeCost(160 * KB, 2.0));      // 200x200 PNG
+    policy.Add(heic, MakeCost(400 * MB, 2000.0));   // 100 MP HEIC
+
+    CHECK(policy.GetCost(icon).priority < policy.GetCost(heic).priority);
+    CHECK(policy.SelectVictim() == icon);
+
+    auto victims = EvictToBudget(policy, 400 * MB);
+    CHECK(victims.size() == 1 && victims[0] == icon);
+    CHECK(policy.IsActive(heic));
+}
+
+// A mixed browsing workload: entries are evicted cheapest re-decode first, and the slow
+// formats survive even though they are by far the largest
+void TestSyntheticWorkload() {
+    GdsfPolicy policy;
+    struct Entry { size_t bytes; double decodeMs; };
+    const Entry entries[] = {
+        { 160 * KB, 2.0 },     // 0: icon
+        { 8 * MB, 40.0 },      // 1: screen-level JPEG
+        { 8 * MB, 60.0 },      // 2: screen-level PNG
+        { 96 * MB, 150.0 },    // 3: 24 MP JPEG at full size
+        { 400 * MB, 2000.0 },  // 4: 100 MP HEIC
+        { 64 * KB, 1.0 },      // 5: thumbnail-sized GIF
+    };
+    for (GdsfPolicy::Handle i = 0; i < 6; ++i) {
+        policy.Add(i, MakeCost(entries[i].bytes, entries[i].decodeMs));
+    }
+
+    // Small entries go in order of re-decode cost; the full-size JPEG is above the size
+    // floor and charged per byte (1.6 ms/MB), which puts it between the two screen levels
+    auto victims = EvictToBudget(policy, 400 * MB);
+    const std::vector<GdsfPolicy::Handle> expected = { 5, 0, 1, 3, 2 };
+    CHECK(victims == expected);
+    CHECK(policy.IsActive(4));
+    CHECK(policy.GetTotalBytes() <= 400 * MB);
+}
+
+// Hits raise an entry's priority, so a repeatedly viewed cheap image outlives an
+// untouched one of the same cost
+void TestHitsProtectEntries() {
+    GdsfPolicy policy;
+    policy.Add(0, MakeCost(8 * MB, 40.0));
+    policy.Add(1, MakeCost(8 * MB, 40.0));
+    policy.Touch(0);
+    policy.Touch(0);
+    CHECK(policy.GetCost(0).hits == 3);
+    CHECK(policy.SelectVictim() == 1);
+}
+
+// Eviction raises the inflation value, so a fresh entry outranks an old, untouched one
+// that was once worth more
+void TestInflationAgesOutStaleEntries() {
+    GdsfPolicy policy;
+    policy.Add(0, MakeCost(8 * MB, 10.0));
+    policy.Add(1, MakeCost(8 * MB, 40.0));
+    policy.Add(2, MakeCost(8 * MB, 40.0));
+    policy.Remove(policy.SelectVictim(), true);  // 0
+    policy.Remove(policy.SelectVictim(), true);  // 1
+    CHECK(policy.GetInflation() == policy.GetCost(2).priority);
+
+    policy.Add(3, MakeCost(8 * MB, 10.0));
+    CHECK(policy.SelectVictim() == 2);
+    CHECK(policy.GetTotalBytes() == 16 * MB);
+}
+
+}  // namespace
+
+int main() {
+    TestIconEvictedBeforeHeic();
+    TestSyntheticWorkload();
+    TestHitsProtectEntries();
+    TestInflationAgesOutStaleEntries();
+    return test::Finish("CachePolicyTests");
+}
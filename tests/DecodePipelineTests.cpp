@@ -0,0 +1,178 @@
+#include "DecodePipeline.h"
+#include "LruIndex.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <thread>
+
+namespace {
+
+// Stands in for the WIC decode: slow enough that concurrent callers overlap with it
+class FakeDecoder {
+public:
+    explicit FakeDecoder(std::chrono::milliseconds duration) : m_duration(duration) {}
+
+    std::shared_ptr<DecodedImage> Decode(const DecodeRequest& request) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_calls[request.filePath]++;
+        }
+        std::this_thread::sleep_for(m_duration);
+        auto decoded = std::make_shared<DecodedImage>();
+        decoded->filePath = request.filePath;
+        return decoded;
+    }
+
+    int GetCalls(const std::wstring& filePath) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_calls[filePath];
+    }
+
+private:
+    std::chrono::milliseconds m_duration;
+    std::mutex m_mutex;
+    std::map<std::wstring, int> m_calls;
+};
+
+DecodePipeline::Callbacks MakeCallbacks(FakeDecoder& decoder) {
+    DecodePipeline::Callbacks callbacks;
+    callbacks.decode = [&decoder](const DecodeRequest& request, const CancellationToken&) {
+        return decoder.Decode(request);
+    };
+    return callbacks;
+}
+
+// Prefetch, the UI thread's synchronous load and other waiters all asking for the same
+// file at once must share one decode and one result
+void TestConcurrentRequestsShareOneDecode() {
+    TaskPool pool;
+    pool.Start(4);
+    FakeDecoder decoder(std::chrono::milliseconds(50));
+    DecodePipeline pipeline;
+    pipeline.Start(MakeCallbacks(decoder), &pool);
+    pipeline.SetWindow(0, { 0 });
+
+    const DecodeRequest request = { L"a.jpg", 0, ImageLevel::Screen };
+    std::atomic<bool> go{ false };
+    std::vector<DecodePipeline::DecodeFuture> futures(16);
+    std::vector<std::thread> callers;
+    for (size_t i = 0; i < futures.size(); ++i) {
+        callers.emplace_back([&, i] {
+            while (!go) std::this_thread::yield();
+            if (i % 4 == 0) {
+                pipeline.Enqueue(request);
+            }
+            futures[i] = pipeline.Request(request, false);
+        });
+    }
+    go = true;
+    for (auto& caller : callers) {
+        caller.join();
+    }
+
+    // The UI thread's inline load joins the decode already under way
+    auto inlineLoad = pipeline.Request(request, true);
+    auto result = inlineLoad.get();
+    CHECK(result != nullptr);
+    for (auto& future : futures) {
+        CHECK(future.get() == result);
+    }
+    CHECK(decoder.GetCalls(L"a.jpg") == 1);
+    CHECK(pipeline.TakeCompleted().size() == 1);
+
+    pipeline.Stop();
+    pool.Stop();
+}
+
+// Re-enqueueing a file on every navigation keeps one decode queued or running
+void TestRepeatedEnqueueDecodesOnce() {
+    TaskPool pool;
+    pool.Start(2);
+    FakeDecoder decoder(std::chrono::milliseconds(20));
+    DecodePipeline pipeline;
+    pipeline.Start(MakeCallbacks(decoder), &pool);
+
+    std::unordered_set<size_t> window;
+    for (size_t i = 0; i < 8; ++i) {
+        window.insert(i);
+    }
+    pipeline.SetWindow(0, window);
+    for (int round = 0; round < 200; ++round) {
+        for (size_t i = 0; i < 8; ++i) {
+            pipeline.Enqueue({ L"image" + std::to_wstring(i), i, ImageLevel::Screen });
+        }
+    }
+
+    size_t taken = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (taken < 8 && std::chrono::steady_clock::now() < deadline) {
+        taken += pipeline.TakeCompleted().size();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    CHECK(taken == 8);
+    for (size_t i = 0; i < 8; ++i) {
+        CHECK(decoder.GetCalls(L"image" + std::to_wstring(i)) == 1);
+    }
+
+    pipeline.Stop();
+    pool.Stop();
+}
+
+// Nanoseconds per cache step (a hit, a miss inserted and the oldest entry evicted) at a
+// given size, best of several runs
+double MeasureLruStep(size_t entries) {
+    std::vector<std::wstring> keys;
+    for (size_t i = 0; i < entries * 2; ++i) {
+        keys.push_back(L"C:\\Photos\\2024\\Holiday\\IMG_" + std::to_wstring(100000 + i) + L".JPG");
+    }
+
+    double best = 1e300;
+    for (int run = 0; run < 5; ++run) {
+        LruIndex<size_t> lru;
+        for (size_t i = 0; i < entries; ++i) {
+            lru.Insert(keys[i], i);
+        }
+
+        const size_t steps = 20000;
+        size_t next = entries;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t step = 0; step < steps; ++step) {
+            auto hit = lru.Find(keys[(next + step * 7) % keys.size()]);
+            if (hit != lru.INVALID_HANDLE) {
+                lru.Touch(hit);
+            }
+            if (lru.Find(keys[next]) == lru.INVALID_HANDLE) {
+                lru.Insert(keys[next], step);
+                lru.Erase(lru.LeastRecent());
+            }
+            next = (next + 1) % keys.size();
+        }
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, elapsed / steps);
+    }
+    return best;
+}
+
+// The cost of a cache step must not grow with the number of entries (the old vector
+// scan was linear in it)
+void TestLruCostIsFlat() {
+    double small = MeasureLruStep(16);
+    double medium = MeasureLruStep(1024);
+    double large = MeasureLruStep(8192);
+    std::printf("  LRU step: %.0f ns at 16 entries, %.0f ns at 1024, %.0f ns at 8192\n", small, medium, large);
+
+    // A linear scan would be 500x slower at 8192 than at 16; allow for cache misses
+    CHECK(large < small * 8);
+}
+
+}  // namespace
+
+int main() {
+    TestConcurrentRequestsShareOneDecode();
+    TestRepeatedEnqueueDecodesOnce();
+    TestLruCostIsFlat();
+    return test::Finish("DecodePipelineTests");
+}
@@ -0,0 +1,202 @@
+#include "EncodedCache.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// A scratch folder removed when the test ends
+class TempFolder {
+public:
+    TempFolder() : m_path(fs::temp_directory_path() / ("angel-foto-encoded-" + std::to_string(
+        std::chrono::steady_clock::now().time_since_epoch().count()))) {
+        fs::create_directories(m_path);
+    }
+    ~TempFolder() {
+        std::error_code ec;
+        fs::remove_all(m_path, ec);
+    }
+
+    std::wstring Write(const std::string& name, size_t size, uint8_t seed) const {
+        fs::path path = m_path / name;
+        std::vector<char> bytes(size);
+        for (size_t i = 0; i < size; ++i) {
+            bytes[i] = static_cast<char>((i * 31 + seed) & 0xFF);
+        }
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        return path.wstring();
+    }
+
+private:
+    fs::path m_path;
+};
+
+bool HasContents(const EncodedBuffer& bytes, size_t size, uint8_t seed) {
+    if (!bytes || bytes->size() != size) return false;
+    for (size_t i = 0; i < size; ++i) {
+        if (bytes->data()[i] != static_cast<uint8_t>((i * 31 + seed) & 0xFF)) return false;
+    }
+    return true;
+}
+
+void TestReadAndFind() {
+    TempFolder folder;
+    std::wstring path = folder.Write("a.jpg", 5000, 1);
+    EncodedCache cache;
+
+    CHECK(cache.Find(path) == nullptr);
+    EncodedBuffer bytes = cache.Read(path);
+    CHECK(HasContents(bytes, 5000, 1));
+    CHECK(!bytes->IsMapped());
+    CHECK(cache.Find(path) == bytes && cache.Read(path) == bytes);
+    CHECK(cache.GetTotalBytes() == 5000);
+
+    cache.Erase(path);
+    CHECK(cache.Find(path) == nullptr && cache.GetTotalBytes() == 0);
+
+    CHECK(cache.Read(path + L".missing") == nullptr);
+    CHECK(cache.Read(folder.Write("empty.jpg", 0, 0)) == nullptr);
+}
+
+// A file rewritten after it was cached is read again, whether its size or only its
+// modification time changed
+void TestRewrittenFileIsReread() {
+    TempFolder folder;
+    std::wstring path = folder.Write("a.jpg", 4000, 1);
+    EncodedCache cache;
+    EncodedBuffer first = cache.Read(path);
+
+    folder.Write("a.jpg", 3000, 2);
+    CHECK(cache.Find(path) == nullptr);
+    CHECK(HasContents(cache.Read(path), 3000, 2));
+
+    // Same size, later timestamp
+    folder.Write("a.jpg", 3000, 3);
+    fs::last_write_time(path, fs::last_write_time(path) + std::chrono::seconds(5));
+    CHECK(HasContents(cache.Read(path), 3000, 3));
+    CHECK(cache.GetTotalBytes() == 3000);
+
+    // A caller still holding the old bytes keeps them
+    CHECK(HasContents(first, 4000, 1));
+}
+
+void TestBudget() {
+    TempFolder folder;
+    std::wstring a = folder.Write("a.jpg", 4000, 1);
+    std::wstring b = folder.Write("b.jpg", 4000, 2);
+    std::wstring c = folder.Write("c.jpg", 4000, 3);
+    std::wstring large = folder.Write("large.jpg", 20000, 4);
+    EncodedCache cache;
+    cache.SetMaxBytes(10000);
+
+    cache.Read(a);
+    cache.Read(b);
+    cache.Find(a);
+    cache.Read(c);
+    CHECK(cache.Find(b) == nullptr);  // Least recently used
+    CHECK(cache.Find(a) != nullptr && cache.Find(c) != nullptr);
+    CHECK(cache.GetTotalBytes() == 8000);
+
+    // Larger than the whole budget: the caller reads it directly
+    CHECK(cache.Read(large) == nullptr);
+
+    CHECK(cache.Shed(1) == 4000 && cache.GetTotalBytes() == 4000);
+    cache.SetMaxBytes(1000);
+    CHECK(cache.GetTotalBytes() == 0);
+}
+
+void TestReadAhead() {
+    TempFolder folder;
+    std::vector<std::wstring> paths;
+    for (int i = 0; i < 6; ++i) {
+        paths.push_back(folder.Write("img" + std::to_string(i) + ".jpg", 10000 + i, static_cast<uint8_t>(i)));
+    }
+    EncodedCache cache;
+    cache.Start(EncodedCache::DEFAULT_QUEUE_DEPTH);
+    cache.ReadAhead(paths);
+
+    // Read joins a read already in progress instead of starting a second one
+    for (int i = 0; i < 6; ++i) {
+        CHECK(HasContents(cache.Read(paths[i]), 10000 + i, static_cast<uint8_t>(i)));
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (cache.GetTotalBytes() < 60015 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(cache.GetTotalBytes() == 60015);
+    cache.Stop();
+
+    // Queued after Stop: ignored
+    cache.Clear();
+    cache.ReadAhead(paths);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    CHECK(cache.GetTotalBytes() == 0);
+}
+
+void TestSlices() {
+    std::vector<uint8_t> data(100);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i);
+    }
+    EncodedBuffer copy = std::make_shared<EncodedBytes>(std::move(data));
+    EncodedBuffer slice = EncodedBytes::Slice(copy, 10, 20);
+    CHECK(slice && slice->size() == 20 && slice->data() == copy->data() + 10 && !slice->IsMapped());
+    CHECK(EncodedBytes::Slice(copy, 90, 11) == nullptr);
+    CHECK(EncodedBytes::Slice(copy, 101, 0) == nullptr);
+    CHECK(EncodedBytes::Slice(nullptr, 0, 0) == nullptr);
+
+    // A slice of a view keeps the view's owner alive and stays marked as mapped
+    auto owner = std::make_shared<std::vector<uint8_t>>(64, 7);
+    std::weak_ptr<std::vector<uint8_t>> watch = owner;
+    EncodedBuffer view = std::make_shared<EncodedBytes>(owner->data(), owner->size(), owner, true);
+    owner.reset();
+    EncodedBuffer viewSlice = EncodedBytes::Slice(view, 8, 8);
+    view.reset();
+    CHECK(!watch.expired() && viewSlice->IsMapped() && viewSlice->data()[0] == 7);
+    viewSlice.reset();
+    CHECK(watch.expired());
+}
+
+// Copied reads cost a pass over the file; a cache hit costs a stat. Printed so the
+// mapped path can be compared on Windows, where MappedFile exists.
+void TestCopiedReadThroughput() {
+    TempFolder folder;
+    const size_t size = 24 * 1024 * 1024;
+    std::wstring path = folder.Write("camera.jpg", size, 5);
+    EncodedCache cache;
+
+    double bestRead = 1e300;
+    for (int run = 0; run < 3; ++run) {
+        cache.Clear();
+        auto start = std::chrono::steady_clock::now();
+        CHECK(cache.Read(path) != nullptr);
+        bestRead = std::min(bestRead, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 100; ++i) {
+        CHECK(cache.Read(path) != nullptr);
+    }
+    double hit = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 100;
+
+    std::printf("  24 MB file: copied read %.0f MB/s (%.1f ms), cached hit %.1f us\n",
+        size / (1024.0 * 1024.0) / bestRead, bestRead * 1000, hit * 1e6);
+    CHECK(hit < bestRead);
+}
+
+}  // namespace
+
+int main() {
+    TestReadAndFind();
+    TestRewrittenFileIsReread();
+    TestBudget();
+    TestReadAhead();
+    TestSlices();
+    TestCopiedReadThroughput();
+    return test::Finish("EncodedCacheTests");
+}
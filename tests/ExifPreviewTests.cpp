@@ -0,0 +1,327 @@
+#include "ExifPreview.h"
+#include "TestSupport.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr uint32_t IMAGE_WIDTH = 6000;
+constexpr uint32_t IMAGE_HEIGHT = 4000;
+constexpr uint64_t FILE_SIZE = 24 * 1024 * 1024;
+
+// Layout of the synthesized TIFF blocks, from their own headers
+constexpr uint32_t IFD1_OFFSET = 14;        // After the header and an empty IFD0
+constexpr size_t IFD1_COUNT_OFFSET = IFD1_OFFSET;
+constexpr size_t IFD1_ENTRIES_END = IFD1_OFFSET + 2 + 2 * 12;
+constexpr uint32_t THUMBNAIL_OFFSET = IFD1_ENTRIES_END + 4;
+constexpr uint32_t MP_ENTRIES_OFFSET = 8 + 2 + 12 + 4;
+constexpr size_t MP_ENTRY_VALUE_OFFSET = 8 + 2 + 8;   // The MP entry tag's offset field
+
+// Appends values in a TIFF block's byte order
+class TiffWriter {
+public:
+    explicit TiffWriter(bool bigEndian) : m_bigEndian(bigEndian) {
+        Put(bigEndian ? 'M' : 'I');
+        Put(bigEndian ? 'M' : 'I');
+        Put16(42);
+        Put32(8);
+    }
+
+    void Put(uint8_t value) { m_bytes.push_back(value); }
+
+    void Put16(uint16_t value) {
+        Put(static_cast<uint8_t>(m_bigEndian ? value >> 8 : value));
+        Put(static_cast<uint8_t>(m_bigEndian ? value : value >> 8));
+    }
+
+    void Put32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            int shift = m_bigEndian ? 24 - 8 * i : 8 * i;
+            Put(static_cast<uint8_t>(value >> shift));
+        }
+    }
+
+    // Overwrites a value already written
+    void Set16(size_t at, uint16_t value) {
+        TiffWriter patch(m_bigEndian);
+        patch.m_bytes.clear();
+        patch.Put16(value);
+        std::memcpy(m_bytes.data() + at, patch.m_bytes.data(), 2);
+    }
+
+    void Set32(size_t at, uint32_t value) {
+        TiffWriter patch(m_bigEndian);
+        patch.m_bytes.clear();
+        patch.Put32(value);
+        std::memcpy(m_bytes.data() + at, patch.m_bytes.data(), 4);
+    }
+
+    std::vector<uint8_t>& Bytes() { return m_bytes; }
+
+private:
+    bool m_bigEndian;
+    std::vector<uint8_t> m_bytes;
+};
+
+void PutEntry(TiffWriter& tiff, uint16_t tag, uint16_t type, uint32_t count, uint32_t value) {
+    tiff.Put16(tag);
+    tiff.Put16(type);
+    tiff.Put32(count);
+    tiff.Put32(value);
+}
+
+// A small JPEG stand-in: SOI, filler, EOI
+std::vector<uint8_t> FakeJpeg(uint32_t length) {
+    std::vector<uint8_t> bytes(length, 0x5A);
+    bytes[0] = 0xFF;
+    bytes[1] = 0xD8;
+    bytes[length - 2] = 0xFF;
+    bytes[length - 1] = 0xD9;
+    return bytes;
+}
+
+// EXIF block whose IFD1 describes a thumbnail stored right after it
+TiffWriter ExifBlock(bool bigEndian, uint32_t thumbnailLength) {
+    TiffWriter tiff(bigEndian);
+    tiff.Put16(0);              // IFD0: no entries
+    tiff.Put32(IFD1_OFFSET);
+    tiff.Put16(2);              // IFD1
+    PutEntry(tiff, 0x0201, 4, 1, THUMBNAIL_OFFSET);
+    PutEntry(tiff, 0x0202, 4, 1, thumbnailLength);
+    tiff.Put32(0);
+    for (uint8_t byte : FakeJpeg(thumbnailLength)) {
+        tiff.Put(byte);
+    }
+    return tiff;
+}
+
+// MPF block listing the main image and one preview, at an offset from this header
+TiffWriter MpfBlock(bool bigEndian, uint32_t previewOffset, uint32_t previewLength) {
+    TiffWriter tiff(bigEndian);
+    tiff.Put16(1);
+    PutEntry(tiff, 0xB002, 7, 2 * 16, MP_ENTRIES_OFFSET);
+    tiff.Put32(0);
+    for (uint32_t value : { 0x20030000u, 0u, 0u, 0u, 0x00010002u, previewLength, previewOffset, 0u }) {
+        tiff.Put32(value);
+    }
+    return tiff;
+}
+
+struct SyntheticJpeg {
+    std::vector<uint8_t> bytes;
+    uint64_t exifOffset = 0;    // File offsets of the two TIFF headers
+    uint64_t mpfOffset = 0;
+};
+
+void PutSegment(SyntheticJpeg& jpeg, uint8_t marker, const char* id, size_t idSize,
+    const std::vector<uint8_t>& body) {
+    size_t length = 2 + idSize + body.size();
+    jpeg.bytes.insert(jpeg.bytes.end(), { 0xFF, marker, static_cast<uint8_t>(length >> 8),
+        static_cast<uint8_t>(length) });
+    jpeg.bytes.insert(jpeg.bytes.end(), id, id + idSize);
+    jpeg.bytes.insert(jpeg.bytes.end(), body.begin(), body.end());
+}
+
+void PutFrameHeader(SyntheticJpeg& jpeg) {
+    PutSegment(jpeg, 0xC0, "", 0, { 8, IMAGE_HEIGHT >> 8, IMAGE_HEIGHT & 0xFF, IMAGE_WIDTH >> 8,
+        IMAGE_WIDTH & 0xFF, 1, 1, 0x11, 0 });
+}
+
+// SOI, the APP1/APP2 blocks given (either may be empty), the frame header and SOS
+SyntheticJpeg MakeJpeg(const std::vector<uint8_t>& exif, const std::vector<uint8_t>& mpf) {
+    SyntheticJpeg jpeg;
+    jpeg.bytes = { 0xFF, 0xD8 };
+    if (!exif.empty()) {
+        jpeg.exifOffset = jpeg.bytes.size() + 4 + 6;
+        PutSegment(jpeg, 0xE1, "Exif\0\0", 6, exif);
+    }
+    if (!mpf.empty()) {
+        jpeg.mpfOffset = jpeg.bytes.size() + 4 + 4;
+        PutSegment(jpeg, 0xE2, "MPF\0", 4, mpf);
+    }
+    PutFrameHeader(jpeg);
+    jpeg.bytes.insert(jpeg.bytes.end(), { 0xFF, 0xDA, 0x00, 0x08 });
+    return jpeg;
+}
+
+bool Locate(const SyntheticJpeg& jpeg, uint64_t fileSize, uint32_t maxBytes, ExifPreviewInfo& info) {
+    info = {};
+    return ExifPreview::Locate(jpeg.bytes.data(), jpeg.bytes.size(), fileSize, maxBytes, info);
+}
+
+// Both byte orders, for the thumbnail and for an MPF preview
+void TestByteOrders() {
+    for (bool bigEndian : { false, true }) {
+        ExifPreviewInfo info;
+        SyntheticJpeg thumbnailOnly = MakeJpeg(ExifBlock(bigEndian, 6000).Bytes(), {});
+        CHECK(Locate(thumbnailOnly, FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info));
+        CHECK(info.offset == thumbnailOnly.exifOffset + THUMBNAIL_OFFSET && info.length == 6000);
+        CHECK(info.imageWidth == IMAGE_WIDTH && info.imageHeight == IMAGE_HEIGHT);
+
+        SyntheticJpeg mpfOnly = MakeJpeg({}, MpfBlock(bigEndian, 4 * 1024 * 1024, 400000).Bytes());
+        CHECK(Locate(mpfOnly, FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info));
+        CHECK(info.offset == mpfOnly.mpfOffset + 4 * 1024 * 1024 && info.length == 400000);
+    }
+
+    // Neither byte order mark: not a TIFF block
+    TiffWriter exif = ExifBlock(false, 6000);
+    exif.Bytes()[0] = exif.Bytes()[1] = 'X';
+    ExifPreviewInfo info;
+    CHECK(!Locate(MakeJpeg(exif.Bytes(), {}), FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info));
+}
+
+// The larger MPF preview wins over the IFD1 thumbnail, unless it is over maxBytes
+void TestLargestWithinMaxBytes() {
+    for (bool bigEndian : { false, true }) {
+        SyntheticJpeg jpeg = MakeJpeg(ExifBlock(bigEndian, 6000).Bytes(),
+            MpfBlock(bigEndian, 8 * 1024 * 1024, 900000).Bytes());
+        ExifPreviewInfo info;
+        CHECK(Locate(jpeg, FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info));
+        CHECK(info.offset == jpeg.mpfOffset + 8 * 1024 * 1024 && info.length == 900000);
+
+        CHECK(Locate(jpeg, FILE_SIZE, 899999, info));
+        CHECK(info.offset == jpeg.exifOffset + THUMBNAIL_OFFSET && info.length == 6000);
+
+        CHECK(Locate(jpeg, FILE_SIZE, 900000, info) && info.length == 900000);
+        CHECK(!Locate(jpeg, FILE_SIZE, 5999, info));
+    }
+}
+
+// A preview that would end past the end of the file is skipped
+void TestOffsetsPastFileSize() {
+    SyntheticJpeg jpeg = MakeJpeg(ExifBlock(true, 6000).Bytes(), MpfBlock(true, 8 * 1024 * 1024, 900000).Bytes());
+    uint64_t mpfEnd = jpeg.mpfOffset + 8 * 1024 * 1024 + 900000;
+    ExifPreviewInfo info;
+    CHECK(Locate(jpeg, mpfEnd, ExifPreview::DEFAULT_MAX_BYTES, info) && info.length == 900000);
+    CHECK(Locate(jpeg, mpfEnd - 1, ExifPreview::DEFAULT_MAX_BYTES, info) && info.length == 6000);
+
+    uint64_t thumbnailEnd = jpeg.exifOffset + THUMBNAIL_OFFSET + 6000;
+    CHECK(Locate(jpeg, thumbnailEnd, ExifPreview::DEFAULT_MAX_BYTES, info) && info.length == 6000);
+    CHECK(!Locate(jpeg, thumbnailEnd - 1, ExifPreview::DEFAULT_MAX_BYTES, info));
+
+    // An offset near the top of the 32-bit range
+    jpeg = MakeJpeg({}, MpfBlock(false, 0xFFFFFFF0, 900000).Bytes());
+    CHECK(!Locate(jpeg, FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info));
+}
+
+// Headers cut short anywhere, and an EXIF block cut short inside a segment that still
+// parses: no reads past the bytes given, and the thumbnail only once IFD1 is whole
+void TestTruncatedSegments() {
+    SyntheticJpeg jpeg = MakeJpeg(ExifBlock(false, 6000).Bytes(), MpfBlock(false, 8 * 1024 * 1024, 900000).Bytes());
+    ExifPreviewInfo info;
+    // The frame header comes last; it is clipped like any segment, and counts once its
+    // height and width are in
+    const size_t frameSizeEnd = jpeg.bytes.size() - 4 - 9 + 5;
+    for (size_t size = 0; size < jpeg.bytes.size(); ++size) {
+        std::vector<uint8_t> prefix(jpeg.bytes.begin(), jpeg.bytes.begin() + size);
+        bool found = ExifPreview::Locate(prefix.data(), prefix.size(), FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info);
+        CHECK(found == (size >= frameSizeEnd));
+    }
+
+    for (size_t size = 0; size <= THUMBNAIL_OFFSET; ++size) {
+        std::vector<uint8_t> exif = ExifBlock(false, 6000).Bytes();
+        exif.resize(size);
+        bool found = Locate(MakeJpeg(exif, {}), FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info);
+        CHECK(found == (size >= IFD1_ENTRIES_END));
+    }
+
+    // A segment length running past the header is clipped to it (frame header first here,
+    // so the clipped EXIF block is the last thing parsed)
+    for (size_t size : { IFD1_ENTRIES_END - 1, IFD1_ENTRIES_END }) {
+        SyntheticJpeg overlong;
+        overlong.bytes = { 0xFF, 0xD8 };
+        PutFrameHeader(overlong);
+        size_t lengthAt = overlong.bytes.size() + 2;
+        std::vector<uint8_t> exif = ExifBlock(false, 6000).Bytes();
+        exif.resize(size);
+        PutSegment(overlong, 0xE1, "Exif\0\0", 6, exif);
+        overlong.bytes[lengthAt] = overlong.bytes[lengthAt + 1] = 0xFF;
+        CHECK(Locate(overlong, FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info) == (size == IFD1_ENTRIES_END));
+    }
+}
+
+// IFD counts and offsets read from the file that point past the block end find nothing
+void TestCountsAndOffsetsPastBuffer() {
+    ExifPreviewInfo info;
+    for (bool bigEndian : { false, true }) {
+        // IFD0's count puts its next-IFD pointer past the end
+        TiffWriter exif = ExifBlock(bigEndian, 6000);
+        exif.Set16(8, 0xFFFF);
+        CHECK(!Locate(MakeJpeg(exif.Bytes(), {}), FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info));
+
+        // IFD1's count runs the tag search past the end when the offset tag is missing
+        exif = ExifBlock(bigEndian, 6000);
+        exif.Set16(IFD1_COUNT_OFFSET, 0xFFFF);
+        CHECK(Locate(MakeJpeg(exif.Bytes(), {}), FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info));
+        exif.Set16(IFD1_COUNT_OFFSET + 2, 0x0100);
+        CHECK(!Locate(MakeJpeg(exif.Bytes(), {}), FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info));
+
+        for (uint32_t ifd1 : { 0xFFFFFFFFu, 0xFFFFFFFEu, 0x7FFFFFFFu, static_cast<uint32_t>(exif.Bytes().size()) }) {
+            exif = ExifBlock(bigEndian, 6000);
+            exif.Set32(10, ifd1);
+            CHECK(!Locate(MakeJpeg(exif.Bytes(), {}), FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info));
+        }
+
+        exif = ExifBlock(bigEndian, 6000);
+        exif.Set32(4, 0xFFFFFFFE);
+        CHECK(!Locate(MakeJpeg(exif.Bytes(), {}), FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info));
+
+        // A broken MP entry leaves the thumbnail in place
+        for (uint32_t entries : { 0xFFFFFFFFu, 0xFFFFFFF0u, 0x7FFFFFF8u, MP_ENTRIES_OFFSET + 17 }) {
+            TiffWriter mpf = MpfBlock(bigEndian, 8 * 1024 * 1024, 900000);
+            mpf.Set32(MP_ENTRY_VALUE_OFFSET, entries);
+            CHECK(Locate(MakeJpeg(ExifBlock(bigEndian, 6000).Bytes(), mpf.Bytes()), FILE_SIZE,
+                ExifPreview::DEFAULT_MAX_BYTES, info));
+            CHECK(info.length == 6000);
+        }
+
+        // An entry count far beyond the entries present stops at the block end
+        TiffWriter mpf = MpfBlock(bigEndian, 8 * 1024 * 1024, 900000);
+        mpf.Set32(MP_ENTRY_VALUE_OFFSET - 4, 0xFFFFFFF0);
+        CHECK(Locate(MakeJpeg({}, mpf.Bytes()), FILE_SIZE, ExifPreview::DEFAULT_MAX_BYTES, info));
+        CHECK(info.length == 900000);
+    }
+}
+
+// Read returns the preview's bytes whether they sit inside the header it reads or past it
+void TestReadFromFile() {
+    fs::path path = fs::temp_directory_path() / ("angel-foto-exif-" + std::to_string(
+        std::chrono::steady_clock::now().time_since_epoch().count()) + ".jpg");
+    constexpr uint32_t PREVIEW_LENGTH = 50000;
+    for (uint32_t previewOffset : { 2000u, static_cast<uint32_t>(ExifPreview::HEADER_BYTES) + 4096 }) {
+        SyntheticJpeg jpeg = MakeJpeg(ExifBlock(false, 6000).Bytes(),
+            MpfBlock(false, previewOffset, PREVIEW_LENGTH).Bytes());
+        std::vector<uint8_t> file = jpeg.bytes;
+        file.resize(jpeg.mpfOffset + previewOffset + PREVIEW_LENGTH + 1024, 0);
+        std::vector<uint8_t> preview = FakeJpeg(PREVIEW_LENGTH);
+        std::memcpy(file.data() + jpeg.mpfOffset + previewOffset, preview.data(), preview.size());
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+        }
+
+        ExifPreviewInfo info;
+        std::vector<uint8_t> read;
+        CHECK(ExifPreview::Read(path.wstring(), ExifPreview::DEFAULT_MAX_BYTES, info, read));
+        CHECK(read == preview);
+        CHECK(info.imageWidth == IMAGE_WIDTH && info.imageHeight == IMAGE_HEIGHT);
+    }
+    std::error_code ec;
+    fs::remove(path, ec);
+}
+
+}  // namespace
+
+int main() {
+    TestByteOrders();
+    TestLargestWithinMaxBytes();
+    TestOffsetsPastFileSize();
+    TestTruncatedSegments();
+    TestCountsAndOffsetsPastBuffer();
+    TestReadFromFile();
+    return test::Finish("ExifPreviewTests");
+}
@@ -0,0 +1,327 @@
+#include "GifCompositor.h"
+#include "GifStream.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+
+namespace {
+
+constexpr uint32_t OPAQUE = 0xFF000000u;
+constexpr uint32_t RED = OPAQUE | 0xFF0000u;
+constexpr uint32_t GREEN = OPAQUE | 0x00FF00u;
+constexpr uint32_t BLUE = OPAQUE | 0x0000FFu;
+constexpr uint32_t WHITE = OPAQUE | 0xFFFFFFu;
+
+GifFrame MakeFrame(uint32_t left, uint32_t top, uint32_t width, uint32_t height,
+    GifDisposal disposal, uint8_t fill, int transparentIndex = -1) {
+    GifFrame frame;
+    frame.left = left;
+    frame.top = top;
+    frame.width = width;
+    frame.height = height;
+    frame.disposal = disposal;
+    frame.transparentIndex = transparentIndex;
+    frame.indices.assign(static_cast<size_t>(width) * height, fill);
+    return frame;
+}
+
+// Straightforward expansion of frame index: replay every frame from the first onto a
+// full canvas, applying the previous frame's disposal before each one
+std::vector<uint32_t> ExpandFrame(const GifAnimation& animation, size_t index) {
+    const uint32_t width = animation.width;
+    const uint32_t height = animation.height;
+    std::vector<uint32_t> canvas(static_cast<size_t>(width) * height, 0);
+    std::vector<uint32_t> saved;
+
+    auto clip = [&](const GifFrame& frame, uint32_t& left, uint32_t& top, uint32_t& right, uint32_t& bottom) {
+        left = std::min(frame.left, width);
+        top = std::min(frame.top, height);
+        right = std::min(frame.left + frame.width, width);
+        bottom = std::min(frame.top + frame.height, height);
+    };
+
+    for (size_t n = 0; n <= index; ++n) {
+        uint32_t left, top, right, bottom;
+        if (n > 0) {
+            const GifFrame& previous = animation.frames[n - 1];
+            clip(previous, left, top, right, bottom);
+            size_t k = 0;
+            for (uint32_t y = top; y < bottom; ++y) {
+                for (uint32_t x = left; x < right; ++x) {
+                    if (previous.disposal == GifDisposal::Background) {
+                        canvas[y * width + x] = 0;
+                    } else if (previous.disposal == GifDisposal::Previous) {
+                        canvas[y * width + x] = saved[k++];
+                    }
+                }
+            }
+        }
+
+        const GifFrame& frame = animation.frames[n];
+        const auto& palette = animation.palettes[frame.palette];
+        clip(frame, left, top, right, bottom);
+        saved.clear();
+        for (uint32_t y = top; y < bottom; ++y) {
+            for (uint32_t x = left; x < right; ++x) {
+                if (frame.disposal == GifDisposal::Previous) {
+                    saved.push_back(canvas[y * width + x]);
+                }
+                uint8_t colour = frame.indices[(y - frame.top) * frame.width + (x - frame.left)];
+                if (colour != frame.transparentIndex) {
+                    canvas[y * width + x] = palette[colour];
+                }
+            }
+        }
+    }
+    return canvas;
+}
+
+bool Matches(const PixelBuffer& canvas, const std::vector<uint32_t>& expected) {
+    return canvas.pixels.size() == expected.size() * sizeof(uint32_t) &&
+        std::memcmp(canvas.pixels.data(), expected.data(), canvas.pixels.size()) == 0;
+}
+
+uint32_t PixelAt(const PixelBuffer& canvas, uint32_t x, uint32_t y) {
+    uint32_t pixel = 0;
+    std::memcpy(&pixel, canvas.pixels.data() + static_cast<size_t>(y) * canvas.stride + x * 4, sizeof(pixel));
+    return pixel;
+}
+
+// A small animation exercising each disposal, transparency, a frame hanging off the
+// canvas and a second palette
+std::shared_ptr<GifAnimation> MakeHandcraftedAnimation() {
+    auto animation = std::make_shared<GifAnimation>();
+    animation->width = 8;
+    animation->height = 6;
+
+    std::vector<uint32_t> global(GifAnimation::PALETTE_SIZE, 0);
+    global[1] = RED;
+    global[2] = GREEN;
+    global[3] = BLUE;
+    std::vector<uint32_t> local(GifAnimation::PALETTE_SIZE, 0);
+    local[1] = WHITE;
+    animation->palettes = { global, local };
+
+    // 0: red background, kept
+    animation->frames.push_back(MakeFrame(0, 0, 8, 6, GifDisposal::Keep, 1));
+
+    // 1: green 4x4 with a transparent hole, restored to the red background afterwards
+    GifFrame hole = MakeFrame(2, 1, 4, 4, GifDisposal::Previous, 2, 0);
+    hole.indices[5] = 0;
+    animation->frames.push_back(hole);
+
+    // 2: blue 3x2, cleared to transparent afterwards
+    animation->frames.push_back(MakeFrame(1, 3, 3, 2, GifDisposal::Background, 3));
+
+    // 3: white from the local palette, partly off the right and bottom edges
+    GifFrame edge = MakeFrame(6, 4, 5, 5, GifDisposal::None, 1);
+    edge.palette = 1;
+    animation->frames.push_back(edge);
+
+    // 4: fully transparent frame, which must change nothing
+    animation->frames.push_back(MakeFrame(0, 0, 8, 6, GifDisposal::Keep, 7, 7));
+    return animation;
+}
+
+void TestHandcraftedGoldenFrames() {
+    auto animation = MakeHandcraftedAnimation();
+    GifCompositor compositor(animation);
+
+    const PixelBuffer& first = compositor.Compose(0);
+    CHECK(PixelAt(first, 0, 0) == RED && PixelAt(first, 7, 5) == RED);
+
+    const PixelBuffer& second = compositor.Compose(1);
+    CHECK(PixelAt(second, 2, 1) == GREEN);
+    CHECK(PixelAt(second, 3, 2) == RED);  // Transparent hole shows the frame below
+    CHECK(PixelAt(second, 6, 1) == RED);
+
+    const PixelBuffer& third = compositor.Compose(2);
+    CHECK(PixelAt(third, 2, 1) == RED);   // Restored to previous
+    CHECK(PixelAt(third, 1, 3) == BLUE);
+
+    const PixelBuffer& fourth = compositor.Compose(3);
+    CHECK(PixelAt(fourth, 1, 3) == 0);    // Restored to (transparent) background
+    CHECK(PixelAt(fourth, 7, 5) == WHITE);
+    CHECK(PixelAt(fourth, 5, 5) == RED);
+
+    for (size_t i = 0; i < animation->frames.size(); ++i) {
+        CHECK(Matches(compositor.Compose(i), ExpandFrame(*animation, i)));
+    }
+}
+
+// Random frames of every kind: offsets, sizes past the canvas, disposals and palettes
+std::shared_ptr<GifAnimation> MakeRandomAnimation() {
+    std::mt19937 random(7);
+    auto animation = std::make_shared<GifAnimation>();
+    animation->width = 53;
+    animation->height = 41;
+    for (int p = 0; p < 3; ++p) {
+        std::vector<uint32_t> palette(GifAnimation::PALETTE_SIZE);
+        for (auto& colour : palette) {
+            colour = random() | OPAQUE;
+        }
+        animation->palettes.push_back(palette);
+    }
+    for (int f = 0; f < 60; ++f) {
+        GifFrame frame;
+        frame.left = random() % 50;
+        frame.top = random() % 40;
+        frame.width = 1 + random() % 60;
+        frame.height = 1 + random() % 45;
+        frame.disposal = static_cast<GifDisposal>(random() % 4);
+        frame.transparentIndex = random() % 3 == 0 ? -1 : static_cast<int>(random() % 256);
+        frame.palette = random() % 3;
+        uint8_t transparent = static_cast<uint8_t>(std::max(0, frame.transparentIndex));
+        frame.indices.resize(static_cast<size_t>(frame.width) * frame.height);
+        for (auto& index : frame.indices) {
+            index = random() % 4 == 0 ? transparent : static_cast<uint8_t>(random() % 256);
+        }
+        animation->frames.push_back(frame);
+    }
+    return animation;
+}
+
+// Composed in playback order with wraps and a jump back
+void TestRandomFramesMatchExpansion() {
+    auto animation = MakeRandomAnimation();
+    GifCompositor compositor(animation);
+    for (size_t step = 0; step < 150; ++step) {
+        size_t index = step == 100 ? 17 : step % animation->frames.size();
+        CHECK(Matches(compositor.Compose(index), ExpandFrame(*animation, index)));
+    }
+}
+
+// Stands in for the display bitmaps: ImageData keeps a ring of copies of the canvas and
+// each one copies only the area changed since it was last shown
+class DisplayRing {
+public:
+    DisplayRing(uint32_t width, uint32_t height) {
+        for (auto& slot : m_slots) {
+            slot.width = width;
+            slot.height = height;
+            slot.stride = width * 4;
+            slot.pixels.assign(static_cast<size_t>(slot.stride) * height, 0xCD);
+            m_stale.push_back({ 0, 0, width, height });
+        }
+    }
+
+    const PixelBuffer& Show(const PixelBuffer& canvas, const GifCompositor::Rect& changed) {
+        for (auto& stale : m_stale) {
+            stale = GifCompositor::Union(stale, changed);
+        }
+        m_current = (m_current + 1) % SLOTS;
+        PixelBuffer& slot = m_slots[m_current];
+        const GifCompositor::Rect& stale = m_stale[m_current];
+        if (!stale.IsEmpty()) {
+            for (uint32_t y = stale.top; y < stale.bottom; ++y) {
+                size_t offset = static_cast<size_t>(y) * canvas.stride + stale.left * 4;
+                std::memcpy(slot.pixels.data() + offset, canvas.pixels.data() + offset,
+                    (stale.right - stale.left) * 4);
+            }
+        }
+        m_stale[m_current] = {};
+        return slot;
+    }
+
+private:
+    static constexpr size_t SLOTS = 2;
+    PixelBuffer m_slots[SLOTS];
+    std::vector<GifCompositor::Rect> m_stale;
+    size_t m_current = 0;
+};
+
+// Uploading only the dirty rect must leave each display copy identical to the full frame
+void TestDirtyRectsReproduceFrames() {
+    for (auto animation : { MakeHandcraftedAnimation(), MakeRandomAnimation() }) {
+        GifCompositor compositor(animation);
+        DisplayRing display(animation->width, animation->height);
+        for (size_t step = 0; step < 3 * animation->frames.size(); ++step) {
+            size_t index = step % animation->frames.size();
+            const PixelBuffer& canvas = compositor.Compose(index);
+            const PixelBuffer& shown = display.Show(canvas, compositor.TakeDirtyRect());
+            CHECK(Matches(shown, ExpandFrame(*animation, index)));
+        }
+    }
+}
+
+void TestResetDirtiesWholeCanvas() {
+    auto animation = MakeHandcraftedAnimation();
+    GifCompositor compositor(animation);
+    compositor.Compose(1);
+    compositor.TakeDirtyRect();
+    CHECK(compositor.TakeDirtyRect().IsEmpty());
+
+    compositor.Reset();
+    GifCompositor::Rect dirty = compositor.TakeDirtyRect();
+    CHECK(dirty.left == 0 && dirty.top == 0 && dirty.right == animation->width &&
+        dirty.bottom == animation->height);
+}
+
+// A frame that cannot be read leaves the canvas as it was
+void TestUnreadableFrameKeepsCanvas() {
+    auto animation = MakeHandcraftedAnimation();
+    GifCompositor compositor(animation->width, animation->height);
+    compositor.ComposeNext(animation->frames[0], animation->palettes[0].data());
+    compositor.TakeDirtyRect();
+    const PixelBuffer& canvas = compositor.ComposeNext(animation->frames[1], nullptr);
+    CHECK(Matches(canvas, ExpandFrame(*animation, 0)));
+    CHECK(compositor.TakeDirtyRect().IsEmpty());
+}
+
+class AnimationSource : public GifFrameSource {
+public:
+    explicit AnimationSource(std::shared_ptr<const GifAnimation> animation) : m_animation(std::move(animation)) {}
+
+    bool ReadFrame(size_t index, GifFrame& frame, std::vector<uint32_t>& palette) override {
+        frame = m_animation->frames[index];
+        palette = m_animation->palettes[frame.palette];
+        return true;
+    }
+
+private:
+    std::shared_ptr<const GifAnimation> m_animation;
+};
+
+// Streamed playback through the display ring, including wraps and a jump, must show the
+// same frames as the full expansion
+void TestStreamMatchesExpansion() {
+    auto animation = MakeRandomAnimation();
+    const size_t frameCount = animation->frames.size();
+    TaskPool pool;
+    pool.Start(2);
+    {
+        GifStream stream(std::make_shared<AnimationSource>(animation), frameCount, animation->width,
+            animation->height, &pool);
+        DisplayRing display(animation->width, animation->height);
+        PixelBuffer canvas;
+        GifCompositor::Rect changed = {};
+        for (size_t step = 0; step < 2 * frameCount + 20; ++step) {
+            size_t index = step == frameCount + 7 ? 3 : step % frameCount;
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            bool taken = false;
+            while (!(taken = stream.TakeFrame(index, canvas, changed)) &&
+                std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            CHECK(taken);
+            if (!taken) break;
+            CHECK(Matches(display.Show(canvas, changed), ExpandFrame(*animation, index)));
+        }
+    }
+    pool.Stop();
+}
+
+}  // namespace
+
+int main() {
+    TestHandcraftedGoldenFrames();
+    TestRandomFramesMatchExpansion();
+    TestDirtyRectsReproduceFrames();
+    TestResetDirtiesWholeCanvas();
+    TestUnreadableFrameKeepsCanvas();
+    TestStreamMatchesExpansion();
+    return test::Finish("GifCompositorTests");
+}
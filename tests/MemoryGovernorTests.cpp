@@ -0,0 +1,144 @@
+#include "MemoryGovernor.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+constexpr size_t MB = 1024 * 1024;
+
+// Handlers that record the order they ran in and free a fixed amount from one consumer,
+// reporting the new usage back as the cache and the undo stack do
+class FakeSubsystems {
+public:
+    explicit FakeSubsystems(MemoryGovernor& governor) : m_governor(governor) {}
+
+    void Install(ShedStage stage, MemoryConsumer consumer, size_t bytesFreed) {
+        m_governor.SetShedHandler(stage, [this, stage, consumer, bytesFreed](size_t bytesToFree) {
+            m_calls.push_back(stage);
+            m_requested.push_back(bytesToFree);
+            size_t usage = m_governor.GetUsage(consumer);
+            size_t freed = std::min(usage, bytesFreed);
+            m_governor.SetUsage(consumer, usage - freed);
+            return freed;
+        });
+    }
+
+    const std::vector<ShedStage>& GetCalls() const { return m_calls; }
+    const std::vector<size_t>& GetRequested() const { return m_requested; }
+
+    void Reset() {
+        m_calls.clear();
+        m_requested.clear();
+    }
+
+private:
+    MemoryGovernor& m_governor;
+    std::vector<ShedStage> m_calls;
+    std::vector<size_t> m_requested;
+};
+
+// Decoded images and undo history over a 1 GB ceiling; each stage frees 100 MB
+void Setup(MemoryGovernor& governor, FakeSubsystems& fakes) {
+    governor.SetCeiling(1024 * MB);
+    governor.SetUsage(MemoryConsumer::DecodedImages, 900 * MB);
+    governor.SetUsage(MemoryConsumer::UndoHistory, 400 * MB);
+    fakes.Install(ShedStage::UndoHistory, MemoryConsumer::UndoHistory, 100 * MB);
+    fakes.Install(ShedStage::AnimationFrames, MemoryConsumer::DecodedImages, 100 * MB);
+    fakes.Install(ShedStage::FarPrefetch, MemoryConsumer::DecodedImages, 100 * MB);
+}
+
+void TestUsageTotals() {
+    MemoryGovernor governor;
+    CHECK(governor.GetCeiling() == MemoryGovernor::DEFAULT_CEILING);
+    governor.SetUsage(MemoryConsumer::DecodedImages, 10 * MB);
+    governor.SetUsage(MemoryConsumer::EncodedBytes, 5 * MB);
+    governor.SetUsage(MemoryConsumer::Overlays, 1 * MB);
+    governor.SetUsage(MemoryConsumer::DecodedImages, 20 * MB);  // Absolute, not a delta
+    CHECK(governor.GetUsage(MemoryConsumer::DecodedImages) == 20 * MB);
+    CHECK(governor.GetTotalUsage() == 26 * MB);
+}
+
+// Cheapest loss first, whatever order the handlers were registered in
+void TestShedOrder() {
+    MemoryGovernor governor;
+    FakeSubsystems fakes(governor);
+    Setup(governor, fakes);
+    governor.SetCeiling(900 * MB);  // 1300 MB held: needs all three stages and more
+
+    CHECK(governor.Enforce() == 300 * MB);
+    const auto& calls = fakes.GetCalls();
+    CHECK(calls.size() == 3 && calls[0] == ShedStage::FarPrefetch &&
+        calls[1] == ShedStage::AnimationFrames && calls[2] == ShedStage::UndoHistory);
+
+    // Each stage is asked for what is still over the ceiling
+    const auto& requested = fakes.GetRequested();
+    CHECK(requested[0] == 400 * MB && requested[1] == 300 * MB && requested[2] == 200 * MB);
+    CHECK(governor.GetTotalUsage() == 1000 * MB);
+}
+
+// Once a stage brings usage under the ceiling, the later (costlier) stages are left alone
+void TestStopsUnderTarget() {
+    MemoryGovernor governor;
+    FakeSubsystems fakes(governor);
+    Setup(governor, fakes);
+    governor.SetCeiling(1250 * MB);  // 50 MB over
+
+    CHECK(governor.Enforce() == 100 * MB);
+    CHECK(fakes.GetCalls().size() == 1 && fakes.GetCalls()[0] == ShedStage::FarPrefetch);
+    CHECK(governor.GetUsage(MemoryConsumer::UndoHistory) == 400 * MB);
+
+    // 1200 MB left, 150 MB over a lower ceiling: two stages, undo history kept
+    fakes.Reset();
+    governor.SetCeiling(1050 * MB);
+    CHECK(governor.Enforce() == 200 * MB);
+    CHECK(fakes.GetCalls().size() == 2 && fakes.GetCalls()[1] == ShedStage::AnimationFrames);
+    CHECK(governor.GetTotalUsage() == 1000 * MB);
+    CHECK(governor.GetUsage(MemoryConsumer::UndoHistory) == 400 * MB);
+}
+
+void TestEnforceUnderCeilingIsNoOp() {
+    MemoryGovernor governor;
+    FakeSubsystems fakes(governor);
+    Setup(governor, fakes);
+    governor.SetCeiling(1300 * MB);  // Exactly at the ceiling
+
+    CHECK(governor.Enforce() == 0);
+    CHECK(fakes.GetCalls().empty());
+    CHECK(governor.GetTotalUsage() == 1300 * MB);
+
+    // A missing handler is skipped, not fatal
+    MemoryGovernor bare;
+    bare.SetCeiling(1 * MB);
+    bare.SetUsage(MemoryConsumer::DecodedImages, 10 * MB);
+    CHECK(bare.Enforce() == 0);
+}
+
+// Memory pressure sheds to half the ceiling, even when under the ceiling itself
+void TestLowMemorySheds() {
+    MemoryGovernor governor;
+    FakeSubsystems fakes(governor);
+    Setup(governor, fakes);
+    governor.SetCeiling(2000 * MB);
+    CHECK(governor.Enforce() == 0);
+
+    // 1300 MB against a 1000 MB target: all three stages run
+    CHECK(governor.OnLowMemory() == 300 * MB);
+    CHECK(fakes.GetCalls().size() == 3);
+    CHECK(fakes.GetRequested()[0] == 300 * MB);
+    CHECK(governor.GetTotalUsage() == 1000 * MB);
+
+    fakes.Reset();
+    CHECK(governor.OnLowMemory() == 0 && fakes.GetCalls().empty());
+}
+
+}  // namespace
+
+int main() {
+    TestUsageTotals();
+    TestShedOrder();
+    TestStopsUnderTarget();
+    TestEnforceUnderCeilingIsNoOp();
+    TestLowMemorySheds();
+    return test::Finish("MemoryGovernorTests");
+}
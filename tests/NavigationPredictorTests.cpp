@@ -0,0 +1,263 @@
+#include "NavigationPredictor.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <iterator>
+#include <map>
+#include <set>
+
+namespace {
+
+constexpr size_t FOLDER_SIZE = 200;
+
+// A camera JPEG on a laptop: each decode takes longer than a key repeat, but the workers
+// together keep up with a held arrow key
+constexpr size_t WORKERS = 6;
+constexpr uint64_t DECODE_MS = 250;
+
+// One recorded input: the index shown at timeMs, and whether the key was released after it
+struct TraceStep {
+    uint64_t timeMs;
+    size_t index;
+    bool keyUp;
+};
+
+// Held arrow key (auto-repeat every repeatMs) from first for count images
+void AppendScrub(std::vector<TraceStep>& trace, uint64_t& timeMs, size_t& index, int direction,
+    size_t count, uint64_t repeatMs) {
+    for (size_t i = 0; i < count; ++i) {
+        timeMs += repeatMs;
+        index += direction;
+        trace.push_back({ timeMs, index, i + 1 == count });
+    }
+}
+
+// Single presses, reading each image for pauseMs
+void AppendBrowse(std::vector<TraceStep>& trace, uint64_t& timeMs, size_t& index, int direction,
+    size_t count, uint64_t pauseMs) {
+    AppendScrub(trace, timeMs, index, direction, count, pauseMs);
+    for (size_t i = trace.size() - count; i < trace.size(); ++i) {
+        trace[i].keyUp = true;
+    }
+}
+
+void AppendJump(std::vector<TraceStep>& trace, uint64_t& timeMs, size_t& index, size_t target, uint64_t pauseMs) {
+    timeMs += pauseMs;
+    index = target;
+    trace.push_back({ timeMs, index, true });
+}
+
+// Decodes requested images on a fixed number of workers, each taking decodeMs, and
+// cancels queued requests that leave the window (as DecodePipeline::SetWindow does).
+// Only the window stays decoded, as with a cache budget sized for it.
+class DecodeSimulator {
+public:
+    DecodeSimulator(size_t workers, uint64_t decodeMs) : m_busyUntil(workers, 0), m_decodeMs(decodeMs) {}
+
+    void Request(const std::vector<size_t>& wanted, uint64_t nowMs) {
+        AdvanceTo(nowMs);
+        m_requestMs = nowMs;
+        m_queue.clear();
+
+        // The cache is sized for the window, so anything outside it is gone
+        std::set<size_t> window(wanted.begin(), wanted.end());
+        for (auto it = m_decoded.begin(); it != m_decoded.end();) {
+            it = window.count(*it) ? std::next(it) : m_decoded.erase(it);
+        }
+        for (size_t index : wanted) {
+            if (!m_decoded.count(index) && !m_inFlight.count(index)) {
+                m_queue.push_back(index);
+            }
+        }
+        AdvanceTo(nowMs);
+    }
+
+    bool IsDecoded(size_t index, uint64_t nowMs) {
+        AdvanceTo(nowMs);
+        return m_decoded.count(index) != 0;
+    }
+
+private:
+    void AdvanceTo(uint64_t nowMs) {
+        for (;;) {
+            // Finish everything due, then start queued work on the first idle worker
+            for (auto it = m_inFlight.begin(); it != m_inFlight.end();) {
+                if (it->second <= nowMs) {
+                    m_decoded.insert(it->first);
+                    it = m_inFlight.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            size_t worker = 0;
+            for (size_t w = 1; w < m_busyUntil.size(); ++w) {
+                if (m_busyUntil[w] < m_busyUntil[worker]) worker = w;
+            }
+            if (m_queue.empty() || m_busyUntil[worker] > nowMs) {
+                return;
+            }
+            uint64_t start = std::max(m_busyUntil[worker], m_requestMs);
+            m_busyUntil[worker] = start + m_decodeMs;
+            m_inFlight[m_queue.front()] = start + m_decodeMs;
+            m_queue.pop_front();
+        }
+    }
+
+    std::vector<uint64_t> m_busyUntil;
+    uint64_t m_decodeMs;
+    uint64_t m_requestMs = 0;  // When the queue was last replaced
+    std::deque<size_t> m_queue;
+    std::map<size_t, uint64_t> m_inFlight;
+    std::set<size_t> m_decoded;
+};
+
+// Images a window asks for, in the order the pipeline starts them: nearest the current
+// one first, the one ahead before the one behind at equal distance, jump targets last
+std::vector<size_t> WindowRequests(size_t index, const PrefetchWindow& window) {
+    std::vector<size_t> requests = { index };
+    for (size_t distance = 1; distance <= std::max(window.ahead, window.behind); ++distance) {
+        if (distance <= window.ahead) requests.push_back(index + distance);
+        if (distance <= window.behind) requests.push_back(index - distance);
+    }
+    requests.insert(requests.end(), window.jumpTargets.begin(), window.jumpTargets.end());
+    return requests;
+}
+
+// Fraction of navigations that land on an already decoded image
+double ReplayHitRate(const std::vector<TraceStep>& trace, size_t startIndex, bool predictive) {
+    NavigationPredictor predictor;
+    predictor.Reset(startIndex);
+    DecodeSimulator decoder(WORKERS, DECODE_MS);
+
+    size_t index = startIndex;
+    predictor.OnNavigate(index, FOLDER_SIZE, 0);
+    PrefetchWindow symmetric = { NavigationPredictor::DEFAULT_BASE_COUNT, NavigationPredictor::DEFAULT_BASE_COUNT, {} };
+    decoder.Request(WindowRequests(index, symmetric), 0);
+
+    size_t hits = 0;
+    for (const auto& step : trace) {
+        hits += decoder.IsDecoded(step.index, step.timeMs) ? 1 : 0;
+        index = step.index;
+
+        PrefetchWindow window = symmetric;
+        window.behind = std::min(window.behind, index);
+        window.ahead = std::min(window.ahead, FOLDER_SIZE - 1 - index);
+        predictor.OnNavigate(index, FOLDER_SIZE, step.timeMs);
+        if (predictive) {
+            window = predictor.Predict(index, FOLDER_SIZE, step.timeMs);
+        }
+        decoder.Request(WindowRequests(index, window), step.timeMs);
+        if (step.keyUp) {
+            predictor.OnScrubEnd();
+        }
+    }
+    return static_cast<double>(hits) / trace.size();
+}
+
+void CheckHitRates(const char* name, const std::vector<TraceStep>& trace, size_t startIndex, double minGain) {
+    double symmetric = ReplayHitRate(trace, startIndex, false);
+    double predictive = ReplayHitRate(trace, startIndex, true);
+    std::printf("  %s: %.0f%% symmetric, %.0f%% predictive\n", name, 100 * symmetric, 100 * predictive);
+    CHECK(predictive >= symmetric + minGain);
+
+    // Replaying the same trace must give the same result
+    CHECK(ReplayHitRate(trace, startIndex, true) == predictive);
+}
+
+// Held right arrow faster than the workers can decode, then reading slowly
+void TestScrubTrace() {
+    std::vector<TraceStep> trace;
+    uint64_t timeMs = 0;
+    size_t index = 20;
+    AppendScrub(trace, timeMs, index, +1, 60, 50);
+    timeMs += 1000;
+    AppendBrowse(trace, timeMs, index, +1, 10, 900);
+    AppendScrub(trace, timeMs, index, -1, 40, 50);
+    CheckHitRates("scrub", trace, 20, 0.30);
+}
+
+// Browsing near the start, with repeated trips to the last image and back
+void TestHomeEndTrace() {
+    std::vector<TraceStep> trace;
+    uint64_t timeMs = 0;
+    size_t index = 10;
+    for (int round = 0; round < 6; ++round) {
+        AppendBrowse(trace, timeMs, index, +1, 4, 700);
+        AppendJump(trace, timeMs, index, FOLDER_SIZE - 1, 700);
+        AppendJump(trace, timeMs, index, 0, 700);
+        AppendBrowse(trace, timeMs, index, +1, 3, 700);
+    }
+    CheckHitRates("home/end", trace, 10, 0.10);
+}
+
+// Single steps a second apart: the predictor must not lose to the symmetric window
+void TestSlowBrowseTrace() {
+    std::vector<TraceStep> trace;
+    uint64_t timeMs = 0;
+    size_t index = 50;
+    AppendBrowse(trace, timeMs, index, +1, 20, 1000);
+    AppendBrowse(trace, timeMs, index, -1, 20, 1000);
+    CheckHitRates("slow browse", trace, 50, 0.0);
+}
+
+// The windows themselves for the key situations
+void TestWindows() {
+    NavigationPredictor predictor;
+    predictor.Reset(100);
+    PrefetchWindow idle = predictor.Predict(100, FOLDER_SIZE, 0);
+    CHECK(idle.behind == 3 && idle.ahead == 3 && idle.jumpTargets.empty());
+
+    // Scrubbing forward at 20 images per second: 1 behind, 8 ahead
+    uint64_t timeMs = 0;
+    size_t index = 100;
+    predictor.OnNavigate(index, FOLDER_SIZE, timeMs);
+    for (int i = 0; i < 10; ++i) {
+        timeMs += 50;
+        predictor.OnNavigate(++index, FOLDER_SIZE, timeMs);
+    }
+    PrefetchWindow forward = predictor.Predict(index, FOLDER_SIZE, timeMs);
+    CHECK(forward.behind == 1 && forward.ahead == 8);
+    CHECK(predictor.GetNavigationIntervalMs(timeMs) > 45.0 && predictor.GetNavigationIntervalMs(timeMs) < 55.0);
+
+    // Idle again once the key is released or the repeats stop
+    PrefetchWindow paused = predictor.Predict(index, FOLDER_SIZE, timeMs + 1000);
+    CHECK(paused.behind == 3 && paused.ahead == 3);
+    predictor.OnScrubEnd();
+    PrefetchWindow released = predictor.Predict(index, FOLDER_SIZE, timeMs);
+    CHECK(released.behind == 3 && released.ahead == 3);
+
+    // Scrubbing backward mirrors the window
+    for (int i = 0; i < 10; ++i) {
+        timeMs += 50;
+        predictor.OnNavigate(--index, FOLDER_SIZE, timeMs);
+    }
+    PrefetchWindow backward = predictor.Predict(index, FOLDER_SIZE, timeMs);
+    CHECK(backward.behind == 8 && backward.ahead == 1);
+
+    // Clamped at the ends of the folder
+    CHECK(predictor.Predict(2, FOLDER_SIZE, timeMs).behind == 2);
+    CHECK(predictor.Predict(FOLDER_SIZE - 1, FOLDER_SIZE, timeMs).ahead == 0);
+
+    // After a jump to the end, both ends are predicted
+    predictor.OnScrubEnd();
+    timeMs += 500;
+    predictor.OnNavigate(FOLDER_SIZE - 1, FOLDER_SIZE, timeMs);
+    PrefetchWindow atEnd = predictor.Predict(FOLDER_SIZE - 1, FOLDER_SIZE, timeMs);
+    CHECK(atEnd.jumpTargets.size() == 1 && atEnd.jumpTargets[0] == 0);
+    PrefetchWindow middle = predictor.Predict(100, FOLDER_SIZE, timeMs);
+    CHECK(middle.jumpTargets.size() == 2);
+
+    predictor.Reset(5);
+    CHECK(predictor.Predict(5, FOLDER_SIZE, timeMs).jumpTargets.empty());
+}
+
+}  // namespace
+
+int main() {
+    TestWindows();
+    TestScrubTrace();
+    TestHomeEndTrace();
+    TestSlowBrowseTrace();
+    return test::Finish("NavigationPredictorTests");
+}
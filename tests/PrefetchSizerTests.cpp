@@ -0,0 +1,175 @@
+#include "PrefetchSizer.h"
+#include "TestSupport.h"
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+constexpr size_t MB = 1024 * 1024;
+
+// One decode as the cache records it
+struct Sample {
+    double decodeMs;
+    size_t bytes;
+};
+
+// Screen-level decodes recorded on a laptop: 24 MP JPEGs on the local SSD, and raw files
+// embedded previews could not serve, read from a NAS
+const std::vector<Sample> LOCAL_JPEG = {
+    { 38.0, 8 * MB }, { 42.0, 8 * MB }, { 35.0, 8 * MB }, { 51.0, 8 * MB }, { 40.0, 8 * MB },
+    { 37.0, 8 * MB }, { 44.0, 8 * MB }, { 39.0, 8 * MB },
+};
+const std::vector<Sample> NAS_RAW = {
+    { 610.0, 24 * MB }, { 580.0, 24 * MB }, { 720.0, 24 * MB }, { 655.0, 24 * MB },
+    { 590.0, 24 * MB }, { 640.0, 24 * MB },
+};
+
+void Replay(PrefetchSizer& sizer, const std::wstring& folder, const std::wstring& format,
+    const std::vector<Sample>& samples) {
+    for (const auto& sample : samples) {
+        sizer.Record(folder, format, sample.decodeMs, sample.bytes);
+    }
+}
+
+PrefetchSizer::Profile MakeProfile(double decodeMs, double bytes) {
+    PrefetchSizer::Profile profile;
+    profile.decodeMs = decodeMs;
+    profile.bytes = bytes;
+    profile.samples = 1;
+    return profile;
+}
+
+PrefetchSizer::Limits MakeLimits(size_t workerCount, size_t memoryBytes) {
+    PrefetchSizer::Limits limits;
+    limits.workerCount = workerCount;
+    limits.memoryBytes = memoryBytes;
+    return limits;
+}
+
+// With decoders and memory to spare, the window covers 1200 ms of navigation at the
+// current pace, and an idle user is treated as one image every 400 ms
+void TestWindowCoversPace() {
+    auto cheap = MakeProfile(5.0, 1.0 * MB);
+    auto unlimited = MakeLimits(64, 0);
+
+    CHECK(PrefetchSizer::ComputeWindowCount(cheap, 0.0, unlimited) == 3);
+    CHECK(PrefetchSizer::ComputeWindowCount(cheap, 400.0, unlimited) == 3);
+    CHECK(PrefetchSizer::ComputeWindowCount(cheap, 100.0, unlimited) == 12);
+    CHECK(PrefetchSizer::ComputeWindowCount(cheap, 1000.0, unlimited) == 2);
+
+    for (double interval = 60.0; interval <= 1200.0; interval += 10.0) {
+        size_t count = PrefetchSizer::ComputeWindowCount(cheap, interval, unlimited);
+        CHECK(count * interval >= PrefetchSizer::DEFAULT_COVER_MS);
+        CHECK((count - 1) * interval < PrefetchSizer::DEFAULT_COVER_MS);
+    }
+}
+
+// No wider than the workers can decode within the covered span
+void TestWorkerCap() {
+    auto slow = MakeProfile(300.0, 1.0 * MB);
+    CHECK(PrefetchSizer::ComputeWindowCount(slow, 50.0, MakeLimits(2, 0)) == 8);
+    CHECK(PrefetchSizer::ComputeWindowCount(slow, 50.0, MakeLimits(4, 0)) == 16);
+    CHECK(PrefetchSizer::ComputeWindowCount(slow, 50.0, MakeLimits(0, 0)) == 4);  // At least one worker
+
+    // Pace still wins when it asks for fewer
+    CHECK(PrefetchSizer::ComputeWindowCount(slow, 400.0, MakeLimits(4, 0)) == 3);
+}
+
+// Both sides and the current image fit in three quarters of the budget
+void TestMemoryCap() {
+    auto large = MakeProfile(10.0, 24.0 * MB);
+    CHECK(PrefetchSizer::ComputeWindowCount(large, 50.0, MakeLimits(64, 256 * MB)) == 3);
+    CHECK(PrefetchSizer::ComputeWindowCount(large, 50.0, MakeLimits(64, 1024 * MB)) == 15);
+    for (size_t budget = 64 * MB; budget <= 2048 * MB; budget += 64 * MB) {
+        size_t count = PrefetchSizer::ComputeWindowCount(large, 50.0, MakeLimits(64, budget));
+        CHECK(count == PrefetchSizer::MIN_COUNT || (2 * count + 1) * 24.0 * MB <= budget * 0.75);
+    }
+}
+
+void TestClamp() {
+    auto unlimited = MakeLimits(64, 0);
+    CHECK(PrefetchSizer::ComputeWindowCount(MakeProfile(5000.0, 1.0 * MB), 50.0, MakeLimits(1, 0)) == 1);
+    CHECK(PrefetchSizer::ComputeWindowCount(MakeProfile(10.0, 400.0 * MB), 50.0, MakeLimits(64, 256 * MB)) == 1);
+    CHECK(PrefetchSizer::ComputeWindowCount(MakeProfile(1.0, 1.0 * MB), 10.0, unlimited) == 20);
+    CHECK(PrefetchSizer::ComputeWindowCount(MakeProfile(0.0, 0.0), 0.01, unlimited) == 20);
+}
+
+// Recorded profiles: the fast local folder may run far ahead while scrubbing, the NAS
+// folder only as far as its decodes can keep up with
+void TestRecordedProfiles() {
+    PrefetchSizer sizer;
+    sizer.SetLimits(MakeLimits(6, 512 * MB));
+    Replay(sizer, L"C:\\Photos", L"jpeg", LOCAL_JPEG);
+    Replay(sizer, L"\\\\nas\\raw", L"cr2", NAS_RAW);
+
+    auto local = sizer.GetProfile(L"C:\\Photos", L"jpeg");
+    auto nas = sizer.GetProfile(L"\\\\nas\\raw", L"cr2");
+    CHECK(local.samples == LOCAL_JPEG.size() && nas.samples == NAS_RAW.size());
+    CHECK(local.decodeMs > 35.0 && local.decodeMs < 51.0);
+    CHECK(nas.decodeMs > 580.0 && nas.decodeMs < 720.0);
+    CHECK(local.bytes == 8.0 * MB && nas.bytes == 24.0 * MB);
+
+    size_t localScrub = sizer.GetWindowCount(L"C:\\Photos", L"jpeg", 50.0);
+    size_t nasScrub = sizer.GetWindowCount(L"\\\\nas\\raw", L"cr2", 50.0);
+    size_t localIdle = sizer.GetWindowCount(L"C:\\Photos", L"jpeg", 0.0);
+    std::printf("  Scrubbing at 50 ms: %zu images for local JPEG, %zu for NAS raw; idle %zu\n",
+        localScrub, nasScrub, localIdle);
+    CHECK(localScrub == 20);
+    CHECK(nasScrub == 7);  // Limited by the 512 MB budget before the six workers
+    CHECK(localIdle == 3);
+
+    sizer.Clear();
+    CHECK(sizer.GetProfile(L"C:\\Photos", L"jpeg").samples == 0);
+}
+
+// An unmeasured folder borrows its format's profile, then the defaults
+void TestProfileFallback() {
+    PrefetchSizer sizer;
+    Replay(sizer, L"\\\\nas\\raw", L"cr2", NAS_RAW);
+    sizer.Record(L"C:\\Photos", L"cr2", 100.0, 24 * MB);
+
+    auto measured = sizer.GetProfile(L"C:\\Photos", L"cr2");
+    CHECK(measured.samples == 1 && measured.decodeMs == 100.0);
+
+    auto borrowed = sizer.GetProfile(L"D:\\Elsewhere", L"cr2");
+    CHECK(borrowed.samples == NAS_RAW.size() + 1);
+
+    auto defaults = sizer.GetProfile(L"D:\\Elsewhere", L"png");
+    CHECK(defaults.samples == 0 && defaults.decodeMs == PrefetchSizer::Profile().decodeMs);
+
+    // Nonsense samples are ignored
+    sizer.Record(L"C:\\Photos", L"cr2", -1.0, 24 * MB);
+    sizer.Record(L"C:\\Photos", L"cr2", 10.0, 0);
+    CHECK(sizer.GetProfile(L"C:\\Photos", L"cr2").samples == 1);
+}
+
+// Past the folder limit, folder profiles are forgotten together and formats remain
+void TestFolderProfilesReset() {
+    PrefetchSizer sizer;
+    sizer.Record(L"C:\\First", L"jpeg", 500.0, 8 * MB);
+    size_t folders = 1;
+    while (sizer.GetProfile(L"C:\\First", L"jpeg").samples == 1 && folders < 10000) {
+        sizer.Record(L"C:\\Folder" + std::to_wstring(folders), L"jpeg", 20.0, 8 * MB);
+        ++folders;
+    }
+    std::printf("  Folder profiles reset after %zu folders\n", folders - 1);
+
+    // The first folder now reads the format's profile, which kept every sample
+    CHECK(folders == 257);
+    auto first = sizer.GetProfile(L"C:\\First", L"jpeg");
+    CHECK(first.samples == folders);
+    CHECK(sizer.GetProfile(L"C:\\Folder256", L"jpeg").samples == 1);
+}
+
+}  // namespace
+
+int main() {
+    TestWindowCoversPace();
+    TestWorkerCap();
+    TestMemoryCap();
+    TestClamp();
+    TestRecordedProfiles();
+    TestProfileFallback();
+    TestFolderProfilesReset();
+    return test::Finish("PrefetchSizerTests");
+}
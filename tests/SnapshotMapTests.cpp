@@ -0,0 +1,148 @@
+#include "SnapshotMap.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr size_t KEY_COUNT = 512;
+constexpr size_t WRITERS = 8;
+constexpr size_t LOOKUPS = 200000;
+
+// Each value remembers the key it was stored under, so a reader can tell a torn or
+// misplaced entry from a correct one
+struct Entry {
+    size_t key;
+    uint64_t version;
+};
+
+std::vector<std::wstring> MakeKeys() {
+    std::vector<std::wstring> keys;
+    for (size_t i = 0; i < KEY_COUNT; ++i) {
+        keys.push_back(L"C:\\Photos\\IMG_" + std::to_wstring(1000 + i) + L".JPG");
+    }
+    return keys;
+}
+
+struct Latency {
+    double p50Ns;
+    double p99Ns;
+    bool consistent;
+};
+
+// Times single lookups on one thread (the UI thread) while WRITERS threads churn the
+// map under one mutex, as the cache's decode workers do
+template <typename FindFn, typename SetFn, typename EraseFn>
+Latency MeasureUnderWriters(const std::vector<std::wstring>& keys, FindFn find, SetFn set, EraseFn erase) {
+    std::mutex writerMutex;
+    std::atomic<bool> done{ false };
+    std::vector<std::thread> writers;
+    for (size_t w = 0; w < WRITERS; ++w) {
+        writers.emplace_back([&, w] {
+            std::mt19937 random(static_cast<uint32_t>(w + 1));
+            uint64_t version = 0;
+            while (!done) {
+                size_t key = random() % KEY_COUNT;
+                std::lock_guard<std::mutex> lock(writerMutex);
+                if (random() % 4 == 0) {
+                    erase(keys[key]);
+                } else {
+                    set(keys[key], std::make_shared<Entry>(Entry{ key, ++version }));
+                }
+            }
+        });
+    }
+
+    std::mt19937 random(99);
+    std::vector<double> samples;
+    samples.reserve(LOOKUPS);
+    bool consistent = true;
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        size_t key = random() % KEY_COUNT;
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<Entry> entry = find(keys[key]);
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        consistent = consistent && (!entry || entry->key == key);
+    }
+
+    done = true;
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return { samples[samples.size() / 2], samples[samples.size() * 99 / 100], consistent };
+}
+
+void TestBasicOperations() {
+    SnapshotMap<std::shared_ptr<Entry>> map;
+    CHECK(map.Find(L"a") == nullptr);
+
+    map.Set(L"a", std::make_shared<Entry>(Entry{ 1, 1 }));
+    map.Set(L"b", std::make_shared<Entry>(Entry{ 2, 1 }));
+    CHECK(map.Find(L"a")->key == 1 && map.Find(L"b")->key == 2);
+
+    // A reader holding an old value keeps it after the entry is replaced
+    auto held = map.Find(L"a");
+    map.Set(L"a", std::make_shared<Entry>(Entry{ 1, 2 }));
+    CHECK(held->version == 1 && map.Find(L"a")->version == 2);
+
+    map.Erase(L"a");
+    map.Erase(L"missing");
+    CHECK(map.Find(L"a") == nullptr && map.Find(L"b") != nullptr);
+
+    map.Clear();
+    CHECK(map.Find(L"b") == nullptr);
+}
+
+// UI-thread lookups must not queue behind writers. The mutex-guarded map is printed for
+// comparison; the bound only guards against lookups that block on the writers' lock.
+void TestLookupLatencyUnderWriters() {
+    auto keys = MakeKeys();
+
+    SnapshotMap<std::shared_ptr<Entry>> snapshot;
+    Latency snapshotLatency = MeasureUnderWriters(keys,
+        [&](const std::wstring& key) { return snapshot.Find(key); },
+        [&](const std::wstring& key, std::shared_ptr<Entry> value) { snapshot.Set(key, std::move(value)); },
+        [&](const std::wstring& key) { snapshot.Erase(key); });
+
+    std::mutex mapMutex;
+    std::unordered_map<std::wstring, std::shared_ptr<Entry>> locked;
+    Latency mutexLatency = MeasureUnderWriters(keys,
+        [&](const std::wstring& key) {
+            std::lock_guard<std::mutex> lock(mapMutex);
+            auto it = locked.find(key);
+            return it != locked.end() ? it->second : nullptr;
+        },
+        [&](const std::wstring& key, std::shared_ptr<Entry> value) {
+            std::lock_guard<std::mutex> lock(mapMutex);
+            locked[key] = std::move(value);
+        },
+        [&](const std::wstring& key) {
+            std::lock_guard<std::mutex> lock(mapMutex);
+            locked.erase(key);
+        });
+
+    // Only meaningful with more hardware threads than writers; on fewer the writers rarely
+    // hold the lock while the reader runs
+    std::printf("  Lookup with %zu writers on %u hardware threads: snapshot p50 %.0f ns, p99 %.0f ns; "
+        "mutex p50 %.0f ns, p99 %.0f ns\n", WRITERS, std::thread::hardware_concurrency(),
+        snapshotLatency.p50Ns, snapshotLatency.p99Ns, mutexLatency.p50Ns, mutexLatency.p99Ns);
+    CHECK(snapshotLatency.consistent && mutexLatency.consistent);
+    CHECK(snapshotLatency.p99Ns < 1e6);
+}
+
+}  // namespace
+
+int main() {
+    TestBasicOperations();
+    TestLookupLatencyUnderWriters();
+    return test::Finish("SnapshotMapTests");
+}
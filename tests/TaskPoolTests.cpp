@@ -0,0 +1,278 @@
+#include "TaskPool.h"
+#include "BlockCompressor.h"
+#include "TestSupport.h"
+#include "YCbCrConverter.h"
+#include <chrono>
+#include <cstdio>
+#include <set>
+
+namespace {
+
+// Blocks the pool's only worker until released, so later submissions stay queued
+class Gate {
+public:
+    void Wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_entered = true;
+        m_cv.notify_all();
+        m_cv.wait(lock, [this] { return m_open; });
+    }
+
+    void WaitUntilEntered() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return m_entered; });
+    }
+
+    void Open() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_open = true;
+        m_cv.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_entered = false;
+    bool m_open = false;
+};
+
+bool WaitFor(const std::atomic<size_t>& counter, size_t target) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (counter < target) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Small tasks submitted from several threads at once all run exactly once
+void TestEveryTaskRunsOnce() {
+    constexpr size_t SUBMITTERS = 4;
+    constexpr size_t TASKS_EACH = 20000;
+    TaskPool pool;
+    pool.Start(4);
+
+    std::vector<std::atomic<int>> runs(SUBMITTERS * TASKS_EACH);
+    std::atomic<size_t> completed{ 0 };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> submitters;
+    for (size_t s = 0; s < SUBMITTERS; ++s) {
+        submitters.emplace_back([&, s] {
+            for (size_t i = 0; i < TASKS_EACH; ++i) {
+                size_t id = s * TASKS_EACH + i;
+                pool.Submit(static_cast<TaskPriority>(id % 3), [&, id] {
+                    runs[id]++;
+                    completed++;
+                });
+            }
+        });
+    }
+    for (auto& submitter : submitters) {
+        submitter.join();
+    }
+    CHECK(WaitFor(completed, runs.size()));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("  %zu tasks from %zu threads: %.0f tasks/s\n", runs.size(), SUBMITTERS, runs.size() / seconds);
+
+    bool allOnce = true;
+    for (auto& count : runs) {
+        allOnce = allOnce && count == 1;
+    }
+    CHECK(allOnce);
+    pool.Stop();
+}
+
+// Stands in for decoding one camera JPEG for a far prefetch slot: generate its planes,
+// expand them to BGRA and block-compress the result
+bool DecodeSyntheticImage(uint32_t seed) {
+    constexpr uint32_t WIDTH = 768;
+    constexpr uint32_t HEIGHT = 512;
+    PlanarYCbCr planes;
+    planes.width = WIDTH;
+    planes.height = HEIGHT;
+    planes.chromaWidth = WIDTH / 2;
+    planes.chromaHeight = HEIGHT / 2;
+    planes.y.resize(static_cast<size_t>(WIDTH) * HEIGHT);
+    planes.cb.resize(static_cast<size_t>(planes.chromaWidth) * planes.chromaHeight);
+    planes.cr.resize(planes.cb.size());
+    for (size_t i = 0; i < planes.y.size(); ++i) {
+        planes.y[i] = static_cast<uint8_t>((i % WIDTH + i / WIDTH + seed) & 0xFF);
+    }
+    for (size_t i = 0; i < planes.cb.size(); ++i) {
+        planes.cb[i] = static_cast<uint8_t>(96 + (i + seed) % 64);
+        planes.cr[i] = static_cast<uint8_t>(160 - (i * 3 + seed) % 64);
+    }
+
+    PixelBuffer pixels;
+    BlockImage compressed;
+    return YCbCrConverter::ConvertToBgra(planes, pixels) && BlockCompressor::Compress(pixels, compressed);
+}
+
+// Images per second decoding a synthetic folder on workerCount workers
+double MeasureFolderThroughput(size_t workerCount, size_t imageCount) {
+    TaskPool pool;
+    pool.Start(workerCount);
+    std::atomic<size_t> completed{ 0 };
+    std::atomic<size_t> failed{ 0 };
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < imageCount; ++i) {
+        pool.Submit(TaskPriority::Prefetch, [&, i] {
+            if (!DecodeSyntheticImage(static_cast<uint32_t>(i))) failed++;
+            completed++;
+        });
+    }
+    CHECK(WaitFor(completed, imageCount));
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CHECK(failed == 0);
+    pool.Stop();
+    return imageCount / seconds;
+}
+
+// Decoding scales with workers up to the default count. Where that is one worker (a
+// single hardware thread) there is nothing to compare, so only the numbers are printed.
+void TestFolderDecodeScales() {
+    const size_t maxWorkers = TaskPool::DefaultWorkerCount();
+    const size_t imageCount = 8 * maxWorkers;
+    std::vector<double> throughput;
+    for (size_t workers = 1; workers <= maxWorkers; ++workers) {
+        throughput.push_back(MeasureFolderThroughput(workers, imageCount));
+        std::printf("  %zu worker(s): %.1f images/s\n", workers, throughput.back());
+    }
+    if (maxWorkers > 1) {
+        CHECK(throughput.back() > throughput.front());
+    }
+}
+
+// Work a task spawns lands on its worker's own queue; idle peers must steal it
+void TestIdleWorkersSteal() {
+    TaskPool pool;
+    pool.Start(4);
+
+    constexpr size_t CHILDREN = 64;
+    std::mutex mutex;
+    std::set<std::thread::id> workers;
+    std::atomic<size_t> completed{ 0 };
+    pool.Submit(TaskPriority::Prefetch, [&] {
+        for (size_t i = 0; i < CHILDREN; ++i) {
+            pool.Submit(TaskPriority::Prefetch, [&] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    workers.insert(std::this_thread::get_id());
+                }
+                completed++;
+            });
+        }
+    });
+
+    CHECK(WaitFor(completed, CHILDREN));
+    CHECK(workers.size() > 1);
+    pool.Stop();
+}
+
+// A queued interactive task runs before queued prefetch and background work
+void TestPriorityOrder() {
+    TaskPool pool;
+    pool.Start(1);
+    Gate gate;
+    pool.Submit(TaskPriority::Interactive, [&] { gate.Wait(); });
+    gate.WaitUntilEntered();
+
+    std::mutex mutex;
+    std::vector<TaskPriority> order;
+    std::atomic<size_t> completed{ 0 };
+    for (TaskPriority priority : { TaskPriority::Background, TaskPriority::Prefetch, TaskPriority::Interactive }) {
+        pool.Submit(priority, [&, priority] {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(priority);
+            completed++;
+        });
+    }
+    gate.Open();
+
+    CHECK(WaitFor(completed, 3));
+    CHECK(order.size() == 3 && order[0] == TaskPriority::Interactive &&
+        order[1] == TaskPriority::Prefetch && order[2] == TaskPriority::Background);
+    pool.Stop();
+}
+
+// Stop lets the running task finish but discards queued ones, and later submissions are
+// ignored
+void TestStopDiscardsQueuedTasks() {
+    TaskPool pool;
+    pool.Start(1);
+    Gate gate;
+    pool.Submit(TaskPriority::Interactive, [&] { gate.Wait(); });
+    gate.WaitUntilEntered();
+
+    std::atomic<size_t> ran{ 0 };
+    for (int i = 0; i < 100; ++i) {
+        pool.Submit(TaskPriority::Background, [&] { ran++; });
+    }
+
+    std::thread stopper([&] { pool.Stop(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    gate.Open();
+    stopper.join();
+    CHECK(ran == 0);
+
+    pool.Submit(TaskPriority::Interactive, [&] { ran++; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    CHECK(ran == 0);
+
+    // A stopped pool can be started again
+    pool.Start(2);
+    pool.Submit(TaskPriority::Interactive, [&] { ran++; });
+    CHECK(WaitFor(ran, 1));
+    pool.Stop();
+}
+
+// Submissions racing Stop and Start from other threads: every task the pool accepts runs
+// or is discarded by the Stop that follows it, never by a later pool
+void TestSubmitRacingStop() {
+    TaskPool pool;
+    pool.Start(2);
+    std::atomic<bool> done{ false };
+    std::atomic<size_t> ran{ 0 };
+    std::vector<std::thread> submitters;
+    for (int s = 0; s < 4; ++s) {
+        submitters.emplace_back([&] {
+            while (!done) {
+                pool.Submit(TaskPriority::Prefetch, [&] { ran++; });
+            }
+        });
+    }
+    for (int cycle = 0; cycle < 200; ++cycle) {
+        pool.Stop();
+        pool.Start(2);
+    }
+    done = true;
+    for (auto& submitter : submitters) {
+        submitter.join();
+    }
+    pool.Stop();
+
+    // A stale task or a wrapped count would show up here as a run from an empty pool
+    size_t before = ran;
+    pool.Start(2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(ran == before);
+
+    std::atomic<size_t> after{ 0 };
+    pool.Submit(TaskPriority::Interactive, [&] { after++; });
+    CHECK(WaitFor(after, 1));
+    pool.Stop();
+}
+
+}  // namespace
+
+int main() {
+    TestEveryTaskRunsOnce();
+    TestFolderDecodeScales();
+    TestIdleWorkersSteal();
+    TestPriorityOrder();
+    TestStopDiscardsQueuedTasks();
+    TestSubmitRacingStop();
+    return test::Finish("TaskPoolTests");
+}
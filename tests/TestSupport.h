@@ -0,0 +1,30 @@
+#pragma once
+// Minimal checks for the platform-neutral unit tests: each test binary counts failed
+// CHECKs and returns non-zero from main if any failed, which is all CTest needs.
+#include <cstdio>
+
+namespace test {
+
+inline int& FailureCount() {
+    static int failures = 0;
+    return failures;
+}
+
+inline void Fail(const char* file, int line, const char* expression) {
+    std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", file, line, expression);
+    ++FailureCount();
+}
+
+inline int Finish(const char* name) {
+    if (FailureCount() == 0) {
+        std::printf("%s: passed\n", name);
+        return 0;
+    }
+    std::fprintf(stderr, "%s: %d check(s) failed\n", name, FailureCount());
+    return 1;
+}
+
+}  // namespace test
+
+#define CHECK(expression) \
+    do { if (!(expression)) test::Fail(__FILE__, __LINE__, #expression); } while (0)
@@ -0,0 +1,229 @@
+#include "TileGrid.h"
+#include "LruIndex.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <random>
+#include <set>
+
+namespace {
+
+constexpr uint32_t TILE = TileGrid::DEFAULT_TILE_SIZE;
+constexpr uint32_t SCREEN_WIDTH = 1920;
+constexpr uint32_t SCREEN_HEIGHT = 1080;
+
+bool Overlaps(const ImageRegion& a, const ImageRegion& b) {
+    return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+// The request's example: a 30000x20000 scan
+void TestLevels() {
+    TileGrid grid(30000, 20000);
+    CHECK(grid.GetLevelCount() == 7);  // 30000 -> 469 in six halvings
+    CHECK(grid.GetColumnCount(0) == 59 && grid.GetRowCount(0) == 40);
+    CHECK(grid.GetLevelWidth(1) == 15000 && grid.GetLevelHeight(1) == 10000);
+    CHECK(grid.GetLevelWidth(6) == 469 && grid.GetLevelHeight(6) == 313);
+    CHECK(grid.GetColumnCount(6) == 1 && grid.GetRowCount(6) == 1);
+
+    // Odd sizes round up, so no level loses its last pixel
+    TileGrid odd(1025, 3);
+    CHECK(odd.GetLevelCount() == 3);  // 513 is still one pixel too wide for a tile
+    CHECK(odd.GetLevelWidth(1) == 513 && odd.GetLevelHeight(1) == 2);
+    CHECK(odd.GetColumnCount(1) == 2);
+
+    TileGrid small(100, 80);
+    CHECK(small.GetLevelCount() == 1);
+    CHECK(TileGrid(0, 80).GetLevelCount() == 0);
+}
+
+void TestSelectLevel() {
+    TileGrid grid(30000, 20000);
+    CHECK(grid.SelectLevel(2.0) == 0);
+    CHECK(grid.SelectLevel(1.0) == 0);
+    CHECK(grid.SelectLevel(0.75) == 0);
+    CHECK(grid.SelectLevel(0.5) == 1);
+    CHECK(grid.SelectLevel(0.49) == 1);
+    CHECK(grid.SelectLevel(0.25) == 2);
+    CHECK(grid.SelectLevel(0.001) == grid.GetLevelCount() - 1);
+    CHECK(grid.SelectLevel(0.0) == 0);
+    CHECK(grid.SelectLevel(-1.0) == 0);
+
+    // The chosen level never has fewer pixels than the screen shows
+    for (double scale = 0.01; scale < 1.0; scale *= 1.1) {
+        uint32_t level = grid.SelectLevel(scale);
+        if (level < grid.GetLevelCount() - 1) {
+            CHECK(static_cast<double>(grid.GetLevelWidth(level)) >= grid.GetImageWidth() * scale);
+        }
+    }
+}
+
+// Tiles of every level cover the whole image exactly, edge tiles included
+void TestBoundsCoverImage() {
+    TileGrid grid(30000, 20000);
+    TileBounds edge = grid.GetBounds({ 0, 58, 39 });
+    CHECK(edge.x == 58 * TILE && edge.width == 30000 - 58 * TILE);
+    CHECK(edge.y == 39 * TILE && edge.height == 20000 - 39 * TILE);
+    CHECK(grid.GetBounds({ 0, 59, 0 }).width == 0);
+
+    for (uint32_t level = 0; level < grid.GetLevelCount(); ++level) {
+        uint64_t pixels = 0;
+        for (uint32_t row = 0; row < grid.GetRowCount(level); ++row) {
+            for (uint32_t column = 0; column < grid.GetColumnCount(level); ++column) {
+                TileBounds bounds = grid.GetBounds({ level, column, row });
+                CHECK(bounds.width > 0 && bounds.height > 0);
+                pixels += static_cast<uint64_t>(bounds.width) * bounds.height;
+            }
+        }
+        CHECK(pixels == static_cast<uint64_t>(grid.GetLevelWidth(level)) * grid.GetLevelHeight(level));
+
+        uint32_t lastColumn = grid.GetColumnCount(level) - 1;
+        uint32_t lastRow = grid.GetRowCount(level) - 1;
+        ImageRegion corner = grid.GetImageRegion({ level, lastColumn, lastRow });
+        CHECK(corner.right == 30000.0 && corner.bottom == 20000.0);
+    }
+}
+
+// Visible tiles are exactly those overlapping the view, nearest its centre first, and
+// their number depends on the screen, not the image
+void TestVisibleTiles() {
+    TileGrid grid(30000, 20000);
+    std::mt19937 random(3);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    size_t mostTiles = 0;
+
+    for (int i = 0; i < 200; ++i) {
+        double scale = std::pow(2.0, -6.0 * unit(random));
+        uint32_t level = grid.SelectLevel(scale);
+        double viewWidth = SCREEN_WIDTH / scale;
+        double viewHeight = SCREEN_HEIGHT / scale;
+        double left = unit(random) * 30000.0 - viewWidth / 2;
+        double top = unit(random) * 20000.0 - viewHeight / 2;
+        ImageRegion view = { left, top, left + viewWidth, top + viewHeight };
+
+        auto tiles = grid.GetVisibleTiles(level, view);
+        std::set<std::wstring> listed;
+        for (const auto& tile : tiles) {
+            CHECK(tile.level == level);
+            CHECK(Overlaps(grid.GetImageRegion(tile), view));
+            listed.insert(TileGrid::MakeKey(tile));
+        }
+        CHECK(listed.size() == tiles.size());
+
+        for (uint32_t row = 0; row < grid.GetRowCount(level); ++row) {
+            for (uint32_t column = 0; column < grid.GetColumnCount(level); ++column) {
+                TileKey key = { level, column, row };
+                if (Overlaps(grid.GetImageRegion(key), view)) {
+                    CHECK(listed.count(TileGrid::MakeKey(key)) == 1);
+                }
+            }
+        }
+
+        double centerX = (std::max(view.left, 0.0) + std::min(view.right, 30000.0)) / 2;
+        double centerY = (std::max(view.top, 0.0) + std::min(view.bottom, 20000.0)) / 2;
+        // In whole tiles of the level, so partial edge tiles rank by their grid position
+        double unitsX = static_cast<double>(grid.GetLevelWidth(level)) / 30000.0 / TILE;
+        double unitsY = static_cast<double>(grid.GetLevelHeight(level)) / 20000.0 / TILE;
+        auto distance = [&](const TileKey& key) {
+            double dx = key.column + 0.5 - centerX * unitsX;
+            double dy = key.row + 0.5 - centerY * unitsY;
+            return dx * dx + dy * dy;
+        };
+        for (size_t t = 1; t < tiles.size(); ++t) {
+            CHECK(distance(tiles[t - 1]) <= distance(tiles[t]) + 1e-6);
+        }
+        mostTiles = std::max(mostTiles, tiles.size());
+    }
+
+    // A screen at level scale 0.5-1 spans at most two screens' worth of level pixels,
+    // plus a partial tile on each side
+    size_t bound = (2 * SCREEN_WIDTH / TILE + 2) * (2 * SCREEN_HEIGHT / TILE + 2);
+    CHECK(mostTiles > 0 && mostTiles <= bound);
+
+    CHECK(grid.GetVisibleTiles(0, { -500.0, -500.0, -1.0, -1.0 }).empty());
+    CHECK(grid.GetVisibleTiles(grid.GetLevelCount(), { 0.0, 0.0, 100.0, 100.0 }).empty());
+}
+
+// The tile cache as TiledImage runs it: an LruIndex under a byte budget, evicting the
+// least recently used tiles but never the ones just made visible
+void TestTileCacheStaysWithinBudget() {
+    TileGrid grid(30000, 20000);
+    LruIndex<size_t> cache;
+    size_t totalBytes = 0;
+    const size_t tileBytes = static_cast<size_t>(TILE) * TILE * 4;
+    const size_t maxBytes = 48 * tileBytes;
+
+    std::mt19937 random(11);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for (int step = 0; step < 500; ++step) {
+        double scale = std::pow(2.0, -6.0 * unit(random));
+        double viewWidth = SCREEN_WIDTH / scale;
+        double viewHeight = SCREEN_HEIGHT / scale;
+        double left = unit(random) * 30000.0 - viewWidth / 2;
+        double top = unit(random) * 20000.0 - viewHeight / 2;
+        auto visible = grid.GetVisibleTiles(grid.SelectLevel(scale),
+            { left, top, left + viewWidth, top + viewHeight });
+
+        for (const auto& tile : visible) {
+            std::wstring key = TileGrid::MakeKey(tile);
+            auto existing = cache.Find(key);
+            if (existing != cache.INVALID_HANDLE) {
+                cache.Touch(existing);
+                continue;
+            }
+            TileBounds bounds = grid.GetBounds(tile);
+            size_t bytes = static_cast<size_t>(bounds.width) * bounds.height * 4;
+            cache.Insert(key, bytes);
+            totalBytes += bytes;
+        }
+
+        while (totalBytes > maxBytes && cache.Size() > visible.size()) {
+            auto victim = cache.LeastRecent();
+            totalBytes -= cache.GetValue(victim);
+            cache.Erase(victim);
+        }
+
+        CHECK(totalBytes <= std::max(maxBytes, visible.size() * tileBytes));
+        for (const auto& tile : visible) {
+            CHECK(cache.Find(TileGrid::MakeKey(tile)) != cache.INVALID_HANDLE);
+        }
+    }
+}
+
+void TestLruOrder() {
+    LruIndex<int> lru;
+    auto a = lru.Insert(L"a", 1);
+    auto b = lru.Insert(L"b", 2);
+    auto c = lru.Insert(L"c", 3);
+    CHECK(lru.MostRecent() == c && lru.LeastRecent() == a);
+
+    lru.Touch(a);
+    CHECK(lru.MostRecent() == a && lru.LeastRecent() == b);
+    CHECK(lru.NextOlder(a) == c && lru.NextNewer(c) == a);
+
+    // Replacing keeps the handle and refreshes recency
+    CHECK(lru.Insert(L"b", 20) == b);
+    CHECK(lru.GetValue(b) == 20 && lru.MostRecent() == b && lru.LeastRecent() == c);
+
+    // Erased slots are reused, so the slab does not grow with churn
+    lru.Erase(c);
+    CHECK(lru.Find(L"c") == lru.INVALID_HANDLE);
+    CHECK(lru.Insert(L"d", 4) == c);
+    CHECK(lru.Size() == 3 && lru.GetKey(c) == L"d");
+
+    CHECK(lru.Erase(L"a") && !lru.Erase(L"a"));
+    CHECK(lru.LeastRecent() == b && lru.MostRecent() == c);
+
+    lru.Clear();
+    CHECK(lru.IsEmpty() && lru.MostRecent() == lru.INVALID_HANDLE);
+}
+
+}  // namespace
+
+int main() {
+    TestLevels();
+    TestSelectLevel();
+    TestBoundsCoverImage();
+    TestVisibleTiles();
+    TestTileCacheStaysWithinBudget();
+    TestLruOrder();
+    return test::Finish("TileGridTests");
+}
@@ -0,0 +1,166 @@
+#include "YCbCrConverter.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+// The integer kernel must stay this close to an exact conversion (WIC's expansion of the
+// same JPEG differs by rounding only, and 40 dB is where differences start to show)
+constexpr double MIN_PSNR_DB = 45.0;
+constexpr int MAX_CHANNEL_ERROR = 3;
+
+// Deterministic mix of smooth gradients, hard edges and noise, so both the chroma
+// upsampling and the colour matrix are exercised
+uint8_t Sample(uint32_t x, uint32_t y, uint32_t seed) {
+    uint32_t noise = (x * 73856093u) ^ (y * 19349663u) ^ (seed * 83492791u);
+    noise = (noise ^ (noise >> 13)) * 0x5bd1e995u;
+    uint32_t gradient = (x * 3 + y * 5 + seed * 40) & 0xFF;
+    uint32_t edge = ((x / 7 + y / 5) & 1) ? 60 : 0;
+    return static_cast<uint8_t>((gradient + edge + ((noise >> 24) & 0x1F)) & 0xFF);
+}
+
+PlanarYCbCr MakePlanes(uint32_t width, uint32_t height, uint32_t chromaWidth, uint32_t chromaHeight) {
+    PlanarYCbCr planes;
+    planes.width = width;
+    planes.height = height;
+    planes.chromaWidth = chromaWidth;
+    planes.chromaHeight = chromaHeight;
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            planes.y.push_back(Sample(x, y, 0));
+        }
+    }
+    for (uint32_t y = 0; y < chromaHeight; ++y) {
+        for (uint32_t x = 0; x < chromaWidth; ++x) {
+            planes.cb.push_back(Sample(x, y, 1));
+            planes.cr.push_back(Sample(x, y, 2));
+        }
+    }
+    return planes;
+}
+
+// Chroma at an output position, linearly interpolated with centred siting
+double UpsampleChroma(const std::vector<uint8_t>& plane, const PlanarYCbCr& planes, uint32_t x, uint32_t y) {
+    auto tap = [](uint32_t position, uint32_t outputSize, uint32_t sourceSize, uint32_t& first, double& weight) {
+        double centre = (position + 0.5) * sourceSize / outputSize - 0.5;
+        centre = std::clamp(centre, 0.0, static_cast<double>(sourceSize - 1));
+        first = std::min(static_cast<uint32_t>(centre), sourceSize - 1);
+        weight = centre - first;
+    };
+
+    uint32_t x0 = 0;
+    uint32_t y0 = 0;
+    double wx = 0.0;
+    double wy = 0.0;
+    tap(x, planes.width, planes.chromaWidth, x0, wx);
+    tap(y, planes.height, planes.chromaHeight, y0, wy);
+    uint32_t x1 = std::min(x0 + 1, planes.chromaWidth - 1);
+    uint32_t y1 = std::min(y0 + 1, planes.chromaHeight - 1);
+
+    auto at = [&](uint32_t cx, uint32_t cy) { return static_cast<double>(plane[cy * planes.chromaWidth + cx]); };
+    double top = at(x0, y0) * (1 - wx) + at(x1, y0) * wx;
+    double bottom = at(x0, y1) * (1 - wx) + at(x1, y1) * wx;
+    return top * (1 - wy) + bottom * wy;
+}
+
+// Floating-point BT.601 full-range conversion, as a JPEG decoder expanding to BGRA does
+PixelBuffer ReferenceConvert(const PlanarYCbCr& planes) {
+    PixelBuffer out;
+    out.width = planes.width;
+    out.height = planes.height;
+    out.stride = planes.width * 4;
+    out.pixels.resize(static_cast<size_t>(out.stride) * out.height);
+
+    auto toByte = [](double value) {
+        return static_cast<uint8_t>(std::clamp(std::lround(value), 0L, 255L));
+    };
+    for (uint32_t y = 0; y < planes.height; ++y) {
+        for (uint32_t x = 0; x < planes.width; ++x) {
+            double luma = planes.y[y * planes.width + x];
+            double blue = UpsampleChroma(planes.cb, planes, x, y) - 128.0;
+            double red = UpsampleChroma(planes.cr, planes, x, y) - 128.0;
+            uint8_t* pixel = out.pixels.data() + static_cast<size_t>(y) * out.stride + x * 4;
+            pixel[0] = toByte(luma + 1.772 * blue);
+            pixel[1] = toByte(luma - 0.344136 * blue - 0.714136 * red);
+            pixel[2] = toByte(luma + 1.402 * red);
+            pixel[3] = 255;
+        }
+    }
+    return out;
+}
+
+// PSNR over the colour channels, and the largest single-channel difference
+double Psnr(const PixelBuffer& actual, const PixelBuffer& expected, int& maxError, bool& alphaOpaque) {
+    double squaredError = 0.0;
+    size_t samples = 0;
+    maxError = 0;
+    alphaOpaque = true;
+    for (size_t i = 0; i < expected.pixels.size(); i += 4) {
+        for (size_t c = 0; c < 3; ++c) {
+            int difference = static_cast<int>(actual.pixels[i + c]) - expected.pixels[i + c];
+            squaredError += static_cast<double>(difference) * difference;
+            maxError = std::max(maxError, std::abs(difference));
+            samples++;
+        }
+        alphaOpaque = alphaOpaque && actual.pixels[i + 3] == 255;
+    }
+    if (squaredError == 0.0) {
+        return INFINITY;
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / (squaredError / samples));
+}
+
+void CheckAgainstReference(uint32_t width, uint32_t height, uint32_t chromaWidth, uint32_t chromaHeight) {
+    PlanarYCbCr planes = MakePlanes(width, height, chromaWidth, chromaHeight);
+    PixelBuffer converted;
+    CHECK(YCbCrConverter::ConvertToBgra(planes, converted));
+    CHECK(converted.width == width && converted.height == height && converted.stride == width * 4);
+    if (converted.pixels.size() != static_cast<size_t>(width) * height * 4) {
+        CHECK(converted.pixels.size() == static_cast<size_t>(width) * height * 4);
+        return;
+    }
+
+    int maxError = 0;
+    bool alphaOpaque = false;
+    double psnr = Psnr(converted, ReferenceConvert(planes), maxError, alphaOpaque);
+    std::printf("  %ux%u, chroma %ux%u: %.1f dB, max error %d\n", width, height, chromaWidth,
+        chromaHeight, psnr, maxError);
+    CHECK(psnr >= MIN_PSNR_DB);
+    CHECK(maxError <= MAX_CHANNEL_ERROR);
+    CHECK(alphaOpaque);
+}
+
+void TestSubsampledLayouts() {
+    CheckAgainstReference(640, 480, 320, 240);  // 4:2:0
+    CheckAgainstReference(640, 480, 320, 480);  // 4:2:2
+    CheckAgainstReference(640, 480, 640, 480);  // 4:4:4
+}
+
+// Odd sizes leave a partial chroma sample at the edge, and widths that are not a multiple
+// of 8 send the row tail through the scalar path
+void TestOddSizes() {
+    for (uint32_t width = 1; width <= 19; width += 3) {
+        CheckAgainstReference(width, 7, (width + 1) / 2, 4);
+    }
+    CheckAgainstReference(1001, 3, 501, 2);
+}
+
+void TestRejectsInconsistentPlanes() {
+    PixelBuffer out;
+    CHECK(!YCbCrConverter::ConvertToBgra(PlanarYCbCr(), out));
+
+    PlanarYCbCr planes = MakePlanes(16, 16, 8, 8);
+    planes.cr.resize(10);
+    CHECK(!YCbCrConverter::ConvertToBgra(planes, out));
+}
+
+}  // namespace
+
+int main() {
+    TestSubsampledLayouts();
+    TestOddSizes();
+    TestRejectsInconsistentPlanes();
+    return test::Finish("YCbCrConverterTests");
+}